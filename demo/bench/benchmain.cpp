@@ -0,0 +1,763 @@
+#include "inputstate.h"
+
+#include "medea/core.h"
+#include "medea/scene.h"
+#include "medea/light.h"
+#include "medea/metaimage.h"
+#include "medea/cpuprofiler.h"
+#include "medea/memorytracker.h"
+#include "medea/dynamicresolution.h"
+#include "medea/temporalupscaler.h"
+
+#include "benchscene.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+
+/// medea-bench: renders a procedural scene along a fixed camera path and writes frame time percentiles, per-pass GPU times,
+///  cull stats and memory usage as JSON. Run from the build directory, e.g.
+///     ./medea-bench --entities 20000 --lights 256 --volumetrics 0 --out novol.json
+///
+/// The window is created hidden; the swapchain still presents, uncapped (IMMEDIATE) by default. With --present-mode fifo keep --frames
+///  high enough that vsync jitter averages out, or compare gpuMs rather than frameMs.
+///
+/// --taa 1 --render-scale 0.67 renders at 2/3 resolution and temporally upscales; after the run, the last frame is compared against a native
+///  render of the same camera ("temporalUpscale" in the JSON), so quality can be tracked next to the frame times.
+
+using namespace Bench;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /// everything that rasterizes the camera's view, on either shading path
+    constexpr std::array<std::string_view, 7> GEOMETRY_PASSES = {"preZ", "preZLate", "mainPass", "visibility", "visibilityLate", "materialClassify", "materialResolve"};
+
+    double msSince(Clock::time_point t0, Clock::time_point t1 = Clock::now()) {
+        return std::chrono::duration<double, std::milli>(t1 - t0).count();
+    }
+
+    void printUsage() {
+        std::cerr<<"usage: medea-bench [--entities N] [--mesh-rings N] [--mesh-variants N] [--materials N] [--lights N] [--volumetrics 0|1]\n"
+                 <<"                   [--async-compute 0|1] [--shadow-cull 0|1] [--occlusion 0|1] [--clusters 0|1]\n"
+                 <<"                   [--mesh-shading 0|1] [--visibility-buffer 0|1] [--quantize-vertices 0|1]\n"
+                 <<"                   [--lod 0|1] [--lod-error px] [--shadow-lod-bias N] [--instancing 0|1]\n"
+                 <<"                   [--material-pipelines 0|1] [--depth-pipelines 0|1]\n"
+                 <<"                   [--present-mode immediate|mailbox|fifo|fifo-relaxed] [--max-latency N]\n"
+                 <<"                   [--dynamic-res targetMs] [--render-scale S] [--taa 0|1]\n"
+                 <<"                   [--warmup N] [--frames N] [--seed N] [--radius R] [--width W] [--height H]\n"
+                 <<"                   [--vert path] [--frag path] [--out path.json] [--trace path.json]"<<std::endl;
+    }
+
+    std::optional<vk::PresentModeKHR> parsePresentMode(const std::string& s) {
+        if (s == "immediate")       return vk::PresentModeKHR::eImmediate;
+        if (s == "mailbox")         return vk::PresentModeKHR::eMailbox;
+        if (s == "fifo")            return vk::PresentModeKHR::eFifo;
+        if (s == "fifo-relaxed")    return vk::PresentModeKHR::eFifoRelaxed;
+
+        return std::nullopt;
+    }
+
+    bool parseArgs(int argc, char** argv, BenchConfig& cfg) {
+        for (int i=1; i<argc; i++) {
+            std::string key = argv[i];
+
+            if (key == "--help" || key == "-h") return false;
+
+            if (i+1 >= argc) {
+                std::cerr<<"Missing value for "<<key<<std::endl;
+                return false;
+            }
+
+            std::string val = argv[++i];
+
+            try {
+                if (key == "--entities")            cfg.entities = std::stoul(val);
+                else if (key == "--mesh-rings")     cfg.meshRings = std::stoul(val);
+                else if (key == "--mesh-variants")  cfg.meshVariants = std::stoul(val);
+                else if (key == "--materials")      cfg.materials = std::stoul(val);
+                else if (key == "--lights")         cfg.lights = std::stoul(val);
+                else if (key == "--volumetrics")    cfg.volumetrics = val != "0" && val != "false";
+                else if (key == "--async-compute")  cfg.asyncCompute = val != "0" && val != "false";
+                else if (key == "--shadow-cull")    cfg.shadowCulling = val != "0" && val != "false";
+                else if (key == "--occlusion")      cfg.occlusionCulling = val != "0" && val != "false";
+                else if (key == "--clusters")       cfg.clusterCulling = val != "0" && val != "false";
+                else if (key == "--mesh-shading")   cfg.meshShading = val != "0" && val != "false";
+                else if (key == "--visibility-buffer") cfg.visibilityBuffer = val != "0" && val != "false";
+                else if (key == "--quantize-vertices") cfg.quantizedVertices = val != "0" && val != "false";
+                else if (key == "--lod")            cfg.lod = val != "0" && val != "false";
+                else if (key == "--lod-error")      cfg.lodErrorPixels = std::stod(val);
+                else if (key == "--shadow-lod-bias") cfg.shadowLodBias = std::stoul(val);
+                else if (key == "--instancing")     cfg.instancing = val != "0" && val != "false";
+                else if (key == "--material-pipelines") cfg.materialPipelines = val != "0" && val != "false";
+                else if (key == "--depth-pipelines") cfg.depthPipelines = val != "0" && val != "false";
+                else if (key == "--present-mode") {
+                    auto mode = parsePresentMode(val);
+
+                    if (!mode) throw std::invalid_argument(val);
+
+                    cfg.presentMode = *mode;
+                }
+                else if (key == "--max-latency")    cfg.maxFrameLatency = std::stoul(val);
+                else if (key == "--dynamic-res")    cfg.dynamicResTargetMs = std::stod(val);
+                else if (key == "--render-scale")   cfg.renderScale = std::stod(val);
+                else if (key == "--taa")            cfg.taa = val != "0" && val != "false";
+                else if (key == "--warmup")         cfg.warmupFrames = std::stoul(val);
+                else if (key == "--frames")         cfg.frames = std::stoul(val);
+                else if (key == "--seed")           cfg.seed = std::stoul(val);
+                else if (key == "--radius")         cfg.worldRadius = std::stod(val);
+                else if (key == "--width")          cfg.resolution.x = std::stoi(val);
+                else if (key == "--height")         cfg.resolution.y = std::stoi(val);
+                else if (key == "--vert")           cfg.vertexShader = val;
+                else if (key == "--frag")           cfg.fragmentShader = val;
+                else if (key == "--out")            cfg.outPath = val;
+                else if (key == "--trace")          cfg.tracePath = val;
+                else {
+                    std::cerr<<"Unknown argument "<<key<<std::endl;
+                    return false;
+                }
+            } catch (const std::exception&) {
+                std::cerr<<"Bad value \""<<val<<"\" for "<<key<<std::endl;
+                return false;
+            }
+        }
+
+        if (cfg.frames == 0) {
+            std::cerr<<"--frames must be > 0"<<std::endl;
+            return false;
+        }
+
+        if (cfg.renderScale <= 0.0 || cfg.renderScale > 1.0) {
+            std::cerr<<"--render-scale must be in (0, 1]"<<std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    struct Summary {
+        double mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+    };
+
+    /// nearest rank percentiles
+    Summary summarize(std::vector<double> samples) {
+        Summary out;
+
+        if (samples.empty()) return out;
+
+        std::sort(samples.begin(), samples.end());
+
+        auto rank = [&] (double p) {
+            size_t idx = (size_t) std::ceil(p * samples.size());
+
+            return samples.at(std::clamp<size_t>(idx, 1, samples.size()) - 1);
+        };
+
+        out.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+        out.p50 = rank(0.50);
+        out.p95 = rank(0.95);
+        out.p99 = rank(0.99);
+        out.max = samples.back();
+
+        return out;
+    }
+
+    void writeSummary(std::ostream& out, const char* name, const Summary& s) {
+        out << "\"" << name << "\":{\"mean\":" << s.mean << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << ",\"max\":" << s.max << "}";
+    }
+
+    struct PassAccum {
+        uint32_t depth = 0;
+        double totalMs = 0;
+        uint32_t samples = 0;
+    };
+
+    /// GPU time the async compute passes spent running alongside graphics passes (top level markers only). Needs both queues' timestamps
+    ///  to be in one time domain, which the spec doesn't promise, so sanity check against the gpuMs difference with --async-compute 0
+    double asyncOverlapMs(const std::vector<Medea::GPUPassTiming>& timings, const std::vector<std::string>& asyncPasses) {
+        std::vector<std::pair<double, double>> graphics, compute;
+
+        for (auto& t : timings) {
+            if (t.depth != 1) continue;
+
+            bool async = std::find(asyncPasses.begin(), asyncPasses.end(), t.name) != asyncPasses.end();
+
+            (async ? compute : graphics).push_back({t.startMs, t.startMs + t.ms});
+        }
+
+        double out = 0;
+
+        //graphics passes don't overlap each other (one queue, in order), so no need to merge them first
+        for (auto& c : compute) {
+            for (auto& g : graphics) out += std::max(0.0, std::min(c.second, g.second) - std::max(c.first, g.first));
+        }
+
+        return out;
+    }
+
+    Medea::AllocatedBuffer makeReadback(Medea::Core& core, vk::DeviceSize size) {
+        return Medea::AllocatedBuffer(core.device, core.allocator, size, vk::BufferUsageFlagBits::eTransferDst,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, VMA_MEMORY_USAGE_AUTO);
+    }
+
+    /// top left extent of img -> buf, tightly packed
+    void copyToReadback(vk::CommandBuffer cmd, Medea::AllocatedImage& img, Medea::AllocatedBuffer& buf, VkExtent2D extent) {
+        img.transitionSync(cmd, vk::ImageLayout::eTransferSrcOptimal);
+
+        vk::BufferImageCopy region(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), {0, 0, 0},
+                                   vk::Extent3D(extent.width, extent.height, 1));
+
+        cmd.copyImageToBuffer(*img.image, vk::ImageLayout::eTransferSrcOptimal, buf.buffer, region);
+
+        Medea::BarrierBatch().memory(Medea::ResourceUsage::transferWrite(), Medea::ResourceUsage::hostRead()).flush(cmd);
+    }
+
+    /// RGB in [0, 1]; the upscaler's output is RGBA16F, the reference is the RGBA8 unorm color target
+    double rmse(Medea::AllocatedBuffer& half4, Medea::AllocatedBuffer& unorm4, size_t pixels) {
+        VK_REQUIRE(vmaInvalidateAllocation(half4.allocator, half4.allocation, 0, VK_WHOLE_SIZE));
+        VK_REQUIRE(vmaInvalidateAllocation(unorm4.allocator, unorm4.allocation, 0, VK_WHOLE_SIZE));
+
+        const uint16_t* a = (const uint16_t*) half4.info.pMappedData;
+        const uint8_t* b = (const uint8_t*) unorm4.info.pMappedData;
+
+        double sum = 0;
+
+        for (size_t i=0; i<pixels; i++) {
+            for (size_t c=0; c<3; c++) {
+                double d = std::clamp(glm::unpackHalf1x16(a[i*4 + c]), 0.f, 1.f) - b[i*4 + c] / 255.0;
+
+                sum += d * d;
+            }
+        }
+
+        return std::sqrt(sum / std::max<size_t>(pixels * 3, 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+
+    if (!parseArgs(argc, argv, cfg)) {
+        printUsage();
+        return 1;
+    }
+
+    InputState input;
+
+    glfwInitVulkanLoader(vkGetInstanceProcAddr);
+    glfwInit();
+
+    //GLFW can't do a surfaceless Vulkan context, so "headless" means an invisible window
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* glWindow = glfwCreateWindow(cfg.resolution.x, cfg.resolution.y, "medea-bench", NULL, NULL);
+
+    Medea::Window window(cfg.resolution, glWindow, input);
+
+    vk::raii::Context vkContext;
+
+    Medea::Core core = Medea::Core::make(vkContext, window, Medea::PresentSettings{cfg.presentMode, cfg.maxFrameLatency});
+
+    Medea::CPUProfiler::setEnabled(!cfg.tracePath.empty());
+
+    Medea::MVKWindow& present = core.primaryWindow;
+
+    VkExtent2D extent{(uint32_t) cfg.resolution.x, (uint32_t) cfg.resolution.y};
+
+    //sampled for the upscaler
+    Medea::AllocatedImage colorTarget = Medea::AllocatedImage::make(core,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+        vk::ImageAspectFlagBits::eColor, Medea::RenderConstants::screenFormat, {extent.width, extent.height, 1}, false, false);
+
+    Medea::AllocatedImage depthTarget = Medea::AllocatedImage::make(core,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+        vk::ImageAspectFlagBits::eDepth, vk::Format::eD32Sfloat, {extent.width, extent.height, 1}, false, true);
+
+    //targets stay at full size; with --dynamic-res/--render-scale, only the top left getExtent() of them is rendered and blitted (or upscaled)
+    Medea::DynamicResolution dynRes(extent, Medea::DynamicResolutionSettings{.targetMs = cfg.dynamicResTargetMs,
+                                                                             .minScale = std::min(0.5, cfg.renderScale),
+                                                                             .maxScale = cfg.renderScale});
+
+    std::optional<Medea::TemporalUpscaler> taa;
+
+    if (cfg.taa) taa.emplace(Medea::TemporalUpscaler::make(core, extent, extent));
+
+    Medea::BindlessTextureArray textures;
+
+    std::unique_ptr<Medea::GPUSceneGraph> graph;
+    std::unique_ptr<Medea::RenderWorld> world;
+    Scene scene;
+
+    //setup frame: everything is recorded straight into the first frame's command buffer
+    {
+        Medea::DrawingFrame frame = present.startDraw();
+        vk::CommandBuffer cmd = *frame.frame.mainBuffer;
+
+        Medea::CleanupJobQueueCallback cleanup = [&] (Medea::CleanupJob job) { frame.frame.cleanupJobs.push_back(job); };
+        Medea::CommandJobQueueCallback upload = [cmd, cleanup] (Medea::CommandJob job) { job(cmd, cleanup); };
+
+        //bindless array needs at least one readable texture
+        {
+            Medea::MemoryCategoryScope texMemory(Medea::MemoryCategory::textures);
+
+            auto white = std::make_shared<Medea::AllocatedImage>(Medea::AllocatedImage::make(core,
+                vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, vk::ImageAspectFlagBits::eColor,
+                vk::Format::eR8G8B8A8Unorm, {1, 1, 1}, false, false));
+
+            uint8_t pixel[4] = {255, 255, 255, 255};
+
+            Medea::Internal::transferToGPU(upload, core.allocator, *core.device, pixel, vk::Extent3D(1, 1, 1), vk::Format::eR8G8B8A8Unorm, white);
+
+            Medea::multiTransition(cmd, {*white}, {vk::ImageLayout::eShaderReadOnlyOptimal});
+
+            textures.addTexture(core, white, vk::SamplerCreateInfo());
+        }
+
+        graph = std::make_unique<Medea::GPUSceneGraph>(core, cmd, textures);
+        graph->settings.volumetrics = cfg.volumetrics;
+        graph->settings.asyncCompute = cfg.asyncCompute;
+        graph->settings.shadowCulling = cfg.shadowCulling;
+        graph->settings.occlusionCulling = cfg.occlusionCulling;
+        graph->settings.clusterCulling = cfg.clusterCulling;
+        graph->settings.meshShading = cfg.meshShading;
+        graph->settings.lod = cfg.lod;
+        graph->settings.lodErrorPixels = cfg.lodErrorPixels;
+        graph->settings.shadowLodBias = cfg.shadowLodBias;
+        graph->settings.instancing = cfg.instancing;
+        graph->settings.materialPipelines = cfg.materialPipelines;
+        graph->settings.depthPipelines = cfg.depthPipelines;
+
+        scene = makeSceneResources(core, cmd, upload, *graph, cfg);
+
+        graph->compileMaterialSets(core, cfg.visibilityBuffer ? Medea::ShadingPath::visibilityBuffer : Medea::ShadingPath::forward);
+
+        world = std::make_unique<Medea::RenderWorld>(core, cmd, *graph);
+
+        populateWorld(scene, *world, cfg);
+
+        colorTarget.transitionSync(cmd, vk::ImageLayout::eTransferSrcOptimal, true);
+
+        present.endDraw(*colorTarget.image, extent);
+    }
+
+    //the lights don't move, so this is built once; filterLights then only tests the ones near the camera
+    Medea::LightIndex lightIndex;
+
+    for (uint32_t i=0; i<scene.lights.size(); i++) lightIndex.add(scene.lights.at(i), i);
+
+    std::vector<double> cpuMs, gpuMs, frameMs, latencyMs;
+    uint64_t latencySamples = 0;
+    std::map<std::string, PassAccum> passes;
+    std::vector<std::string> passOrder;
+    double entitiesSum = 0, visibleSum = 0, lightsSum = 0, shadowDrawsSum = 0, shadowDroppedSum = 0;
+    double earlySum = 0, lateSum = 0, occludedSum = 0, clustersSum = 0, clustersVisibleSum = 0;
+    double instanceDrawsSum = 0, shadowInstanceDrawsSum = 0;
+    Medea::GPUPipelineStats shadowPassSum;
+    uint32_t shadowPassSamples = 0;
+    Medea::GPUPipelineStats geometrySum;    //<- the camera's raster passes: pre-Z (both phases) + main pass
+    uint32_t geometrySamples = 0;
+    double overlapSum = 0;
+    double scaleSum = 0, minScale = 1.0;
+    uint32_t cullSamples = 0;
+
+    Medea::BarrierStats barrierSum;     //<- summed per-frame diffs over measured frames
+
+    const glm::mat4 proj = window.getProjectMatrix(glm::radians(70.f));
+    const double FRAME_DT = 1.0 / 60.0;
+
+    const uint32_t totalFrames = cfg.warmupFrames + cfg.frames;
+
+    std::vector<Medea::LightDef> filtered;
+
+    Clock::time_point lastFrameStart = Clock::now();
+
+    for (uint32_t f=0; f<totalFrames; f++) {
+        MEDEA_PROFILE_ZONE("bench frame");
+
+        //latency limit first, then "input"; the camera path doesn't read any, but this is where a game would
+        present.markInput();
+
+        glfwPollEvents();
+
+        const bool measured = f >= cfg.warmupFrames;
+
+        //fixed timestep, so the camera path (and thus the rendered frames) don't depend on how fast we run
+        const double time = f * FRAME_DT;
+
+        Clock::time_point frameStart = Clock::now();
+
+        CameraState cam = cameraAt(cfg, time);
+
+        {
+            MEDEA_PROFILE_ZONE("filterLights");
+
+            CameraRenderContext ctx(cam.view, proj);
+            Placement camPlace(Vec3(cam.eye.x, cam.eye.y, cam.eye.z), lookRotation(cam.target - cam.eye));
+
+            filtered.clear();
+
+            if (scene.lights.size()) {
+                Medea::Spotlight::filterLights(filtered, scene.lights, lightIndex, ctx, Cull::Cone(camPlace, 600.0, glm::radians(60.0)),
+                                               Medea::RenderConstants::shadowAtlasBlockResolution);
+            }
+
+            graph->lights.clear();
+
+            for (auto& l : filtered) graph->lights.push_back(l);
+        }
+
+        double cpuBefore = msSince(frameStart);
+
+        Medea::BarrierStats barriersBefore = Medea::BarrierStats::get();
+
+        Medea::DrawingFrame frame = present.startDraw();
+
+        //don't count the fence wait in startDraw as CPU time; that's the GPU (or vsync) being the bottleneck
+        Clock::time_point recordStart = Clock::now();
+
+        vk::CommandBuffer cmd = *frame.frame.mainBuffer;
+        Medea::CleanupJobQueueCallback cleanup = [&] (Medea::CleanupJob job) { frame.frame.cleanupJobs.push_back(job); };
+
+        if (cfg.dynamicResTargetMs > 0) dynRes.update(graph->getProfiler());
+
+        VkExtent2D renderExtent = dynRes.getExtent();
+
+        graph->render(core, cmd, cleanup, cam.view, proj, *world, dynRes.getViewport(), {colorTarget}, depthTarget, vk::CompareOp::eLess, time,
+                      taa ? &*taa : nullptr);
+
+        Medea::AllocatedImage& presented = taa ? taa->getOutput() : colorTarget;
+
+        presented.transitionSync(cmd, vk::ImageLayout::eTransferSrcOptimal);
+
+        double cpuRecord = msSince(recordStart);
+
+        present.endDraw(*presented.image, taa ? taa->getOutputExtent() : renderExtent);
+
+        Medea::BarrierStats barriers = Medea::BarrierStats::get() - barriersBefore;
+
+        if (f > 0 && measured) frameMs.push_back(msSince(lastFrameStart, frameStart));
+        lastFrameStart = frameStart;
+
+        if (!measured) continue;
+
+        cpuMs.push_back(cpuBefore + cpuRecord);
+
+        scaleSum += dynRes.getScale();
+        minScale = std::min(minScale, dynRes.getScale());
+
+        //a present completes a few frames after it's submitted, so this is some earlier frame's latency
+        const Medea::PresentStats& presentStats = present.getPresentStats();
+
+        if (presentStats.samples != latencySamples) latencyMs.push_back(presentStats.lastLatencyMs);
+        latencySamples = presentStats.samples;
+
+        barrierSum.batches += barriers.batches;
+        barrierSum.memoryBarriers += barriers.memoryBarriers;
+        barrierSum.bufferBarriers += barriers.bufferBarriers;
+        barrierSum.imageBarriers += barriers.imageBarriers;
+        barrierSum.allCommandsBarriers += barriers.allCommandsBarriers;
+        barrierSum.elided += barriers.elided;
+
+        const Medea::GPUProfiler& profiler = graph->getProfiler();
+
+        if (profiler.isSupported() && profiler.getTimings().size()) {
+            gpuMs.push_back(profiler.getFrameTimeMs());
+
+            overlapSum += asyncOverlapMs(profiler.getTimings(), graph->getRenderGraphStats().asyncPasses);
+
+            for (auto& t : profiler.getTimings()) {
+                auto [it, inserted] = passes.try_emplace(t.name, PassAccum{t.depth});
+
+                if (inserted) passOrder.push_back(t.name);
+
+                it->second.totalMs += t.ms;
+                it->second.samples++;
+            }
+        }
+
+        const Medea::GPUCullStats& cull = graph->getCullStats();
+
+        entitiesSum += cull.entities;
+        visibleSum += cull.broadphaseVisible;
+        lightsSum += cull.lights;
+        shadowDrawsSum += cull.shadowDraws;
+        shadowDroppedSum += cull.shadowDrawsDropped;
+        earlySum += cull.occlusionEarly;
+        lateSum += cull.occlusionLate;
+        occludedSum += cull.occluded;
+        clustersSum += cull.clusters;
+        clustersVisibleSum += cull.clustersVisible;
+        instanceDrawsSum += cull.instanceDraws;
+        shadowInstanceDrawsSum += cull.shadowInstanceDraws;
+        cullSamples++;
+
+        //shadow pass vertex work; compare runs with --shadow-cull 0 and 1
+        for (auto& p : graph->getPipelineStats().getPassStats()) {
+            if (p.name != "shadowPass") continue;
+
+            shadowPassSum += p.stats;
+            shadowPassSamples++;
+        }
+
+        //triangles reaching the rasterizer; compare runs with --mesh-shading 0 and 1. Fragment invocations show what the visibility buffer saves
+        bool geometryFound = false;
+
+        for (auto& p : graph->getPipelineStats().getPassStats()) {
+            if (std::find(GEOMETRY_PASSES.begin(), GEOMETRY_PASSES.end(), p.name) == GEOMETRY_PASSES.end()) continue;
+
+            geometrySum += p.stats;
+            geometryFound = true;
+        }
+
+        if (geometryFound) geometrySamples++;
+    }
+
+    present.drain();
+
+    //upscaled vs native: one more upscaled frame of the last camera (no motion, so it's the converged history), then the same frame rendered
+    // natively without the upscaler
+    double taaRmse = 0;
+
+    if (taa) {
+        const double time = (totalFrames - 1) * FRAME_DT;
+        CameraState cam = cameraAt(cfg, time);
+
+        size_t pixels = size_t(extent.width) * extent.height;
+
+        Medea::AllocatedBuffer upscaled = makeReadback(core, pixels * 8);
+        Medea::AllocatedBuffer native = makeReadback(core, pixels * 4);
+
+        for (int pass=0; pass<2; pass++) {
+            Medea::DrawingFrame frame = present.startDraw();
+
+            vk::CommandBuffer cmd = *frame.frame.mainBuffer;
+            Medea::CleanupJobQueueCallback cleanup = [&] (Medea::CleanupJob job) { frame.frame.cleanupJobs.push_back(job); };
+
+            if (pass == 0) {
+                graph->render(core, cmd, cleanup, cam.view, proj, *world, dynRes.getViewport(), {colorTarget}, depthTarget, vk::CompareOp::eLess, time, &*taa);
+
+                copyToReadback(cmd, taa->getOutput(), upscaled, extent);
+            }
+            else {
+                graph->render(core, cmd, cleanup, cam.view, proj, *world, vk::Viewport(0, 0, extent.width, extent.height, 0, 1),
+                              {colorTarget}, depthTarget, vk::CompareOp::eLess, time);
+
+                copyToReadback(cmd, colorTarget, native, extent);
+            }
+
+            colorTarget.transitionSync(cmd, vk::ImageLayout::eTransferSrcOptimal);
+
+            present.endDraw(*colorTarget.image, extent);
+        }
+
+        present.drain();
+
+        taaRmse = rmse(upscaled, native, pixels);
+    }
+
+    std::ofstream out(cfg.outPath);
+
+    if (!out) {
+        std::cerr<<"Failed to open \""<<cfg.outPath<<"\" for bench output"<<std::endl;
+        return 1;
+    }
+
+    out << std::fixed << std::setprecision(4);
+
+    out << "{\n\"config\":{\"entities\":" << cfg.entities << ",\"meshRings\":" << cfg.meshRings << ",\"meshVariants\":" << cfg.meshVariants
+        << ",\"materials\":" << cfg.materials << ",\"lights\":" << cfg.lights << ",\"volumetrics\":" << (cfg.volumetrics ? "true" : "false")
+        << ",\"asyncCompute\":" << (cfg.asyncCompute ? "true" : "false") << ",\"shadowCulling\":" << (cfg.shadowCulling ? "true" : "false")
+        << ",\"occlusionCulling\":" << (cfg.occlusionCulling ? "true" : "false") << ",\"clusterCulling\":" << (cfg.clusterCulling ? "true" : "false")
+        << ",\"meshShading\":" << (cfg.meshShading ? "true" : "false") << ",\"visibilityBuffer\":" << (cfg.visibilityBuffer ? "true" : "false")
+        << ",\"quantizedVertices\":" << (cfg.quantizedVertices ? "true" : "false")
+        << ",\"lod\":" << (cfg.lod ? "true" : "false") << ",\"lodErrorPixels\":" << cfg.lodErrorPixels << ",\"shadowLodBias\":" << cfg.shadowLodBias
+        << ",\"instancing\":" << (cfg.instancing ? "true" : "false") << ",\"materialPipelines\":" << (cfg.materialPipelines ? "true" : "false")
+        << ",\"depthPipelines\":" << (cfg.depthPipelines ? "true" : "false")
+        << ",\"presentMode\":\"" << vk::to_string(cfg.presentMode) << "\",\"maxFrameLatency\":" << cfg.maxFrameLatency
+        << ",\"dynamicResTargetMs\":" << cfg.dynamicResTargetMs << ",\"renderScale\":" << cfg.renderScale << ",\"taa\":" << (cfg.taa ? "true" : "false")
+        << ",\"warmupFrames\":" << cfg.warmupFrames << ",\"frames\":" << cfg.frames << ",\"seed\":" << cfg.seed
+        << ",\"width\":" << extent.width << ",\"height\":" << extent.height << "},\n";
+
+    out << "\"device\":\"" << std::string(core.gpu.getProperties().deviceName.data()) << "\",\n";
+
+    writeSummary(out, "cpuMs", summarize(cpuMs));
+    out << ",\n";
+    writeSummary(out, "gpuMs", summarize(gpuMs));
+    out << ",\n";
+    writeSummary(out, "frameMs", summarize(frameMs));
+    out << ",\n";
+
+    //mode is what the swapchain actually got. Without presentWait, latency only goes up to the GPU finishing the frame
+    out << "\"present\":{\"mode\":\"" << vk::to_string(present.getPresentStats().mode) << "\",\"presentWait\":"
+        << (present.getPresentStats().presentWait ? "true" : "false") << ",";
+    writeSummary(out, "latencyMs", summarize(latencyMs));
+    out << "},\n";
+
+    out << "\"passes\":[";
+
+    for (size_t i=0; i<passOrder.size(); i++) {
+        const PassAccum& p = passes.at(passOrder.at(i));
+
+        if (i) out << ",";
+
+        out << "\n  {\"name\":\"" << passOrder.at(i) << "\",\"depth\":" << p.depth << ",\"avgMs\":" << (p.samples ? p.totalMs / p.samples : 0.0) << "}";
+    }
+
+    out << "],\n";
+
+    double n = std::max(cullSamples, 1u);
+
+    out << "\"cull\":{\"entities\":" << entitiesSum / n << ",\"broadphaseVisible\":" << visibleSum / n << ",\"lights\":" << lightsSum / n
+        << ",\"shadowDraws\":" << shadowDrawsSum / n << ",\"shadowDrawsDropped\":" << shadowDroppedSum / n
+        << ",\"occlusionEarly\":" << earlySum / n << ",\"occlusionLate\":" << lateSum / n << ",\"occluded\":" << occludedSum / n
+        << ",\"clusters\":" << clustersSum / n << ",\"clustersVisible\":" << clustersVisibleSum / n
+        << ",\"instanceDraws\":" << instanceDrawsSum / n << ",\"shadowInstanceDraws\":" << shadowInstanceDrawsSum / n << "},\n";
+
+    //per frame, from pipeline statistics queries (zero without pipelineStatisticsQuery). The shadow pass only reads positions, so
+    // positionBytes (invocations * stride; compare runs with --quantize-vertices 0 and 1) is about all the vertex fetch it does
+    double sn = std::max(shadowPassSamples, 1u);
+    double shadowMs = 0;
+    const size_t positionStride = scene.ground->vertexBasePositions.stride();
+
+    if (auto it = passes.find("shadowPass"); it != passes.end() && it->second.samples) shadowMs = it->second.totalMs / it->second.samples;
+
+    out << "\"shadowPass\":{\"culling\":" << (cfg.shadowCulling ? "true" : "false")
+        << ",\"vertexInvocations\":" << shadowPassSum.vertexShaderInvocations / sn
+        << ",\"primitives\":" << shadowPassSum.inputAssemblyPrimitives / sn
+        << ",\"fragmentInvocations\":" << shadowPassSum.fragmentShaderInvocations / sn
+        << ",\"positionStride\":" << positionStride
+        << ",\"positionBytes\":" << shadowPassSum.vertexShaderInvocations / sn * positionStride
+        << ",\"gpuMs\":" << shadowMs << "},\n";
+
+    //per frame, same passes as the triangle counts. Clipping invocations count triangles out of either the vertex or the mesh path, so
+    // trianglesPerMs is rasterizer throughput, and the invocation counts show how much the task shader culled
+    double gn = std::max(geometrySamples, 1u);
+    double geometryMs = 0;
+
+    for (std::string_view name : GEOMETRY_PASSES) {
+        auto it = passes.find(std::string(name));
+
+        if (it != passes.end() && it->second.samples) geometryMs += it->second.totalMs / it->second.samples;
+    }
+
+    out << "\"geometry\":{\"meshShading\":" << (cfg.meshShading && graph->meshShadingAvailable() ? "true" : "false")
+        << ",\"meshShadingAvailable\":" << (graph->meshShadingAvailable() ? "true" : "false")
+        << ",\"vertexInvocations\":" << geometrySum.vertexShaderInvocations / gn
+        << ",\"unindexedVertexInvocations\":" << 3 * geometrySum.inputAssemblyPrimitives / gn
+        << ",\"clippingInvocations\":" << geometrySum.clippingInvocations / gn
+        << ",\"clippingPrimitives\":" << geometrySum.clippingPrimitives / gn
+        << ",\"fragmentInvocations\":" << geometrySum.fragmentShaderInvocations / gn
+        << ",\"gpuMs\":" << geometryMs
+        << ",\"trianglesPerMs\":" << (geometryMs > 0 ? geometrySum.clippingInvocations / gn / geometryMs : 0.0) << "},\n";
+
+    //every distinct mesh once; simulated vertex cache (see indexedmesh.h), from unindexed (a vertex per corner) to welded to reordered.
+    // The measured counterpart is geometry's vertexInvocations vs unindexedVertexInvocations. lodTriangles: per LOD level, summed over the
+    // meshes that have it
+    {
+        uint64_t soupVertices = 0, vertices = 0, triangles = 0, weldedInvocations = 0, optimizedInvocations = 0;
+        std::vector<uint64_t> lodTriangles;
+
+        auto addMesh = [&] (const Medea::FullMesh<BenchVertex>& m) {
+            soupVertices += m.indexStats.soupVertices;
+            vertices += m.totalVertices;
+            triangles += m.indexStats.optimized.triangles;
+            weldedInvocations += m.indexStats.welded.invocations;
+            optimizedInvocations += m.indexStats.optimized.invocations;
+
+            if (lodTriangles.size() < m.lods.levels.size()) lodTriangles.resize(m.lods.levels.size(), 0);
+
+            for (size_t i=0; i<m.lods.levels.size(); i++) lodTriangles.at(i) += m.lods.levels.at(i).indexCount / 3;
+        };
+
+        for (auto& m : scene.meshes) addMesh(*m);
+        addMesh(*scene.ground);
+
+        double tris = std::max<uint64_t>(triangles, 1);
+
+        out << "\"meshes\":{\"count\":" << scene.meshes.size() + 1 << ",\"triangles\":" << triangles << ",\"soupVertices\":" << soupVertices
+            << ",\"vertices\":" << vertices << ",\"weldedInvocations\":" << weldedInvocations << ",\"optimizedInvocations\":" << optimizedInvocations
+            << ",\"weldedACMR\":" << weldedInvocations / tris << ",\"optimizedACMR\":" << optimizedInvocations / tris << ",\"lodTriangles\":[";
+
+        for (size_t i=0; i<lodTriangles.size(); i++) out << (i ? "," : "") << lodTriangles.at(i);
+
+        out << "]},\n";
+    }
+
+    //per frame; compare against the per-pass GPU times above to see what the barriers cost
+    out << "\"barriers\":{\"batches\":" << barrierSum.batches / n << ",\"memory\":" << barrierSum.memoryBarriers / n
+        << ",\"buffer\":" << barrierSum.bufferBarriers / n << ",\"image\":" << barrierSum.imageBarriers / n
+        << ",\"allCommands\":" << barrierSum.allCommandsBarriers / n << ",\"elided\":" << barrierSum.elided / n << "},\n";
+
+    const Medea::RenderGraphStats& rg = graph->getRenderGraphStats();
+
+    out << "\"renderGraph\":{\"passes\":" << rg.passes << ",\"culledPasses\":" << rg.culledPasses << ",\"transients\":" << rg.transients
+        << ",\"memorySlots\":" << rg.memorySlots << ",\"transientBytes\":" << rg.transientBytes << ",\"allocatedBytes\":" << rg.allocatedBytes << "},\n";
+
+    //overlapMs is per frame, averaged like the pass times (which, for async passes, also need the compute queue to have timestamps)
+    out << "\"asyncCompute\":{\"available\":" << (core.caps.asyncCompute ? "true" : "false") << ",\"passes\":" << rg.asyncPasses.size()
+        << ",\"submits\":" << rg.submits << ",\"queueTransfers\":" << rg.queueTransfers
+        << ",\"overlapMs\":" << (gpuMs.size() ? overlapSum / gpuMs.size() : 0.0) << "},\n";
+
+    //per axis scale; stays 1 without --dynamic-res
+    out << "\"dynamicResolution\":{\"avgScale\":" << scaleSum / std::max<size_t>(cpuMs.size(), 1) << ",\"minScale\":" << minScale
+        << ",\"finalWidth\":" << dynRes.getExtent().width << ",\"finalHeight\":" << dynRes.getExtent().height << "},\n";
+
+    //RGB error of the last upscaled frame against the same frame rendered at native resolution; PSNR in dB
+    if (taa) {
+        out << "\"temporalUpscale\":{\"rmse\":" << taaRmse << ",\"psnr\":" << (taaRmse > 0 ? 20.0 * std::log10(1.0 / taaRmse) : 99.0) << "},\n";
+    }
+
+    out << "\"memory\":{\"categories\":{";
+
+    bool first = true;
+
+    for (auto& c : Medea::MemoryTracker::get().getCategoryUsage()) {
+        if (!first) out << ",";
+        first = false;
+
+        out << "\"" << Medea::memoryCategoryName(c.category) << "\":" << c.bytes;
+    }
+
+    out << "},\"heaps\":[";
+
+    auto heaps = Medea::MemoryTracker::get().getHeapBudgets();
+
+    for (size_t i=0; i<heaps.size(); i++) {
+        if (i) out << ",";
+
+        out << "{\"index\":" << heaps.at(i).heapIndex << ",\"deviceLocal\":" << (heaps.at(i).deviceLocal ? "true" : "false")
+            << ",\"usage\":" << heaps.at(i).usage << ",\"budget\":" << heaps.at(i).budget << "}";
+    }
+
+    out << "]}\n}\n";
+
+    out.close();
+
+    if (!cfg.tracePath.empty()) Medea::CPUProfiler::get().writeChromeTrace(cfg.tracePath);
+
+    Summary cpu = summarize(cpuMs), gpu = summarize(gpuMs);
+
+    std::cerr<<std::fixed<<std::setprecision(3)<<"cpu p50/p95/p99 "<<cpu.p50<<" / "<<cpu.p95<<" / "<<cpu.p99<<" ms, gpu p50/p95/p99 "
+             <<gpu.p50<<" / "<<gpu.p95<<" / "<<gpu.p99<<" ms -> "<<cfg.outPath<<std::endl;
+
+    world.reset();
+    scene = Scene{};
+    graph.reset();
+
+    glfwTerminate();
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "medea/scene.h"
+#include "medea/light.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <random>
+#include <string>
+#include <vector>
+
+/// Procedural scenes for medea-bench. Everything here is a pure function of BenchConfig (incl. the seed) and the frame index,
+///  so two runs with the same arguments render the same frames.
+
+namespace Bench {
+
+    struct BenchConfig {
+        uint32_t entities = 4096;
+        uint32_t meshRings = 12;            //<- UV sphere rings; triangles per mesh = 2 * rings * (2 * rings)
+        uint32_t meshVariants = 4;
+        uint32_t materials = 4;             //<- separate MaterialSets, i.e. megashader switch cases
+        uint32_t lights = 1024;
+        bool volumetrics = true;
+        bool asyncCompute = false;          //<- only does anything with volumetrics on, on a GPU with a separate compute queue family
+        bool shadowCulling = false;         //<- Medea::RenderSettings::shadowCulling
+        bool occlusionCulling = false;      //<- Medea::RenderSettings::occlusionCulling
+        bool clusterCulling = false;        //<- Medea::RenderSettings::clusterCulling
+        bool meshShading = false;           //<- Medea::RenderSettings::meshShading; the vertex path regardless without mesh shader support
+        bool visibilityBuffer = false;      //<- Medea::ShadingPath::visibilityBuffer instead of forward; picked at compileMaterialSets
+        bool quantizedVertices = false;     //<- every mesh's position stream as Medea::VertexFormat::quantized
+        bool lod = false;                   //<- Medea::RenderSettings::lod; the LOD chains get built either way
+        double lodErrorPixels = 1.0;
+        uint32_t shadowLodBias = 1;
+        bool instancing = false;            //<- Medea::RenderSettings::instancing; meshVariants * materials bounds the groups
+        bool materialPipelines = false;     //<- Medea::RenderSettings::materialPipelines
+        bool depthPipelines = false;        //<- Medea::RenderSettings::depthPipelines; the bench material is Medea::DepthMode::position
+
+        vk::PresentModeKHR presentMode = vk::PresentModeKHR::eImmediate;   //<- uncapped; falls back to FIFO where unsupported
+        uint32_t maxFrameLatency = 2;       //<- see Medea::PresentSettings
+        double dynamicResTargetMs = 0;      //<- GPU frame time for Medea::DynamicResolution to hold; 0 = always render at full resolution
+        double renderScale = 1.0;           //<- per axis; the render resolution, or the upper bound for --dynamic-res
+        bool taa = false;                   //<- Medea::TemporalUpscaler up to the window resolution; also compared against a native frame at the end
+
+        uint32_t warmupFrames = 120;
+        uint32_t frames = 1200;
+        uint32_t seed = 1;
+
+        double worldRadius = 120.0;
+        Coord resolution = Coord(1280, 720);
+
+        std::string vertexShader = "./bench/shader/benchmat.vert";
+        std::string fragmentShader = "./bench/shader/benchmat.frag";
+
+        std::string outPath = "bench.json";
+        std::string tracePath;              //<- empty: no CPU trace
+    };
+
+    struct BenchVertex {
+        glm::avec2 uv;
+    };
+
+    struct BenchUniform {
+        glm::avec4 albedo;
+        glm::avec4 roughnessMetallic;
+    };
+
+    using BenchMaterial = Medea::MaterialSet<BenchUniform, BenchVertex>;
+
+    /// 4 draws in [0, 1), in a fixed order (argument evaluation order isn't, so don't call the rng twice in one expression)
+    inline glm::vec4 uniform4(std::mt19937& rng) {
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+        glm::vec4 out;
+
+        for (int i=0; i<4; i++) out[i] = unit(rng);
+
+        return out;
+    }
+
+    /// NOTE: assumes Quaternion stores (x, y, z, w), same as RenderEntity::rot / LightDef::dirQuat
+    inline Quaternion toQuaternion(const glm::quat& q) {
+        return Quaternion(glm::avec4(q.x, q.y, q.z, q.w));
+    }
+
+    /// rotation taking the engine's forward (-Z) to dir
+    inline Quaternion lookRotation(glm::vec3 dir, glm::vec3 up = glm::vec3(0, 1, 0)) {
+        if (std::abs(glm::dot(glm::normalize(dir), up)) > 0.999f) up = glm::vec3(0, 0, 1);
+
+        return toQuaternion(glm::quatLookAt(glm::normalize(dir), up));
+    }
+
+    /// Non-indexed UV sphere, squashed by scale
+    inline std::vector<Medea::MVertex<BenchVertex>> makeSphere(uint32_t rings, glm::vec3 scale) {
+        rings = std::max(rings, 3u);
+        const uint32_t segments = rings * 2;
+
+        auto point = [&] (uint32_t r, uint32_t s) {
+            double theta = glm::pi<double>() * double(r) / double(rings);
+            double phi = 2.0 * glm::pi<double>() * double(s) / double(segments);
+
+            glm::vec3 unit(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+            return Medea::MVertex<BenchVertex>(unit * scale, glm::normalize(unit / scale), glm::vec2(float(s) / segments, float(r) / rings));
+        };
+
+        std::vector<Medea::MVertex<BenchVertex>> out;
+        out.reserve(rings * segments * 6);
+
+        for (uint32_t r=0; r<rings; r++) {
+            for (uint32_t s=0; s<segments; s++) {
+                out.push_back(point(r, s));
+                out.push_back(point(r+1, s));
+                out.push_back(point(r+1, s+1));
+
+                out.push_back(point(r, s));
+                out.push_back(point(r+1, s+1));
+                out.push_back(point(r, s+1));
+            }
+        }
+
+        return out;
+    }
+
+    inline std::vector<Medea::MVertex<BenchVertex>> makeGround(float halfExtent) {
+        glm::vec3 n(0, 1, 0);
+
+        glm::vec3 c[4] = {{-halfExtent, 0, -halfExtent}, {halfExtent, 0, -halfExtent}, {halfExtent, 0, halfExtent}, {-halfExtent, 0, halfExtent}};
+        glm::vec2 uv[4] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+
+        std::vector<Medea::MVertex<BenchVertex>> out;
+
+        for (int i : {0, 2, 1, 0, 3, 2}) out.push_back(Medea::MVertex<BenchVertex>(c[i], n, uv[i]));
+
+        return out;
+    }
+
+    struct Scene {
+        std::vector<std::shared_ptr<Medea::FullMesh<BenchVertex>>> meshes;
+        std::shared_ptr<Medea::FullMesh<BenchVertex>> ground;
+        std::vector<std::unique_ptr<BenchMaterial>> materials;
+        std::vector<Medea::Spotlight> lights;
+    };
+
+    /// Material sets have to exist before GPUSceneGraph::compileMaterialSets, and entities can only be added after, so this is split in two
+    inline Scene makeSceneResources(Medea::Core& core, vk::CommandBuffer cmd, Medea::CommandJobQueueCallback upload, Medea::GPUSceneGraph& graph, const BenchConfig& cfg) {
+        Scene out;
+
+        std::mt19937 rng(cfg.seed);
+
+        for (uint32_t i=0; i<std::max(cfg.materials, 1u); i++) {
+            out.materials.push_back(std::make_unique<BenchMaterial>(graph, core, cmd, cfg.vertexShader, cfg.fragmentShader));
+        }
+
+        const Medea::VertexFormat format = cfg.quantizedVertices ? Medea::VertexFormat::quantized : Medea::VertexFormat::full;
+
+        for (uint32_t i=0; i<std::max(cfg.meshVariants, 1u); i++) {
+            glm::vec4 r = uniform4(rng);
+            glm::vec3 scale(0.5f + r.x, 0.5f + r.y * 2.f, 0.5f + r.z);
+
+            out.meshes.push_back(Medea::FullMesh<BenchVertex>::make(upload, core.allocator, *core.device, graph.getMeshIndices(),
+                                                                    makeSphere(cfg.meshRings, scale), format));
+        }
+
+        out.ground = Medea::FullMesh<BenchVertex>::make(upload, core.allocator, *core.device, graph.getMeshIndices(),
+                                                        makeGround(float(cfg.worldRadius * 1.5)), format);
+
+        //spotlights scattered over the disc, pointing (mostly) down
+        for (uint32_t i=0; i<cfg.lights; i++) {
+            glm::vec4 r0 = uniform4(rng), r1 = uniform4(rng);
+
+            double r = cfg.worldRadius * std::sqrt(r0.x);
+            double a = 2.0 * glm::pi<double>() * r0.y;
+
+            Vec3 pos(r * std::cos(a), 6.0 + 6.0 * r0.z, r * std::sin(a));
+            glm::vec3 dir(r0.w - 0.5f, -2.f, r1.x - 0.5f);
+
+            Vec3 color(0.2 + r1.y, 0.2 + r1.z, 0.2 + r1.w);
+
+            glm::vec4 r2 = uniform4(rng);
+
+            Placement p(pos, lookRotation(dir));
+            Placement offset(Vec3(0, 0, 0), toQuaternion(glm::quat(1, 0, 0, 0)));
+
+            out.lights.push_back(Medea::Spotlight(p, offset, 16.0 + 16.0 * r2.x, 60.0 + 30.0 * r2.y, color * 20.0));
+        }
+
+        return out;
+    }
+
+    inline void populateWorld(Scene& scene, Medea::RenderWorld& world, const BenchConfig& cfg) {
+        //different stream from makeSceneResources, so changing e.g. the light count doesn't move every entity
+        std::mt19937 rng(cfg.seed * 7919u + 1);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+        scene.materials.at(0)->add(world, BenchUniform{glm::vec4(0.5, 0.5, 0.5, 1), glm::vec4(0.8, 0, 0, 0)}, *scene.ground,
+                                   Placement(Vec3(0, 0, 0), toQuaternion(glm::quat(1, 0, 0, 0))));
+
+        for (uint32_t i=0; i<cfg.entities; i++) {
+            double r = cfg.worldRadius * std::sqrt(unit(rng));
+            double a = 2.0 * glm::pi<double>() * unit(rng);
+
+            Vec3 pos(r * std::cos(a), 1.0 + 2.0 * unit(rng), r * std::sin(a));
+
+            glm::quat rot = glm::angleAxis(2.f * glm::pi<float>() * unit(rng), glm::vec3(0, 1, 0));
+
+            auto& mesh = *scene.meshes.at(i % scene.meshes.size());
+            auto& mat = *scene.materials.at((i / scene.meshes.size()) % scene.materials.size());
+
+            glm::vec4 albedo = uniform4(rng), params = uniform4(rng);
+
+            BenchUniform u{glm::vec4(glm::vec3(albedo), 1), glm::vec4(params.x, params.y, 0, 0)};
+
+            mat.add(world, u, mesh, Placement(pos, toQuaternion(rot)));
+        }
+    }
+
+    struct CameraState {
+        glm::mat4 view;
+        glm::vec3 eye;
+        glm::vec3 target;
+    };
+
+    /// Deterministic orbit through the scene; a full loop takes 20 seconds of (fixed step) bench time
+    inline CameraState cameraAt(const BenchConfig& cfg, double time) {
+        const double LOOP_SECONDS = 20.0;
+
+        double a = 2.0 * glm::pi<double>() * time / LOOP_SECONDS;
+        double r = cfg.worldRadius * 0.6;
+
+        glm::vec3 eye(r * std::cos(a), 8.0 + 4.0 * std::sin(a * 3.0), r * std::sin(a));
+
+        //look a bit ahead along the orbit, slightly inwards
+        double ahead = a + 0.6;
+        glm::vec3 target(r * 0.8 * std::cos(ahead), 2.0, r * 0.8 * std::sin(ahead));
+
+        return CameraState{glm::lookAt(eye, target, glm::vec3(0, 1, 0)), eye, target};
+    }
+}
@@ -0,0 +1,593 @@
+#include <benchmark/benchmark.h>
+
+#include "medea/light.h"
+#include "medea/cull.h"
+#include "medea/gvector.h"
+#include "medea/scene.h"
+#include "medea/internal/metacodegen.h"
+
+#include "benchscene.h"
+
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+/// medea-microbench: CPU-only hot paths, no Vulkan device needed; links only the engine TUs these need (see CMakeLists.txt), so one that
+///  calls into the rest of the engine won't link. Every benchmark builds its inputs from a fixed seed, so runs are comparable:
+///     ./medea-microbench --benchmark_out=base.json --benchmark_out_format=json
+///     ./medea-microbench --benchmark_filter=FilterLights --benchmark_repetitions=10
+
+namespace {
+    const uint32_t SEED = 1234;
+
+    /// filterLights logs to cout/cerr on every call; keep that out of the timings
+    struct SilenceStreams {
+        std::stringstream sink;
+        std::streambuf* oldOut;
+        std::streambuf* oldErr;
+
+        SilenceStreams() : oldOut(std::cout.rdbuf(sink.rdbuf())), oldErr(std::cerr.rdbuf(sink.rdbuf())) {}
+
+        ~SilenceStreams() {
+            std::cout.rdbuf(oldOut);
+            std::cerr.rdbuf(oldErr);
+        }
+
+        void drain() {
+            sink.str({});
+            sink.clear();
+        }
+    };
+
+    Placement identityPlacement(Vec3 pos) {
+        return Placement(pos, Bench::toQuaternion(glm::quat(1, 0, 0, 0)));
+    }
+
+    /// scattered over a worldSize x worldSize square around the origin
+    std::vector<Medea::Spotlight> makeLights(size_t count, double worldSize = 200.0) {
+        std::mt19937 rng(SEED);
+
+        std::vector<Medea::Spotlight> out;
+        out.reserve(count);
+
+        for (size_t i=0; i<count; i++) {
+            glm::vec4 r0 = Bench::uniform4(rng), r1 = Bench::uniform4(rng);
+
+            Vec3 pos(worldSize * (r0.x - 0.5), 4.0 + 8.0 * r0.y, worldSize * (r0.z - 0.5));
+            glm::vec3 dir(r0.w - 0.5f, -2.f, r1.x - 0.5f);
+
+            out.push_back(Medea::Spotlight(Placement(pos, Bench::lookRotation(dir)), identityPlacement(Vec3(0, 0, 0)),
+                                           8.0 + 24.0 * r1.y, 30.0 + 60.0 * r1.z, Vec3(1, 1, 1)));
+        }
+
+        return out;
+    }
+
+    struct Camera {
+        glm::mat4 view, proj;
+        Placement place;
+        Cull::Cone cone;
+    };
+
+    Camera makeCamera() {
+        glm::vec3 eye(0, 10, 60), target(0, 0, 0);
+
+        Placement place(Vec3(eye.x, eye.y, eye.z), Bench::lookRotation(target - eye));
+
+        return Camera{glm::lookAt(eye, target, glm::vec3(0, 1, 0)), glm::perspective(glm::radians(70.f), 16.f / 9.f, 0.5f, 600.f),
+                      place, Cull::Cone(place, 600.0, glm::radians(60.0))};
+    }
+}
+
+
+static void BM_FilterLights(benchmark::State& state) {
+    auto lights = makeLights(state.range(0));
+    Camera cam = makeCamera();
+
+    CameraRenderContext ctx(cam.view, cam.proj);
+
+    std::vector<Medea::LightDef> out;
+
+    SilenceStreams silence;
+
+    for (auto _ : state) {
+        Medea::Spotlight::filterLights(out, lights, ctx, cam.cone, Medea::RenderConstants::shadowAtlasBlockResolution);
+
+        benchmark::DoNotOptimize(out.data());
+        silence.drain();
+    }
+
+    state.SetItemsProcessed(state.iterations() * lights.size());
+    state.counters["kept"] = out.size();
+}
+BENCHMARK(BM_FilterLights)->Arg(1000)->Arg(10000)->Arg(100000);
+
+
+/// lights over a world much bigger than the camera cone; arg 1 picks the plain (0) or LightIndex (1) filterLights
+static void BM_FilterLightsWorld(benchmark::State& state) {
+    auto lights = makeLights(state.range(0), 8000.0);
+    Camera cam = makeCamera();
+
+    CameraRenderContext ctx(cam.view, cam.proj);
+
+    Medea::LightIndex index;
+
+    for (uint32_t i=0; i<lights.size(); i++) index.add(lights.at(i), i);
+
+    std::vector<Medea::LightDef> out;
+
+    SilenceStreams silence;
+
+    for (auto _ : state) {
+        if (state.range(1)) Medea::Spotlight::filterLights(out, lights, index, ctx, cam.cone, Medea::RenderConstants::shadowAtlasBlockResolution);
+        else Medea::Spotlight::filterLights(out, lights, ctx, cam.cone, Medea::RenderConstants::shadowAtlasBlockResolution);
+
+        benchmark::DoNotOptimize(out.data());
+        silence.drain();
+    }
+
+    state.SetItemsProcessed(state.iterations() * lights.size());
+    state.counters["kept"] = out.size();
+    state.counters["treeHeight"] = index.getHeight();
+}
+BENCHMARK(BM_FilterLightsWorld)->ArgsProduct({{10000, 100000}, {0, 1}});
+
+
+/// every light moves a bit each iteration; most stay inside their leaf's padding
+static void BM_LightIndexUpdate(benchmark::State& state) {
+    auto lights = makeLights(state.range(0), 8000.0);
+
+    Medea::LightIndex index;
+
+    for (uint32_t i=0; i<lights.size(); i++) index.add(lights.at(i), i);
+
+    std::vector<Placement> places;
+    places.reserve(lights.size());
+
+    std::mt19937 rng(SEED);
+
+    for (size_t i=0; i<lights.size(); i++) {
+        glm::vec4 r = Bench::uniform4(rng);
+
+        places.push_back(Placement(Vec3(8000.0 * (r.x - 0.5), 4.0 + 8.0 * r.y, 8000.0 * (r.z - 0.5)), Bench::lookRotation(glm::vec3(0, -1, 0))));
+    }
+
+    double t = 0.0;
+
+    for (auto _ : state) {
+        t += 0.1;
+
+        for (size_t i=0; i<lights.size(); i++) {
+            Placement p = places[i];
+            p.pos = p.pos + Vec3(std::sin(t + i), 0, std::cos(t + i)) * 2.0;
+
+            lights[i].setPos(p);
+        }
+
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * lights.size());
+    state.counters["treeHeight"] = index.getHeight();
+}
+BENCHMARK(BM_LightIndexUpdate)->Arg(10000);
+
+
+static void BM_GetPriority(benchmark::State& state) {
+    auto lights = makeLights(state.range(0));
+    Camera cam = makeCamera();
+
+    glm::mat4 viewProj = cam.proj * cam.view;
+
+    for (auto _ : state) {
+        double total = 0.0;
+
+        for (auto& l : lights) total += l.getPriority(cam.cone, viewProj).priority;
+
+        benchmark::DoNotOptimize(total);
+    }
+
+    state.SetItemsProcessed(state.iterations() * lights.size());
+}
+BENCHMARK(BM_GetPriority)->Arg(10000);
+
+
+static void BM_CoordToZOrder(benchmark::State& state) {
+    const int SPAN = 256;
+
+    for (auto _ : state) {
+        u64 acc = 0;
+
+        for (int y=0; y<SPAN; y++) for (int x=0; x<SPAN; x++) acc ^= Medea::coordToZOrder(Coord(x, y));
+
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(state.iterations() * SPAN * SPAN);
+}
+BENCHMARK(BM_CoordToZOrder);
+
+
+static void BM_ZOrderToCoord(benchmark::State& state) {
+    const u64 COUNT = 256 * 256;
+
+    for (auto _ : state) {
+        int acc = 0;
+
+        for (u64 i=0; i<COUNT; i++) {
+            Coord c = Medea::zOrderToCoord(i);
+            acc += c.x ^ c.y;
+        }
+
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(state.iterations() * COUNT);
+}
+BENCHMARK(BM_ZOrderToCoord);
+
+
+namespace {
+    /// range(0) entries, range(1) percent of them modified; scattered at random, so runs are short
+    std::set<size_t> makeModified(size_t size, size_t percent) {
+        std::mt19937 rng(SEED);
+        std::uniform_int_distribution<size_t> pick(0, 99);
+
+        std::set<size_t> out;
+
+        for (size_t i=0; i<size; i++) if (pick(rng) < percent) out.insert(i);
+
+        return out;
+    }
+}
+
+static void BM_GVectorPatchList(benchmark::State& state) {
+    std::vector<Medea::RenderEntity> backing(state.range(0));
+    std::set<size_t> modified = makeModified(backing.size(), state.range(1));
+
+    std::vector<size_t> idxList;
+    std::vector<Medea::RenderEntity> patchList;
+
+    for (auto _ : state) {
+        Medea::Internal::buildPatchList(modified, backing, idxList, patchList);
+
+        benchmark::DoNotOptimize(patchList.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * modified.size());
+}
+BENCHMARK(BM_GVectorPatchList)->Args({10000, 10})->Args({10000, 100})->Args({100000, 10});
+
+
+static void BM_GVectorCoalesce(benchmark::State& state) {
+    std::set<size_t> modified = makeModified(state.range(0), state.range(1));
+    std::vector<size_t> idxList(modified.begin(), modified.end());
+
+    size_t copies = 0;
+
+    for (auto _ : state) {
+        auto out = Medea::Internal::coalescePatchCopies(idxList, sizeof(Medea::RenderEntity));
+
+        copies = out.size();
+        benchmark::DoNotOptimize(out.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * idxList.size());
+    state.counters["copies"] = copies;
+}
+BENCHMARK(BM_GVectorCoalesce)->Args({10000, 10})->Args({10000, 100})->Args({100000, 10});
+
+
+namespace {
+    std::vector<Cull::Sphere> makeSpheres(size_t count) {
+        std::mt19937 rng(SEED);
+
+        std::vector<Cull::Sphere> out;
+
+        for (size_t i=0; i<count; i++) {
+            glm::vec4 r = Bench::uniform4(rng);
+
+            out.push_back(Cull::Sphere(identityPlacement(Vec3(400.0 * r.x - 200.0, 20.0 * r.y, 400.0 * r.z - 200.0)), 0.5 + 4.0 * r.w));
+        }
+
+        return out;
+    }
+
+    Cull::SphereBatch toBatch(const std::vector<Cull::Sphere>& spheres) {
+        Cull::SphereBatch out;
+
+        out.reserve(spheres.size());
+        for (auto& s : spheres) out.push_back(s);
+
+        return out;
+    }
+
+    /// 8 points (a box) per object, around the spheres from makeSpheres
+    std::vector<Cull::PointBatch> makeBoxCorners(size_t count) {
+        std::vector<Cull::PointBatch> out(8);
+
+        for (auto& s : makeSpheres(count)) {
+            for (int k=0; k<8; k++) out[k].push_back(s.pos + Vec3(k & 1 ? s.rad : -s.rad, k & 2 ? s.rad : -s.rad, k & 4 ? s.rad : -s.rad));
+        }
+
+        return out;
+    }
+}
+
+static void BM_ConeVsSphere(benchmark::State& state) {
+    auto spheres = makeSpheres(state.range(0));
+
+    Cull::Cone cone = makeCamera().cone;
+
+    for (auto _ : state) {
+        size_t visible = 0;
+
+        for (auto& s : spheres) visible += Cull::testConeVsSphere(cone, s);
+
+        benchmark::DoNotOptimize(visible);
+    }
+
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_ConeVsSphere)->Arg(10000)->Arg(100000);
+
+
+static void BM_ConeVsSphereBatch(benchmark::State& state) {
+    Cull::SphereBatch spheres = toBatch(makeSpheres(state.range(0)));
+    std::vector<uint8_t> visible(spheres.size());
+
+    Cull::Cone cone = makeCamera().cone;
+
+    for (auto _ : state) {
+        Cull::testConeVsSpheres(cone, spheres, visible.data());
+
+        benchmark::DoNotOptimize(visible.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_ConeVsSphereBatch)->Arg(10000)->Arg(100000);
+
+
+static void BM_FrustumVsSphereBatch(benchmark::State& state) {
+    Cull::SphereBatch spheres = toBatch(makeSpheres(state.range(0)));
+    std::vector<uint8_t> visible(spheres.size());
+
+    Camera cam = makeCamera();
+    glm::mat4 viewProj = cam.proj * cam.view;
+
+    for (auto _ : state) {
+        Cull::testFrustumVsSpheres(viewProj, spheres, visible.data());
+
+        benchmark::DoNotOptimize(visible.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * spheres.size());
+}
+BENCHMARK(BM_FrustumVsSphereBatch)->Arg(100000);
+
+
+/// scalar baseline for BM_ProjectBoundsBatch: transformPoint + AABB3, like Spotlight::getPriority
+static void BM_ProjectBounds(benchmark::State& state) {
+    auto corners = makeBoxCorners(state.range(0));
+
+    Camera cam = makeCamera();
+    glm::mat4 viewProj = cam.proj * cam.view;
+
+    const size_t n = corners.front().size();
+
+    for (auto _ : state) {
+        double acc = 0.0;
+
+        for (size_t i=0; i<n; i++) {
+            AABB3 bounds(transformPoint(viewProj, Vec3(corners[0].x[i], corners[0].y[i], corners[0].z[i])));
+
+            for (size_t k=1; k<corners.size(); k++) bounds.add(transformPoint(viewProj, Vec3(corners[k].x[i], corners[k].y[i], corners[k].z[i])));
+
+            acc += bounds.hi.x - bounds.lo.x;
+        }
+
+        benchmark::DoNotOptimize(acc);
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ProjectBounds)->Arg(100000);
+
+
+static void BM_ProjectBoundsBatch(benchmark::State& state) {
+    auto corners = makeBoxCorners(state.range(0));
+
+    Camera cam = makeCamera();
+    glm::mat4 viewProj = cam.proj * cam.view;
+
+    Cull::BoundsBatch bounds;
+
+    for (auto _ : state) {
+        Cull::projectBounds(viewProj, corners, bounds);
+
+        benchmark::DoNotOptimize(bounds.loX.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * bounds.size());
+}
+BENCHMARK(BM_ProjectBoundsBatch)->Arg(100000);
+
+
+static void BM_CppStructToGLSL(benchmark::State& state) {
+    for (auto _ : state) {
+        std::stringstream out;
+
+        Medea::Internal::cppStructToGLSL<Medea::RenderEntity>(out, "RenderEntity");
+        Medea::Internal::cppStructToGLSL<Medea::LightDef>(out, "LightDef");
+
+        benchmark::DoNotOptimize(out.str());
+    }
+}
+BENCHMARK(BM_CppStructToGLSL);
+
+
+namespace {
+    std::string readOrEmpty(const std::string& path) {
+        return Medea::readFile(path).value_or("");
+    }
+}
+
+static void BM_MaterialToLib(benchmark::State& state) {
+    std::string vtx = readOrEmpty("./bench/shader/benchmat.vert");
+    std::string frag = readOrEmpty("./bench/shader/benchmat.frag");
+
+    if (vtx.empty() || frag.empty()) {
+        state.SkipWithError("run from the build directory; needs ./bench/shader/");
+        return;
+    }
+
+    for (auto _ : state) {
+        auto v = Medea::Internal::materialToLibVtx<Bench::BenchUniform, Bench::BenchVertex>(vtx, "mat0", 0);
+        auto f = Medea::Internal::materialToLibFrag<Bench::BenchUniform>(frag, "mat0", 0);
+
+        benchmark::DoNotOptimize(v.src);
+        benchmark::DoNotOptimize(f.src);
+    }
+}
+BENCHMARK(BM_MaterialToLib);
+
+
+static void BM_VMaterialSrcFrag(benchmark::State& state) {
+    std::string frag = readOrEmpty("./bench/shader/benchmat.frag");
+
+    if (frag.empty() || !std::filesystem::exists("./shader/shared/builtins.slib")) {
+        state.SkipWithError("run from the build directory; needs ./shader/shared/ and ./bench/shader/");
+        return;
+    }
+
+    std::vector<Medea::Internal::VMaterialFragment> materials;
+
+    for (int64_t i=0; i<state.range(0); i++) {
+        materials.push_back(Medea::Internal::materialToLibFrag<Bench::BenchUniform>(frag, "mat" + std::to_string(i), i));
+    }
+
+    for (auto _ : state) {
+        std::string src = Medea::Internal::vmaterialSrcFrag<Medea::Internal::GSGV2F, Medea::Internal::GSGFOut>(materials, "");
+
+        benchmark::DoNotOptimize(src);
+    }
+}
+BENCHMARK(BM_VMaterialSrcFrag)->Arg(4)->Arg(32);
+
+
+static void BM_FullMeshDeinterleave(benchmark::State& state) {
+    auto vertices = Bench::makeSphere(state.range(0), glm::vec3(1.0f, 1.5f, 0.8f));
+
+    for (auto _ : state) {
+        auto d = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices);
+
+        benchmark::DoNotOptimize(d.positions.data());
+        benchmark::DoNotOptimize(d.attributes.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vertices.size());
+}
+BENCHMARK(BM_FullMeshDeinterleave)->Arg(16)->Arg(64);
+
+//FullMesh::make's indexing: soup dedupe + weld + vertex cache, overdraw & fetch reordering
+static void BM_BuildIndexedMesh(benchmark::State& state) {
+    auto vertices = Bench::makeSphere(state.range(0), glm::vec3(1.0f, 1.5f, 0.8f));
+    auto d = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices);
+
+    Medea::IndexedMesh m;
+
+    for (auto _ : state) {
+        std::vector<uint32_t> canonical = Medea::dedupeSoup<Medea::MVertex<Bench::BenchVertex>>(vertices);
+        m = Medea::buildIndexedMesh(d.positions, canonical);
+
+        benchmark::DoNotOptimize(m.indices.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vertices.size() / 3);
+    state.counters["soupACMR"] = 3.0;                  //<- unindexed: every corner is an invocation
+    state.counters["weldedACMR"] = m.welded.acmr;
+    state.counters["optimizedACMR"] = m.optimized.acmr;
+    state.counters["optimizedATVR"] = m.optimized.atvr;
+}
+BENCHMARK(BM_BuildIndexedMesh)->Arg(16)->Arg(64);
+
+//FullMesh::make's meshlet build: greedy clustering + bounds/cones, over the indexed mesh
+static void BM_BuildMeshlets(benchmark::State& state) {
+    auto vertices = Bench::makeSphere(state.range(0), glm::vec3(1.0f, 1.5f, 0.8f));
+    auto soup = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices);
+
+    Medea::IndexedMesh indexed = Medea::buildIndexedMesh(soup.positions, Medea::dedupeSoup<Medea::MVertex<Bench::BenchVertex>>(vertices));
+    auto d = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices, indexed.vertices);
+
+    size_t meshlets = 0, meshletVertices = 0;
+
+    for (auto _ : state) {
+        Medea::MeshletData m = Medea::buildMeshlets(d.positions, indexed.indices);
+
+        meshlets = m.meshlets.size();
+        meshletVertices = m.vertices.size();
+        benchmark::DoNotOptimize(m.meshlets.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * vertices.size() / 3);
+    state.counters["meshlets"] = meshlets;
+    state.counters["vertsPerTri"] = double(meshletVertices) / (vertices.size() / 3);   //<- mesh shader vertex invocations per triangle
+}
+BENCHMARK(BM_BuildMeshlets)->Arg(16)->Arg(64);
+
+//FullMesh::make's LOD chain: a binary search over clustering grids per level, all against the indexed mesh
+static void BM_BuildLodChain(benchmark::State& state) {
+    auto vertices = Bench::makeSphere(state.range(0), glm::vec3(1.0f, 1.5f, 0.8f));
+    auto soup = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices);
+
+    Medea::IndexedMesh indexed = Medea::buildIndexedMesh(soup.positions, Medea::dedupeSoup<Medea::MVertex<Bench::BenchVertex>>(vertices));
+    auto d = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices, indexed.vertices);
+
+    std::vector<Medea::LodLevel> chain;
+
+    for (auto _ : state) {
+        chain = Medea::buildLodChain(d.positions, indexed.indices);
+
+        benchmark::DoNotOptimize(chain.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * indexed.indices.size() / 3);
+    state.counters["levels"] = chain.size();
+    state.counters["coarsestTriangles"] = chain.back().indices.size() / 3;
+    state.counters["coarsestError"] = chain.back().error;      //<- object space
+}
+BENCHMARK(BM_BuildLodChain)->Arg(16)->Arg(64);
+
+//FullMesh::make's VertexFormat::quantized encode, and how far what the shader decodes is off
+static void BM_QuantizePositions(benchmark::State& state) {
+    auto vertices = Bench::makeSphere(state.range(0), glm::vec3(1.0f, 1.5f, 0.8f));
+    auto d = Medea::FullMesh<Bench::BenchVertex>::deinterleave(vertices);
+
+    Medea::QuantizedPositions q;
+
+    for (auto _ : state) {
+        q = Medea::quantizePositions(d.positions);
+
+        benchmark::DoNotOptimize(q.vertices.data());
+    }
+
+    std::vector<Medea::VertexPosition> decoded = Medea::dequantizePositions(q);
+
+    float posError = 0, normalDot = 1;
+
+    for (size_t i=0; i<decoded.size(); i++) {
+        posError = std::max(posError, glm::length(glm::vec3(decoded.at(i).pos) - glm::vec3(d.positions.at(i).pos)));
+        normalDot = std::min(normalDot, glm::dot(glm::vec3(decoded.at(i).normal), glm::normalize(glm::vec3(d.positions.at(i).normal))));
+    }
+
+    state.SetItemsProcessed(state.iterations() * d.positions.size());
+    state.counters["bytesPerVertex"] = double(q.pack().size() * sizeof(uint32_t)) / d.positions.size();   //<- vs sizeof(VertexPosition)
+    state.counters["maxPosError"] = posError;
+    state.counters["minNormalDot"] = normalDot;
+}
+BENCHMARK(BM_QuantizePositions)->Arg(16)->Arg(64);
+
+
+BENCHMARK_MAIN();
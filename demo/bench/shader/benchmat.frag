@@ -0,0 +1,9 @@
+// medea-bench default material; albedo * a fixed sun + ambient
+
+void _medeaMain(model, view, projection, u) {
+    const vec3 sunDir = normalize(vec3(0.3, 1.0, 0.2));
+
+    float ndotl = max(dot(normalize(fragWorldNormal), sunDir), 0.0);
+
+    fragColor = vec4(u.albedo.rgb * (0.15 + 0.85 * ndotl), 1.0);
+}
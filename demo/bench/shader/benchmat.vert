@@ -0,0 +1,13 @@
+// medea-bench default material. Deliberately cheap; pass the game's materials with --vert/--frag to bench real shading.
+// "_medeaMain(...)" gets rewritten into a typed, per-material entry point by MaterialSet (see metacodegen.h)
+
+void _medeaMain(model, view, projection, pos, normal, v, u) {
+    vec4 world = model * vec4(pos, 1.0);
+
+    fragWorldPos = world.xyz;
+    fragWorldNormal = normalize(mat3(model) * normal);
+    fragUV = v.uv;
+    fragTex = 0;
+
+    gl_Position = projection * view * world;
+}
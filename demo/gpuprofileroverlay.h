@@ -0,0 +1,104 @@
+#pragma once
+
+#include "imgui.h"
+
+#include "medea/gpuprofiler.h"
+
+/// Per-pass GPU timing table. Call between ImGui::NewFrame() and ImGui::Render(), e.g.
+///     drawGPUProfilerOverlay(sceneGraph.getProfiler(), &showProfiler);
+inline void drawGPUProfilerOverlay(const Medea::GPUProfiler& profiler, bool* open = nullptr) {
+    ImGui::SetNextWindowBgAlpha(0.7f);
+
+    if (!ImGui::Begin("GPU passes", open, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing)) {
+        ImGui::End();
+        return;
+    }
+
+    if (!profiler.isSupported()) {
+        ImGui::TextUnformatted("Timestamps unsupported on this queue");
+        ImGui::End();
+        return;
+    }
+
+    double frameMs = profiler.getAverageFrameTimeMs();
+
+    ImGui::Text("GPU frame: %.3f ms", frameMs);
+
+    if (ImGui::BeginTable("passes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("avg ms");
+        ImGui::TableSetupColumn("%");
+        ImGui::TableHeadersRow();
+
+        for (auto& t : profiler.getTimings()) {
+            ImGui::TableNextRow();
+
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Indent(t.depth * 10.f + 0.001f);
+            ImGui::TextUnformatted(t.name.c_str());
+            ImGui::Unindent(t.depth * 10.f + 0.001f);
+
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.3f", t.ms);
+
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", t.avgMs);
+
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.1f", frameMs > 0.0 ? 100.0 * t.avgMs / frameMs : 0.0);
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+/// Per-pass pipeline statistics; answers "is this pass vertex or fill bound"
+inline void drawPipelineStatsOverlay(const Medea::PipelineStatsProfiler& stats, bool* open = nullptr) {
+    ImGui::SetNextWindowBgAlpha(0.7f);
+
+    if (!ImGui::Begin("GPU pipeline stats", open, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing)) {
+        ImGui::End();
+        return;
+    }
+
+    if (!stats.isSupported()) {
+        ImGui::TextUnformatted("pipelineStatisticsQuery unsupported");
+        ImGui::End();
+        return;
+    }
+
+    auto row = [] (const char* name, const Medea::GPUPipelineStats& s) {
+        ImGui::TableNextRow();
+
+        ImGui::TableSetColumnIndex(0);
+        ImGui::TextUnformatted(name);
+
+        uint64_t cols[] = {s.inputAssemblyVertices, s.vertexShaderInvocations, s.clippingPrimitives, s.fragmentShaderInvocations, s.computeShaderInvocations};
+
+        for (int i=0; i<5; i++) {
+            ImGui::TableSetColumnIndex(i+1);
+            ImGui::Text("%llu", (unsigned long long) cols[i]);
+        }
+    };
+
+    if (ImGui::BeginTable("stats", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("Pass");
+        ImGui::TableSetupColumn("IA verts");
+        ImGui::TableSetupColumn("VS inv");
+        ImGui::TableSetupColumn("clip prims");
+        ImGui::TableSetupColumn("FS inv");
+        ImGui::TableSetupColumn("CS inv");
+        ImGui::TableHeadersRow();
+
+        for (auto& p : stats.getPassStats()) row(p.name.c_str(), p.stats);
+
+        row("total", stats.getFrameStats());
+
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
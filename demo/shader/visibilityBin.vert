@@ -0,0 +1,16 @@
+#version 460
+
+// Visibility buffer (see GSGBindlessShader::VisibilityPipelines): one fullscreen triangle at the depth of material bin gl_InstanceIndex, so
+//  that against the material depth (visibilityClassify.frag) and an equal depth test, a resolve draw only shades its own bin's pixels.
+//  The classify pass draws it too, where the depth doesn't matter
+
+// = visibilityClassify.frag's binDepth
+float binDepth(uint bin) {
+    return float(bin) / 256.0;
+}
+
+void main() {
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+
+    gl_Position = vec4(uv * 2.0 - 1.0, binDepth(uint(gl_InstanceIndex)), 1.0);
+}
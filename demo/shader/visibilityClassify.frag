@@ -0,0 +1,20 @@
+#version 460
+
+// Visibility buffer, material classification: writes each covered pixel's material bin (the top 8 bits of the visibility buffer's y; see
+//  Internal::VisibilityBits) as its depth. The resolve then draws one fullscreen triangle per bin at that depth (visibilityBin.vert) with
+//  an equal test, so early depth testing sorts pixels into bins for free. Uncovered pixels keep the clear (1.0), which no bin has
+
+// megashader set 2
+layout (set = 2, binding = 2) uniform usampler2D medeaVisibility;
+
+float binDepth(uint bin) {
+    return float(bin) / 256.0;
+}
+
+void main() {
+    uvec2 vis = texelFetch(medeaVisibility, ivec2(gl_FragCoord.xy), 0).xy;
+
+    if (vis.x == 0xFFFFFFFFu) discard;
+
+    gl_FragDepth = binDepth(vis.y >> 24);
+}
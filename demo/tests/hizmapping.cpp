@@ -0,0 +1,71 @@
+#include "medea/hizpyramid.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+
+/// medea-test-hiz: occlusion culling's NDC -> Hi-Z texel mapping (hiZUVScaleBias) against where the rasterizer actually puts a point,
+///  i.e. Vulkan's viewport transform with the flipped viewport v2Bind sets. No Vulkan device needed
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char* what) {
+        if (ok) return;
+
+        std::cerr<<"FAIL: "<<what<<"\n";
+        failures++;
+    }
+
+    /// the framebuffer pixel ndc lands in, with v2Bind's viewport: y = height, height = -height
+    glm::ivec2 rasterPixel(glm::vec2 ndc, glm::vec4 viewport) {
+        float vy = viewport.w;
+        float vh = -viewport.w;
+
+        glm::vec2 fb(viewport.x + (ndc.x + 1.f) * 0.5f * viewport.z, vy + (ndc.y + 1.f) * 0.5f * vh);
+
+        return glm::ivec2(glm::floor(fb));
+    }
+
+    /// the texel occlusionCull.comp / meshletCull.task fetch at mip 0
+    glm::ivec2 hiZTexel(glm::vec2 ndc, glm::vec4 viewport, glm::vec2 base) {
+        glm::vec4 sb = Medea::hiZUVScaleBias(viewport, base);
+
+        glm::vec2 uv = ndc * glm::vec2(sb.x, sb.y) + glm::vec2(sb.z, sb.w);
+
+        return glm::ivec2(glm::floor(glm::clamp(uv, 0.f, 1.f) * base));
+    }
+}
+
+int main() {
+    const glm::vec2 base(1280, 720);
+    const glm::vec4 viewport(0, 0, 1280, 720);
+
+    //a point above and right of where the camera looks: upper right quadrant of the screen, i.e. low rows
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+    glm::mat4 proj = glm::perspective(glm::radians(90.f), base.x / base.y, 0.1f, 100.f);
+
+    glm::vec4 clip = proj * view * glm::vec4(2, 3, -10, 1);
+    glm::vec2 ndc = glm::vec2(clip) / clip.w;
+
+    glm::ivec2 texel = hiZTexel(ndc, viewport, base);
+
+    check(texel == rasterPixel(ndc, viewport), "projected point samples the texel it was rasterized into");
+    check(texel.y < base.y / 2 && texel.x > base.x / 2, "point up and right of the view axis samples the top right quadrant");
+
+    //known values: NDC (0.5, 0.75) is pixel (960, 90)
+    check(hiZTexel(glm::vec2(0.5f, 0.75f), viewport, base) == glm::ivec2(960, 90), "NDC (0.5, 0.75) -> texel (960, 90)");
+    check(hiZTexel(glm::vec2(-0.999f, 0.999f), viewport, base) == glm::ivec2(0, 0), "NDC top left -> texel (0, 0)");
+    check(hiZTexel(glm::vec2(0.999f, -0.999f), viewport, base) == glm::ivec2(1279, 719), "NDC bottom right -> last texel");
+
+    //dynamic resolution: the viewport's a sub-rect of a larger pyramid base
+    const glm::vec4 subViewport(0, 0, 640, 360);
+
+    check(hiZTexel(glm::vec2(0.5f, 0.75f), subViewport, base) == rasterPixel(glm::vec2(0.5f, 0.75f), subViewport),
+          "sub-rect viewport samples the texel it was rasterized into");
+
+    if (failures == 0) std::cout<<"hiZ mapping: ok\n";
+
+    return failures == 0 ? 0 : 1;
+}
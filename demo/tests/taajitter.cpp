@@ -0,0 +1,60 @@
+#include "medea/temporalupscaler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+
+/// medea-test-taa: the sample offset TemporalUpscaler pushes to temporalUpscale.comp (jitterSampleOffset) against where a pixel of a frame
+///  drawn with the jittered projection actually samples the unjittered scene, through v2Bind's flipped viewport. No Vulkan device needed
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const char* what) {
+        if (ok) return;
+
+        std::cerr<<"FAIL: "<<what<<"\n";
+        failures++;
+    }
+
+    /// framebuffer position (in pixels, +y down) of a world point, with v2Bind's viewport: y = height, height = -height
+    glm::vec2 rasterPos(const glm::mat4& viewProj, glm::vec3 p, glm::vec2 extent) {
+        glm::vec4 clip = viewProj * glm::vec4(p, 1.f);
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+
+        return glm::vec2((ndc.x + 1.f) * 0.5f * extent.x, extent.y - (ndc.y + 1.f) * 0.5f * extent.y);
+    }
+}
+
+int main() {
+    const glm::vec2 extent(1280, 720);
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+    glm::mat4 proj = glm::perspective(glm::radians(90.f), extent.x / extent.y, 0.1f, 100.f);
+
+    const glm::vec3 points[] = {{2, 3, -10}, {-4, -1, -20}, {0, 0, -5}};
+    const glm::vec2 jitters[] = {{0.25f, -0.1667f}, {-0.375f, 0.2778f}, {0.4f, 0.4f}};
+
+    for (glm::vec2 jitter : jitters) {
+        glm::mat4 jittered = Medea::jitteredProjection(proj, jitter, extent);
+        glm::vec2 offset = Medea::jitterSampleOffset(jitter);
+
+        for (glm::vec3 p : points) {
+            //p lands at j in the jittered frame; the pixel there sees the scene at j + offset, which is where p is unjittered
+            glm::vec2 u = rasterPos(proj * view, p, extent);
+            glm::vec2 j = rasterPos(jittered * view, p, extent);
+
+            check(glm::all(glm::lessThan(glm::abs(j + offset - u), glm::vec2(1e-3f))), "sample offset matches the jittered projection");
+        }
+    }
+
+    //signs spelled out: jittering right and up moves the image right and up, so pixels see what's left and below (+y down)
+    glm::vec2 offset = Medea::jitterSampleOffset(glm::vec2(0.25f, 0.25f));
+
+    check(offset.x < 0.f && offset.y > 0.f, "jitter (+x, +y) samples (-x, +y) in pixels");
+
+    if (failures == 0) std::cout<<"TAA jitter: ok\n";
+
+    return failures == 0 ? 0 : 1;
+}
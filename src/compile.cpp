@@ -3,6 +3,7 @@
 #include "internal/metacodegen.h"
 
 #include "renderentity.h"
+#include "meshlod.h"
 
 
 namespace Medea {
@@ -36,6 +37,9 @@ namespace Medea {
             else if (suff == "LightDef") {
                 Internal::cppStructToGLSL<LightDef>(out, "LightDef");
             }
+            else if (suff == "MeshLod") {
+                Internal::cppStructToGLSL<MeshLod>(out, "MeshLod");
+            }
             else {  
                 assert(false);
             }
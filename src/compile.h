@@ -9,6 +9,7 @@ namespace Medea {
         compute,
         vertex,
         fragment,
+        task,
         mesh
     };
 
@@ -24,6 +25,9 @@ namespace Medea {
                 case ShaderStage::fragment:
                 return shaderc_shader_kind::shaderc_glsl_fragment_shader;
 
+                case ShaderStage::task:
+                return shaderc_shader_kind::shaderc_glsl_task_shader;
+
                 case ShaderStage::mesh:
                 return shaderc_shader_kind::shaderc_glsl_mesh_shader;
             }
@@ -42,6 +46,9 @@ namespace Medea {
                 case ShaderStage::fragment:
                 return vk::ShaderStageFlagBits::eFragment;
 
+                case ShaderStage::task:
+                return vk::ShaderStageFlagBits::eTaskEXT;
+
                 case ShaderStage::mesh:
                 return vk::ShaderStageFlagBits::eMeshEXT;
             }
@@ -6,7 +6,7 @@
 namespace Medea {
     BufferRef BufferRef::null = BufferRef::makeNull();
 
-    Core Core::make(vk::raii::Context& context, Medea::Window& window) {
+    Core Core::make(vk::raii::Context& context, Medea::Window& window, const PresentSettings& present) {
         vkb::InstanceBuilder builder; 
 
         constexpr bool USE_VALIDATION_LAYERS = true;
@@ -36,6 +36,7 @@ namespace Medea {
         features12.descriptorIndexing = true;
         features12.shaderSampledImageArrayNonUniformIndexing = true;
         features12.drawIndirectCount = true;
+        features12.timelineSemaphore = true;   //<- cross-queue sync for async compute (RenderGraph)
 
         vk::PhysicalDeviceVulkan11Features features11 = {};
 
@@ -46,6 +47,7 @@ namespace Medea {
         features10.samplerAnisotropy = true;
         features10.shaderInt16 = true;
         features10.shaderCullDistance = true;
+        features10.shaderClipDistance = true;   //<- keeps shadow draws inside their atlas tile
         //  
 
         vkb::PhysicalDeviceSelector selector(vkb_inst);
@@ -72,6 +74,42 @@ namespace Medea {
 
         physicalDevice.enable_extension_if_present(vk::EXTDynamicRenderingUnusedAttachmentsExtensionName);
 
+        DeviceCapabilities outCaps;
+
+        {
+            //only needed for PipelineStatsProfiler
+            VkPhysicalDeviceFeatures statsFeature = {};
+            statsFeature.pipelineStatisticsQuery = true;
+
+            outCaps.pipelineStatistics = physicalDevice.enable_features_if_present(statsFeature);
+        }
+
+        //real per-heap budgets for MemoryTracker, instead of VMA's guesses
+        outCaps.memoryBudget = physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+        {
+            //present ids + waiting on them, for MVKWindow's frame latency limit. present_wait requires present_id
+            VkPhysicalDevicePresentIdFeaturesKHR presentIdFeature{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR };
+            presentIdFeature.presentId = true;
+
+            VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeature{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+            presentWaitFeature.presentWait = true;
+
+            outCaps.presentWait = physicalDevice.enable_extensions_if_present({VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME})
+                && physicalDevice.enable_extension_features_if_present(presentIdFeature)
+                && physicalDevice.enable_extension_features_if_present(presentWaitFeature);
+        }
+
+        {
+            //task + mesh shaders; without them the megashader only has its vertex shader path
+            VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeature{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT };
+            meshShaderFeature.taskShader = true;
+            meshShaderFeature.meshShader = true;
+
+            outCaps.meshShader = physicalDevice.enable_extension_if_present(VK_EXT_MESH_SHADER_EXTENSION_NAME)
+                && physicalDevice.enable_extension_features_if_present(meshShaderFeature);
+        }
+
 
         //vk::raii::SurfaceKHR outDummySurface(outInstance, rawSurface);
 
@@ -89,6 +127,25 @@ namespace Medea {
         vk::raii::Queue outGraphicsQueue(outDevice, VKB_UNWRAP(vkbDevice.get_queue(vkb::QueueType::graphics), "Couldn't find queue"));
         uint32_t outGraphicsQueueFamily = VKB_UNWRAP(vkbDevice.get_queue_index(vkb::QueueType::graphics), "Couldn't find queue index");
 
+        //async compute wants a family without graphics (or at least a different one), otherwise it'd just be the graphics queue with extra steps
+        std::optional<vk::raii::Queue> outComputeQueue;
+        uint32_t outComputeQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+
+        {
+            auto dedicatedIdx = vkbDevice.get_dedicated_queue_index(vkb::QueueType::compute);
+            auto idx = dedicatedIdx ? dedicatedIdx : vkbDevice.get_queue_index(vkb::QueueType::compute);
+
+            if (idx && idx.value() != outGraphicsQueueFamily) {
+                outComputeQueueFamily = idx.value();
+                outComputeQueue.emplace(outDevice, outComputeQueueFamily, 0);
+
+                auto families = outGpu.getQueueFamilyProperties();
+
+                outCaps.asyncCompute = true;
+                outCaps.computeTimestamps = families.at(outComputeQueueFamily).timestampValidBits > 0;
+            }
+        }
+
         uint32_t count = 0;
         //auto features = outGpu.enumerateDeviceExtensionProperties();
 
@@ -113,19 +170,24 @@ namespace Medea {
         allocCreateInfo.device = *outDevice;
         allocCreateInfo.instance = *outInstance;
         allocCreateInfo.physicalDevice = *outGpu;
+        allocCreateInfo.vulkanApiVersion = VK_API_VERSION_1_3;
         allocCreateInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
 
+        if (outCaps.memoryBudget) allocCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
         VmaAllocator outAlloc;
         vmaCreateAllocator(&allocCreateInfo, &outAlloc);
 
+        MemoryTracker::get().attach(outAlloc, outCaps.memoryBudget);
+
         vkDestroySurfaceKHR(*outInstance, rawSurface, nullptr);
 
         return Core(std::move(outInstance), std::move(outGpu), std::move(outDevice), outAlloc, std::move(outDebugMessenger),
-                        std::move(outGraphicsQueue), std::move(outGraphicsQueueFamily), window);
+                        std::move(outGraphicsQueue), std::move(outGraphicsQueueFamily), std::move(outComputeQueue), outComputeQueueFamily, outCaps, window, present);
     }
 
     MVKWindow MVKWindow::make(vk::raii::Instance& instance, vk::raii::Device& device, vk::raii::PhysicalDevice& gpu, 
-                                    vk::raii::Queue& queue, uint32_t graphicsQueueFamily, Medea::Window& w) {
+                                    vk::raii::Queue& queue, uint32_t graphicsQueueFamily, Medea::Window& w, const PresentSettings& settings, bool presentWait) {
         VkSurfaceKHR rawSurface;
 
         VK_REQUIRE(glfwCreateWindowSurface(*instance, w.window, nullptr, &rawSurface));
@@ -141,13 +203,19 @@ namespace Medea {
         vkb::Swapchain vkbSwapchain = 
             VKB_UNWRAP(swapBuilder
             .set_desired_format(VkSurfaceFormatKHR{.format = outSwapchainImageFormat, .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR})
-            .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR) //vsync
+            .set_desired_present_mode(VkPresentModeKHR(settings.mode))
+            .add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR) //vsync; always supported
             .set_desired_extent(w.span.x, w.span.y)
             .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
             .build(), "Couldn't setup swapchain");
 
         vk::raii::SwapchainKHR outSwapchain(device, vkbSwapchain.swapchain);
 
+        if (vkbSwapchain.present_mode != VkPresentModeKHR(settings.mode)) {
+            std::cerr<<"WARNING: present mode "<<string_VkPresentModeKHR(VkPresentModeKHR(settings.mode))<<" isn't supported, using "
+                     <<string_VkPresentModeKHR(vkbSwapchain.present_mode)<<std::endl;
+        }
+
         std::vector<VkImage> outSwapchainImages = VKB_UNWRAP(vkbSwapchain.get_images(), "Couldn't find swapchain images");
         std::vector<vk::raii::ImageView> outSwapchainImageViews;
 
@@ -166,8 +234,13 @@ namespace Medea {
         for (int i=0; i<NUM_FRAMES; i++) frames.push_back(Frame::make(device, graphicsQueueFamily));
 
 
-        return MVKWindow{device, queue, std::move(outSurface), w, std::move(outSwapchain), std::move(outSwapchainImageFormat), 
-                            std::move(outSwapchainImages), std::move(outSwapchainImageViews), swapchainExtent, std::move(frames)};
+        MVKWindow out{device, queue, std::move(outSurface), w, std::move(outSwapchain), std::move(outSwapchainImageFormat), 
+                            std::move(outSwapchainImages), std::move(outSwapchainImageViews), swapchainExtent, std::move(frames), settings};
+
+        out.presentStats.mode = vk::PresentModeKHR(vkbSwapchain.present_mode);
+        out.presentStats.presentWait = presentWait;
+
+        return out;
     }
 
 }
\ No newline at end of file
@@ -12,7 +12,11 @@
 #include <vulkan/vk_enum_string_helper.h>
 
 #include "constants.h"
+#include "cpuprofiler.h"
+#include "memorytracker.h"
+#include "resourcestate.h"
 
+#include <deque>
 #include <sstream>
 #include <fstream>
 
@@ -24,6 +28,7 @@
 namespace Medea {
     namespace RenderConstants {
         const vk::Format screenFormat = vk::Format::eR8G8B8A8Unorm;
+        const vk::Format velocityFormat = vk::Format::eR16G16Sfloat;   //<- screen space motion, in UV units (see TemporalUpscaler)
     }
 
     using CleanupJob = std::function<void()>;
@@ -138,32 +143,22 @@ namespace Medea {
         return out;
     }
 
-    /// TODO: more optimal access masks 
-    inline void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout l0, VkImageLayout l1, bool depth = false) {
-        VkImageMemoryBarrier2 imageBarrier {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
-        imageBarrier.pNext = nullptr;
-
-        imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-        imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;          //disallows writing to src
-        imageBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-        imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;    //disallows reading, writing to dst
-
-        imageBarrier.oldLayout = l0;
-        imageBarrier.newLayout = l1;
-
+    /// Untracked transition (e.g. swapchain images); `from` is how the image was last used, `to` how it'll be used next.
+    /// For AllocatedImage, use AllocatedImage::transition/BarrierBatch instead, which remember `from` for you
+    inline void transitionImage(vk::CommandBuffer cmd, vk::Image image, const ResourceUsage& from, const ResourceUsage& to, bool depth = false) {
         ///specialization; we primarily care about color images. Switch to depth for depth optimal stuff
-        VkImageAspectFlags aspectMask = (depth) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
-        imageBarrier.subresourceRange = imageSubresourceRange(aspectMask);
-        imageBarrier.image = image;
+        vk::ImageAspectFlags aspectMask = (depth) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
 
-        VkDependencyInfo depInfo = {};  ///can chain dependencies via pNext? So, if we're rendering to 5 different images, we can chain 5 dependencies and wait for them all to finish
-        depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-        depInfo.pNext = nullptr;
+        vk::ImageMemoryBarrier2 imageBarrier(from.stage, from.writes() ? from.access : vk::AccessFlagBits2::eNone, to.stage, to.access,
+            from.layout, to.layout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image,
+            vk::ImageSubresourceRange(aspectMask, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers));
 
-        depInfo.imageMemoryBarrierCount = 1;
-        depInfo.pImageMemoryBarriers = &imageBarrier;
+        Internal::pipelineBarrier(cmd, vk::DependencyInfo({}, {}, {}, imageBarrier));
+    }
 
-        vkCmdPipelineBarrier2(cmd, &depInfo);
+    /// layout-only version; stage/access masks are guessed from the layouts (see ResourceUsage::forLayout)
+    inline void transitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout l0, VkImageLayout l1, bool depth = false) {
+        transitionImage(cmd, image, ResourceUsage::forLayout(vk::ImageLayout(l0)), ResourceUsage::forLayout(vk::ImageLayout(l1)), depth);
     }
 
     inline void blitImage(vk::CommandBuffer cmd, vk::Image src, vk::Image dst, vk::Extent2D srcDim, vk::Extent2D dstDim) {
@@ -225,6 +220,9 @@ namespace Medea {
 
         std::vector<CleanupJob> cleanupJobs;
 
+        /// added to this frame's submit by MVKWindow::endDraw, then cleared (e.g. timeline semaphores from RenderGraph's other submits)
+        std::vector<vk::SemaphoreSubmitInfo> extraWaits, extraSignals;
+
         CleanupJobQueueCallback getCleanupCallback() {
             return [&] (CleanupJob job) {
                 cleanupJobs.push_back(job);
@@ -256,7 +254,9 @@ namespace Medea {
             VmaAllocation memory;
 
             WrappedAllocation(VmaAllocator alloc, VmaAllocation mem)
-                : allocator(alloc), memory(mem) {}
+                : allocator(alloc), memory(mem) {
+                MemoryTracker::get().onAllocate(allocator, memory);
+            }
 
             WrappedAllocation(const WrappedAllocation&) = delete;
             WrappedAllocation& operator=(const WrappedAllocation&) = delete;
@@ -267,6 +267,7 @@ namespace Medea {
             }
 
             WrappedAllocation& operator=(WrappedAllocation&& old) {
+                MemoryTracker::get().onFree(allocator, memory);
                 vmaFreeMemory(allocator, memory);
 
                 allocator = old.allocator;
@@ -278,6 +279,7 @@ namespace Medea {
             }
 
             ~WrappedAllocation() {
+                MemoryTracker::get().onFree(allocator, memory);
                 vmaFreeMemory(allocator, memory);
             }
 
@@ -300,6 +302,8 @@ namespace Medea {
         VmaAllocationInfo info;
         vk::DeviceSize size;
 
+        ResourceState _state;   //<- see BarrierBatch::buffer
+
         //AllocatedBuffer()
             //: allocator(nullptr), buffer(nullptr), allocation(nullptr), info({}) {}
 
@@ -316,8 +320,12 @@ namespace Medea {
 
             VkBufferCreateInfo cBufInfo = bufInfo;
 
+            MemoryTracker::get().checkBufferBudget(allocator, cBufInfo, vmaInfo);
+
             VK_REQUIRE(vmaCreateBuffer(allocator, &cBufInfo, &vmaInfo, &this->buffer, &this->allocation, &this->info));
 
+            MemoryTracker::get().onAllocate(allocator, allocation);
+
             if (flags & vk::BufferUsageFlagBits::eShaderDeviceAddress) address = device.getBufferAddress(vk::BufferDeviceAddressInfo(buffer));
             else address = 0;
         }
@@ -335,22 +343,31 @@ namespace Medea {
 
             VkBufferCreateInfo cBufInfo = bufInfo;
 
+            MemoryTracker::get().checkBufferBudget(allocator, cBufInfo, vmaInfo);
+
             VK_REQUIRE(vmaCreateBuffer(allocator, &cBufInfo, &vmaInfo, &this->buffer, &this->allocation, &this->info));
 
+            MemoryTracker::get().onAllocate(allocator, allocation);
+
             if (flags & vk::BufferUsageFlagBits::eShaderDeviceAddress) address = device.getBufferAddress(vk::BufferDeviceAddressInfo(buffer));
             else address = 0;
         }
 
-        AllocatedBuffer(vk::Device device, VmaAllocator allocator_, VkBuffer buffer_, VmaAllocation allocation_, VmaAllocationInfo info_, vk::DeviceSize size_)
+        /// Adopts an existing buffer. allocation_ can be null for buffers bound to memory owned elsewhere (aliasing); the buffer is still destroyed with this
+        AllocatedBuffer(vk::Device device, VmaAllocator allocator_, VkBuffer buffer_, VmaAllocation allocation_, VmaAllocationInfo info_, vk::DeviceSize size_,
+                        vk::BufferUsageFlags flags = {})
             : allocator(allocator_), buffer(buffer_), allocation(allocation_), info(info_), size(size_) {
-            address = 0;
+            if (flags & vk::BufferUsageFlagBits::eShaderDeviceAddress) address = device.getBufferAddress(vk::BufferDeviceAddressInfo(buffer));
+            else address = 0;
+
+            MemoryTracker::get().onAllocate(allocator, allocation);
         }
 
         AllocatedBuffer(const AllocatedBuffer&) = delete;
         AllocatedBuffer& operator=(const AllocatedBuffer&) = delete;
 
         AllocatedBuffer(AllocatedBuffer&& old) 
-            : allocator(old.allocator), buffer(old.buffer), allocation(old.allocation), info(old.info), size(old.size) {
+            : allocator(old.allocator), buffer(old.buffer), allocation(old.allocation), info(old.info), size(old.size), _state(old._state) {
             address = old.address;
 
             old.allocator = nullptr;
@@ -360,7 +377,10 @@ namespace Medea {
         }
 
         AllocatedBuffer& operator=(AllocatedBuffer&& old) {
-            if (allocator) vmaDestroyBuffer(allocator, buffer, allocation);
+            if (allocator) {
+                MemoryTracker::get().onFree(allocator, allocation);
+                vmaDestroyBuffer(allocator, buffer, allocation);
+            }
 
             allocator = old.allocator;
             buffer = old.buffer;
@@ -368,6 +388,7 @@ namespace Medea {
             address = old.address;
             size = old.size;
             info = old.info;
+            _state = old._state;
 
             old.allocation = nullptr;
             old.buffer = nullptr;
@@ -379,7 +400,15 @@ namespace Medea {
         }
 
         ~AllocatedBuffer() {
-            if (allocator) vmaDestroyBuffer(allocator, buffer, allocation);
+            if (allocator) {
+                MemoryTracker::get().onFree(allocator, allocation);
+                vmaDestroyBuffer(allocator, buffer, allocation);
+            }
+        }
+
+        /// Retags for MemoryTracker; allocations are otherwise tagged with the category active when they were made (see MemoryCategoryScope)
+        void setCategory(MemoryCategory category) {
+            MemoryTracker::get().setCategory(allocator, allocation, category);
         }
 
         ///NOTE: default usage of CPU-to-GPU
@@ -401,6 +430,8 @@ namespace Medea {
             VmaAllocation allocation;
             VmaAllocationInfo info;
 
+            MemoryTracker::get().checkBufferBudget(allocator, cBufInfo, vmaInfo);
+
             VK_REQUIRE(vmaCreateBuffer(allocator, &cBufInfo, &vmaInfo, &buffer, &allocation, &info));
 
 
@@ -434,6 +465,8 @@ namespace Medea {
             VmaAllocation allocation;
             VmaAllocationInfo info;
 
+            MemoryTracker::get().checkBufferBudget(allocator, cBufInfo, vmaInfo);
+
             VK_REQUIRE(vmaCreateBuffer(allocator, &cBufInfo, &vmaInfo, &buffer, &allocation, &info));
 
             uint32_t size = (uint32_t) data.size();
@@ -504,6 +537,28 @@ namespace Medea {
         }
     };
 
+    /// How MVKWindow presents. Uncapped (MAILBOX/IMMEDIATE) with a high latency limit for benchmarks, FIFO with maxFrameLatency = 1 for
+    ///  the most responsive vsync'd input
+    struct PresentSettings {
+        /// FIFO_RELAXED, MAILBOX or IMMEDIATE if the surface supports it; falls back to FIFO (always supported)
+        vk::PresentModeKHR mode = vk::PresentModeKHR::eFifo;
+
+        /// max frames submitted but not yet on screen, enforced before each frame starts (see MVKWindow::waitForFrameLatency).
+        ///  0 = only limited by the frames in flight. Without VK_KHR_present_wait this can only wait on GPU completion, not the present itself
+        uint32_t maxFrameLatency = 2;
+    };
+
+    struct PresentStats {
+        vk::PresentModeKHR mode = vk::PresentModeKHR::eFifo;   //<- what the swapchain actually got
+        bool presentWait = false;       //<- latencies are measured up to the present (VK_KHR_present_wait); otherwise only up to GPU completion
+
+        /// input-to-present, i.e. markInput() (or startDraw) to the present being observed complete. Completion is polled once per frame,
+        ///  so these overestimate by up to a frame, except for the frame waitForFrameLatency just blocked on
+        double lastLatencyMs = 0;
+        double avgLatencyMs = 0;        //<- exponential moving average
+        uint64_t samples = 0;           //<- bumped whenever lastLatencyMs changes
+    };
+
     struct DrawingFrame {
         vk::raii::Device& device;
         Frame& frame;
@@ -535,14 +590,70 @@ namespace Medea {
 
         std::vector<Frame> frames;
 
+        PresentSettings presentSettings;
+        PresentStats presentStats;
+
         Frame& getFrame() {
             return frames.at(_currentFrame % frames.size());
         }
 
+        /// Call right before sampling input for the next frame, so its latency is measured from there. Otherwise it's measured from startDraw
+        void markInput() {
+            waitForFrameLatency();
+
+            _inputNs = Profile::nowNs();
+        }
+
+        /// Blocks until at most presentSettings.maxFrameLatency - 1 earlier frames are still queued, so the next one will be at most that many
+        ///  presents behind. Called by startDraw if it hasn't been yet this frame; call it earlier (before input) to actually cut input latency
+        void waitForFrameLatency() {
+            if (_latencyWaited) return;
+            _latencyWaited = true;
+
+            const uint32_t maxLatency = presentSettings.maxFrameLatency;
+
+            if (maxLatency == 0) return;
+
+            MEDEA_PROFILE_ZONE("MVKWindow::waitForFrameLatency");
+
+            const uint64_t SECOND_NS = 1000000000;
+
+            if (presentStats.presentWait) {
+                //the next present gets _presentId + 1
+                if (_presentId + 1 <= maxLatency) return;
+
+                uint64_t target = _presentId + 1 - maxLatency;
+
+                vk::Result res = swapchain.waitForPresent(target, SECOND_NS);
+
+                if (res == vk::Result::eTimeout) std::cerr<<"WARNING: present "<<target<<" hasn't completed after 1s"<<std::endl;
+            }
+            else {
+                //no present timing; the best we can do is wait for the GPU to finish the frame that was submitted maxLatency frames ago
+                if (maxLatency >= frames.size() || _currentFrame < maxLatency) return;
+
+                Frame& f = frames.at((_currentFrame - maxLatency) % frames.size());
+
+                VK_REQUIRE(device.waitForFences(*f.fence, true, SECOND_NS));
+            }
+
+            pollPresents();
+        }
+
+        const PresentStats& getPresentStats() const {
+            return presentStats;
+        }
+
         void drainFrame(Frame& f) {
+            MEDEA_PROFILE_ZONE("MVKWindow::drainFrame");
+
             const uint64_t SECOND_NS = 1000000000;
 
-            VK_REQUIRE(device.waitForFences(*f.fence, true, SECOND_NS));
+            {
+                MEDEA_PROFILE_ZONE("waitForFences");
+
+                VK_REQUIRE(device.waitForFences(*f.fence, true, SECOND_NS));
+            }
 
             for (auto& job : f.cleanupJobs) job();
 
@@ -561,10 +672,20 @@ namespace Medea {
             
             Frame& frame = getFrame();
 
+            waitForFrameLatency();
+
+            _frameInputNs = _inputNs ? _inputNs : Profile::nowNs();
+            _inputNs = 0;
+
             drainFrame(frame);
+            pollPresents();     //<- before the fence reset, since without present_wait that's how this frame's last present is resolved
             device.resetFences(*frame.fence);
 
-            _lastSwapchainImageIdx = VK_UNWRAP(swapchain.acquireNextImage(SECOND_NS, *frame.swapchainSemaphore));
+            {
+                MEDEA_PROFILE_ZONE("acquireNextImage");
+
+                _lastSwapchainImageIdx = VK_UNWRAP(swapchain.acquireNextImage(SECOND_NS, *frame.swapchainSemaphore));
+            }
             
             frame.mainBuffer.reset();
 
@@ -574,55 +695,129 @@ namespace Medea {
             
             VkImage scImage = swapchainImages.at(_lastSwapchainImageIdx);
 
-            //image from [don't care] to general rendering R/W format
-            transitionImage(*frame.mainBuffer, scImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
+            //the swapchain image's transition to a blit target is recorded in endDraw, right before the blit; nothing before it waits on acquire
             return DrawingFrame{device, frame, swapchain, scImage, frame.fence, _lastSwapchainImageIdx};
         }
 
+        /// Extra semaphores for the current frame's submit in endDraw, for work submitted separately that the frame's command buffer depends on (or vice versa)
+        void addSubmitWait(const vk::SemaphoreSubmitInfo& info) {
+            assert(_frameStarted);
+
+            getFrame().extraWaits.push_back(info);
+        }
+
+        void addSubmitSignal(const vk::SemaphoreSubmitInfo& info) {
+            assert(_frameStarted);
+
+            getFrame().extraSignals.push_back(info);
+        }
+
         void endDraw(vk::Image src, VkExtent2D extents) {
+            MEDEA_PROFILE_ZONE("MVKWindow::endDraw");
+
             assert(_frameStarted);
 
             Frame& frame = getFrame();
 
             vk::Image swapImg = swapchainImages.at(_lastSwapchainImageIdx);
 
+            //image from [don't care] to blit target. Source stage matches the acquire semaphore's wait stage below, so only the blit waits on it
+            transitionImage(*frame.mainBuffer, swapImg, ResourceUsage{vk::PipelineStageFlagBits2::eBlit, {}},
+                            ResourceUsage{vk::PipelineStageFlagBits2::eBlit, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal});
+
             blitImage(*frame.mainBuffer, src, swapImg, extents, swapchainExtent);
             
-            transitionImage(*frame.mainBuffer, swapImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+            transitionImage(*frame.mainBuffer, swapImg, ResourceUsage::transferWrite(vk::ImageLayout::eTransferDstOptimal), ResourceUsage::present());
 
             frame.mainBuffer.end();
 
             auto c0 = vk::CommandBufferSubmitInfo(*frame.mainBuffer, 0);
-            auto w0 = vk::SemaphoreSubmitInfo(*frame.swapchainSemaphore, 1, vk::PipelineStageFlags2(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT));
-            auto s0 = vk::SemaphoreSubmitInfo(*frame.renderSemaphore, 1, vk::PipelineStageFlags2(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT));
+            //the swapchain image is first touched by the blit above, and last by its transition to present
+            auto w0 = vk::SemaphoreSubmitInfo(*frame.swapchainSemaphore, 1, vk::PipelineStageFlagBits2::eBlit);
+            auto s0 = vk::SemaphoreSubmitInfo(*frame.renderSemaphore, 1, vk::PipelineStageFlagBits2::eAllCommands);
+
+            std::vector<vk::SemaphoreSubmitInfo> waits = {w0}, signals = {s0};
+
+            waits.insert(waits.end(), frame.extraWaits.begin(), frame.extraWaits.end());
+            signals.insert(signals.end(), frame.extraSignals.begin(), frame.extraSignals.end());
 
-            auto sub = vk::SubmitInfo2(vk::SubmitFlags(), w0, c0, s0);
+            frame.extraWaits.clear();
+            frame.extraSignals.clear();
+
+            auto sub = vk::SubmitInfo2(vk::SubmitFlags(), waits, c0, signals);
 
             submit(sub, *frame.fence, *frame.renderSemaphore);
 
             _currentFrame++;
             _frameStarted = false;
+            _latencyWaited = false;
         }
 
+        /// @param presentWait VK_KHR_present_id/present_wait are enabled on the device (DeviceCapabilities::presentWait)
         static MVKWindow make(vk::raii::Instance& instance, vk::raii::Device& device, vk::raii::PhysicalDevice& gpu, vk::raii::Queue& queue, 
-                                uint32_t graphicsQueueFamily, Medea::Window& w);
+                                uint32_t graphicsQueueFamily, Medea::Window& w, const PresentSettings& settings, bool presentWait);
 
         //private:
         
         void submit(vk::SubmitInfo2& sub, vk::Fence fence, vk::Semaphore renderSemaphore) {
-            //queue.submit(sub);
-            queue.submit2(sub, fence);
+            {
+                MEDEA_PROFILE_ZONE("queueSubmit");
+
+                //queue.submit(sub);
+                queue.submit2(sub, fence);
+            }
 
             vk::PresentInfoKHR present(renderSemaphore, *swapchain, _lastSwapchainImageIdx);
 
+            uint64_t id = ++_presentId;
+            vk::PresentIdKHR presentId(1, &id);
+
+            if (presentStats.presentWait) present.setPNext(&presentId);
+
+            _pendingPresents.push_back(PendingPresent{id, _frameInputNs, size_t(_currentFrame % frames.size())});
+
+            MEDEA_PROFILE_ZONE("queuePresent");
+
             VK_REQUIRE(queue.presentKHR(present));
         }
 
+        /// Resolves whichever pending presents have completed, oldest first, without blocking
+        void pollPresents() {
+            while (_pendingPresents.size()) {
+                PendingPresent& p = _pendingPresents.front();
+
+                bool done;
+
+                if (presentStats.presentWait)   done = swapchain.waitForPresent(p.id, 0) == vk::Result::eSuccess;
+                else                            done = frames.at(p.frame).fence.getStatus() == vk::Result::eSuccess;
+
+                if (!done) break;
+
+                double ms = double(Profile::nowNs() - p.inputNs) / 1e6;
+
+                presentStats.lastLatencyMs = ms;
+                presentStats.avgLatencyMs = presentStats.samples ? presentStats.avgLatencyMs * 0.9 + ms * 0.1 : ms;
+                presentStats.samples++;
+
+                _pendingPresents.pop_front();
+            }
+        }
+
+        struct PendingPresent {
+            uint64_t id;
+            uint64_t inputNs;
+            size_t frame;
+        };
+
         bool _frameStarted = false;
+        bool _latencyWaited = false;
         uint32_t _lastSwapchainImageIdx = 0;
         long long _currentFrame = 0;
 
+        uint64_t _presentId = 0;        //<- last one handed to presentKHR; ids start at 1
+        uint64_t _inputNs = 0, _frameInputNs = 0;
+        std::deque<PendingPresent> _pendingPresents;
+
     };
 
     namespace Internal {
@@ -630,11 +825,22 @@ namespace Medea {
             VmaAllocator allocator;
 
             ~RAIIAllocator() {
+                MemoryTracker::get().detach(allocator);
                 vmaDestroyAllocator(allocator);
             }
         };
     }
 
+    /// @brief Optional device features/extensions; these are enabled in Core::make if the GPU has them, so check before relying on one
+    struct DeviceCapabilities {
+        bool pipelineStatistics = false;
+        bool memoryBudget = false;      //<- VK_EXT_memory_budget; MemoryTracker falls back to VMA's estimates without it
+        bool asyncCompute = false;      //<- a compute queue family separate from graphics (Core::computeQueue)
+        bool computeTimestamps = false; //<- ...and it can write timestamps, so GPUProfiler can time passes on it
+        bool presentWait = false;       //<- VK_KHR_present_id + VK_KHR_present_wait, for MVKWindow's frame latency limit/measurements
+        bool meshShader = false;        //<- VK_EXT_mesh_shader with task shaders, for the megashader's meshlet path (RenderSettings::meshShading)
+    };
+
     /// @brief Represents all of the global state the Vulkan renderer needs
     struct Core {
         vk::raii::Instance instance;
@@ -650,18 +856,25 @@ namespace Medea {
         vk::raii::Queue graphicsQueue; 
         uint32_t graphicsQueueFamily;
 
+        /// Separate compute family for RenderGraph's async compute passes; empty on single-queue devices (everything stays on graphicsQueue)
+        std::optional<vk::raii::Queue> computeQueue;
+        uint32_t computeQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+
+        DeviceCapabilities caps;
+
         MVKWindow primaryWindow;
 
         Core(vk::raii::Instance i, vk::raii::PhysicalDevice _gpu, vk::raii::Device d, VmaAllocator alloc, vk::raii::DebugUtilsMessengerEXT msg, 
-                    vk::raii::Queue gq, uint32_t graphicsQFamily, Medea::Window& w)
+                    vk::raii::Queue gq, uint32_t graphicsQFamily, std::optional<vk::raii::Queue> cq, uint32_t computeQFamily,
+                    DeviceCapabilities capabilities, Medea::Window& w, const PresentSettings& present)
             : instance(std::move(i)), _internalAllocator{alloc}, gpu(_gpu), device(std::move(d)), allocator(alloc), debugMessenger(std::move(msg)), graphicsQueue(gq), graphicsQueueFamily(graphicsQFamily),
-            primaryWindow(MVKWindow::make(instance, device, gpu, graphicsQueue, graphicsQueueFamily, w)) {}
+            computeQueue(std::move(cq)), computeQueueFamily(computeQFamily), caps(capabilities), primaryWindow(MVKWindow::make(instance, device, gpu, graphicsQueue, graphicsQueueFamily, w, present, caps.presentWait)) {}
 
         ~Core() {
             primaryWindow.drain();
         }
 
-        static Core make(vk::raii::Context& context, Medea::Window& window);
+        static Core make(vk::raii::Context& context, Medea::Window& window, const PresentSettings& present = {});
     };
 
 
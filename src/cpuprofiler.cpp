@@ -0,0 +1,167 @@
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+using namespace Medea::Profile;
+
+std::atomic<bool> Internal::profilerEnabled = true;
+std::atomic<uint32_t> Internal::clearEpoch = 0;
+
+CPUProfiler& CPUProfiler::get() {
+    static CPUProfiler profiler;
+
+    return profiler;
+}
+
+Internal::ThreadBuffer* Internal::registerThread() {
+    CPUProfiler& p = CPUProfiler::get();
+
+    //keeps the buffer alive for this thread even if the profiler drops it (discarded scratch threads)
+    thread_local std::shared_ptr<ThreadBuffer> owner;
+
+    std::lock_guard lock(p.mutex);
+
+    owner = std::make_shared<ThreadBuffer>(p.nextThreadID++);
+
+    p.threads.push_back(owner);
+
+    return owner.get();
+}
+
+void CPUProfiler::setThreadName(std::string_view name) {
+    CPUProfiler& p = get();
+
+    Internal::ThreadBuffer* buf = Internal::getThreadBuffer();
+
+    std::lock_guard lock(p.mutex);
+
+    buf->threadName = std::string(name);
+}
+
+void CPUProfiler::clear() {
+    Internal::clearEpoch.fetch_add(1, std::memory_order_relaxed);
+}
+
+namespace {
+    void writeEscaped(std::ostream& out, std::string_view str) {
+        for (char c : str) {
+            if (c == '"' || c == '\\') out << '\\' << c;
+            else if ((unsigned char) c < 0x20) out << ' ';
+            else out << c;
+        }
+    }
+}
+
+void CPUProfiler::writeChromeTrace(std::ostream& out) {
+    std::lock_guard lock(mutex);
+
+    threads.erase(std::remove_if(threads.begin(), threads.end(), [](auto& t) { return t->discard; }), threads.end());
+
+    uint64_t epoch = UINT64_MAX;
+
+    //snapshot first, so that timestamps can be rebased to the earliest event
+    std::vector<std::vector<ZoneEvent>> snapshots;
+
+    for (auto& t : threads) {
+        using Buf = Internal::ThreadBuffer;
+
+        uint64_t head = t->head.load(std::memory_order_acquire);
+
+        //a thread that hasn't recorded since the last clear() hasn't dropped its events yet
+        bool cleared = t->epoch.load(std::memory_order_acquire) == Internal::clearEpoch.load(std::memory_order_relaxed);
+        uint64_t start = cleared ? t->start.load(std::memory_order_relaxed) : head;
+
+        uint64_t count = start <= head ? std::min<uint64_t>(head - start, Buf::CAPACITY) : 0;
+
+        std::vector<ZoneEvent> events;
+        events.reserve(count);
+
+        for (uint64_t i = head - count; i < head; i++) events.push_back(t->events[i & (Buf::CAPACITY - 1)]);
+
+        //writer lapped us while copying; the oldest entries may be torn
+        uint64_t newHead = t->head.load(std::memory_order_acquire);
+        if (newHead - (head - count) > Buf::CAPACITY) {
+            size_t torn = std::min<uint64_t>(newHead - (head - count) - Buf::CAPACITY, events.size());
+            events.erase(events.begin(), events.begin() + torn);
+        }
+
+        for (auto& e : events) epoch = std::min(epoch, e.beginNs);
+
+        snapshots.push_back(std::move(events));
+    }
+
+    if (epoch == UINT64_MAX) epoch = 0;
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool first = true;
+
+    for (size_t ti=0; ti<threads.size(); ti++) {
+        auto& t = threads.at(ti);
+
+        if (!first) out << ",\n";
+        first = false;
+
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << t->threadID << ",\"args\":{\"name\":\"";
+        writeEscaped(out, t->threadName);
+        out << "\"}}";
+
+        for (auto& e : snapshots.at(ti)) {
+            out << ",\n{\"ph\":\"X\",\"cat\":\"medea\",\"pid\":1,\"tid\":" << t->threadID
+                << ",\"ts\":" << (e.beginNs - epoch) / 1000.0
+                << ",\"dur\":" << (e.endNs - e.beginNs) / 1000.0
+                << ",\"args\":{\"depth\":" << e.depth << "}"
+                << ",\"name\":\"";
+            writeEscaped(out, e.name);
+            out << "\"}";
+        }
+    }
+
+    out << "\n]}\n";
+}
+
+bool CPUProfiler::writeChromeTrace(std::string_view path) {
+    std::ofstream file{std::string(path)};
+
+    if (!file) {
+        std::cerr<<"Failed to open \""<<path<<"\" for CPU trace output"<<std::endl;
+        return false;
+    }
+
+    writeChromeTrace(file);
+
+    return true;
+}
+
+double CPUProfiler::measureOverhead(size_t iterations) {
+    double result = 0.0;
+
+    std::thread scratch([&] () {
+        Internal::ThreadBuffer* buf = Internal::getThreadBuffer();
+
+        bool wasEnabled = isEnabled();
+        setEnabled(true);
+
+        uint64_t t0 = nowNs();
+
+        for (size_t i=0; i<iterations; i++) {
+            Zone z("overhead");
+        }
+
+        uint64_t t1 = nowNs();
+
+        setEnabled(wasEnabled);
+
+        result = double(t1 - t0) / double(std::max<size_t>(iterations, 1));
+
+        std::lock_guard lock(mutex);
+        buf->discard = true;
+    });
+
+    scratch.join();
+
+    return result;
+}
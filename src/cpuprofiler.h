@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Scoped-zone CPU profiler; zones are recorded into per-thread ring buffers and can be dumped as Chrome trace JSON
+///  (chrome://tracing, ui.perfetto.dev).
+///
+///     void foo() {
+///         MEDEA_PROFILE_ZONE("foo");
+///         ...
+///     }
+///
+/// Zone names must be string literals (only the pointer is stored).
+/// Define MEDEA_NO_CPU_PROFILER to compile all zones out; the profiler can also be toggled at runtime via CPUProfiler::setEnabled.
+
+namespace Medea::Profile {
+
+    struct ZoneEvent {
+        const char* name;
+        uint64_t beginNs;
+        uint64_t endNs;
+        uint32_t depth;
+    };
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    namespace Internal {
+        /// bumped by CPUProfiler::clear; each thread applies it to its own buffer (see ThreadBuffer::push)
+        extern std::atomic<uint32_t> clearEpoch;
+
+        /// Single writer (the owning thread); readers only look at it when exporting
+        struct ThreadBuffer {
+            static constexpr size_t CAPACITY = 1 << 16; //<- power of 2
+
+            std::vector<ZoneEvent> events;
+            std::atomic<uint64_t> head = 0;
+            std::atomic<uint64_t> start = 0;            //<- first event recorded since the last clear that was applied
+            std::atomic<uint32_t> epoch = 0;            //<- last clearEpoch applied
+            uint32_t depth = 0;
+            uint32_t threadID;
+            std::string threadName;
+            bool discard = false;
+
+            ThreadBuffer(uint32_t tid)
+                : events(CAPACITY), threadID(tid), threadName("thread "+std::to_string(tid)) {}
+
+            void push(const ZoneEvent& e) {
+                uint64_t h = head.load(std::memory_order_relaxed);
+
+                //clear() only bumps the epoch; the owner drops its own events, so nothing else ever writes here
+                uint32_t ce = clearEpoch.load(std::memory_order_relaxed);
+
+                if (ce != epoch.load(std::memory_order_relaxed)) {
+                    start.store(h, std::memory_order_relaxed);
+                    epoch.store(ce, std::memory_order_release);
+                }
+
+                events[h & (CAPACITY - 1)] = e;
+
+                head.store(h + 1, std::memory_order_release);
+            }
+        };
+
+        extern std::atomic<bool> profilerEnabled;
+
+        ThreadBuffer* registerThread();
+
+        inline ThreadBuffer* getThreadBuffer() {
+            thread_local ThreadBuffer* buf = nullptr;
+
+            if (!buf) buf = registerThread();
+
+            return buf;
+        }
+    }
+
+    class CPUProfiler {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Internal::ThreadBuffer>> threads;
+        uint32_t nextThreadID = 0;
+
+        friend Internal::ThreadBuffer* Internal::registerThread();
+
+        public:
+        static CPUProfiler& get();
+
+        static void setEnabled(bool enabled) {
+            Internal::profilerEnabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        static bool isEnabled() {
+            return Internal::profilerEnabled.load(std::memory_order_relaxed);
+        }
+
+        /// names the calling thread in exported traces
+        static void setThreadName(std::string_view name);
+
+        /// Drops all recorded events. Safe while other threads record: each one drops its own at its next zone, and until then its
+        ///  events aren't exported
+        void clear();
+
+        /// Writes every event still held in the ring buffers as Chrome trace event JSON.
+        /// Threads may keep recording while this runs; events overwritten mid-export are skipped
+        void writeChromeTrace(std::ostream& out);
+        bool writeChromeTrace(std::string_view path);
+
+        /// @return average cost in ns of one enabled zone (begin + end), measured on a scratch thread that isn't exported
+        double measureOverhead(size_t iterations = 1000000);
+    };
+
+    class Zone {
+        Internal::ThreadBuffer* buf;
+        const char* name;
+        uint64_t begin;
+
+        public:
+        explicit Zone(const char* zoneName) {
+            if (!Internal::profilerEnabled.load(std::memory_order_relaxed)) {
+                buf = nullptr;
+                return;
+            }
+
+            buf = Internal::getThreadBuffer();
+            name = zoneName;
+            buf->depth++;
+            begin = nowNs();
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+        ~Zone() {
+            if (!buf) return;
+
+            uint64_t end = nowNs();
+
+            buf->depth--;
+            buf->push(ZoneEvent{name, begin, end, buf->depth});
+        }
+    };
+}
+
+#define MEDEA_PROFILE_CONCAT_INNER(a, b) a##b
+#define MEDEA_PROFILE_CONCAT(a, b) MEDEA_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef MEDEA_NO_CPU_PROFILER
+    #define MEDEA_PROFILE_ZONE(name) ::Medea::Profile::Zone MEDEA_PROFILE_CONCAT(_medeaProfileZone, __LINE__)(name)
+#else
+    #define MEDEA_PROFILE_ZONE(name) do {} while (0)
+#endif
+
+#define MEDEA_PROFILE_FUNCTION() MEDEA_PROFILE_ZONE(__func__)
@@ -1,5 +1,13 @@
 #include "cull.h"
 
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 
 bool Cull::frustrumInFrustrum(glm::mat4 projToCull0, glm::mat4 projToCull1) {
     AABB3 a0(transformPoint(projToCull0, Vec3(-1,-1,-1)));
@@ -28,4 +36,195 @@ bool Cull::testConeVsSphere(Vec3 origin, Vec3 fwd, double size, double angle, Ve
     const bool backCull  = V1len < -testSphereRad;
 
     return !(angleCull || frontCull || backCull);
-}
\ No newline at end of file
+}
+
+namespace {
+    struct ConeParams {
+        float ox, oy, oz, fx, fy, fz, size, cosA, sinA;
+
+        ConeParams(const Cull::Cone& c)
+            : ox(c.pos.x), oy(c.pos.y), oz(c.pos.z), fx(c.fwd.x), fy(c.fwd.y), fz(c.fwd.z), size(c.length), cosA(std::cos(c.angle)), sinA(std::sin(c.angle)) {}
+    };
+
+    /// normalized, so a signed distance is dot(xyz, p) + w. Near is z >= -w, which holds for both depth conventions (glm::perspective's -1..1
+    ///  and Vulkan's 0..1), at the cost of not culling a sliver right in front of the camera under the latter
+    std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& m) {
+        glm::vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        std::array<glm::vec4, 6> planes = {r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2};
+
+        for (auto& p : planes) p /= glm::length(glm::vec3(p));
+
+        return planes;
+    }
+
+    //one lane of each batch test; also the tail (and everything, without AVX2)
+
+    uint8_t coneLane(const ConeParams& c, float x, float y, float z, float r) {
+        float vx = x - c.ox, vy = y - c.oy, vz = z - c.oz;
+
+        float vLenSq = vx*vx + vy*vy + vz*vz;
+        float v1Len = vx*c.fx + vy*c.fy + vz*c.fz;
+        float closest = c.cosA * std::sqrt(std::max(vLenSq - v1Len*v1Len, 0.f)) - v1Len * c.sinA;
+
+        return !(closest > r || v1Len > r + c.size || v1Len < -r);
+    }
+
+    uint8_t frustumLane(const std::array<glm::vec4, 6>& planes, float x, float y, float z, float r) {
+        for (auto& p : planes) {
+            if (p.x*x + p.y*y + p.z*z + p.w < -r) return 0;
+        }
+
+        return 1;
+    }
+
+    void projectLane(const glm::mat4& m, const std::vector<Cull::PointBatch>& points, Cull::BoundsBatch& out, size_t i) {
+        glm::vec3 lo(INFINITY), hi(-INFINITY);
+
+        for (auto& pts : points) {
+            glm::vec4 clip = m * glm::vec4(pts.x[i], pts.y[i], pts.z[i], 1.f);
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+
+        out.loX[i] = lo.x; out.loY[i] = lo.y; out.loZ[i] = lo.z;
+        out.hiX[i] = hi.x; out.hiY[i] = hi.y; out.hiZ[i] = hi.z;
+    }
+
+#ifdef __AVX2__
+    /// -mavx2 doesn't imply FMA
+    __m256 madd(__m256 a, __m256 b, __m256 c) {
+#ifdef __FMA__
+        return _mm256_fmadd_ps(a, b, c);
+#else
+        return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+    }
+
+    /// 8 lane "culled" comparison mask to one visible byte per lane
+    void storeVisible(__m256 culled, uint8_t* out) {
+        int bits = _mm256_movemask_ps(culled);
+
+        for (int l=0; l<8; l++) out[l] = !((bits >> l) & 1);
+    }
+#endif
+}
+
+
+void Cull::testConeVsSpheres(const Cone& cone, const SphereBatch& spheres, uint8_t* out) {
+    const ConeParams c(cone);
+    const size_t n = spheres.size();
+
+    size_t i = 0;
+
+#ifdef __AVX2__
+    const __m256 ox = _mm256_set1_ps(c.ox), oy = _mm256_set1_ps(c.oy), oz = _mm256_set1_ps(c.oz);
+    const __m256 fx = _mm256_set1_ps(c.fx), fy = _mm256_set1_ps(c.fy), fz = _mm256_set1_ps(c.fz);
+    const __m256 size = _mm256_set1_ps(c.size), cosA = _mm256_set1_ps(c.cosA), sinA = _mm256_set1_ps(c.sinA);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; i + BATCH_WIDTH <= n; i += BATCH_WIDTH) {
+        __m256 vx = _mm256_sub_ps(_mm256_loadu_ps(&spheres.x[i]), ox);
+        __m256 vy = _mm256_sub_ps(_mm256_loadu_ps(&spheres.y[i]), oy);
+        __m256 vz = _mm256_sub_ps(_mm256_loadu_ps(&spheres.z[i]), oz);
+        __m256 r = _mm256_loadu_ps(&spheres.rad[i]);
+
+        __m256 vLenSq = madd(vz, vz, madd(vy, vy, _mm256_mul_ps(vx, vx)));
+        __m256 v1Len = madd(vz, fz, madd(vy, fy, _mm256_mul_ps(vx, fx)));
+
+        __m256 perpSq = _mm256_max_ps(_mm256_sub_ps(vLenSq, _mm256_mul_ps(v1Len, v1Len)), zero);
+        __m256 closest = _mm256_sub_ps(_mm256_mul_ps(cosA, _mm256_sqrt_ps(perpSq)), _mm256_mul_ps(v1Len, sinA));
+
+        __m256 culled = _mm256_or_ps(_mm256_cmp_ps(closest, r, _CMP_GT_OQ),
+                        _mm256_or_ps(_mm256_cmp_ps(v1Len, _mm256_add_ps(r, size), _CMP_GT_OQ),
+                                     _mm256_cmp_ps(v1Len, _mm256_sub_ps(zero, r), _CMP_LT_OQ)));
+
+        storeVisible(culled, out + i);
+    }
+#endif
+
+    for (; i<n; i++) out[i] = coneLane(c, spheres.x[i], spheres.y[i], spheres.z[i], spheres.rad[i]);
+}
+
+void Cull::testFrustumVsSpheres(const glm::mat4& viewProj, const SphereBatch& spheres, uint8_t* out) {
+    const auto planes = frustumPlanes(viewProj);
+    const size_t n = spheres.size();
+
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + BATCH_WIDTH <= n; i += BATCH_WIDTH) {
+        __m256 x = _mm256_loadu_ps(&spheres.x[i]);
+        __m256 y = _mm256_loadu_ps(&spheres.y[i]);
+        __m256 z = _mm256_loadu_ps(&spheres.z[i]);
+        __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.rad[i]));
+
+        __m256 outside = _mm256_setzero_ps();
+
+        for (auto& p : planes) {
+            __m256 d = madd(z, _mm256_set1_ps(p.z), madd(y, _mm256_set1_ps(p.y), madd(x, _mm256_set1_ps(p.x), _mm256_set1_ps(p.w))));
+
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, negR, _CMP_LT_OQ));
+        }
+
+        storeVisible(outside, out + i);
+    }
+#endif
+
+    for (; i<n; i++) out[i] = frustumLane(planes, spheres.x[i], spheres.y[i], spheres.z[i], spheres.rad[i]);
+}
+
+void Cull::projectBounds(const glm::mat4& m, const std::vector<PointBatch>& points, BoundsBatch& out) {
+    const size_t n = points.empty() ? 0 : points.front().size();
+
+    for (auto& pts : points) assert(pts.size() == n);
+
+    out.resize(n);
+
+    size_t i = 0;
+
+#ifdef __AVX2__
+    //columns of m, splatted: clip = m[0] * x + m[1] * y + m[2] * z + m[3]
+    __m256 col[4][4];
+
+    for (int c=0; c<4; c++) for (int r=0; r<4; r++) col[c][r] = _mm256_set1_ps(m[c][r]);
+
+    for (; i + BATCH_WIDTH <= n; i += BATCH_WIDTH) {
+        __m256 lo[3], hi[3];
+
+        for (int a=0; a<3; a++) {
+            lo[a] = _mm256_set1_ps(INFINITY);
+            hi[a] = _mm256_set1_ps(-INFINITY);
+        }
+
+        for (auto& pts : points) {
+            __m256 x = _mm256_loadu_ps(&pts.x[i]);
+            __m256 y = _mm256_loadu_ps(&pts.y[i]);
+            __m256 z = _mm256_loadu_ps(&pts.z[i]);
+
+            __m256 clip[4];
+
+            for (int r=0; r<4; r++) clip[r] = madd(col[2][r], z, madd(col[1][r], y, madd(col[0][r], x, col[3][r])));
+
+            __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.f), clip[3]);
+
+            for (int a=0; a<3; a++) {
+                __m256 ndc = _mm256_mul_ps(clip[a], invW);
+
+                lo[a] = _mm256_min_ps(lo[a], ndc);
+                hi[a] = _mm256_max_ps(hi[a], ndc);
+            }
+        }
+
+        _mm256_storeu_ps(&out.loX[i], lo[0]); _mm256_storeu_ps(&out.loY[i], lo[1]); _mm256_storeu_ps(&out.loZ[i], lo[2]);
+        _mm256_storeu_ps(&out.hiX[i], hi[0]); _mm256_storeu_ps(&out.hiY[i], hi[1]); _mm256_storeu_ps(&out.hiZ[i], hi[2]);
+    }
+#endif
+
+    for (; i<n; i++) projectLane(m, points, out, i);
+}
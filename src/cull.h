@@ -4,6 +4,9 @@
 
 #include "aabb.h"
 
+#include <vector>
+#include <cstdint>
+
 inline const Vec3 perspectiveDivide(const glm::vec4& in) {
     return Vec3::GlmXYZ(in) / in.w;
 }
@@ -44,4 +47,82 @@ namespace Cull {
     inline bool testConeVsSphere(const Cull::Cone& cone, const Sphere& sphere) {
         return testConeVsSphere(cone.pos, cone.fwd, cone.length, cone.angle, sphere.pos, sphere.rad);
     }
+
+
+    /// Batch versions of the tests above: structure of arrays, float, BATCH_WIDTH objects at a time with AVX2 (scalar otherwise, and for the
+    ///  remainder). Results match the scalar tests up to float precision
+
+    constexpr size_t BATCH_WIDTH = 8;
+
+    struct SphereBatch {
+        std::vector<float> x, y, z, rad;
+
+        void push_back(const Sphere& s) {
+            x.push_back(s.pos.x);
+            y.push_back(s.pos.y);
+            z.push_back(s.pos.z);
+            rad.push_back(s.rad);
+        }
+
+        void reserve(size_t n) {
+            x.reserve(n); y.reserve(n); z.reserve(n); rad.reserve(n);
+        }
+
+        void clear() {
+            x.clear(); y.clear(); z.clear(); rad.clear();
+        }
+
+        size_t size() const {
+            return x.size();
+        }
+    };
+
+    struct PointBatch {
+        std::vector<float> x, y, z;
+
+        void push_back(const Vec3& p) {
+            x.push_back(p.x);
+            y.push_back(p.y);
+            z.push_back(p.z);
+        }
+
+        void reserve(size_t n) {
+            x.reserve(n); y.reserve(n); z.reserve(n);
+        }
+
+        void clear() {
+            x.clear(); y.clear(); z.clear();
+        }
+
+        size_t size() const {
+            return x.size();
+        }
+    };
+
+    /// per object AABB, e.g. of its points in NDC
+    struct BoundsBatch {
+        std::vector<float> loX, loY, loZ, hiX, hiY, hiZ;
+
+        void resize(size_t n) {
+            loX.resize(n); loY.resize(n); loZ.resize(n); hiX.resize(n); hiY.resize(n); hiZ.resize(n);
+        }
+
+        size_t size() const {
+            return loX.size();
+        }
+
+        AABB3 at(size_t i) const {
+            return AABB3(Vec3(loX[i], loY[i], loZ[i]), Vec3(hiX[i], hiY[i], hiZ[i]));
+        }
+    };
+
+    /// out[i] = testConeVsSphere(cone, spheres[i]); out needs room for spheres.size()
+    extern void testConeVsSpheres(const Cone& cone, const SphereBatch& spheres, uint8_t* out);
+
+    /// out[i] = 0 if spheres[i] is fully outside one of viewProj's clip planes, 1 otherwise
+    extern void testFrustumVsSpheres(const glm::mat4& viewProj, const SphereBatch& spheres, uint8_t* out);
+
+    /// out[i] = AABB of transformPoint(m, points[k][i]) over every k, i.e. object i's points projected and divided by w.
+    ///  Every points[k] has to be the same size
+    extern void projectBounds(const glm::mat4& m, const std::vector<PointBatch>& points, BoundsBatch& out);
 }
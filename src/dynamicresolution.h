@@ -0,0 +1,120 @@
+#pragma once
+
+#include "gpuprofiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+/// Dynamic render resolution. Render targets are allocated once at the max (output) extent; each frame renders into the top left
+///  getExtent() of them, and MVKWindow::endDraw's blit scales that up to the swapchain:
+///
+///     DynamicResolution dynRes(maxExtent, DynamicResolutionSettings{.targetMs = 8.0});
+///     ...
+///     dynRes.update(graph.getProfiler());
+///     graph.render(core, cmd, cleanup, view, proj, world, dynRes.getViewport(), {color}, depth, vk::CompareOp::eLess, time);
+///     present.endDraw(*color.image, dynRes.getExtent());
+///
+/// Both axes are scaled together, so the aspect ratio (and with it the projection matrix) doesn't change: only the width is aligned, the
+///  height is derived from it. The froxel grid and volumetric lighting are defined over NDC with fixed resolutions (see constants.h), so
+///  they cover the same frustum at any scale.
+
+namespace Medea {
+
+    struct DynamicResolutionSettings {
+        double targetMs = 16.0;         //<- GPU time to hold; leave some headroom under the actual frame budget
+        double minScale = 0.5;          //<- per axis, so 0.5 is a quarter of the pixels
+        double maxScale = 1.0;
+
+        double gain = 0.5;              //<- fraction of the way to the estimated scale moved per update
+        double deadband = 0.02;         //<- scale changes smaller than this are ignored, so the resolution doesn't jitter around the target
+
+        /// GPU times are a few frames stale (see GPUProfiler), so after a change wait for it to show up in the timings before changing again
+        uint32_t settleFrames = BUF_FRAMES_IN_FLIGHT + 1;
+
+        uint32_t alignment = 8;         //<- the width is rounded down to a multiple of this; the height follows the aspect ratio
+    };
+
+    class DynamicResolution {
+        VkExtent2D maxExtent;
+        DynamicResolutionSettings settings;
+
+        double scale;
+        VkExtent2D extent;
+
+        uint64_t lastResolvedFrame = 0;
+        uint32_t framesSinceChange = 0;
+
+        void applyScale(double s) {
+            scale = std::clamp(s, settings.minScale, settings.maxScale);
+
+            uint32_t width = uint32_t(std::floor(maxExtent.width * scale));
+
+            if (settings.alignment > 1) width -= width % settings.alignment;
+
+            width = std::clamp(width, std::min(settings.alignment, maxExtent.width), maxExtent.width);
+
+            //aligning both axes separately would stretch the image (the projection is for maxExtent's aspect ratio), so the height's
+            // derived from the aligned width instead; within half a pixel of the exact aspect ratio
+            uint32_t height = uint32_t(std::lround(double(width) * maxExtent.height / std::max(maxExtent.width, 1u)));
+
+            extent = VkExtent2D{width, std::clamp(height, std::min(1u, maxExtent.height), maxExtent.height)};
+        }
+
+        public:
+        DynamicResolution(VkExtent2D max, DynamicResolutionSettings s = {})
+            : maxExtent(max), settings(s) {
+            applyScale(settings.maxScale);
+        }
+
+        /// Feed one GPU frame time (e.g. GPUProfiler::getFrameTimeMs()). GPU cost is assumed to be roughly proportional to pixel count,
+        ///  so the scale that'd hit the target is scale * sqrt(targetMs / gpuMs)
+        void update(double gpuMs) {
+            framesSinceChange++;
+
+            if (gpuMs <= 0.0 || framesSinceChange < settings.settleFrames) return;
+
+            double ideal = scale * std::sqrt(settings.targetMs / gpuMs);
+            double next = scale + (ideal - scale) * settings.gain;
+
+            if (std::abs(next - scale) < settings.deadband) return;
+
+            applyScale(next);
+            framesSinceChange = 0;
+        }
+
+        /// Only feeds frames the profiler hasn't reported before, so call it every frame
+        void update(const GPUProfiler& profiler) {
+            if (!profiler.isSupported() || profiler.getResolvedFrames() == lastResolvedFrame) return;
+
+            lastResolvedFrame = profiler.getResolvedFrames();
+
+            update(profiler.getFrameTimeMs());
+        }
+
+        void setSettings(const DynamicResolutionSettings& s) {
+            settings = s;
+            applyScale(scale);
+        }
+
+        const DynamicResolutionSettings& getSettings() const {
+            return settings;
+        }
+
+        double getScale() const {
+            return scale;
+        }
+
+        /// render area this frame, at (0, 0) in the max size targets
+        VkExtent2D getExtent() const {
+            return extent;
+        }
+
+        vk::Viewport getViewport() const {
+            return vk::Viewport(0, 0, float(extent.width), float(extent.height), 0, 1);
+        }
+
+        VkExtent2D getMaxExtent() const {
+            return maxExtent;
+        }
+    };
+}
@@ -0,0 +1,159 @@
+#include "entityclusters.h"
+
+#include "cpuprofiler.h"
+
+#include <limits>
+
+using namespace Medea;
+
+EntityClusters::EntityClusters(Core& core, vk::CommandBuffer cmd, float _cellSize)
+    : bounds(core.allocator, core.device, cmd), members(core.allocator, core.device, cmd), cellSize(_cellSize) {
+    assert(cellSize > 0.f);
+}
+
+uint64_t EntityClusters::cellKey(const glm::vec3& pos) const {
+    glm::ivec3 c(glm::floor(pos / cellSize));
+
+    //21 bits per axis; far enough out, cells alias, which only makes clusters looser
+    auto pack = [] (int32_t v) { return uint64_t(v) & 0x1FFFFF; };
+
+    return pack(c.x) | (pack(c.y) << 21) | (pack(c.z) << 42);
+}
+
+void EntityClusters::markDirty(uint32_t cluster) {
+    ClusterInfo& info = clusters.at(cluster);
+
+    if (info.dirty) return;
+
+    info.dirty = true;
+    dirtyClusters.push_back(cluster);
+}
+
+uint32_t EntityClusters::clusterFor(uint64_t cell) {
+    std::vector<uint32_t>& inCell = cells[cell];
+
+    for (uint32_t c : inCell) if (clusters.at(c).count < CAPACITY) return c;
+
+    uint32_t c;
+
+    if (freeClusters.size() > 0) {
+        c = freeClusters.back();
+        freeClusters.pop_back();
+    }
+    else {
+        c = clusters.size();
+        clusters.push_back(ClusterInfo{});
+
+        bounds.push_back(Internal::EntityClusterBounds{});
+
+        for (uint32_t i=0; i<CAPACITY; i++) members.push_back(0);
+    }
+
+    //a reused cluster may still be waiting on update() to upload it as empty; leave it marked
+    clusters.at(c).cell = cell;
+    clusters.at(c).count = 0;
+
+    inCell.push_back(c);
+    liveClusters++;
+
+    return c;
+}
+
+void EntityClusters::add(size_t id, const glm::vec3& pos) {
+    if (membership.size() <= id) membership.resize(id + 1);
+
+    assert(membership.at(id).cluster == NONE);
+
+    uint32_t c = clusterFor(cellKey(pos));
+    ClusterInfo& info = clusters.at(c);
+
+    uint32_t slot = info.count++;
+
+    members.atMut(c * CAPACITY + slot) = id;
+    membership.at(id) = Membership{c, slot};
+
+    markDirty(c);
+}
+
+void EntityClusters::move(size_t id, const glm::vec3& pos) {
+    Membership m = membership.at(id);
+
+    assert(m.cluster != NONE);
+
+    if (clusters.at(m.cluster).cell == cellKey(pos)) {
+        markDirty(m.cluster);
+        return;
+    }
+
+    remove(id);
+    add(id, pos);
+}
+
+void EntityClusters::remove(size_t id) {
+    Membership m = membership.at(id);
+
+    assert(m.cluster != NONE);
+
+    ClusterInfo& info = clusters.at(m.cluster);
+
+    //last member fills the hole, so members stay packed at the front
+    uint32_t last = info.count - 1;
+
+    if (m.slot != last) {
+        uint32_t moved = members.at(m.cluster * CAPACITY + last);
+
+        members.atMut(m.cluster * CAPACITY + m.slot) = moved;
+        membership.at(moved).slot = m.slot;
+    }
+
+    info.count--;
+    membership.at(id) = Membership{};
+
+    markDirty(m.cluster);
+
+    if (info.count > 0) return;
+
+    std::vector<uint32_t>& inCell = cells.at(info.cell);
+
+    std::erase(inCell, m.cluster);
+    if (inCell.empty()) cells.erase(info.cell);
+
+    freeClusters.push_back(m.cluster);
+    liveClusters--;
+}
+
+void EntityClusters::update(const glist<RenderEntity>& entities, VmaAllocator allocator, vk::Device device, vk::CommandBuffer cmd) {
+    MEDEA_PROFILE_ZONE("EntityClusters::update");
+
+    for (uint32_t c : dirtyClusters) {
+        ClusterInfo& info = clusters.at(c);
+
+        info.dirty = false;
+
+        Internal::EntityClusterBounds b;
+        b.count = info.count;
+
+        if (info.count > 0) {
+            glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+            for (uint32_t i=0; i<info.count; i++) {
+                const RenderEntity& e = entities.at(members.at(c * CAPACITY + i));
+
+                glm::vec3 p = e.pos;
+
+                lo = glm::min(lo, p - glm::vec3(e.boundingSphereRad));
+                hi = glm::max(hi, p + glm::vec3(e.boundingSphereRad));
+            }
+
+            b.lo = glm::vec4(lo, 0);
+            b.hi = glm::vec4(hi, 0);
+        }
+
+        bounds.atMut(c) = b;
+    }
+
+    dirtyClusters.clear();
+
+    bounds.gpuUpdate(allocator, device, cmd);
+    members.gpuUpdate(allocator, device, cmd);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "core.h"
+#include "gvector.h"
+#include "renderentity.h"
+
+#include <unordered_map>
+
+/// Spatial grouping of RenderWorld's entities for GPU culling: entities are bucketed by grid cell, each cell split into clusters of up to
+///  CAPACITY entities. Every cluster's bounds (covering its members' bounding spheres) and member list live on the GPU, so
+///  GPUSceneGraph::render can cull clusters first and then only read the RenderEntity records of the ones that survive
+///  (see RenderSettings::clusterCulling).
+///
+/// Updated incrementally: RenderWorld::add/setPos/remove move single entities between clusters (or just mark their cluster's bounds stale),
+///  and update() refits stale bounds and uploads whatever changed.
+
+namespace Medea {
+
+    namespace Internal {
+        /// clusterCull.comp's cluster array entry. Members are at [cluster * EntityClusters::CAPACITY, + count) in the member array
+        struct alignas(16) EntityClusterBounds {
+            glm::vec4 lo = glm::vec4(0);     //<- xyz; AABB of the members' bounding spheres
+            glm::vec4 hi = glm::vec4(0);
+            uint32_t count = 0;             //<- 0 for free clusters, which are always culled
+            uint32_t pad0 = 0, pad1 = 0, pad2 = 0;
+        };
+    }
+
+    class EntityClusters {
+        public:
+        static constexpr uint32_t CAPACITY = 64;    //<- clusterEntityCull.comp's workgroup size
+
+        private:
+        static constexpr uint32_t NONE = ~0u;
+
+        struct Membership {
+            uint32_t cluster = NONE;
+            uint32_t slot = 0;
+        };
+
+        struct ClusterInfo {
+            uint64_t cell = 0;
+            uint32_t count = 0;
+            bool dirty = false;
+        };
+
+        gvector<Internal::EntityClusterBounds> bounds;
+        gvector<uint32_t> members;                  //<- CAPACITY slots per cluster, RenderEntityIDs
+
+        std::vector<ClusterInfo> clusters;
+        std::vector<Membership> membership;         //<- by RenderEntityID
+        std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+        std::vector<uint32_t> freeClusters;
+        std::vector<uint32_t> dirtyClusters;
+
+        float cellSize;
+        size_t liveClusters = 0;
+
+        uint64_t cellKey(const glm::vec3& pos) const;
+
+        void markDirty(uint32_t cluster);
+
+        /// a non-full cluster in cell, or a new one
+        uint32_t clusterFor(uint64_t cell);
+
+        public:
+        /// @param cellSize grid spacing, in world units; roughly how far apart entities in the same cluster can be
+        EntityClusters(Core& core, vk::CommandBuffer cmd, float cellSize = 32.f);
+
+        EntityClusters(const EntityClusters&) = delete;
+        EntityClusters& operator=(const EntityClusters&) = delete;
+
+        void add(size_t id, const glm::vec3& pos);
+
+        /// only changes cluster if pos is in a different cell; otherwise just refits the bounds on the next update()
+        void move(size_t id, const glm::vec3& pos);
+
+        void remove(size_t id);
+
+        /// refit stale bounds from entities, then upload. Call before entities' own gpuUpdate, so they go up in the same upload pass
+        void update(const glist<RenderEntity>& entities, VmaAllocator allocator, vk::Device device, vk::CommandBuffer cmd);
+
+        /// cluster slots on the GPU, free ones included; what cluster cull dispatches over
+        size_t size() const {
+            return clusters.size();
+        }
+
+        /// clusters with at least one entity
+        size_t liveCount() const {
+            return liveClusters;
+        }
+
+        AllocatedBuffer& getBounds() {
+            return bounds.getBuffer();
+        }
+
+        AllocatedBuffer& getMembers() {
+            return members.getBuffer();
+        }
+    };
+}
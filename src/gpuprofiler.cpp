@@ -0,0 +1,297 @@
+#include "gpuprofiler.h"
+
+#include <iomanip>
+
+using namespace Medea;
+
+GPUProfiler GPUProfiler::make(Core& core, uint32_t maxMarkersPerFrame) {
+    vk::PhysicalDeviceProperties props = core.gpu.getProperties();
+
+    uint32_t validBits = core.gpu.getQueueFamilyProperties().at(core.graphicsQueueFamily).timestampValidBits;
+
+    bool supported = validBits > 0;
+
+    if (!supported) std::cerr<<"WARN: graphics queue doesn't support timestamps; GPUProfiler disabled"<<std::endl;
+
+    uint64_t mask = validBits >= 64 ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+
+    uint32_t maxQueries = maxMarkersPerFrame * 2;
+
+    std::vector<FrameQueries> frames;
+    frames.reserve(BUF_FRAMES_IN_FLIGHT);
+
+    for (int i=0; i<BUF_FRAMES_IN_FLIGHT; i++) {
+        vk::QueryPoolCreateInfo qpci({}, vk::QueryType::eTimestamp, maxQueries);
+
+        frames.push_back(FrameQueries{vk::raii::QueryPool(core.device, qpci)});
+    }
+
+    return GPUProfiler(std::move(frames), maxQueries, props.limits.timestampPeriod, mask, supported);
+}
+
+void GPUProfiler::resolve(FrameQueries& f) {
+    if (!f.written || f.usedQueries == 0) return;
+
+    //no wait flag: if the frame somehow isn't done, we drop it rather than stall
+    auto [result, data] = f.pool.getResults<uint64_t>(0, f.usedQueries, f.usedQueries * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+
+    if (result != vk::Result::eSuccess) return;
+
+    bool sameLayout = timings.size() == f.markers.size();
+
+    for (size_t i=0; sameLayout && i<timings.size(); i++) sameLayout = timings.at(i).name == f.markers.at(i).name;
+
+    if (!sameLayout) timings.clear();
+
+    uint64_t frameStart = data.at(f.markers.at(0).beginQuery) & timestampMask;
+
+    for (size_t i=0; i<f.markers.size(); i++) {
+        const Marker& m = f.markers.at(i);
+
+        uint64_t t0 = data.at(m.beginQuery) & timestampMask;
+        uint64_t t1 = data.at(m.endQuery) & timestampMask;
+
+        double ms = double((t1 - t0) & timestampMask) * timestampPeriodNs / 1e6;
+        double startMs = double((t0 - frameStart) & timestampMask) * timestampPeriodNs / 1e6;
+
+        if (!sameLayout) timings.push_back(GPUPassTiming{m.name, m.depth, ms, ms, startMs});
+        else {
+            GPUPassTiming& t = timings.at(i);
+
+            t.ms = ms;
+            t.startMs = startMs;
+            t.avgMs = t.avgMs * (1.0 - averageWeight) + ms * averageWeight;
+        }
+    }
+
+    resolvedFrames++;
+}
+
+void GPUProfiler::beginFrame(vk::CommandBuffer cmd) {
+    assert(!frameOpen && "GPUProfiler::beginFrame without endFrame; one frame at a time");
+
+    frameOpen = false;
+
+    if (!supported) return;
+
+    if (openMarkers.size()) {
+        std::cerr<<"WARN: GPUProfiler frame ended with "<<openMarkers.size()<<" open markers"<<std::endl;
+        openMarkers.clear();
+    }
+
+    frameIdx = (frameIdx + 1) % frames.size();
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    resolve(f);
+
+    f.markers.clear();
+    f.usedQueries = 0;
+    f.written = true;
+
+    cmd.resetQueryPool(*f.pool, 0, maxQueries);
+
+    frameOpen = true;
+}
+
+void GPUProfiler::endFrame() {
+    frameOpen = false;
+}
+
+void GPUProfiler::begin(vk::CommandBuffer cmd, std::string_view name) {
+    if (!supported || !frameOpen) return;
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    if (f.usedQueries + 2 > maxQueries) {
+        std::cerr<<"WARN: GPUProfiler out of queries, dropping marker \""<<name<<"\""<<std::endl;
+        openMarkers.push_back(SIZE_MAX);
+        return;
+    }
+
+    uint32_t q = f.usedQueries;
+    f.usedQueries += 2;
+
+    f.markers.push_back(Marker{std::string(name), q, q+1, (uint32_t) openMarkers.size()});
+    openMarkers.push_back(f.markers.size()-1);
+
+    cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, *f.pool, q);
+}
+
+void GPUProfiler::end(vk::CommandBuffer cmd) {
+    if (!supported || !frameOpen) return;
+
+    assert(openMarkers.size() > 0);
+
+    size_t idx = openMarkers.back();
+    openMarkers.pop_back();
+
+    if (idx == SIZE_MAX) return;
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, *f.pool, f.markers.at(idx).endQuery);
+}
+
+double GPUProfiler::getFrameTimeMs() const {
+    double total = 0.0;
+
+    for (auto& t : timings) if (t.depth == 0) total += t.ms;
+
+    return total;
+}
+
+double GPUProfiler::getAverageFrameTimeMs() const {
+    double total = 0.0;
+
+    for (auto& t : timings) if (t.depth == 0) total += t.avgMs;
+
+    return total;
+}
+
+void GPUProfiler::print(std::ostream& out) const {
+    std::stringstream str;
+
+    str << std::fixed << std::setprecision(3);
+
+    for (auto& t : timings) {
+        str << std::string(t.depth * 2, ' ') << std::left << std::setw(32 - t.depth * 2) << t.name
+            << std::right << std::setw(9) << t.ms << " ms" << std::setw(9) << t.avgMs << " ms avg\n";
+    }
+
+    out << str.str();
+}
+
+
+PipelineStatsProfiler PipelineStatsProfiler::make(Core& core, uint32_t maxPassesPerFrame) {
+    bool supported = core.caps.pipelineStatistics;
+
+    std::vector<FrameQueries> frames;
+
+    if (!supported) {
+        std::cerr<<"WARN: pipelineStatisticsQuery unsupported; PipelineStatsProfiler disabled"<<std::endl;
+
+        return PipelineStatsProfiler(std::move(frames), 0, false);
+    }
+
+    frames.reserve(BUF_FRAMES_IN_FLIGHT);
+
+    for (int i=0; i<BUF_FRAMES_IN_FLIGHT; i++) {
+        vk::QueryPoolCreateInfo qpci({}, vk::QueryType::ePipelineStatistics, maxPassesPerFrame, GPUPipelineStats::queryFlags());
+
+        frames.push_back(FrameQueries{vk::raii::QueryPool(core.device, qpci)});
+    }
+
+    return PipelineStatsProfiler(std::move(frames), maxPassesPerFrame, true);
+}
+
+void PipelineStatsProfiler::resolve(FrameQueries& f) {
+    if (!f.written || f.names.size() == 0) return;
+
+    const uint32_t count = (uint32_t) f.names.size();
+    const size_t stride = GPUPipelineStats::COUNTERS * sizeof(uint64_t);
+
+    auto [result, data] = f.pool.getResults<uint64_t>(0, count, count * stride, stride, vk::QueryResultFlagBits::e64);
+
+    if (result != vk::Result::eSuccess) return;
+
+    passStats.clear();
+    frameStats = GPUPipelineStats{};
+
+    for (uint32_t i=0; i<count; i++) {
+        const uint64_t* c = data.data() + i * GPUPipelineStats::COUNTERS;
+
+        GPUPipelineStats s{c[0], c[1], c[2], c[3], c[4], c[5], c[6]};
+
+        passStats.push_back(GPUPassStats{f.names.at(i), s});
+        frameStats += s;
+    }
+}
+
+void PipelineStatsProfiler::beginFrame(vk::CommandBuffer cmd) {
+    assert(!frameOpen && "PipelineStatsProfiler::beginFrame without endFrame; one frame at a time");
+
+    frameOpen = false;
+
+    if (!supported) return;
+
+    if (openDepth) std::cerr<<"WARN: PipelineStatsProfiler frame ended with an open pass"<<std::endl;
+
+    openDepth = 0;
+    droppedOpen = false;
+
+    frameIdx = (frameIdx + 1) % frames.size();
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    resolve(f);
+
+    f.names.clear();
+    f.written = true;
+
+    cmd.resetQueryPool(*f.pool, 0, maxQueries);
+
+    frameOpen = true;
+}
+
+void PipelineStatsProfiler::endFrame() {
+    frameOpen = false;
+}
+
+void PipelineStatsProfiler::begin(vk::CommandBuffer cmd, std::string_view name) {
+    if (!supported || !frameOpen) return;
+
+    openDepth++;
+
+    if (openDepth > 1) return;
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    if (f.names.size() >= maxQueries) {
+        std::cerr<<"WARN: PipelineStatsProfiler out of queries, dropping pass \""<<name<<"\""<<std::endl;
+        droppedOpen = true;
+        return;
+    }
+
+    f.names.push_back(std::string(name));
+
+    cmd.beginQuery(*f.pool, (uint32_t) f.names.size()-1, {});
+}
+
+void PipelineStatsProfiler::end(vk::CommandBuffer cmd) {
+    if (!supported || !frameOpen) return;
+
+    assert(openDepth > 0);
+
+    openDepth--;
+
+    if (openDepth > 0) return;
+
+    if (droppedOpen) {
+        droppedOpen = false;
+        return;
+    }
+
+    FrameQueries& f = frames.at(frameIdx);
+
+    cmd.endQuery(*f.pool, (uint32_t) f.names.size()-1);
+}
+
+void PipelineStatsProfiler::print(std::ostream& out) const {
+    std::stringstream str;
+
+    auto row = [&] (std::string_view name, const GPUPipelineStats& s) {
+        str << std::left << std::setw(24) << name << std::right
+            << " vtx "  << std::setw(10) << s.inputAssemblyVertices
+            << " vs "   << std::setw(10) << s.vertexShaderInvocations
+            << " clip " << std::setw(10) << s.clippingPrimitives
+            << " fs "   << std::setw(11) << s.fragmentShaderInvocations
+            << " cs "   << std::setw(10) << s.computeShaderInvocations << "\n";
+    };
+
+    for (auto& p : passStats) row(p.name, p.stats);
+
+    row("total", frameStats);
+
+    out << str.str();
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "core.h"
+#include "gvector.h"
+
+#include <string>
+#include <vector>
+
+namespace Medea {
+
+    struct GPUPassTiming {
+        std::string name;
+        uint32_t depth;     //<- nesting level of the marker; 0 is outermost
+        double ms;          //<- most recently resolved frame
+        double avgMs;       //<- exponential moving average, since single frame timings are noisy
+        double startMs;     //<- since the frame's first marker began; markers on another queue (async compute) are only comparable if the device shares one timestamp domain
+    };
+
+    /// @brief Timestamp query based GPU profiler.
+    ///  One query pool per frame in flight; a pool is only read back when it's about to be reused, at which point the frame that wrote it
+    ///  has been waited on (see MVKWindow::drainFrame), so readback never stalls. Results are therefore a few frames stale.
+    ///
+    ///  Usage:
+    ///     profiler.beginFrame(cmd);
+    ///     {
+    ///         auto s = profiler.scope(cmd, "shadowPass");
+    ///         ...
+    ///     }
+    ///     profiler.endFrame();
+    class GPUProfiler {
+        struct Marker {
+            std::string name;
+            uint32_t beginQuery;
+            uint32_t endQuery;
+            uint32_t depth;
+        };
+
+        struct FrameQueries {
+            vk::raii::QueryPool pool;
+            std::vector<Marker> markers;
+            uint32_t usedQueries = 0;
+            bool written = false;
+        };
+
+        std::vector<FrameQueries> frames;
+        size_t frameIdx = 0;
+
+        uint32_t maxQueries;
+        double timestampPeriodNs;
+        uint64_t timestampMask;
+        bool supported;
+        bool frameOpen = false;
+
+        std::vector<size_t> openMarkers;
+
+        std::vector<GPUPassTiming> timings;
+        uint64_t resolvedFrames = 0;
+
+        GPUProfiler(std::vector<FrameQueries>&& f, uint32_t maxQ, double periodNs, uint64_t mask, bool isSupported)
+            : frames(std::move(f)), maxQueries(maxQ), timestampPeriodNs(periodNs), timestampMask(mask), supported(isSupported) {}
+
+        void resolve(FrameQueries& f);
+
+        public:
+        /// smoothing factor for GPUPassTiming::avgMs
+        double averageWeight = 0.1;
+
+        GPUProfiler(const GPUProfiler&) = delete;
+        GPUProfiler& operator=(const GPUProfiler&) = delete;
+
+        GPUProfiler(GPUProfiler&&) = default;
+        GPUProfiler& operator=(GPUProfiler&&) = default;
+
+        class Scope {
+            GPUProfiler* profiler;
+            vk::CommandBuffer cmd;
+
+            public:
+            Scope(GPUProfiler* p, vk::CommandBuffer c)
+                : profiler(p), cmd(c) {}
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+            Scope(Scope&& old)
+                : profiler(old.profiler), cmd(old.cmd) {
+                old.profiler = nullptr;
+            }
+
+            ~Scope() {
+                if (profiler) profiler->end(cmd);
+            }
+        };
+
+        /// @param maxMarkersPerFrame markers past this are silently dropped (with a warning)
+        static GPUProfiler make(Core& core, uint32_t maxMarkersPerFrame = 64);
+
+        /// Must be called outside of a render pass, once per frame, before any markers. Reads back the oldest pool & resets it.
+        ///  Pools rotate once per call, so a second call in the same frame would reset one that's still in flight
+        void beginFrame(vk::CommandBuffer cmd);
+
+        /// after the frame's last marker; markers outside beginFrame/endFrame are ignored
+        void endFrame();
+
+        /// Markers must be begun/ended outside of beginRendering/endRendering, or both inside the same one
+        void begin(vk::CommandBuffer cmd, std::string_view name);
+        void end(vk::CommandBuffer cmd);
+
+        [[nodiscard]] Scope scope(vk::CommandBuffer cmd, std::string_view name) {
+            begin(cmd, name);
+            return Scope(this, cmd);
+        }
+
+        bool isSupported() const { return supported; }
+
+        /// @return per-marker timings, in the order the markers were begun. Empty until the first frame has been resolved.
+        const std::vector<GPUPassTiming>& getTimings() const { return timings; }
+
+        /// @return how many frames have been read back so far; changes whenever getTimings() does, so consumers can skip frames they've seen
+        uint64_t getResolvedFrames() const { return resolvedFrames; }
+
+        /// @return summed time of all depth 0 markers
+        double getFrameTimeMs() const;
+        double getAverageFrameTimeMs() const;
+
+        void print(std::ostream& out) const;
+    };
+
+
+    struct GPUPipelineStats {
+        uint64_t inputAssemblyVertices = 0;
+        uint64_t inputAssemblyPrimitives = 0;
+        uint64_t vertexShaderInvocations = 0;
+        uint64_t clippingInvocations = 0;
+        uint64_t clippingPrimitives = 0;
+        uint64_t fragmentShaderInvocations = 0;
+        uint64_t computeShaderInvocations = 0;
+
+        static constexpr uint32_t COUNTERS = 7;
+
+        /// same order as the members above, which is also the bit order of the query flags
+        static vk::QueryPipelineStatisticFlags queryFlags() {
+            using qflag = vk::QueryPipelineStatisticFlagBits;
+
+            return qflag::eInputAssemblyVertices | qflag::eInputAssemblyPrimitives | qflag::eVertexShaderInvocations 
+                 | qflag::eClippingInvocations | qflag::eClippingPrimitives | qflag::eFragmentShaderInvocations | qflag::eComputeShaderInvocations;
+        }
+
+        GPUPipelineStats& operator+=(const GPUPipelineStats& o) {
+            inputAssemblyVertices += o.inputAssemblyVertices;
+            inputAssemblyPrimitives += o.inputAssemblyPrimitives;
+            vertexShaderInvocations += o.vertexShaderInvocations;
+            clippingInvocations += o.clippingInvocations;
+            clippingPrimitives += o.clippingPrimitives;
+            fragmentShaderInvocations += o.fragmentShaderInvocations;
+            computeShaderInvocations += o.computeShaderInvocations;
+
+            return *this;
+        }
+    };
+
+    struct GPUPassStats {
+        std::string name;
+        GPUPipelineStats stats;
+    };
+
+    /// @brief VK_QUERY_TYPE_PIPELINE_STATISTICS counterpart of GPUProfiler, with the same per-frame-in-flight rotation and stall-free readback.
+    ///  Vulkan doesn't allow two pipeline statistics queries to be active at once, so unlike GPUProfiler markers these don't nest;
+    ///  a begin() while another pass is open is ignored (and its matching end() too).
+    ///  Needs the pipelineStatisticsQuery device feature; it's a no-op otherwise.
+    class PipelineStatsProfiler {
+        struct FrameQueries {
+            vk::raii::QueryPool pool;
+            std::vector<std::string> names;
+            bool written = false;
+        };
+
+        std::vector<FrameQueries> frames;
+        size_t frameIdx = 0;
+
+        uint32_t maxQueries;
+        bool supported;
+        bool frameOpen = false;
+
+        uint32_t openDepth = 0;
+        bool droppedOpen = false;
+
+        std::vector<GPUPassStats> passStats;
+        GPUPipelineStats frameStats;
+
+        PipelineStatsProfiler(std::vector<FrameQueries>&& f, uint32_t maxQ, bool isSupported)
+            : frames(std::move(f)), maxQueries(maxQ), supported(isSupported) {}
+
+        void resolve(FrameQueries& f);
+
+        public:
+        PipelineStatsProfiler(const PipelineStatsProfiler&) = delete;
+        PipelineStatsProfiler& operator=(const PipelineStatsProfiler&) = delete;
+
+        PipelineStatsProfiler(PipelineStatsProfiler&&) = default;
+        PipelineStatsProfiler& operator=(PipelineStatsProfiler&&) = default;
+
+        static PipelineStatsProfiler make(Core& core, uint32_t maxPassesPerFrame = 32);
+
+        /// same rules as GPUProfiler::beginFrame/endFrame
+        void beginFrame(vk::CommandBuffer cmd);
+        void endFrame();
+
+        void begin(vk::CommandBuffer cmd, std::string_view name);
+        void end(vk::CommandBuffer cmd);
+
+        bool isSupported() const { return supported; }
+
+        /// @return counters of each pass of the most recently resolved frame, in recording order
+        const std::vector<GPUPassStats>& getPassStats() const { return passStats; }
+
+        /// @return sum of every pass of the most recently resolved frame
+        const GPUPipelineStats& getFrameStats() const { return frameStats; }
+
+        void print(std::ostream& out) const;
+    };
+}
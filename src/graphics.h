@@ -17,7 +17,10 @@ namespace Medea {
         vk::raii::PipelineLayout& pipelineLayout;
         vk::PipelineDepthStencilStateCreateInfo depth;
         vk::PipelineRenderingCreateInfo renderInfo;
-        vk::Format colorAttachmentFormat;
+        std::vector<vk::Format> colorAttachmentFormats;
+
+        std::vector<vk::SpecializationMapEntry> specEntries;
+        std::vector<uint32_t> specData;
 
         PipelineBuilder(vk::raii::PipelineLayout& layout)
             : pipelineLayout(layout) {}
@@ -33,16 +36,20 @@ namespace Medea {
             pipelineLayout.clear();
             depth = decltype(depth){};
             renderInfo = decltype(renderInfo){};
+            specEntries.clear();
+            specData.clear();
         }
 
         vk::raii::Pipeline build(vk::raii::Device& device) {
             vk::PipelineViewportStateCreateInfo viewport({}, 1, nullptr, 1, nullptr);
 
+            //same blend state for every attachment
+            std::vector<vk::PipelineColorBlendAttachmentState> blendAttachments(colorAttachmentFormats.size(), colorBlendAttachment);
+
             vk::PipelineColorBlendStateCreateInfo colorBlending;
             colorBlending.setLogicOpEnable(false)
                 .setLogicOp(vk::LogicOp::eCopy)
-                .setAttachmentCount(1)
-                .setPAttachments(&colorBlendAttachment);
+                .setAttachments(blendAttachments);
 
             std::vector<vk::DynamicState> dynamics = {vk::DynamicState::eViewport, vk::DynamicState::eCullMode, vk::DynamicState::eScissor, 
                     vk::DynamicState::eDepthCompareOp, vk::DynamicState::eDepthTestEnable};
@@ -54,7 +61,19 @@ namespace Medea {
             vk::PipelineVertexInputStateCreateInfo vtxInfo;
             vk::PipelineViewportStateCreateInfo vpInfo({}, 1, nullptr, 1, nullptr);
 
-            gfxInfo.setStages(shaderStages)
+            //same constants for every stage; ids a stage doesn't declare are ignored
+            vk::SpecializationInfo specInfo;
+            specInfo.setMapEntries(specEntries)
+                .setDataSize(specData.size() * sizeof(uint32_t))
+                .setPData(specData.data());
+
+            std::vector<vk::PipelineShaderStageCreateInfo> stages = shaderStages;
+
+            if (!specEntries.empty()) {
+                for (auto& s : stages) s.setPSpecializationInfo(&specInfo);
+            }
+
+            gfxInfo.setStages(stages)
                 .setLayout(*pipelineLayout)
                 .setPInputAssemblyState(&inputAssembly)
                 .setPRasterizationState(&rasterizer)
@@ -96,6 +115,54 @@ namespace Medea {
             return *this;
         }
 
+        /// a vertex shader and no fragment stage, for depth-only pipelines (no color attachments)
+        PipelineBuilder& setVertexShader(vk::raii::Device& device, std::string_view vtxSrc, std::string_view vtxName) {
+            shaderModules.clear();
+            shaderModules.reserve(1);
+            shaderStages.clear();
+
+            shaderModules.push_back(compileShader<ShaderStage::vertex>(device, vtxSrc, vtxName).value());
+
+            shaderStages.push_back(vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eVertex, *shaderModules.at(0), "main"));
+
+            return *this;
+        }
+
+        /// task + mesh shaders instead of a vertex shader (VK_EXT_mesh_shader). Topology and vertex input are then ignored
+        PipelineBuilder& setMeshShaders(vk::raii::Device& device, std::string_view taskSrc, std::string_view meshSrc, std::string_view fragSrc,
+                                        std::string_view taskName, std::string_view meshName, std::string_view fragName) {
+            shaderModules.clear();
+            shaderModules.reserve(3);
+            shaderStages.clear();
+
+            shaderModules.push_back(compileShader<ShaderStage::task>(device, taskSrc, taskName).value());
+            shaderModules.push_back(compileShader<ShaderStage::mesh>(device, meshSrc, meshName).value());
+            shaderModules.push_back(compileShader<ShaderStage::fragment>(device, fragSrc, fragName).value());
+
+            shaderStages.push_back(vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eTaskEXT, *shaderModules.at(0), "main"));
+            shaderStages.push_back(vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eMeshEXT, *shaderModules.at(1), "main"));
+            shaderStages.push_back(vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eFragment, *shaderModules.at(2), "main"));
+
+            return *this;
+        }
+
+        /// a uint specialization constant for every stage. Shaders are compiled once per builder, so set this and build() again for
+        ///  each variant
+        PipelineBuilder& setSpecialization(uint32_t constantID, uint32_t value) {
+            for (size_t i=0; i<specEntries.size(); i++) {
+                if (specEntries.at(i).constantID != constantID) continue;
+
+                specData.at(i) = value;
+
+                return *this;
+            }
+
+            specEntries.push_back(vk::SpecializationMapEntry(constantID, specData.size() * sizeof(uint32_t), sizeof(uint32_t)));
+            specData.push_back(value);
+
+            return *this;
+        }
+
         PipelineBuilder& setTopology(vk::PrimitiveTopology t) {
             inputAssembly.setTopology(t)
                 .setPrimitiveRestartEnable(false);
@@ -138,9 +205,14 @@ namespace Medea {
         }
 
         PipelineBuilder& setColorAttachmentFormat(vk::Format f) {
-            colorAttachmentFormat = f;
+            return setColorAttachmentFormats({f});
+        }
+
+        /// one per fragment shader output location
+        PipelineBuilder& setColorAttachmentFormats(const std::vector<vk::Format>& formats) {
+            colorAttachmentFormats = formats;
 
-            renderInfo.setColorAttachmentFormats(colorAttachmentFormat);
+            renderInfo.setColorAttachmentFormats(colorAttachmentFormats);
 
             return *this;
         }
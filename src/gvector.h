@@ -7,6 +7,8 @@
 
 #include "constants.h"
 #include <unordered_set>
+#include <set>
+#include <span>
 #include "compute.h"
 
 #include "internal/metacodegen.h"
@@ -83,6 +85,43 @@ namespace Medea {
     using RollingBufferImage = RollingBufferBase<AllocatedImage>;
 
 
+    namespace Internal {
+        /// gathers modified entries (skipping ones since popped) into a contiguous upload, in index order
+        template<typename T>
+        void buildPatchList(const std::set<size_t>& modified, const std::vector<T>& backing, std::vector<size_t>& idxList, std::vector<T>& patchList) {
+            idxList.clear();
+            patchList.clear();
+
+            for (size_t idx : modified) {
+                if (idx >= backing.size()) continue;
+
+                idxList.push_back(idx);
+                patchList.push_back(backing.at(idx));
+            }
+        }
+
+        /// copies from a patch list (laid out by buildPatchList) to the GPU array; runs of consecutive indices become one copy.
+        /// The first copy is always the array header
+        inline std::vector<vk::BufferCopy2> coalescePatchCopies(std::span<const size_t> idxList, size_t objSize) {
+            std::vector<vk::BufferCopy2> copies = {vk::BufferCopy2(0, 0, RenderConstants::arrayHeaderSize)};
+
+            for (size_t i=0; i<idxList.size(); i++) {
+                size_t trgOff = idxList[i] * objSize + RenderConstants::arrayHeaderSize;
+                size_t srcOff = i * objSize + RenderConstants::arrayHeaderSize;
+
+                if (i > 0 && idxList[i-1] == idxList[i]-1) {
+                    copies.at(copies.size()-1).size += objSize;
+                }
+                else {
+                    copies.push_back(vk::BufferCopy2(srcOff, trgOff, objSize));
+                }
+            }
+
+            return copies;
+        }
+    }
+
+
     template<typename T>
     class gvector {
         std::vector<T> backing;
@@ -211,20 +250,19 @@ namespace Medea {
         void gpuUpdate(VmaAllocator allocator, vk::Device device, vk::CommandBuffer cmd) {
             if (modified.size() == 0) return;
 
+            MEDEA_PROFILE_ZONE("gvector::gpuUpdate");
+
             std::vector<size_t> idxList;
             std::vector<T> patchList;
 
-            for (size_t idx : modified) {
-                if (idx >= backing.size()) continue;
-
-                idxList.push_back(idx);
-                patchList.push_back(backing.at(idx));
-            }
+            Internal::buildPatchList(modified, backing, idxList, patchList);
 
             modified.clear();
 
             vk::BufferUsageFlags tbufDefault = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
 
+            MemoryCategoryScope stagingMemory(MemoryCategory::transients);
+
             transferDataBuf.next(AllocatedBuffer::loadCPUWithHeader(allocator, device, std::span<T>(patchList), tbufDefault, backing.size()));
             //transferIdxBuf.next( AllocatedBuffer::loadCPUWithSize(allocator, idxList,   bufDefault));
 
@@ -237,22 +275,11 @@ namespace Medea {
 
 
 
-            std::vector<vk::BufferCopy2> copies = {vk::BufferCopy2(0, 0, RenderConstants::arrayHeaderSize)};
-            for (size_t i=0; i<idxList.size(); i++) {
-                size_t trgOff = idxList.at(i) * sizeof(T) + RenderConstants::arrayHeaderSize;
-                size_t srcOff = i * sizeof(T) + RenderConstants::arrayHeaderSize;
-
-                size_t objSize = sizeof(T);
-
-                assert(trgOff + objSize <= gpuBacking.get().info.size);
-                assert(srcOff + objSize <= transferDataBuf.get().info.size);
+            std::vector<vk::BufferCopy2> copies = Internal::coalescePatchCopies(idxList, sizeof(T));
 
-                if (i > 0 && idxList.at(i-1) == idxList.at(i)-1) {
-                    copies.at(copies.size()-1).size += objSize;
-                }
-                else {
-                    copies.push_back(vk::BufferCopy2(srcOff, trgOff, sizeof(T)));
-                }
+            for (auto& c : copies) {
+                assert(c.dstOffset + c.size <= gpuBacking.get().info.size);
+                assert(c.srcOffset + c.size <= transferDataBuf.get().info.size);
             }
 
             cmd.copyBuffer2(vk::CopyBufferInfo2(transferDataBuf.get().buffer, gpuBacking.get().buffer, copies));
@@ -0,0 +1,118 @@
+#include "hizpyramid.h"
+
+#include <bit>
+
+using namespace Medea;
+
+std::vector<vk::DescriptorSetLayoutBinding> hiZBuildBindings() {
+    return {vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute),
+            vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute)};
+}
+
+VkExtent2D mipExtent(VkExtent2D base, uint32_t mip) {
+    return VkExtent2D{std::max(1u, (base.width + (1u << mip) - 1) >> mip), std::max(1u, (base.height + (1u << mip) - 1) >> mip)};
+}
+
+
+HiZPyramid HiZPyramid::make(Core& core) {
+    vk::SamplerCreateInfo sci({}, vk::Filter::eNearest, vk::Filter::eNearest, vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge);
+
+    sci.setMaxLod(VK_LOD_CLAMP_NONE);
+
+    std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios =
+        {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 1),
+         DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eStorageImage, 1)};
+
+    //one set per mip per frame, freed once the frame's done
+    DescriptorAllocator descriptors = DescriptorAllocator::make(core.device, MAX_MIPS * (2 * BUF_FRAMES_IN_FLIGHT + 1), poolRatios);
+
+    return HiZPyramid(vk::raii::Sampler(core.device, sci),
+        ComputeShader<Internal::HiZBuildPush>::make(core.device, "./shader/hiZBuild.comp", hiZBuildBindings()),
+        std::move(descriptors));
+}
+
+void HiZPyramid::resize(Core& core, CleanupJobQueueCallback cleanup, VkExtent2D depthExtent) {
+    if (image && depthExtent.width == maxExtent.width && depthExtent.height == maxExtent.height) return;
+
+    if (image) {
+        auto old = std::make_shared<AllocatedImage>(std::move(*image));
+        auto oldViews = std::make_shared<std::vector<vk::raii::ImageView>>(std::move(mipViews));
+
+        cleanup([old, oldViews] () {});
+
+        image.reset();
+        mipViews.clear();
+    }
+
+    maxExtent = depthExtent;
+
+    //mips are mipExtent (rounded up) of whatever's rendered, which floor halving of the depth's own extent can be a texel short of
+    VkExtent2D allocExtent{std::bit_ceil(std::max(maxExtent.width, 1u)), std::bit_ceil(std::max(maxExtent.height, 1u))};
+
+    uint32_t mips = std::min<uint32_t>(MAX_MIPS, std::bit_width(std::max(allocExtent.width, allocExtent.height)));
+
+    vk::ImageCreateInfo ici({}, vk::ImageType::e2D, vk::Format::eR32Sfloat, vk::Extent3D(allocExtent.width, allocExtent.height, 1), mips, 1,
+        vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+        vk::SharingMode::eExclusive, core.graphicsQueueFamily);
+
+    vk::ImageViewCreateInfo ivci({}, {}, vk::ImageViewType::e2D, vk::Format::eR32Sfloat);
+
+    image.emplace(AllocatedImage::make(core, ici, ivci, vk::ImageAspectFlagBits::eColor, vk::ImageViewType::e2D, mips, false));
+
+    for (uint32_t i=0; i<mips; i++) {
+        vk::ImageViewCreateInfo mipInfo({}, *image->image, vk::ImageViewType::e2D, vk::Format::eR32Sfloat, {},
+                                        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, i, 1, 0, 1));
+
+        mipViews.push_back(vk::raii::ImageView(core.device, mipInfo));
+    }
+}
+
+void HiZPyramid::addBuildPass(Core& core, RenderGraph& graph, CleanupJobQueueCallback cleanup, RGHandle depth, RGHandle pyramid, VkExtent2D renderExtent) {
+    assert(image);
+
+    baseExtent = renderExtent;
+
+    graph.addPass("hiZBuild",
+        [&] (RenderGraph::PassBuilder& b) {
+            b.read(depth, ResourceUsage::computeRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                .write(pyramid, ResourceUsage::computeWrite(vk::ImageLayout::eGeneral), true);
+        },
+        [&core, &graph, this, cleanup, depth, renderExtent] (vk::CommandBuffer cmd) {
+            AllocatedImage& depthImg = graph.getImage(depth);
+
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shader.pipeline);
+
+            const uint32_t LOCAL_W = 8;
+
+            for (uint32_t mip=0; mip<mipViews.size(); mip++) {
+                std::shared_ptr<vk::raii::DescriptorSet> dset = std::make_shared<vk::raii::DescriptorSet>(std::move(descriptors.allocate(core.device, shader.descLayout)));
+
+                cleanup([dset] () {});
+
+                vk::DescriptorImageInfo srcDII = mip == 0 ? vk::DescriptorImageInfo(sampler, depthImg.imageView, vk::ImageLayout::eShaderReadOnlyOptimal)
+                                                          : vk::DescriptorImageInfo(sampler, mipViews.at(mip - 1), vk::ImageLayout::eGeneral);
+                vk::DescriptorImageInfo dstDII({}, mipViews.at(mip), vk::ImageLayout::eGeneral);
+
+                vk::WriteDescriptorSet w0(*dset, 0, 0, vk::DescriptorType::eCombinedImageSampler, srcDII, {}, {});
+                vk::WriteDescriptorSet w1(*dset, 1, 0, vk::DescriptorType::eStorageImage, dstDII, {}, {});
+
+                {
+                    MEDEA_PROFILE_ZONE("descriptorWrites");
+
+                    core.device.updateDescriptorSets({w0, w1}, {});
+                }
+
+                VkExtent2D src = mip == 0 ? renderExtent : mipExtent(renderExtent, mip - 1);
+                VkExtent2D dst = mipExtent(renderExtent, mip);
+
+                //the previous mip's writes have to land before this one reads them
+                if (mip > 0) BarrierBatch().memory(ResourceUsage::computeWrite(), ResourceUsage::computeRead()).flush(cmd);
+
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, shader.layout, 0, **dset, {});
+                shader.setPush(cmd, Internal::HiZBuildPush{glm::ivec4(src.width, src.height, dst.width, dst.height), mip == 0 ? 0u : 1u});
+
+                cmd.dispatch((dst.width + LOCAL_W - 1) / LOCAL_W, (dst.height + LOCAL_W - 1) / LOCAL_W, 1);
+            }
+        });
+}
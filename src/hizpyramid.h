@@ -0,0 +1,80 @@
+#pragma once
+
+#include "core.h"
+#include "metaimage.h"
+#include "compute.h"
+#include "rendergraph.h"
+
+#include <optional>
+
+/// Hierarchical-Z: a max-depth mip chain over the rendered area of a depth buffer. Mip 0 is the depth itself, each mip after it is the max of
+///  the (up to) 2x2 texels under it, so a texel at any level is at least as far as everything it covers. Odd sizes round up, which keeps that
+///  true at the edges; a mip 0 pixel p is covered by texel p >> level. The image is allocated at power of two extents, so every level's
+///  rounded up extent fits in it.
+///
+/// Used by GPUSceneGraph::render for occlusion culling (see RenderSettings::occlusionCulling).
+
+namespace Medea {
+
+    namespace Internal {
+        struct HiZBuildPush {
+            glm::ivec4 srcDstExtent;
+            uint32_t reduce;            //<- 0: copy (mip 0 from the depth buffer), 1: 2x2 max
+        };
+    }
+
+    /// NDC xy -> Hi-Z UV, as uv = ndc * xy + zw, for a viewport rasterized the way GSGBindlessShader::v2Bind does it: Y flipped, so NDC
+    ///  +y is the viewport's top row
+    /// @param viewport x, y, width, height, unflipped
+    /// @param base the pyramid's mip 0 extent (HiZPyramid::getBaseExtent)
+    inline glm::vec4 hiZUVScaleBias(glm::vec4 viewport, glm::vec2 base) {
+        glm::vec2 extent(viewport.z, viewport.w);
+
+        return glm::vec4(glm::vec2(0.5f, -0.5f) * extent / base, (glm::vec2(viewport.x, viewport.y) + 0.5f * extent) / base);
+    }
+
+    class HiZPyramid {
+        std::optional<AllocatedImage> image;        //<- R32F, the depth buffer's full extent rounded up to powers of two
+        std::vector<vk::raii::ImageView> mipViews;
+
+        vk::raii::Sampler sampler;
+
+        ComputeShader<Internal::HiZBuildPush> shader;
+        DescriptorAllocator descriptors;
+
+        VkExtent2D maxExtent = {0, 0};
+        VkExtent2D baseExtent = {0, 0};             //<- mip 0, i.e. the last build's render extent
+
+        HiZPyramid(vk::raii::Sampler&& s, ComputeShader<Internal::HiZBuildPush>&& cs, DescriptorAllocator&& desc)
+            : sampler(std::move(s)), shader(std::move(cs)), descriptors(std::move(desc)) {}
+
+        public:
+        static constexpr uint32_t MAX_MIPS = 16;
+
+        static HiZPyramid make(Core& core);
+
+        /// (Re)allocates if the depth buffer's extent changed. The old image is kept alive until the frame's done with it
+        void resize(Core& core, CleanupJobQueueCallback cleanup, VkExtent2D depthExtent);
+
+        /// Declares a pass building the pyramid from depth's top left renderExtent. Call resize() first.
+        ///  The pyramid stays in eGeneral; declare reads as ResourceUsage::computeRead(vk::ImageLayout::eGeneral)
+        void addBuildPass(Core& core, RenderGraph& graph, CleanupJobQueueCallback cleanup, RGHandle depth, RGHandle pyramid, VkExtent2D renderExtent);
+
+        AllocatedImage& getImage() {
+            return image.value();
+        }
+
+        /// nearest, clamped; for texelFetch
+        const vk::raii::Sampler& getSampler() const {
+            return sampler;
+        }
+
+        VkExtent2D getBaseExtent() const {
+            return baseExtent;
+        }
+
+        uint32_t getMipCount() const {
+            return mipViews.size();
+        }
+    };
+}
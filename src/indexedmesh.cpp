@@ -0,0 +1,296 @@
+#include "indexedmesh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace Medea;
+
+namespace {
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    /// FIFO cache via insertion timestamps: v is cached iff fewer than cacheSize vertices went in after it
+    struct FifoCache {
+        std::vector<uint32_t> insertedAt;
+        uint32_t time;
+        const uint32_t cacheSize;
+
+        FifoCache(uint32_t vertexCount, uint32_t _cacheSize) : insertedAt(vertexCount, 0), time(_cacheSize + 1), cacheSize(_cacheSize) {}
+
+        bool cached(uint32_t v) const {
+            return time - insertedAt[v] <= cacheSize;
+        }
+
+        /// @return whether it missed
+        bool touch(uint32_t v) {
+            if (cached(v)) return false;
+
+            insertedAt[v] = time++;
+
+            return true;
+        }
+    };
+}
+
+VertexCacheStats Medea::simulateVertexCache(std::span<const uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize) {
+    assert(indices.size() % 3 == 0);
+
+    VertexCacheStats out;
+    out.triangles = indices.size() / 3;
+
+    FifoCache cache(vertexCount, cacheSize);
+
+    for (uint32_t i : indices) out.invocations += cache.touch(i);
+
+    out.acmr = out.triangles > 0 ? float(out.invocations) / out.triangles : 0.f;
+    out.atvr = vertexCount > 0 ? float(out.invocations) / vertexCount : 0.f;
+
+    return out;
+}
+
+void Medea::optimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize) {
+    assert(indices.size() % 3 == 0);
+
+    const uint32_t triCount = indices.size() / 3;
+
+    if (triCount == 0) return;
+
+    //vertex -> the triangles using it
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+
+    for (uint32_t i : indices) offsets[i + 1]++;
+    for (uint32_t v=0; v<vertexCount; v++) offsets[v + 1] += offsets[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+    for (uint32_t i=0; i<indices.size(); i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    //triangles per vertex not emitted yet
+    std::vector<uint32_t> live(vertexCount);
+
+    for (uint32_t v=0; v<vertexCount; v++) live[v] = offsets[v + 1] - offsets[v];
+
+    std::vector<bool> emitted(triCount, false);
+    std::vector<uint32_t> deadEnd, candidates;
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+
+    FifoCache cache(vertexCount, cacheSize);
+
+    uint32_t cursor = 0;
+
+    //fanning ran out of cached candidates: back up through recently used vertices, then just take the next one with triangles left
+    auto skipDeadEnd = [&] () -> uint32_t {
+        while (!deadEnd.empty()) {
+            uint32_t d = deadEnd.back();
+            deadEnd.pop_back();
+
+            if (live[d] > 0) return d;
+        }
+
+        while (cursor < vertexCount) {
+            if (live[cursor] > 0) return cursor;
+
+            cursor++;
+        }
+
+        return NONE;
+    };
+
+    uint32_t fan = skipDeadEnd();
+
+    while (fan != NONE) {
+        candidates.clear();
+
+        for (uint32_t a=offsets[fan]; a<offsets[fan + 1]; a++) {
+            uint32_t t = adjacency[a];
+
+            if (emitted[t]) continue;
+
+            emitted[t] = true;
+
+            for (int k=0; k<3; k++) {
+                uint32_t v = indices[3 * t + k];
+
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+
+                live[v]--;
+                cache.touch(v);
+            }
+        }
+
+        //the oldest candidate that'd still be cached once its remaining triangles are fanned (~2 new vertices each)
+        uint32_t best = NONE;
+        int64_t bestPriority = -1;
+
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) continue;
+
+            int64_t age = cache.time - cache.insertedAt[v];
+            int64_t priority = age + 2 * int64_t(live[v]) <= cacheSize ? age : 0;
+
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        fan = best != NONE ? best : skipDeadEnd();
+    }
+
+    assert(out.size() == indices.size());
+
+    std::copy(out.begin(), out.end(), indices.begin());
+}
+
+void Medea::optimizeOverdraw(std::span<uint32_t> indices, std::span<const VertexPosition> positions, uint32_t cacheSize) {
+    assert(indices.size() % 3 == 0);
+
+    const uint32_t triCount = indices.size() / 3;
+
+    if (triCount < 2) return;
+
+    struct Cluster {
+        uint32_t begin, end;    //<- triangles
+        float key;
+    };
+
+    std::vector<Cluster> clusters;
+
+    //a triangle missing all three vertices starts over anyway, so moving it (and what follows) elsewhere costs the cache nothing
+    FifoCache cache(positions.size(), cacheSize);
+
+    for (uint32_t t=0; t<triCount; t++) {
+        uint32_t misses = 0;
+
+        for (int k=0; k<3; k++) misses += cache.touch(indices[3 * t + k]);
+
+        if (misses == 3) {
+            if (!clusters.empty()) clusters.back().end = t;
+
+            clusters.push_back(Cluster{t, triCount, 0.f});
+        }
+    }
+
+    //area weighted centers & normals; (b - a) x (c - a) is twice the area along the normal
+    auto triangle = [&] (uint32_t t, glm::vec3& center, glm::vec3& areaNormal) {
+        glm::vec3 a = positions[indices[3 * t]].pos, b = positions[indices[3 * t + 1]].pos, c = positions[indices[3 * t + 2]].pos;
+
+        center = (a + b + c) / 3.f;
+        areaNormal = glm::cross(b - a, c - a);
+    };
+
+    glm::vec3 meshCenter(0);
+    float meshArea = 0;
+
+    for (uint32_t t=0; t<triCount; t++) {
+        glm::vec3 center, areaNormal;
+        triangle(t, center, areaNormal);
+
+        float area = glm::length(areaNormal);
+
+        meshCenter += center * area;
+        meshArea += area;
+    }
+
+    if (meshArea <= 0.f) return;
+
+    meshCenter /= meshArea;
+
+    for (auto& cl : clusters) {
+        glm::vec3 center(0), normal(0);
+        float area = 0;
+
+        for (uint32_t t=cl.begin; t<cl.end; t++) {
+            glm::vec3 c, n;
+            triangle(t, c, n);
+
+            float a = glm::length(n);
+
+            center += c * a;
+            normal += n;
+            area += a;
+        }
+
+        float normalLen = glm::length(normal);
+
+        //degenerate, or faces every way at once; sorts between the outward and inward facing ones
+        if (area <= 0.f || normalLen <= 1e-12f) continue;
+
+        cl.key = glm::dot(center / area - meshCenter, normal / normalLen);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [] (const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+
+    for (auto& cl : clusters) out.insert(out.end(), indices.begin() + 3 * cl.begin, indices.begin() + 3 * cl.end);
+
+    std::copy(out.begin(), out.end(), indices.begin());
+}
+
+std::vector<uint32_t> Medea::optimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount) {
+    std::vector<uint32_t> remap(vertexCount, NONE);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+
+    for (uint32_t& i : indices) {
+        if (remap[i] == NONE) {
+            remap[i] = order.size();
+            order.push_back(i);
+        }
+
+        i = remap[i];
+    }
+
+    return order;
+}
+
+IndexedMesh Medea::buildIndexedMesh(std::span<const VertexPosition> soupPositions, std::span<const uint32_t> canonical) {
+    assert(soupPositions.size() % 3 == 0);
+    assert(canonical.size() == soupPositions.size());
+
+    IndexedMesh out;
+    out.indices.reserve(soupPositions.size());
+
+    //canonical soup vertex -> welded vertex, numbered as first seen
+    std::vector<uint32_t> welded(soupPositions.size(), NONE);
+
+    for (uint32_t i=0; i<soupPositions.size(); i++) {
+        uint32_t c = canonical[i];
+
+        if (welded[c] == NONE) {
+            welded[c] = out.vertices.size();
+            out.vertices.push_back(c);
+        }
+
+        out.indices.push_back(welded[c]);
+    }
+
+    const uint32_t vertexCount = out.vertices.size();
+
+    out.welded = simulateVertexCache(out.indices, vertexCount);
+
+    std::vector<VertexPosition> positions;
+    positions.reserve(vertexCount);
+
+    for (uint32_t v : out.vertices) positions.push_back(soupPositions[v]);
+
+    optimizeVertexCache(out.indices, vertexCount);
+    optimizeOverdraw(out.indices, positions);
+
+    std::vector<uint32_t> order = optimizeVertexFetch(out.indices, vertexCount);
+
+    std::vector<uint32_t> soupVertices(order.size());
+
+    for (uint32_t i=0; i<order.size(); i++) soupVertices[i] = out.vertices[order[i]];
+
+    out.vertices = std::move(soupVertices);
+    out.optimized = simulateVertexCache(out.indices, out.vertices.size());
+
+    return out;
+}
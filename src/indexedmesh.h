@@ -0,0 +1,57 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Indexed meshes: FullMesh::make welds its triangle soup into unique vertices + an index buffer, then reorders both so the GPU's
+///  post-transform cache actually hits (optimizeVertexCache), nearer surfaces tend to draw first (optimizeOverdraw), and vertices are
+///  fetched in the order they're first used (optimizeVertexFetch).
+///
+/// The cache model is a FIFO of VertexCacheLimits::fifoSize entries. Real hardware doesn't cache exactly like that (batching differs per
+///  vendor), so simulateVertexCache's counts are an estimate; the bench's pipeline statistics are the measured ones.
+
+namespace Medea {
+
+    namespace VertexCacheLimits {
+        constexpr uint32_t fifoSize = 16;
+    }
+
+    /// post-transform cache behaviour of an index buffer
+    struct VertexCacheStats {
+        uint32_t triangles = 0;
+        uint32_t invocations = 0;   //<- cache misses, i.e. vertex shader invocations
+        float acmr = 0;             //<- average cache miss ratio: invocations per triangle. 3 is a soup, ~0.5-0.7 is about as good as it gets
+        float atvr = 0;             //<- average transform to vertex ratio: invocations per unique vertex; 1 is optimal
+    };
+
+    struct IndexedMesh {
+        std::vector<uint32_t> vertices;     //<- per vertex (in fetch order), the soup vertex it came from
+        std::vector<uint32_t> indices;      //<- 3 per triangle, into vertices; CCW like the soup
+
+        VertexCacheStats welded;            //<- just welded, in soup order
+        VertexCacheStats optimized;         //<- after all the reordering
+    };
+
+    /// welds, then runs every optimization below
+    /// @param canonical per soup vertex, the first soup vertex identical to it (see dedupeSoup)
+    extern IndexedMesh buildIndexedMesh(std::span<const VertexPosition> soupPositions, std::span<const uint32_t> canonical);
+
+    /// Tipsify (Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007): fans around the most
+    ///  recently cached vertex that still has triangles left. Linear time
+    extern void optimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount, uint32_t cacheSize = VertexCacheLimits::fifoSize);
+
+    /// splits the (cache optimized) triangles into clusters where the cache starts over anyway, then draws the clusters facing away from the
+    ///  mesh's center first; from outside, those tend to be in front. Only reorders at cache restarts, so the cache hit rate stays put
+    extern void optimizeOverdraw(std::span<uint32_t> indices, std::span<const VertexPosition> positions,
+                                 uint32_t cacheSize = VertexCacheLimits::fifoSize);
+
+    /// renumbers vertices in order of first use, and rewrites indices to match
+    /// @return per new vertex, the old one
+    extern std::vector<uint32_t> optimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount);
+
+    extern VertexCacheStats simulateVertexCache(std::span<const uint32_t> indices, uint32_t vertexCount,
+                                                uint32_t cacheSize = VertexCacheLimits::fifoSize);
+}
@@ -7,8 +7,11 @@
 //this shouldn't /need/ core.h, it just needs BufferRef, but it's not that big of a deal
 #include "medea/core.h"
 #include "medea/primitives.h"
+#include "medea/meshlet.h"
+#include "medea/vertexquantize.h"
 
 #include <memory>
+#include <set>
 #include <string>
 #include <sstream>
 #include <string_view>
@@ -383,42 +386,40 @@ namespace Medea::Internal {
         return {out.str(), uStructName, uArrayName, vStructName, vArrayName, mainName, materialID};
     }
 
+    /// specialization constant (id 0) picking the one material a pipeline runs; anyMaterial (the megashader) switches on the entity's
+    namespace MaterialSpecialization {
+        constexpr uint32_t constantID = 0;
+        constexpr uint32_t anyMaterial = 0xFFFFFFFF;
+    }
+
     inline void vmaterialHeader(std::stringstream& out) {
         out << "#version 460\n"
             << "#extension GL_EXT_buffer_reference : require\n"
             << "#extension GL_EXT_nonuniform_qualifier : require\n"
             << "#extension GL_EXT_shader_explicit_arithmetic_types : require\n"
             << "#extension GL_KHR_shader_subgroup_vote : require\n\n";
+
+        //specialized, the material switches fold to one case, and the other materials' code (and registers) go with the rest
+        out << "layout (constant_id = "<<MaterialSpecialization::constantID<<") const uint _MEDEA_MATERIAL = "<<MaterialSpecialization::anyMaterial<<"u;\n"
+            << "uint _medeaMaterial(uint materialID) { return _MEDEA_MATERIAL == "<<MaterialSpecialization::anyMaterial<<"u ? materialID : _MEDEA_MATERIAL; }\n\n";
     }
     
     struct IntrinsicV2F {
         uint32_t _fragInstanceIndex;
     };
 
-    template<typename V2F, typename FOut>
-    std::string vmaterialSrcFrag(std::span<VMaterialFragment> arr, std::string_view bonusSrc) {
-        std::stringstream out;
-
-        vmaterialHeader(out);
-
-        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
-
-        writeShaderVertexIO<V2F>()(out, "in");
-        writeShaderVertexIO<IntrinsicV2F>()(out, "in", TotalElements<V2F>::value);
-        writeShaderVertexIO<FOut>()(out, "out");
-
-
-        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+    /// the fragment shader minus its declarations and the shared builtins: fragment builtins, materials, and the entry point (named mainName)
+    inline void vmaterialFragStage(std::stringstream& out, std::span<VMaterialFragment> arr, std::string_view mainName, std::string_view mainEpilogue) {
         std::string fragBuiltins = readFile("./shader/shared/builtins-frag.slib").value();
 
-        out << globalBuiltins << "\n" << fragBuiltins << "\n";
+        out << fragBuiltins << "\n";
 
         for (auto& vmfrag : arr) {
             out << vmfrag.src;
         }
 
 
-        out << "\n\nvoid main() {\n"
+        out << "\n\nvoid "<<mainName<<"() {\n"
 
             <<"\tRenderEntity entity = _getRenderEntity();\n"
             <<"\tmat4 model = _medeaEntityToModel(entity);\n"
@@ -426,7 +427,7 @@ namespace Medea::Internal {
             <<"\tmat4 proj = _medeaGetProj();\n"    
 
             //<<"\tif (_push.depthOnly != 0) return;"
-            << "\tswitch (entity.materialID) {\n";
+            << "\tswitch (_medeaMaterial(entity.materialID)) {\n";
 
         for (auto& vmfrag : arr) {
             out << "\t\tcase "<<vmfrag.materialID<<":\n"
@@ -438,46 +439,107 @@ namespace Medea::Internal {
 
         out << "\t}\n"
             << "\t fragColor.rgb = colorCorrect(fragColor.rgb);\n"
-            << "\t fragColor.rgb += vec3(bayerDither());"
+            << "\t fragColor.rgb += vec3(bayerDither());\n"
+            << mainEpilogue
             << "}\n";
-
-        return out.str();
     }
 
-    ///WARN: this is fragile & highly specialized to my use case & could be coded to be more reusable
-    template<typename V2F>
-    std::string vmaterialSrcVtx(std::span<VMaterialVertex> arr, std::string_view bonusSrc) {
+    /// @param mainEpilogue appended to main(), after the material's entry point (and color correction) ran
+    template<typename V2F, typename FOut>
+    std::string vmaterialSrcFrag(std::span<VMaterialFragment> arr, std::string_view bonusSrc, std::string_view mainEpilogue = "") {
         std::stringstream out;
 
         vmaterialHeader(out);
 
         out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
 
-        writeShaderVertexIO<V2F>()(out, "out");
-        writeShaderVertexIO<IntrinsicV2F>()(out, "out", TotalElements<V2F>::value);
+        writeShaderVertexIO<V2F>()(out, "in");
+        writeShaderVertexIO<IntrinsicV2F>()(out, "in", TotalElements<V2F>::value);
+        writeShaderVertexIO<FOut>()(out, "out");
 
 
         std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
 
         out << globalBuiltins << "\n";
 
+        vmaterialFragStage(out, arr, "main", mainEpilogue);
 
+        return out.str();
+    }
+
+    /// Position stream decode per RenderEntity::vertexFormat, after the vertex builtins: _medeaLoadPosNormal is _medeaGetPosNormal plus
+    ///  VertexFormat::quantized (same math as vertexquantize.cpp's dequantize*). _medeaLoadTangent(entity, normal) takes the undecoded
+    ///  (object space) normal; streams without tangents give the tangentBasis one
+    inline void vertexDecodeGLSL(std::stringstream& out) {
+        const uint32_t QUANTIZED = (uint32_t) VertexFormat::quantized;
+
+        cppStructToGLSL<QuantizedVertexPosition>(out, "QuantizedVertexPosition");
+        cppStructToGLSL<QuantizedPositionHeader>(out, "QuantizedPositionHeader");
+
+        out << "layout(buffer_reference, std430) readonly buffer _MedeaQuantizedPositions {\n"
+            << "\tQuantizedPositionHeader header;\n"
+            << "\tQuantizedVertexPosition data[];\n"
+            << "};\n\n";
+
+        out << "vec3 _medeaOctDecode(vec2 e) {\n"
+            << "\tvec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+            << "\tfloat t = max(-n.z, 0.0);\n"
+            << "\tn.x += n.x >= 0.0 ? -t : t;\n"
+            << "\tn.y += n.y >= 0.0 ? -t : t;\n"
+            << "\treturn normalize(n);\n"
+            << "}\n\n";
+
+        out << "void _medeaTangentBasis(vec3 n, out vec3 b1, out vec3 b2) {\n"
+            << "\tfloat s = n.z >= 0.0 ? 1.0 : -1.0;\n"
+            << "\tfloat a = -1.0 / (s + n.z);\n"
+            << "\tfloat b = n.x * n.y * a;\n"
+            << "\tb1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);\n"
+            << "\tb2 = vec3(b, s + n.y * n.y * a, -n.y);\n"
+            << "}\n\n";
+
+        out << "void _medeaLoadPosNormal(RenderEntity entity, out vec3 pos, out vec3 normal) {\n"
+            << "\tif (entity.vertexFormat == "<<QUANTIZED<<"u) {\n"
+            << "\t\t_MedeaQuantizedPositions q = _MedeaQuantizedPositions(entity.positionStreamAddress);\n"
+            << "\t\tQuantizedVertexPosition v = q.data[gl_VertexIndex];\n"
+            << "\t\tpos = q.header.offset.xyz + q.header.scale.xyz * vec3(unpackUnorm2x16(v.posXY), unpackUnorm2x16(v.posZTangent).x);\n"
+            << "\t\tnormal = _medeaOctDecode(unpackSnorm2x16(v.normal));\n"
+            << "\t\treturn;\n"
+            << "\t}\n"
+            << "\t_medeaGetPosNormal(entity, pos, normal);\n"
+            << "}\n\n";
+
+        out << "vec4 _medeaLoadTangent(RenderEntity entity, vec3 normal) {\n"
+            << "\tuint t = 0u;\n"
+            << "\tif (entity.vertexFormat == "<<QUANTIZED<<"u) t = _MedeaQuantizedPositions(entity.positionStreamAddress).data[gl_VertexIndex].posZTangent >> 16;\n"
+            << "\tvec3 b1; vec3 b2; _medeaTangentBasis(normal, b1, b2);\n"
+            << "\tfloat angle = float(t % "<<QuantizedTangentBits::angleSteps<<"u) * "
+                <<"(6.28318530718 / "<<QuantizedTangentBits::angleSteps<<".0);\n"
+            << "\treturn vec4(cos(angle) * b1 + sin(angle) * b2, (t & "<<QuantizedTangentBits::bitangentSign<<"u) != 0u ? -1.0 : 1.0);\n"
+            << "}\n\n";
+    }
+
+    /// the vertex shader minus its declarations and the shared builtins: vertex builtins, materials, and the entry point (named mainName)
+    /// @param defaultCase runs for materials not in arr (nothing if empty)
+    inline void vmaterialVtxStage(std::stringstream& out, std::span<VMaterialVertex> arr, std::string_view mainName, std::string_view mainEpilogue,
+                                  std::string_view defaultCase = "") {
         std::string vertBuiltins = readFile("./shader/shared/builtins-vert.slib").value();
 
         out << vertBuiltins << "\n";
 
+        vertexDecodeGLSL(out);
+
         for (auto& vmfrag : arr) {
             out << vmfrag.src;
         }
 
 
-        out << "\n\nvoid main() {\n"
+        out << "\n\nvoid "<<mainName<<"() {\n"
             <<"\tRenderEntity entity = _getRenderEntity();\n"
             <<"\tmat4 model = _medeaEntityToModel(entity);\n"
             <<"\tmat4 view = _medeaGetView();\n"
             <<"\tmat4 proj = _medeaGetProj();\n"
-            <<"\tvec3 pos; vec3 normal; _medeaGetPosNormal(entity, pos, normal);"
-            <<"\tswitch (entity.materialID) {\n";
+            <<"\tvec3 pos; vec3 normal; _medeaLoadPosNormal(entity, pos, normal);"
+            <<"\tswitch (_medeaMaterial(entity.materialID)) {\n";
 
         for (auto& vmfrag : arr) {
             out << "\t\tcase "<<vmfrag.materialID<<":\n"
@@ -488,10 +550,422 @@ namespace Medea::Internal {
                     <<vmfrag.uArrayName<<"(entity.materialUniformArrayAddress).data[entity.materialUniformIdx]);\n"
                 << "\t\tbreak;\n";
         } 
+
+        if (!defaultCase.empty()) {
+            out << "\t\tdefault:\n"
+                << defaultCase
+                << "\t\tbreak;\n";
+        }
+
         out << "\t}\n";
+
+        out << mainEpilogue;
         
         out << "\t_fragInstanceIndex = gl_InstanceIndex;\n}\n";
+    }
+
+    /// the vertex shader minus its declarations: builtins, materials, and the entry point (named mainName)
+    inline void vmaterialVtxBody(std::stringstream& out, std::span<VMaterialVertex> arr, std::string_view mainName, std::string_view mainEpilogue,
+                                 std::string_view defaultCase = "") {
+        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+
+        out << globalBuiltins << "\n";
+
+        vmaterialVtxStage(out, arr, mainName, mainEpilogue, defaultCase);
+    }
+
+    ///WARN: this is fragile & highly specialized to my use case & could be coded to be more reusable
+    /// @param mainEpilogue appended to main(), after the material's entry point ran; entity, model, view, proj, pos and normal are in scope
+    /// @param defaultCase see vmaterialVtxStage
+    template<typename V2F>
+    std::string vmaterialSrcVtx(std::span<VMaterialVertex> arr, std::string_view bonusSrc, std::string_view mainEpilogue = "",
+                                std::string_view defaultCase = "") {
+        std::stringstream out;
+
+        vmaterialHeader(out);
+
+        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
+
+        writeShaderVertexIO<V2F>()(out, "out");
+        writeShaderVertexIO<IntrinsicV2F>()(out, "out", TotalElements<V2F>::value);
+
+        vmaterialVtxBody(out, arr, "main", mainEpilogue, defaultCase);
 
         return out.str();
     }
+
+    #pragma region MeshPath
+
+    /// The mesh path runs the vertex path's code unchanged, once per meshlet vertex: vertex stage builtins become globals the mesh shader
+    ///  sets up (and reads back) around each call
+    inline std::string meshEmulateVertexStage(std::string src) {
+        static const std::pair<std::regex, std::string> BUILTINS[] = {
+            {std::regex("\\bgl_Position\\b"), "_medeaPosition"},
+            {std::regex("\\bgl_VertexIndex\\b"), "_medeaVertexIndex"},
+            {std::regex("\\bgl_InstanceIndex\\b"), "_medeaInstanceIndex"},
+            {std::regex("\\bgl_BaseInstance\\b"), "_medeaInstanceIndex"},     //<- one instance per draw, so the same thing
+            {std::regex("\\bgl_DrawID\\b"), "_medeaDrawID"},
+            {std::regex("\\bgl_ClipDistance\\b"), "_medeaClipDistance"},      //<- declared by whoever uses it, with its size
+        };
+
+        for (auto& [find, replace] : BUILTINS) src = std::regex_replace(src, find, replace);
+
+        return src;
+    }
+
+    /// what meshEmulateVertexStage's code reads and writes instead of the vertex stage builtins
+    inline void vertexStageGlobals(std::stringstream& out) {
+        out << "vec4 _medeaPosition;\n"
+            << "int _medeaVertexIndex;\n"
+            << "int _medeaInstanceIndex;\n"
+            << "int _medeaDrawID;\n\n";
+    }
+
+    /// header, bonus source, and everything the task and mesh shaders share
+    template<typename V2F>
+    void vmaterialMeshPreamble(std::stringstream& out, std::string_view bonusSrc) {
+        vmaterialHeader(out);
+
+        out << "#extension GL_EXT_mesh_shader : require\n\n";
+
+        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
+
+        //vertex outputs as globals (the mesh shader copies them out per vertex; the task shader never reads them)
+        std::stringstream outputs;
+
+        writeShaderVertexIO<V2F>()(outputs, "out");
+        writeShaderVertexIO<IntrinsicV2F>()(outputs, "out", TotalElements<V2F>::value);
+
+        out << std::regex_replace(outputs.str(), std::regex("layout \\(location = \\d+\\) out "), "");
+
+        vertexStageGlobals(out);
+
+        //Meshlet, and MeshletData::pack()'s layout
+        out << "struct _MedeaMeshlet { vec4 sphere; vec4 cone; uint vertexOffset; uint triangleOffset; uint vertexCount; uint triangleCount; };\n"
+            << "layout (buffer_reference, std430) readonly buffer _MedeaMeshlets { _MedeaMeshlet data[]; };\n"
+            << "layout (buffer_reference, std430) readonly buffer _MedeaMeshletData { uint data[]; };\n\n";
+
+        //the task shader's surviving meshlets of one entity (its draw list slot)
+        out << "struct _MedeaMeshletPayload { uint entitySlot; uint meshlets["<<MeshletLimits::perTaskGroup<<"]; };\n"
+            << "taskPayloadSharedEXT _MedeaMeshletPayload _medeaPayload;\n\n";
+    }
+
+    /// @param taskSrc the culling: main(), after the shared builtins (incl. the vertex ones, emulated) so it can use _getRenderEntity() etc.
+    ///  Has to fill _medeaPayload and emit the mesh tasks
+    template<typename V2F>
+    std::string vmaterialSrcTask(std::string_view bonusSrc, std::string_view taskSrc) {
+        std::stringstream out;
+
+        vmaterialMeshPreamble<V2F>(out, bonusSrc);
+
+        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+        std::string vertBuiltins = readFile("./shader/shared/builtins-vert.slib").value();
+
+        out << globalBuiltins << "\n" << meshEmulateVertexStage(vertBuiltins) << "\n";
+
+        out << taskSrc;
+
+        return out.str();
+    }
+
+    /// Mesh shader counterpart of vmaterialSrcVtx: one workgroup per meshlet the task shader kept, one invocation per meshlet vertex running
+    ///  the vertex path's main() (same materials, same epilogue), then copying its outputs into the per-vertex arrays
+    /// @param vertexEpilogue runs per output vertex after its outputs are copied; _medeaOutVertex is its index
+    template<typename V2F>
+    std::string vmaterialSrcMesh(std::span<VMaterialVertex> arr, std::string_view bonusSrc, std::string_view mainEpilogue = "",
+                                 std::string_view vertexEpilogue = "") {
+        std::stringstream out;
+
+        vmaterialMeshPreamble<V2F>(out, bonusSrc);
+
+        out << "layout (local_size_x = "<<MeshletLimits::maxVertices<<", local_size_y = 1, local_size_z = 1) in;\n"
+            << "layout (triangles, max_vertices = "<<MeshletLimits::maxVertices<<", max_primitives = "<<MeshletLimits::maxTriangles<<") out;\n\n";
+
+        std::stringstream outputs;
+
+        writeShaderVertexIO<V2F>()(outputs, "out");
+        writeShaderVertexIO<IntrinsicV2F>()(outputs, "out", TotalElements<V2F>::value);
+
+        const std::string outputStr = outputs.str();
+        const std::regex OUTPUT("layout \\(location = (\\d+)\\) out (\\w+) (\\w+);");
+
+        std::stringstream copies;
+
+        for (auto it = std::sregex_iterator(outputStr.begin(), outputStr.end(), OUTPUT); it != std::sregex_iterator(); it++) {
+            const std::smatch& m = *it;
+
+            out << "layout (location = "<<m[1]<<") out "<<m[2]<<" _medeaOut_"<<m[3]<<"[];\n";
+            copies << "\t\t_medeaOut_"<<m[3]<<"[_medeaOutVertex] = "<<m[3]<<";\n";
+        }
+
+        out << "\n";
+
+        std::stringstream body;
+
+        vmaterialVtxBody(body, arr, "_medeaVertexMain", mainEpilogue);
+
+        out << meshEmulateVertexStage(body.str());
+
+        out << "\n\nvoid main() {\n"
+            << "\t_medeaInstanceIndex = int(_medeaPayload.entitySlot);\n"
+            << "\t_medeaDrawID = int(_medeaPayload.entitySlot);\n"
+            << "\tRenderEntity _entity = _getRenderEntity();\n"
+            << "\t_MedeaMeshletData _data = _MedeaMeshletData(_entity.meshletAddress);\n"
+            << "\t_MedeaMeshlet _meshlet = _MedeaMeshlets(_entity.meshletAddress).data[_medeaPayload.meshlets[gl_WorkGroupID.x]];\n"
+            << "\tSetMeshOutputsEXT(_meshlet.vertexCount, _meshlet.triangleCount);\n"
+            << "\tuint _medeaOutVertex = gl_LocalInvocationIndex;\n"
+            << "\tif (_medeaOutVertex < _meshlet.vertexCount) {\n"
+            << "\t\t_medeaVertexIndex = int(_data.data[_meshlet.vertexOffset + _medeaOutVertex]);\n"
+            << "\t\t_medeaVertexMain();\n"
+            << "\t\tgl_MeshVerticesEXT[_medeaOutVertex].gl_Position = _medeaPosition;\n"
+            << copies.str()
+            << vertexEpilogue
+            << "\t}\n"
+            << "\tfor (uint t = gl_LocalInvocationIndex; t < _meshlet.triangleCount; t += "<<MeshletLimits::maxVertices<<") {\n"
+            << "\t\tuint p = _data.data[_meshlet.triangleOffset + t];\n"
+            << "\t\tgl_PrimitiveTriangleIndicesEXT[t] = uvec3(p & 0xFF, (p >> 8) & 0xFF, (p >> 16) & 0xFF);\n"
+            << "\t}\n"
+            << "}\n";
+
+        return out.str();
+    }
+
+    #pragma endregion MeshPath
+
+    #pragma region VisibilityBuffer
+
+    /// Visibility buffer encoding (VisibilityBuffer in scene.h): x is the draw list slot, y the triangle index in its draw in the low 24 bits
+    ///  and the material bin (draw list * material count + materialID) in the high 8. All ones where nothing was drawn
+    namespace VisibilityBits {
+        constexpr uint32_t primitiveBits = 24;
+        constexpr uint32_t maxBins = 255;   //<- bin 255 would collide with "nothing drawn"
+    }
+
+    /// functions, structs, buffer blocks and constants src defines at global scope (or near enough; this is a regex, not a parser)
+    inline std::set<std::string> glslDefinitions(const std::string& src) {
+        static const std::regex DEFINITIONS[] = {
+            std::regex("\\b\\w+\\s+(\\w+)\\s*\\([^;{}]*\\)\\s*\\{"),      //<- return type, name, parameters, body
+            std::regex("\\b(?:struct|buffer|uniform)\\s+(\\w+)\\s*\\{"),
+            std::regex("\\bconst\\s+\\w+\\s+(\\w+)\\s*="),
+        };
+
+        static const std::set<std::string> KEYWORDS = {"if", "for", "while", "switch", "return", "else"};
+
+        std::set<std::string> out;
+
+        for (auto& def : DEFINITIONS) {
+            for (auto it = std::sregex_iterator(src.begin(), src.end(), def); it != std::sregex_iterator(); it++) {
+                std::string name = (*it)[1];
+
+                if (!KEYWORDS.contains(name)) out.insert(name);
+            }
+        }
+
+        return out;
+    }
+
+    /// renames whatever src defines that other defines too, so both can go in one shader; e.g. a material's vertex and fragment halves both
+    ///  have its uniform struct and an entry point named after it
+    inline std::string prefixSharedDefinitions(std::string src, const std::string& other, std::string_view prefix) {
+        std::set<std::string> theirs = glslDefinitions(other);
+
+        for (auto& name : glslDefinitions(src)) {
+            if (!theirs.contains(name)) continue;
+
+            src = std::regex_replace(src, std::regex("\\b" + name + "\\b"), std::string(prefix) + name);
+        }
+
+        return src;
+    }
+
+    /// Geometry pass fragment shader: no materials, just which triangle of which draw list entry covers the pixel
+    /// @param materialCount for the bin; the draw list's index comes in through the push constants' drawcallIdx
+    template<typename V2F>
+    std::string vmaterialSrcVisibility(std::string_view bonusSrc, uint32_t materialCount) {
+        std::stringstream out;
+
+        vmaterialHeader(out);
+
+        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
+
+        //builtins may refer to the vertex outputs
+        writeShaderVertexIO<V2F>()(out, "in");
+        writeShaderVertexIO<IntrinsicV2F>()(out, "in", TotalElements<V2F>::value);
+
+        out << "layout (location = 0) out uvec2 medeaVisibility;\n\n";
+
+        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+        std::string fragBuiltins = readFile("./shader/shared/builtins-frag.slib").value();
+
+        out << globalBuiltins << "\n" << fragBuiltins << "\n";
+
+        out << "\n\nvoid main() {\n"
+            << "\tRenderEntity entity = _getRenderEntity();\n"
+            << "\tuint bin = _push.drawcallIdx * "<<materialCount<<" + entity.materialID;\n"
+            << "\tmedeaVisibility = uvec2(_fragInstanceIndex, uint(gl_PrimitiveID) | (bin << "<<VisibilityBits::primitiveBits<<"));\n"
+            << "}\n";
+
+        return out.str();
+    }
+
+    /// Material resolve fragment shader, drawn fullscreen once per bin: reads the visibility buffer, runs the vertex path's main() (emulated,
+    ///  like the mesh path) for the pixel's triangle's three vertices, interpolates the vertex outputs perspective correctly, then runs the
+    ///  fragment path's main() on them. Expects the visibility buffer (medeaVisibility), the viewport as v2Bind sets it
+    ///  (medeaVisibilityResolve.viewport) and MeshIndexPool's indices (medeaMeshIndices) in bonusSrc.
+    ///
+    /// Implicit derivatives (texture(), dFdx) only hold inside a triangle; across its edges they see another triangle's reconstruction
+    template<typename V2F, typename FOut>
+    std::string vmaterialSrcResolve(std::span<VMaterialVertex> vertexArr, std::span<VMaterialFragment> fragArr, std::string_view bonusSrc,
+                                    std::string_view vertexEpilogue = "", std::string_view fragEpilogue = "") {
+        std::stringstream out;
+
+        vmaterialHeader(out);
+
+        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
+
+        //every pixel of a bin's draw that failed the material depth test is skipped outright
+        out << "layout (early_fragment_tests) in;\n\n";
+
+        writeShaderVertexIO<FOut>()(out, "out");
+
+        //vertex outputs/fragment inputs as globals, plus each one's three corners
+        std::stringstream inputs;
+
+        writeShaderVertexIO<V2F>()(inputs, "in");
+        writeShaderVertexIO<IntrinsicV2F>()(inputs, "in", TotalElements<V2F>::value);
+
+        const std::string inputStr = inputs.str();
+        const std::regex INPUT("layout \\(location = \\d+\\) (flat )?in (\\w+) (\\w+);");
+
+        std::stringstream copies, interpolation;
+
+        for (auto it = std::sregex_iterator(inputStr.begin(), inputStr.end(), INPUT); it != std::sregex_iterator(); it++) {
+            const std::smatch& m = *it;
+            const std::string type = m[2], name = m[3];
+
+            out << type << " " << name << ";\n";
+
+            if (name == "_fragInstanceIndex") continue;
+
+            out << type << " _medeaCorner_" << name << "[3];\n";
+
+            copies << "\t\t_medeaCorner_" << name << "[_k] = " << name << ";\n";
+
+            //integers are flat; the provoking vertex is the first
+            if (type == "int" || type == "uint") interpolation << "\t" << name << " = _medeaCorner_" << name << "[0];\n";
+            else interpolation << "\t" << name << " = _b.x * _medeaCorner_" << name << "[0] + _b.y * _medeaCorner_" << name << "[1] + _b.z * _medeaCorner_" << name << "[2];\n";
+        }
+
+        out << "\n";
+
+        vertexStageGlobals(out);
+
+        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+
+        out << globalBuiltins << "\n";
+
+        std::stringstream vertexStage, fragStage;
+
+        vmaterialVtxStage(vertexStage, vertexArr, "_medeaVertexMain", vertexEpilogue);
+        vmaterialFragStage(fragStage, fragArr, "_medeaFragmentMain", fragEpilogue);
+
+        //the fragment half keeps its names, so _getRenderEntity() etc. below are the fragment stage's
+        out << prefixSharedDefinitions(meshEmulateVertexStage(vertexStage.str()), fragStage.str(), "_medeaVtx_") << "\n";
+        out << fragStage.str() << "\n";
+
+        //screen space barycentrics of the projected triangle, then weighted by 1/w
+        out << "vec3 _medeaBarycentrics(vec4 c0, vec4 c1, vec4 c2, vec2 ndc) {\n"
+            << "\tvec3 invW = 1.0 / vec3(c0.w, c1.w, c2.w);\n"
+            << "\tvec2 p0 = c0.xy * invW.x, e1 = c1.xy * invW.y - p0, e2 = c2.xy * invW.z - p0, d = ndc - p0;\n"
+            << "\tfloat den = e1.x * e2.y - e2.x * e1.y;\n"
+            << "\tfloat b1 = (d.x * e2.y - e2.x * d.y) / den;\n"
+            << "\tfloat b2 = (e1.x * d.y - d.x * e1.y) / den;\n"
+            << "\tvec3 b = vec3(1.0 - b1 - b2, b1, b2) * invW;\n"
+            << "\treturn b / (b.x + b.y + b.z);\n"
+            << "}\n";
+
+        out << "\n\nvoid main() {\n"
+            << "\tuvec2 _vis = texelFetch(medeaVisibility, ivec2(gl_FragCoord.xy), 0).xy;\n"
+            << "\tuint _prim = _vis.y & "<<((1u << VisibilityBits::primitiveBits) - 1)<<"u;\n"
+            << "\t_medeaInstanceIndex = int(_vis.x);\n"
+            << "\t_medeaDrawID = int(_vis.x);\n"
+            << "\t_fragInstanceIndex = _vis.x;\n"
+            << "\tRenderEntity _entity = _getRenderEntity();\n"
+            << "\tvec4 _clip[3];\n"
+            << "\tfor (int _k = 0; _k < 3; _k++) {\n"
+            << "\t\t_medeaVertexIndex = _entity.vertexOffset + int(medeaMeshIndices.data[_entity.firstIndex + 3 * _prim + uint(_k)]);\n"
+            << "\t\t_medeaVertexMain();\n"
+            << "\t\t_clip[_k] = _medeaPosition;\n"
+            << copies.str()
+            << "\t}\n"
+            << "\tvec2 _ndc = (gl_FragCoord.xy - medeaVisibilityResolve.viewport.xy) / medeaVisibilityResolve.viewport.zw * 2.0 - 1.0;\n"
+            << "\tvec3 _b = _medeaBarycentrics(_clip[0], _clip[1], _clip[2], _ndc);\n"
+            << interpolation.str()
+            << "\t_fragInstanceIndex = _vis.x;\n"
+            << "\t_medeaFragmentMain();\n"
+            << "}\n";
+
+        return out.str();
+    }
+
+    #pragma endregion VisibilityBuffer
+
+    #pragma region DepthOnly
+
+    /// GSGBindlessShader::DepthPipeline: what the shadow and pre-Z passes draw with. Its vertex shader is vmaterialSrcVtx with only the
+    ///  materials whose vertex code has to run, and depthOnlyPosition for the rest
+    namespace DepthOnly {
+        constexpr float alphaCutoff = 0.5f;     //<- DepthMode::alphaTest: fragments with a lower fragColor.a are discarded
+
+        /// what DepthMode::position materials are expected to compute; the main pass tests pre-Z's depth for equality, so it has to
+        ///  come out bit for bit the same (gl_Position is invariant in both)
+        inline const std::string position = "\t\tgl_Position = proj * view * (model * vec4(pos, 1.0));\n";
+    }
+
+    /// Fragment shader for the depth-only passes, if any material is alpha tested: runs those materials' fragment code and discards
+    ///  below DepthOnly::alphaCutoff. Everything else writes depth as is
+    template<typename V2F, typename FOut>
+    std::string vmaterialSrcDepthFrag(std::span<VMaterialFragment> alphaTested, std::string_view bonusSrc) {
+        std::stringstream out;
+
+        vmaterialHeader(out);
+
+        out << "// === bonus src begin \n"<<bonusSrc<<"//bonus src end\n";
+
+        writeShaderVertexIO<V2F>()(out, "in");
+        writeShaderVertexIO<IntrinsicV2F>()(out, "in", TotalElements<V2F>::value);
+        writeShaderVertexIO<FOut>()(out, "out");
+
+        std::string globalBuiltins = readFile("./shader/shared/builtins.slib").value();
+        std::string fragBuiltins = readFile("./shader/shared/builtins-frag.slib").value();
+
+        out << globalBuiltins << "\n" << fragBuiltins << "\n";
+
+        for (auto& vmfrag : alphaTested) {
+            out << vmfrag.src;
+        }
+
+        out << "\n\nvoid main() {\n"
+            <<"\tRenderEntity entity = _getRenderEntity();\n"
+            <<"\tmat4 model = _medeaEntityToModel(entity);\n"
+            <<"\tmat4 view = _medeaGetView();\n"
+            <<"\tmat4 proj = _medeaGetProj();\n"
+            << "\tswitch (_medeaMaterial(entity.materialID)) {\n";
+
+        for (auto& vmfrag : alphaTested) {
+            out << "\t\tcase "<<vmfrag.materialID<<":\n"
+                << "\t\t"<<vmfrag.entryFuncName<<"("
+                    <<"model, view, proj,"
+                    <<vmfrag.uArrayName<<"(entity.materialUniformArrayAddress).data[entity.materialUniformIdx]);\n"
+                << "\t\tif (fragColor.a < "<<DepthOnly::alphaCutoff<<") discard;\n"
+                << "\t\tbreak;\n";
+        }
+
+        out << "\t}\n"
+            << "}\n";
+
+        return out.str();
+    }
+
+    #pragma endregion DepthOnly
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "cull.h"
 
 #include "constants.h"
+#include "cpuprofiler.h"
 
 #include <sstream>
 #include <iomanip>
@@ -73,43 +74,54 @@ namespace Medea {
         return Vec3(in.x, in.y, std::min(Z_HIGH, in.z));
     }
 
-    LightPriority Spotlight::getPriority(const Cull::Cone& cameraCone, const glm::mat4& viewProj) const {
-        //glm::mat4 lightProjToCamView = context.view * glm::inverse(getViewProj());
-        //glm::mat4 camProjToView = glm::inverse(context.projection);
-        //glm::mat4 lightProjToCamProj = context.projection * lightProjToCamView;
+    std::array<Vec3, Spotlight::SCREEN_POINTS> Spotlight::getScreenPoints() const {
+        Quaternion dir = offset.dir * pos.dir;
 
-        if (!Cull::testConeVsSphere(cameraCone, sphereCollider)) return {-1.0, 0};
+        Vec3 fwd   = dir.rotate(Vec3(0,0,-1));
+        Vec3 up    = dir.rotate(Vec3(1,0,0));
+        Vec3 right = dir.rotate(Vec3(0,1,0));
 
-        AABB3 screenBounds(perspectiveDivide(viewProj * clampZHigh(pos.pos).toGlmVec4Pos()));
+        double sideLen = sin(fov / 2.0) * this->depth;
 
-        Quaternion dir = offset.dir * pos.dir;
+        auto farCorner = [&] (int i) {
+            Vec2 mask(i & 1 ? 1 : -1, i & 2 ? 1 : -1);
 
-        {
-            AABB3 screenClip(Vec3(-1, -1, 0), Vec3(1));
+            Vec3 curOff = up * mask.x * sideLen + right * mask.y * sideLen + fwd * this->depth;
 
+            return clampZHigh(pos.pos + offset.pos + curOff);
+        };
 
-            Vec3 fwd   = dir.rotate(Vec3(0,0,-1));
-            Vec3 up    = dir.rotate(Vec3(1,0,0));
-            Vec3 right = dir.rotate(Vec3(0,1,0));
+        return {clampZHigh(pos.pos), farCorner(0), farCorner(1), farCorner(2), farCorner(3)};
+    }
 
-            double sideLen = sin(fov / 2.0) * this->depth;
+    //NDC, with the depth range the priority heuristic has always used
+    static AABB3 screenClipBounds() {
+        return AABB3(Vec3(-1, -1, 0), Vec3(1));
+    }
 
-            for (int i=0; i<4; i++) {
-                Vec2 mask(i & 1 ? 1 : -1, i & 2 ? 1 : -1);
+    LightPriority Spotlight::getPriority(const Cull::Cone& cameraCone, const glm::mat4& viewProj) const {
+        //glm::mat4 lightProjToCamView = context.view * glm::inverse(getViewProj());
+        //glm::mat4 camProjToView = glm::inverse(context.projection);
+        //glm::mat4 lightProjToCamProj = context.projection * lightProjToCamView;
 
-                Vec3 curOff = up * mask.x * sideLen + right * mask.y * sideLen + fwd * this->depth;
+        if (!Cull::testConeVsSphere(cameraCone, sphereCollider)) return {-1.0, 0};
 
-                Vec3 farPos = perspectiveDivide(viewProj * clampZHigh(pos.pos + offset.pos + curOff).toGlmVec4Pos());
+        auto points = getScreenPoints();
 
-                screenBounds.add(farPos);
-            }
-            
-            if (!screenClip.overlap(screenBounds)) return {-1.0, 0};
-        }
+        AABB3 screenBounds(perspectiveDivide(viewProj * points[0].toGlmVec4Pos()));
+
+        for (size_t i=1; i<SCREEN_POINTS; i++) screenBounds.add(perspectiveDivide(viewProj * points[i].toGlmVec4Pos()));
+
+        AABB3 screenClip = screenClipBounds();
+
+        if (!screenClip.overlap(screenBounds)) return {-1.0, 0};
 
         //if (!Cull::frustrumInFrustrum(lightProjToCamProj, glm::translate(glm::mat4(1), glm::vec3(0,0,1)))) return {-1.0, 0};
 
-        
+        return priorityFromScreenBounds(screenBounds);
+    }
+
+    LightPriority Spotlight::priorityFromScreenBounds(AABB3 screenBounds) const {
         //initial heuristic: screenspace as proj space xy AABB span
 
         screenBounds.lo = (screenBounds.lo / 2.0 + Vec3(0.5)).piecewiseClamp(Vec3(0.), Vec3(1.));
@@ -191,6 +203,31 @@ namespace Medea {
 
     void Spotlight::filterLights(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const CameraRenderContext& context, 
                 const Cull::Cone& cameraCone, Coord shadowAtlasBlockRes) {
+        std::vector<uint32_t> all(inLights.size());
+
+        for (uint32_t i=0; i<all.size(); i++) all[i] = i;
+
+        filterCandidates(out, inLights, all, context, cameraCone, shadowAtlasBlockRes);
+    }
+
+    void Spotlight::filterLights(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const LightIndex& index,
+                const CameraRenderContext& context, const Cull::Cone& cameraCone, Coord shadowAtlasBlockRes) {
+        assert(index.size() == inLights.size());
+
+        std::vector<uint32_t> candidates;
+
+        {
+            MEDEA_PROFILE_ZONE("lightIndexQuery");
+
+            index.query(cameraCone, candidates);
+        }
+
+        filterCandidates(out, inLights, candidates, context, cameraCone, shadowAtlasBlockRes);
+    }
+
+    void Spotlight::filterCandidates(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const std::vector<uint32_t>& candidates,
+                const CameraRenderContext& context, const Cull::Cone& cameraCone, Coord shadowAtlasBlockRes) {
+        MEDEA_PROFILE_ZONE("Spotlight::filterLights");
 
         assert(inLights.size() > 0);
 
@@ -201,7 +238,8 @@ namespace Medea {
             return a.first.desiredAtlasRes > b.first.desiredAtlasRes;
         };
 
-        std::vector<std::pair<LightPriority, Spotlight>> cameraCulledLights;
+        //(priority, index into inLights); no light copies until the LightDefs are written
+        std::vector<std::pair<LightPriority, uint32_t>> cameraCulledLights;
 
         glm::mat4 viewProj = context.projection * context.view;
 
@@ -209,27 +247,64 @@ namespace Medea {
 
         //Cull::Cone cameraCone()
 
-        //cull for LOS
-        for (const auto& l : inLights) {
-            LightPriority p = l.getPriority(cameraCone, viewProj);
+        //cull for LOS: getPriority's tests, batched over every candidate (see Cull::testConeVsSpheres), plus a frustum test on the collider
+        {
+            MEDEA_PROFILE_ZONE("cameraCull");
+
+            const size_t n = candidates.size();
+
+            Cull::SphereBatch colliders;
+            std::vector<Cull::PointBatch> screenPoints(SCREEN_POINTS);
+
+            colliders.reserve(n);
+            for (auto& p : screenPoints) p.reserve(n);
+
+            for (uint32_t idx : candidates) {
+                const Spotlight& l = inLights.at(idx);
+
+                colliders.push_back(l.sphereCollider);
+
+                auto points = l.getScreenPoints();
 
-            if (p.priority < 0.0) continue;
+                for (size_t k=0; k<SCREEN_POINTS; k++) screenPoints[k].push_back(points[k]);
+            }
+
+            std::vector<uint8_t> inCone(n), inFrustum(n);
+            Cull::BoundsBatch screenBounds;
+
+            Cull::testConeVsSpheres(cameraCone, colliders, inCone.data());
+            Cull::testFrustumVsSpheres(viewProj, colliders, inFrustum.data());
+            Cull::projectBounds(viewProj, screenPoints, screenBounds);
+
+            AABB3 screenClip = screenClipBounds();
+
+            for (size_t i=0; i<n; i++) {
+                if (!inCone[i] || !inFrustum[i]) continue;
+
+                AABB3 bounds = screenBounds.at(i);
+
+                if (!screenClip.overlap(bounds)) continue;
 
-            assert(p.desiredAtlasRes >= 1);
+                LightPriority p = inLights[candidates[i]].priorityFromScreenBounds(bounds);
 
-            cameraCulledLights.push_back({p, l});
+                assert(p.desiredAtlasRes >= 1);
+
+                cameraCulledLights.push_back({p, candidates[i]});
+            }
         }
 
-        if (cameraCulledLights.size() == 0) cameraCulledLights.push_back(std::pair<LightPriority, Spotlight>({1, 1}, inLights.at(0)));
-        
-        std::cout<<"CPU cull: "<<inLights.size()<<" -> "<<cameraCulledLights.size()<<std::endl;
+        if (cameraCulledLights.size() == 0) cameraCulledLights.push_back(std::pair<LightPriority, uint32_t>({1, 1}, 0));
 
-        std::sort(cameraCulledLights.begin(), cameraCulledLights.end(), priorityCompare);
+        {
+            MEDEA_PROFILE_ZONE("prioritySort");
+
+            std::sort(cameraCulledLights.begin(), cameraCulledLights.end(), priorityCompare);
+        }
 
 
         //make sure lights can fit on the atlas (just culling lowest prio lights for now)
         //TODO: dynamically lower resolution to make them best fit w/o dropping lights?
-        std::vector<std::pair<LightPriority, Spotlight>> priorityCulledLights;
+        std::vector<std::pair<LightPriority, uint32_t>> priorityCulledLights;
 
         const uint MAX_RES = shadowAtlasBlockRes.x * shadowAtlasBlockRes.y;
 
@@ -253,12 +328,14 @@ namespace Medea {
         std::stable_sort(priorityCulledLights.begin(), priorityCulledLights.end(), resCompare);
 
         //add to out lightdef list
+        MEDEA_PROFILE_ZONE("atlasPack");
+
         out.clear();
 
         uint lightAtlasZOrderIdx = 0;
         for (auto& p : priorityCulledLights) {
             const LightPriority& prio = p.first;
-            const Spotlight& light = p.second;
+            const Spotlight& light = inLights.at(p.second);
 
             uint curSize = prio.desiredAtlasRes * prio.desiredAtlasRes;
 
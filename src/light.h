@@ -4,10 +4,14 @@
 #include "3dmath.h"
 
 #include <compare>
+#include <array>
+#include <cassert>
+#include <utility>
 
 #include "context.h"
 #include "intdef.h"
 #include "cull.h"
+#include "lightindex.h"
 
 namespace Medea {
 
@@ -29,6 +33,33 @@ namespace Medea {
 
         Cull::Sphere sphereCollider;
 
+        /// set by LightIndex::add. A copy of an indexed light isn't indexed; a move hands the leaf over, so only one light ever owns it
+        struct IndexHandle {
+            LightIndex* index = nullptr;
+            int32_t leaf = 0;
+
+            IndexHandle() = default;
+            IndexHandle(const IndexHandle&) {}
+            IndexHandle(IndexHandle&& o) noexcept : index(o.index), leaf(o.leaf) {
+                o.index = nullptr;
+                o.leaf = 0;
+            }
+
+            IndexHandle& operator=(const IndexHandle&) {
+                assert(!index && "assigning over an indexed light; LightIndex::remove it first");
+                return *this;
+            }
+
+            IndexHandle& operator=(IndexHandle&& o) noexcept {
+                assert(!index && "assigning over an indexed light; LightIndex::remove it first");
+                std::swap(index, o.index);
+                std::swap(leaf, o.leaf);
+                return *this;
+            }
+        } indexHandle;
+
+        friend class LightIndex;
+
         glm::mat4 getProj() const;
 
         glm::mat4 getViewProj() const {
@@ -42,6 +73,18 @@ namespace Medea {
 
         void updateCollider();
 
+        static constexpr size_t SCREEN_POINTS = 5;
+
+        /// world space points whose projections bound the light on screen: its position, then the 4 corners of its far plane
+        std::array<Vec3, SCREEN_POINTS> getScreenPoints() const;
+
+        /// priority + atlas resolution from the NDC bounds of getScreenPoints(); assumes those overlap the screen
+        LightPriority priorityFromScreenBounds(AABB3 screenBounds) const;
+
+        /// filterLights over only the lights at candidates (indices into inLights)
+        static void filterCandidates(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const std::vector<uint32_t>& candidates,
+                                     const CameraRenderContext& context, const Cull::Cone& cameraCone, Coord shadowAtlasBlockRes);
+
         public:
         static const u32 stdMinResolution = 0;
         static const u32 stdMaxResolution = 4;
@@ -59,13 +102,23 @@ namespace Medea {
 
             pos = p;
             updateCollider();
+
+            if (indexHandle.index) indexHandle.index->update(indexHandle.leaf, sphereCollider);
         }
 
-        //gonna combine this with culling; if <0, the light should be culled from view
+        //gonna combine this with culling; if <0, the light should be culled from view. filterLights does the same thing for all lights at once
         LightPriority getPriority(const Cull::Cone& cameraCone, const glm::mat4& cameraViewProj) const;
         //const LightDef toLightDef();
 
         static void filterLights(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const CameraRenderContext& context, 
                                  const Cull::Cone& cameraPos, Coord shadowAtlasBlockRes);
+
+        /// same, but only tests the lights index returns for cameraPos; index has to have been built from inLights
+        static void filterLights(std::vector<LightDef>& out, const std::vector<Spotlight>& inLights, const LightIndex& index,
+                                 const CameraRenderContext& context, const Cull::Cone& cameraPos, Coord shadowAtlasBlockRes);
     };
+
+    /// interleaves x/y bits (x in the even bits); used to pack shadow atlas blocks
+    u64 coordToZOrder(const Coord& c);
+    Coord zOrderToCoord(u64 in);
 };
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "lightindex.h"
+
+#include "light.h"
+
+#include <iostream>
+#include <cassert>
+
+using namespace Medea;
+
+namespace {
+    glm::vec3 boxCenter(const glm::vec3& lo, const glm::vec3& hi) {
+        return (lo + hi) * 0.5f;
+    }
+
+    //half the surface area; only compared against each other
+    float boxArea(const glm::vec3& lo, const glm::vec3& hi) {
+        glm::vec3 d = hi - lo;
+
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+
+    float unionArea(const glm::vec3& loA, const glm::vec3& hiA, const glm::vec3& loB, const glm::vec3& hiB) {
+        return boxArea(glm::min(loA, loB), glm::max(hiA, hiB));
+    }
+}
+
+int32_t LightIndex::allocNode() {
+    int32_t n;
+
+    if (freeNodes.size() > 0) {
+        n = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else {
+        n = nodes.size();
+        nodes.push_back(Node());
+    }
+
+    nodes.at(n) = Node();
+
+    return n;
+}
+
+void LightIndex::freeNode(int32_t n) {
+    nodes.at(n).height = -1;
+    freeNodes.push_back(n);
+}
+
+void LightIndex::setBounds(Node& node, const Cull::Sphere& bounds) {
+    glm::vec3 c = bounds.pos.toGlmVec3();
+    float r = bounds.rad;
+
+    node.lo = c - glm::vec3(r);
+    node.hi = c + glm::vec3(r);
+}
+
+void LightIndex::add(Spotlight& light, uint32_t lightIdx) {
+    if (light.indexHandle.index) {
+        std::cerr<<"LightIndex::add: light is already indexed"<<std::endl;
+        assert(false);
+
+        light.indexHandle.index->remove(light);
+    }
+
+    int32_t leaf = allocNode();
+    Node& node = nodes.at(leaf);
+
+    setBounds(node, Cull::Sphere(light.sphereCollider.pos, light.sphereCollider.rad * (1.0 + fatMargin)));
+    node.light = lightIdx;
+
+    insertLeaf(leaf);
+    leaves++;
+
+    light.indexHandle.index = this;
+    light.indexHandle.leaf = leaf;
+}
+
+void LightIndex::remove(Spotlight& light) {
+    assert(light.indexHandle.index == this);
+
+    removeLeaf(light.indexHandle.leaf);
+    freeNode(light.indexHandle.leaf);
+    leaves--;
+
+    light.indexHandle.index = nullptr;
+    light.indexHandle.leaf = 0;
+}
+
+void LightIndex::update(int32_t leaf, const Cull::Sphere& bounds) {
+    Node& node = nodes.at(leaf);
+
+    assert(node.isLeaf() && node.height == 0);
+
+    glm::vec3 c = bounds.pos.toGlmVec3();
+    float r = bounds.rad;
+
+    //still inside its padding: nothing to do
+    if (glm::all(glm::greaterThanEqual(c - glm::vec3(r), node.lo)) && glm::all(glm::lessThanEqual(c + glm::vec3(r), node.hi))) return;
+
+    removeLeaf(leaf);
+
+    //pad in the direction it's moving too, so a light moving steadily isn't reinserted every step
+    glm::vec3 drift = c - boxCenter(node.lo, node.hi);
+
+    setBounds(node, Cull::Sphere(bounds.pos, bounds.rad * (1.0 + fatMargin)));
+
+    node.lo = glm::min(node.lo, node.lo + drift);
+    node.hi = glm::max(node.hi, node.hi + drift);
+
+    insertLeaf(leaf);
+}
+
+void LightIndex::insertLeaf(int32_t leaf) {
+    if (root == NONE) {
+        root = leaf;
+        nodes.at(root).parent = NONE;
+        return;
+    }
+
+    glm::vec3 leafLo = nodes.at(leaf).lo;
+    glm::vec3 leafHi = nodes.at(leaf).hi;
+
+    //walk down to the cheapest sibling (surface area heuristic, same costs as b2DynamicTree)
+    int32_t cur = root;
+
+    while (!nodes.at(cur).isLeaf()) {
+        const Node& n = nodes.at(cur);
+
+        float area = boxArea(n.lo, n.hi);
+        float combined = unionArea(n.lo, n.hi, leafLo, leafHi);
+
+        //cost of making a new parent for this node and the leaf, vs. the minimum cost of pushing the leaf further down
+        float cost = 2.0f * combined;
+        float inheritance = 2.0f * (combined - area);
+
+        auto childCost = [&] (int32_t c) {
+            const Node& child = nodes.at(c);
+
+            float grown = unionArea(child.lo, child.hi, leafLo, leafHi);
+
+            if (child.isLeaf()) return grown + inheritance;
+
+            return grown - boxArea(child.lo, child.hi) + inheritance;
+        };
+
+        float costL = childCost(n.left);
+        float costR = childCost(n.right);
+
+        if (cost < costL && cost < costR) break;
+
+        cur = costL < costR ? n.left : n.right;
+    }
+
+    int32_t sibling = cur;
+
+    int32_t oldParent = nodes.at(sibling).parent;
+    int32_t newParent = allocNode();
+
+    {
+        Node& p = nodes.at(newParent);
+
+        p.parent = oldParent;
+        p.lo = glm::min(leafLo, nodes.at(sibling).lo);
+        p.hi = glm::max(leafHi, nodes.at(sibling).hi);
+        p.height = nodes.at(sibling).height + 1;
+        p.left = sibling;
+        p.right = leaf;
+    }
+
+    if (oldParent != NONE) {
+        if (nodes.at(oldParent).left == sibling) nodes.at(oldParent).left = newParent;
+        else nodes.at(oldParent).right = newParent;
+    }
+    else {
+        root = newParent;
+    }
+
+    nodes.at(sibling).parent = newParent;
+    nodes.at(leaf).parent = newParent;
+
+    refit(newParent);
+}
+
+void LightIndex::removeLeaf(int32_t leaf) {
+    if (leaf == root) {
+        root = NONE;
+        return;
+    }
+
+    int32_t parent = nodes.at(leaf).parent;
+    int32_t grandParent = nodes.at(parent).parent;
+    int32_t sibling = nodes.at(parent).left == leaf ? nodes.at(parent).right : nodes.at(parent).left;
+
+    nodes.at(leaf).parent = NONE;
+
+    //the sibling takes the parent's place
+    if (grandParent != NONE) {
+        if (nodes.at(grandParent).left == parent) nodes.at(grandParent).left = sibling;
+        else nodes.at(grandParent).right = sibling;
+
+        nodes.at(sibling).parent = grandParent;
+        freeNode(parent);
+
+        refit(grandParent);
+    }
+    else {
+        root = sibling;
+        nodes.at(sibling).parent = NONE;
+        freeNode(parent);
+    }
+}
+
+void LightIndex::refit(int32_t n) {
+    while (n != NONE) {
+        n = balance(n);
+
+        Node& node = nodes.at(n);
+        const Node& l = nodes.at(node.left);
+        const Node& r = nodes.at(node.right);
+
+        node.height = 1 + std::max(l.height, r.height);
+        node.lo = glm::min(l.lo, r.lo);
+        node.hi = glm::max(l.hi, r.hi);
+
+        n = node.parent;
+    }
+}
+
+int32_t LightIndex::balance(int32_t a) {
+    Node& A = nodes.at(a);
+
+    if (A.isLeaf() || A.height < 2) return a;
+
+    int32_t b = A.left;
+    int32_t c = A.right;
+
+    int32_t diff = nodes.at(c).height - nodes.at(b).height;
+
+    if (diff > 1) {
+        //c is too tall: rotate it up, a becomes one of its children
+        int32_t f = nodes.at(c).left;
+        int32_t g = nodes.at(c).right;
+
+        Node& B = nodes.at(b);
+        Node& C = nodes.at(c);
+        Node& F = nodes.at(f);
+        Node& G = nodes.at(g);
+
+        C.left = a;
+        C.parent = A.parent;
+        A.parent = c;
+
+        if (C.parent != NONE) {
+            if (nodes.at(C.parent).left == a) nodes.at(C.parent).left = c;
+            else nodes.at(C.parent).right = c;
+        }
+        else {
+            root = c;
+        }
+
+        //keep the taller of c's children on c, hand the other to a
+        if (F.height > G.height) {
+            C.right = f;
+            A.right = g;
+            G.parent = a;
+
+            A.lo = glm::min(B.lo, G.lo);
+            A.hi = glm::max(B.hi, G.hi);
+            C.lo = glm::min(A.lo, F.lo);
+            C.hi = glm::max(A.hi, F.hi);
+
+            A.height = 1 + std::max(B.height, G.height);
+            C.height = 1 + std::max(A.height, F.height);
+        }
+        else {
+            C.right = g;
+            A.right = f;
+            F.parent = a;
+
+            A.lo = glm::min(B.lo, F.lo);
+            A.hi = glm::max(B.hi, F.hi);
+            C.lo = glm::min(A.lo, G.lo);
+            C.hi = glm::max(A.hi, G.hi);
+
+            A.height = 1 + std::max(B.height, F.height);
+            C.height = 1 + std::max(A.height, G.height);
+        }
+
+        return c;
+    }
+
+    if (diff < -1) {
+        //mirror of the above
+        int32_t d = nodes.at(b).left;
+        int32_t e = nodes.at(b).right;
+
+        Node& B = nodes.at(b);
+        Node& C = nodes.at(c);
+        Node& D = nodes.at(d);
+        Node& E = nodes.at(e);
+
+        B.left = a;
+        B.parent = A.parent;
+        A.parent = b;
+
+        if (B.parent != NONE) {
+            if (nodes.at(B.parent).left == a) nodes.at(B.parent).left = b;
+            else nodes.at(B.parent).right = b;
+        }
+        else {
+            root = b;
+        }
+
+        if (D.height > E.height) {
+            B.right = d;
+            A.left = e;
+            E.parent = a;
+
+            A.lo = glm::min(C.lo, E.lo);
+            A.hi = glm::max(C.hi, E.hi);
+            B.lo = glm::min(A.lo, D.lo);
+            B.hi = glm::max(A.hi, D.hi);
+
+            A.height = 1 + std::max(C.height, E.height);
+            B.height = 1 + std::max(A.height, D.height);
+        }
+        else {
+            B.right = e;
+            A.left = d;
+            D.parent = a;
+
+            A.lo = glm::min(C.lo, D.lo);
+            A.hi = glm::max(C.hi, D.hi);
+            B.lo = glm::min(A.lo, E.lo);
+            B.hi = glm::max(A.hi, E.hi);
+
+            A.height = 1 + std::max(C.height, D.height);
+            B.height = 1 + std::max(A.height, E.height);
+        }
+
+        return b;
+    }
+
+    return a;
+}
+
+void LightIndex::query(const Cull::Cone& cone, std::vector<uint32_t>& out) const {
+    if (root == NONE) return;
+
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    stack.push_back(root);
+
+    while (stack.size() > 0) {
+        const Node& n = nodes.at(stack.back());
+        stack.pop_back();
+
+        //the cone test only takes spheres; the box's bounding sphere is conservative
+        glm::vec3 c = boxCenter(n.lo, n.hi);
+        double rad = glm::length(n.hi - c);
+
+        if (!Cull::testConeVsSphere(cone, Cull::Sphere(Vec3(c.x, c.y, c.z), rad))) continue;
+
+        if (n.isLeaf()) {
+            out.push_back(n.light);
+            continue;
+        }
+
+        stack.push_back(n.left);
+        stack.push_back(n.right);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "cull.h"
+
+#include <vector>
+#include <cstdint>
+
+/// Dynamic AABB tree over Spotlight colliders, so Spotlight::filterLights only looks at lights near the camera cone instead of every light
+///  in the world:
+///
+///     LightIndex index;
+///     for (uint32_t i=0; i<lights.size(); i++) index.add(lights.at(i), i);
+///     ...
+///     lights.at(i).setPos(p);     //<- keeps its leaf up to date
+///     Spotlight::filterLights(out, lights, index, ctx, cameraCone, atlasBlockRes);
+///
+/// Leaves are padded ("fat"), so a light that moves a little doesn't touch the tree at all; one that leaves its padding is reinserted.
+///  Inserts keep the tree balanced with AVL style rotations, like Box2D's b2DynamicTree.
+///
+/// A Spotlight only knows its own leaf. Copies of an added light aren't indexed (their setPos doesn't touch the tree); moving one, e.g.
+///  the vector growing, hands the leaf over. remove() a light before dropping it from the vector, and don't let the index go out of scope
+///  before its lights.
+
+namespace Medea {
+
+    class Spotlight;
+
+    class LightIndex {
+        static constexpr int32_t NONE = -1;
+
+        struct Node {
+            glm::vec3 lo, hi;
+            int32_t parent = NONE;
+            int32_t left = NONE, right = NONE;     //<- NONE for leaves
+            int32_t height = 0;                     //<- leaves are 0, free nodes -1
+            uint32_t light = 0;                     //<- leaves: index into the light list
+
+            bool isLeaf() const {
+                return left == NONE;
+            }
+        };
+
+        std::vector<Node> nodes;
+        std::vector<int32_t> freeNodes;
+        int32_t root = NONE;
+        size_t leaves = 0;
+
+        int32_t allocNode();
+        void freeNode(int32_t n);
+
+        void insertLeaf(int32_t leaf);
+        void removeLeaf(int32_t leaf);
+
+        /// rotates n's taller child up if it's unbalanced; returns whichever node is now where n was
+        int32_t balance(int32_t n);
+
+        /// recompute AABBs + heights from n up to the root, rebalancing on the way
+        void refit(int32_t n);
+
+        static void setBounds(Node& node, const Cull::Sphere& bounds);
+
+        public:
+        LightIndex() = default;
+
+        //lights point back at their index
+        LightIndex(const LightIndex&) = delete;
+        LightIndex& operator=(const LightIndex&) = delete;
+
+        /// padding added around each leaf, as a fraction of the collider's radius
+        double fatMargin = 0.1;
+
+        /// @param lightIdx index of light in the list later passed to query()/filterLights
+        void add(Spotlight& light, uint32_t lightIdx);
+
+        void remove(Spotlight& light);
+
+        /// called by Spotlight::setPos
+        void update(int32_t leaf, const Cull::Sphere& bounds);
+
+        /// appends the index of every light whose (padded) collider might intersect cone. Conservative: candidates still need testing
+        void query(const Cull::Cone& cone, std::vector<uint32_t>& out) const;
+
+        size_t size() const {
+            return leaves;
+        }
+
+        /// root height, for stats
+        int32_t getHeight() const {
+            return root == NONE ? 0 : nodes.at(root).height;
+        }
+    };
+}
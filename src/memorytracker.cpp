@@ -0,0 +1,337 @@
+#include "memorytracker.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace Medea;
+
+const char* Medea::memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::general:       return "general";
+        case MemoryCategory::meshes:        return "meshes";
+        case MemoryCategory::textures:      return "textures";
+        case MemoryCategory::shadows:       return "shadows";
+        case MemoryCategory::volumetrics:   return "volumetrics";
+        case MemoryCategory::transients:    return "transients";
+        default:                            return "unknown";
+    }
+}
+
+namespace {
+    MemoryCategory categoryOf(const VmaAllocationInfo& info) {
+        uintptr_t raw = reinterpret_cast<uintptr_t>(info.pUserData);
+
+        if (raw >= (uintptr_t) MemoryCategory::COUNT) return MemoryCategory::general;
+
+        return (MemoryCategory) raw;
+    }
+
+    double toMiB(uint64_t bytes) {
+        return double(bytes) / double(1 << 20);
+    }
+}
+
+MemoryTracker& MemoryTracker::get() {
+    static MemoryTracker tracker;
+
+    return tracker;
+}
+
+void MemoryTracker::attach(VmaAllocator alloc, bool hasMemoryBudgetExt) {
+    std::lock_guard lock(mutex);
+
+    if (allocator != VK_NULL_HANDLE && allocator != alloc) std::cerr<<"WARN: MemoryTracker only tracks budgets for one allocator; replacing the previous one"<<std::endl;
+
+    VmaAllocatorInfo info;
+    vmaGetAllocatorInfo(alloc, &info);
+
+    allocator = alloc;
+    device = info.device;
+    budgetExt = hasMemoryBudgetExt;
+    heapWarned = {};
+    frame = 0;
+
+    if (!budgetExt) std::cerr<<"WARN: VK_EXT_memory_budget unavailable; heap budgets are estimates"<<std::endl;
+}
+
+void MemoryTracker::detach(VmaAllocator alloc) {
+    std::lock_guard lock(mutex);
+
+    if (allocator != alloc) return;
+
+    allocator = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+}
+
+void MemoryTracker::checkBudget(VmaAllocator alloc, uint32_t memoryTypeIndex, VkDeviceSize size) {
+    //held throughout, so attach/detach can't swap the allocator out from under the budget query
+    std::lock_guard lock(mutex);
+
+    if (alloc != allocator) return;
+
+    const VkPhysicalDeviceMemoryProperties* props;
+    vmaGetMemoryProperties(allocator, &props);
+
+    uint32_t heap = props->memoryTypes[memoryTypeIndex].heapIndex;
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+
+    uint64_t projected = budgets[heap].usage + size;
+    uint64_t limit = uint64_t(double(budgets[heap].budget) * warnThreshold);
+
+    //only warn when crossing the threshold, not on every allocation past it
+    if (projected <= limit) {
+        heapWarned[heap] = false;
+        return;
+    }
+
+    if (heapWarned[heap]) return;
+
+    heapWarned[heap] = true;
+
+    std::cerr<<"WARN: allocating "<<std::fixed<<std::setprecision(1)<<toMiB(size)<<" MiB ("<<memoryCategoryName(Internal::currentMemoryCategory())
+             <<") brings heap "<<heap<<" to "<<toMiB(projected)<<" / "<<toMiB(budgets[heap].budget)<<" MiB budget"<<std::endl;
+}
+
+void MemoryTracker::checkBufferBudget(VmaAllocator alloc, const VkBufferCreateInfo& bci, const VmaAllocationCreateInfo& aci) {
+    if (bci.size < budgetCheckMinBytes) return;
+
+    {
+        std::lock_guard lock(mutex);
+
+        if (alloc != allocator) return;
+    }
+
+    uint32_t typeIdx;
+
+    if (vmaFindMemoryTypeIndexForBufferInfo(alloc, &bci, &aci, &typeIdx) != VK_SUCCESS) return;
+
+    checkBudget(alloc, typeIdx, bci.size);
+}
+
+void MemoryTracker::checkImageBudget(VmaAllocator alloc, const VkImageCreateInfo& ici, const VmaAllocationCreateInfo& aci) {
+    VkDevice dev;
+
+    {
+        std::lock_guard lock(mutex);
+
+        if (alloc != allocator) return;
+
+        dev = device;
+    }
+
+    VkDeviceImageMemoryRequirements reqInfo = {};
+    reqInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+    reqInfo.pCreateInfo = &ici;
+
+    VkMemoryRequirements2 reqs = {};
+    reqs.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+
+    vkGetDeviceImageMemoryRequirements(dev, &reqInfo, &reqs);
+
+    uint32_t typeIdx;
+
+    if (vmaFindMemoryTypeIndex(alloc, reqs.memoryRequirements.memoryTypeBits, &aci, &typeIdx) != VK_SUCCESS) return;
+
+    checkBudget(alloc, typeIdx, reqs.memoryRequirements.size);
+}
+
+void MemoryTracker::onAllocate(VmaAllocator alloc, VmaAllocation allocation) {
+    if (allocation == VK_NULL_HANDLE) return;
+
+    MemoryCategory category = Internal::currentMemoryCategory();
+
+    vmaSetAllocationUserData(alloc, allocation, reinterpret_cast<void*>(uintptr_t(category)));
+    vmaSetAllocationName(alloc, allocation, memoryCategoryName(category));
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(alloc, allocation, &info);
+
+    Counters& c = counters.at((size_t) category);
+
+    c.bytes.fetch_add(info.size, std::memory_order_relaxed);
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryTracker::onFree(VmaAllocator alloc, VmaAllocation allocation) {
+    if (allocation == VK_NULL_HANDLE) return;
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(alloc, allocation, &info);
+
+    Counters& c = counters.at((size_t) categoryOf(info));
+
+    c.bytes.fetch_sub(info.size, std::memory_order_relaxed);
+    c.allocations.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MemoryTracker::setCategory(VmaAllocator alloc, VmaAllocation allocation, MemoryCategory category) {
+    if (allocation == VK_NULL_HANDLE) return;
+
+    VmaAllocationInfo info;
+    vmaGetAllocationInfo(alloc, allocation, &info);
+
+    MemoryCategory old = categoryOf(info);
+
+    if (old == category) return;
+
+    counters.at((size_t) old).bytes.fetch_sub(info.size, std::memory_order_relaxed);
+    counters.at((size_t) old).allocations.fetch_sub(1, std::memory_order_relaxed);
+
+    counters.at((size_t) category).bytes.fetch_add(info.size, std::memory_order_relaxed);
+    counters.at((size_t) category).allocations.fetch_add(1, std::memory_order_relaxed);
+
+    vmaSetAllocationUserData(alloc, allocation, reinterpret_cast<void*>(uintptr_t(category)));
+    vmaSetAllocationName(alloc, allocation, memoryCategoryName(category));
+}
+
+void MemoryTracker::newFrame() {
+    bool dumpDue;
+    std::string path;
+
+    {
+        std::lock_guard lock(mutex);
+
+        if (allocator == VK_NULL_HANDLE) return;
+
+        frame++;
+
+        //with VK_EXT_memory_budget, this is what makes VMA re-query the driver's budget
+        vmaSetCurrentFrameIndex(allocator, frame);
+
+        dumpDue = dumpPeriod > 0 && frame % dumpPeriod == 0;
+        path = dumpPath;
+    }
+
+    if (dumpDue) writeJSON(path);
+}
+
+void MemoryTracker::setPeriodicDump(uint32_t everyNFrames, std::string_view path) {
+    std::lock_guard lock(mutex);
+
+    dumpPeriod = everyNFrames;
+    dumpPath = std::string(path);
+}
+
+std::vector<MemoryCategoryUsage> MemoryTracker::getCategoryUsage() const {
+    std::vector<MemoryCategoryUsage> out;
+
+    for (size_t i=0; i<counters.size(); i++) {
+        out.push_back(MemoryCategoryUsage{(MemoryCategory) i, counters[i].bytes.load(std::memory_order_relaxed), counters[i].allocations.load(std::memory_order_relaxed)});
+    }
+
+    return out;
+}
+
+std::vector<MemoryHeapBudget> MemoryTracker::getHeapBudgets() {
+    std::lock_guard lock(mutex);
+
+    std::vector<MemoryHeapBudget> out;
+
+    if (allocator == VK_NULL_HANDLE) return out;
+
+    const VkPhysicalDeviceMemoryProperties* props;
+    vmaGetMemoryProperties(allocator, &props);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+
+    for (uint32_t i=0; i<props->memoryHeapCount; i++) {
+        bool deviceLocal = props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+
+        out.push_back(MemoryHeapBudget{i, deviceLocal, budgets[i].usage, budgets[i].budget, budgets[i].statistics.blockBytes, budgets[i].statistics.allocationBytes});
+    }
+
+    return out;
+}
+
+void MemoryTracker::writeJSON(std::ostream& out, bool detailed) {
+    std::vector<MemoryHeapBudget> heaps = getHeapBudgets();
+
+    uint32_t frameIdx;
+    bool hasBudgetExt;
+
+    {
+        std::lock_guard lock(mutex);
+
+        frameIdx = frame;
+        hasBudgetExt = budgetExt;
+    }
+
+    std::stringstream str;
+
+    str << "{\"frame\":" << frameIdx << ",\"memoryBudgetExt\":" << (hasBudgetExt ? "true" : "false") << ",\n\"categories\":{";
+
+    bool first = true;
+
+    for (auto& c : getCategoryUsage()) {
+        if (!first) str << ",";
+        first = false;
+
+        str << "\"" << memoryCategoryName(c.category) << "\":{\"bytes\":" << c.bytes << ",\"allocations\":" << c.allocations << "}";
+    }
+
+    str << "},\n\"heaps\":[";
+
+    for (size_t i=0; i<heaps.size(); i++) {
+        auto& h = heaps.at(i);
+
+        if (i) str << ",";
+
+        str << "{\"index\":" << h.heapIndex << ",\"deviceLocal\":" << (h.deviceLocal ? "true" : "false") << ",\"usage\":" << h.usage << ",\"budget\":" << h.budget
+            << ",\"blockBytes\":" << h.blockBytes << ",\"allocationBytes\":" << h.allocationBytes << "}";
+    }
+
+    str << "]";
+
+    {
+        std::lock_guard lock(mutex);
+
+        if (allocator != VK_NULL_HANDLE) {
+            char* vmaStats = nullptr;
+            vmaBuildStatsString(allocator, &vmaStats, detailed);
+
+            str << ",\n\"vma\":" << vmaStats;
+
+            vmaFreeStatsString(allocator, vmaStats);
+        }
+    }
+
+    str << "}\n";
+
+    out << str.str();
+}
+
+bool MemoryTracker::writeJSON(std::string_view path, bool detailed) {
+    std::ofstream file{std::string(path)};
+
+    if (!file) {
+        std::cerr<<"Failed to open \""<<path<<"\" for memory stats output"<<std::endl;
+        return false;
+    }
+
+    writeJSON(file, detailed);
+
+    return true;
+}
+
+void MemoryTracker::print(std::ostream& out) {
+    std::stringstream str;
+
+    str << std::fixed << std::setprecision(1);
+
+    for (auto& c : getCategoryUsage()) {
+        str << std::left << std::setw(16) << memoryCategoryName(c.category) << std::right << std::setw(10) << toMiB(c.bytes) << " MiB"
+            << std::setw(8) << c.allocations << " allocs\n";
+    }
+
+    for (auto& h : getHeapBudgets()) {
+        str << "heap " << h.heapIndex << (h.deviceLocal ? " (device) " : " (host)   ") << std::setw(10) << toMiB(h.usage) << " / "
+            << toMiB(h.budget) << " MiB\n";
+    }
+
+    out << str.str();
+}
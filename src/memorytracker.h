@@ -0,0 +1,141 @@
+#pragma once
+
+#include "vk_mem_alloc.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// GPU memory accounting on top of VMA. Every AllocatedBuffer/AllocatedImage reports itself here; the category is stored as the
+///  allocation's VMA user data (and name, so it also shows up in vmaBuildStatsString dumps).
+///
+///     {
+///         MemoryCategoryScope s(MemoryCategory::meshes);
+///         auto mesh = FullMesh<...>::make(...);      //<- everything allocated on this thread in here is tagged "meshes"
+///     }
+///     froxelArray.setCategory(MemoryCategory::volumetrics);   //<- or retag a single resource after the fact
+///
+/// With VK_EXT_memory_budget (see DeviceCapabilities::memoryBudget) heap budgets come from the driver, otherwise VMA estimates them.
+
+namespace Medea {
+
+    enum class MemoryCategory : uint8_t {
+        general,
+        meshes,
+        textures,
+        shadows,
+        volumetrics,
+        transients,     //<- staging buffers, per-frame buffers
+
+        COUNT
+    };
+
+    const char* memoryCategoryName(MemoryCategory category);
+
+    namespace Internal {
+        inline MemoryCategory& currentMemoryCategory() {
+            thread_local MemoryCategory category = MemoryCategory::general;
+
+            return category;
+        }
+    }
+
+    /// Tags every allocation made on this thread while it's alive
+    class MemoryCategoryScope {
+        MemoryCategory previous;
+
+        public:
+        explicit MemoryCategoryScope(MemoryCategory category)
+            : previous(Internal::currentMemoryCategory()) {
+            Internal::currentMemoryCategory() = category;
+        }
+
+        MemoryCategoryScope(const MemoryCategoryScope&) = delete;
+        MemoryCategoryScope& operator=(const MemoryCategoryScope&) = delete;
+
+        ~MemoryCategoryScope() {
+            Internal::currentMemoryCategory() = previous;
+        }
+    };
+
+    struct MemoryCategoryUsage {
+        MemoryCategory category;
+        uint64_t bytes;
+        uint64_t allocations;
+    };
+
+    struct MemoryHeapBudget {
+        uint32_t heapIndex;
+        bool deviceLocal;
+        uint64_t usage;             //<- whole process, as reported by the driver (or estimated by VMA)
+        uint64_t budget;
+        uint64_t blockBytes;        //<- VkDeviceMemory owned by our allocator
+        uint64_t allocationBytes;   //<- parts of blockBytes actually handed out
+    };
+
+    class MemoryTracker {
+        struct Counters {
+            std::atomic<uint64_t> bytes = 0;
+            std::atomic<uint64_t> allocations = 0;
+        };
+
+        std::array<Counters, (size_t) MemoryCategory::COUNT> counters;
+
+        std::mutex mutex;
+        VmaAllocator allocator = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        bool budgetExt = false;
+        std::array<bool, VK_MAX_MEMORY_HEAPS> heapWarned = {};
+
+        uint32_t frame = 0;
+        uint32_t dumpPeriod = 0;
+        std::string dumpPath;
+
+        /// alloc has to be the attached allocator; checked again under the lock, in case it was detached since
+        void checkBudget(VmaAllocator alloc, uint32_t memoryTypeIndex, VkDeviceSize size);
+
+        public:
+        /// warn once a heap's projected usage passes this fraction of its budget
+        double warnThreshold = 0.9;
+
+        /// buffers smaller than this skip the budget check; gvector uploads make small staging buffers every frame
+        VkDeviceSize budgetCheckMinBytes = 1 << 20;
+
+        static MemoryTracker& get();
+
+        /// Called by Core::make; only the attached allocator gets budget checks and dumps, but any allocator is counted
+        void attach(VmaAllocator alloc, bool hasMemoryBudgetExt);
+        void detach(VmaAllocator alloc);
+
+        /// Warn (before creating the resource) if it would push its heap over budget
+        void checkBufferBudget(VmaAllocator alloc, const VkBufferCreateInfo& bci, const VmaAllocationCreateInfo& aci);
+        void checkImageBudget(VmaAllocator alloc, const VkImageCreateInfo& ici, const VmaAllocationCreateInfo& aci);
+
+        /// Tags the allocation with the current thread's category & counts it
+        void onAllocate(VmaAllocator alloc, VmaAllocation allocation);
+        /// Must be called before the allocation is freed
+        void onFree(VmaAllocator alloc, VmaAllocation allocation);
+
+        void setCategory(VmaAllocator alloc, VmaAllocation allocation, MemoryCategory category);
+
+        /// Once per frame; refreshes the driver's budget numbers & writes the periodic dump if one is due
+        void newFrame();
+
+        /// @param everyNFrames 0 disables
+        void setPeriodicDump(uint32_t everyNFrames, std::string_view path);
+
+        std::vector<MemoryCategoryUsage> getCategoryUsage() const;
+        std::vector<MemoryHeapBudget> getHeapBudgets();
+
+        /// Per-category totals, heap budgets, and the full vmaBuildStatsString JSON under "vma"
+        void writeJSON(std::ostream& out, bool detailed = false);
+        bool writeJSON(std::string_view path, bool detailed = false);
+
+        void print(std::ostream& out);
+    };
+}
@@ -0,0 +1,154 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace Medea;
+
+namespace {
+    /// bounds + normal cone of the meshlet's triangles, same cone construction (and test) as meshoptimizer's meshopt_computeMeshletBounds
+    void computeBounds(Meshlet& m, const MeshletData& data, std::span<const VertexPosition> positions) {
+        glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+        for (uint32_t i=0; i<m.vertexCount; i++) {
+            glm::vec3 p = positions[data.vertices.at(m.vertexOffset + i)].pos;
+
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float rad = 0.f;
+
+        for (uint32_t i=0; i<m.vertexCount; i++) {
+            rad = std::max(rad, glm::length(glm::vec3(positions[data.vertices.at(m.vertexOffset + i)].pos) - center));
+        }
+
+        m.sphere = glm::vec4(center, rad);
+
+        std::vector<glm::vec3> normals;
+        normals.reserve(m.triangleCount);
+
+        glm::vec3 axis(0);
+
+        for (uint32_t t=0; t<m.triangleCount; t++) {
+            uint32_t packed = data.triangles.at(m.triangleOffset + t);
+
+            glm::vec3 a = positions[data.vertices.at(m.vertexOffset + (packed & 0xFF))].pos;
+            glm::vec3 b = positions[data.vertices.at(m.vertexOffset + ((packed >> 8) & 0xFF))].pos;
+            glm::vec3 c = positions[data.vertices.at(m.vertexOffset + ((packed >> 16) & 0xFF))].pos;
+
+            //CCW is front facing (PipelineBuilder::setCullMode's default)
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float len = glm::length(n);
+
+            //degenerate triangles never render, so they don't constrain the cone
+            if (len <= 1e-12f) continue;
+
+            normals.push_back(n / len);
+            axis += normals.back();
+        }
+
+        m.cone = glm::vec4(0, 0, 0, 1);
+
+        float axisLen = glm::length(axis);
+
+        if (normals.empty() || axisLen <= 1e-6f) return;
+
+        axis /= axisLen;
+
+        float minDot = 1.f;
+
+        for (auto& n : normals) minDot = std::min(minDot, glm::dot(n, axis));
+
+        //a cone wider than ~84 degrees rarely gets culled, and the test gets imprecise; leave it at "never"
+        if (minDot <= 0.1f) return;
+
+        m.cone = glm::vec4(axis, std::sqrt(1.f - minDot * minDot));
+    }
+}
+
+std::vector<uint32_t> MeshletData::pack() const {
+    const uint32_t MESHLET_UINTS = sizeof(Meshlet) / sizeof(uint32_t);
+
+    uint32_t vertexBase = meshlets.size() * MESHLET_UINTS;
+    uint32_t triangleBase = vertexBase + vertices.size();
+
+    std::vector<uint32_t> out(triangleBase + triangles.size());
+
+    for (size_t i=0; i<meshlets.size(); i++) {
+        Meshlet m = meshlets.at(i);
+
+        m.vertexOffset += vertexBase;
+        m.triangleOffset += triangleBase;
+
+        memcpy(out.data() + i * MESHLET_UINTS, &m, sizeof(Meshlet));
+    }
+
+    std::copy(vertices.begin(), vertices.end(), out.begin() + vertexBase);
+    std::copy(triangles.begin(), triangles.end(), out.begin() + triangleBase);
+
+    return out;
+}
+
+MeshletData Medea::buildMeshlets(std::span<const VertexPosition> positions, std::span<const uint32_t> indices) {
+    assert(indices.size() % 3 == 0);
+
+    MeshletData out;
+
+    //mesh vertex -> index in the current meshlet
+    std::unordered_map<uint32_t, uint32_t> local;
+
+    Meshlet cur{};
+
+    auto flush = [&] () {
+        if (cur.triangleCount == 0) return;
+
+        computeBounds(cur, out, positions);
+        out.meshlets.push_back(cur);
+
+        cur = Meshlet{};
+        cur.vertexOffset = out.vertices.size();
+        cur.triangleOffset = out.triangles.size();
+
+        local.clear();
+    };
+
+    for (uint32_t t=0; t<indices.size() / 3; t++) {
+        uint32_t idx[3];
+        uint32_t added = 0;
+
+        for (int k=0; k<3; k++) {
+            idx[k] = indices[3 * t + k];
+
+            bool repeat = (k > 0 && idx[k] == idx[0]) || (k > 1 && idx[k] == idx[1]);
+
+            if (!local.contains(idx[k]) && !repeat) added++;
+        }
+
+        if (cur.vertexCount + added > MeshletLimits::maxVertices || cur.triangleCount + 1 > MeshletLimits::maxTriangles) flush();
+
+        uint32_t packed = 0;
+
+        for (int k=0; k<3; k++) {
+            auto [it, inserted] = local.try_emplace(idx[k], cur.vertexCount);
+
+            if (inserted) {
+                out.vertices.push_back(idx[k]);
+                cur.vertexCount++;
+            }
+
+            packed |= it->second << (8 * k);
+        }
+
+        out.triangles.push_back(packed);
+        cur.triangleCount++;
+    }
+
+    flush();
+
+    return out;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// Meshlets: small clusters of a mesh's triangles, each with its own bounds and normal cone, so the task shader of the megashader's mesh
+///  path (see RenderSettings::meshShading) can frustum, backface and occlusion cull a mesh piece by piece.
+///
+/// Built once per FullMesh from its index buffer (see indexedmesh.h), in the same (cache optimized) triangle order. A meshlet's vertices
+///  index the mesh's vertex streams, same as the vertex path's gl_VertexIndex, so a meshlet runs the vertex code once per vertex it uses.
+
+namespace Medea {
+
+    /// mesh shader limits per meshlet; the mesh shader's max_vertices/max_primitives (and a 64 wide workgroup)
+    namespace MeshletLimits {
+        constexpr uint32_t maxVertices = 64;
+        constexpr uint32_t maxTriangles = 124;
+
+        constexpr uint32_t perTaskGroup = 32;   //<- meshlets tested per task shader workgroup
+    }
+
+    struct alignas(16) Meshlet {
+        glm::vec4 sphere;               //<- xyz: center, w: radius; object space
+        glm::vec4 cone;                 //<- xyz: average normal, w: cutoff (sin of the normals' spread); 1 when the normals are too spread out to cull
+
+        /// in uints from the start of the GPU buffer (MeshletData::pack), which has the meshlets, then the vertices, then the triangles
+        uint32_t vertexOffset;
+        uint32_t triangleOffset;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    struct MeshletData {
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> vertices;     //<- mesh vertex indices
+        std::vector<uint32_t> triangles;    //<- 3 indices into the meshlet's vertices, 8 bits each
+
+        /// the GPU layout: meshlets, vertices, triangles; offsets rebased to the start of the whole thing
+        std::vector<uint32_t> pack() const;
+    };
+
+    /// greedy: walks the triangles in order, starting a new meshlet when the next one doesn't fit. Cache optimized order (optimizeVertexCache)
+    ///  is spatially coherent enough; shuffled triangles make loose meshlets
+    /// @param indices 3 per triangle, into positions
+    extern MeshletData buildMeshlets(std::span<const VertexPosition> positions, std::span<const uint32_t> indices);
+
+    /// per soup vertex, the first one with the same bytes; how FullMesh::make welds. Padding is compared too, so vertices built separately
+    ///  may not match; that only costs sharing
+    template<typename T>
+    std::vector<uint32_t> dedupeSoup(std::span<const T> vertices) {
+        std::vector<uint32_t> out;
+        out.reserve(vertices.size());
+
+        std::unordered_map<std::string_view, uint32_t> seen;
+        seen.reserve(vertices.size());
+
+        for (uint32_t i=0; i<vertices.size(); i++) {
+            std::string_view bytes(reinterpret_cast<const char*>(&vertices[i]), sizeof(T));
+
+            out.push_back(seen.try_emplace(bytes, i).first->second);
+        }
+
+        return out;
+    }
+}
@@ -0,0 +1,189 @@
+#include "meshlod.h"
+
+#include "indexedmesh.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <unordered_map>
+
+using namespace Medea;
+
+namespace {
+    /// symmetric 4x4 plane quadric; error(p) is the (area weighted) sum of squared distances to the planes that went in
+    struct Quadric {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+
+        void addPlane(glm::dvec3 n, double d, double w) {
+            a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+            b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+            c2 += w * n.z * n.z; cd += w * n.z * d;
+            d2 += w * d * d;
+        }
+
+        void operator+=(const Quadric& o) {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+            b2 += o.b2; bc += o.bc; bd += o.bd;
+            c2 += o.c2; cd += o.cd;
+            d2 += o.d2;
+        }
+
+        double error(glm::dvec3 p) const {
+            return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                 + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                 + c2 * p.z * p.z + 2 * cd * p.z
+                 + d2;
+        }
+    };
+}
+
+LodLevel Medea::simplifyClusters(std::span<const VertexPosition> positions, std::span<const uint32_t> indices, uint32_t gridRes) {
+    assert(indices.size() % 3 == 0);
+    assert(gridRes > 0 && gridRes < (1u << 21));
+
+    const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    LodLevel out{{}, 0.f};
+
+    if (positions.empty()) return out;
+
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+    for (auto& p : positions) {
+        lo = glm::min(lo, glm::vec3(p.pos));
+        hi = glm::max(hi, glm::vec3(p.pos));
+    }
+
+    glm::vec3 extent = hi - lo;
+    float maxExtent = std::max({extent.x, extent.y, extent.z});
+
+    if (maxExtent <= 0.f) return out;
+
+    const float cellSize = maxExtent / gridRes;
+
+    //vertex -> cell, cells numbered as first seen
+    std::vector<uint32_t> vertexCell(positions.size());
+    std::unordered_map<uint64_t, uint32_t> cells;
+
+    for (uint32_t v=0; v<positions.size(); v++) {
+        glm::vec3 c = (glm::vec3(positions[v].pos) - lo) / cellSize;
+
+        uint64_t key = 0;
+
+        for (int k=0; k<3; k++) key |= uint64_t(std::min(uint32_t(c[k]), gridRes - 1)) << (21 * k);
+
+        vertexCell[v] = cells.try_emplace(key, cells.size()).first->second;
+    }
+
+    std::vector<Quadric> quadrics(cells.size());
+
+    for (size_t t=0; t<indices.size() / 3; t++) {
+        glm::dvec3 a = glm::vec3(positions[indices[3 * t]].pos);
+        glm::dvec3 b = glm::vec3(positions[indices[3 * t + 1]].pos);
+        glm::dvec3 c = glm::vec3(positions[indices[3 * t + 2]].pos);
+
+        glm::dvec3 n = glm::cross(b - a, c - a);
+        double area = glm::length(n);
+
+        if (area <= 0.0) continue;
+
+        n /= area;
+
+        Quadric q;
+        q.addPlane(n, -glm::dot(n, a), area);
+
+        for (int k=0; k<3; k++) quadrics[vertexCell[indices[3 * t + k]]] += q;
+    }
+
+    //per cell, the vertex its quadric likes best
+    std::vector<uint32_t> keep(cells.size(), NONE);
+    std::vector<double> keepError(cells.size(), std::numeric_limits<double>::max());
+
+    for (uint32_t v=0; v<positions.size(); v++) {
+        uint32_t cell = vertexCell[v];
+        double e = quadrics[cell].error(glm::vec3(positions[v].pos));
+
+        if (e < keepError[cell]) {
+            keepError[cell] = e;
+            keep[cell] = v;
+        }
+    }
+
+    for (uint32_t v=0; v<positions.size(); v++) {
+        out.error = std::max(out.error, glm::length(glm::vec3(positions[v].pos) - glm::vec3(positions[keep[vertexCell[v]]].pos)));
+    }
+
+    //triangles that kept 3 distinct corners, once each; rotated so the smallest index leads, which keeps the winding
+    std::set<std::array<uint32_t, 3>> seen;
+
+    out.indices.reserve(indices.size());
+
+    for (size_t t=0; t<indices.size() / 3; t++) {
+        std::array<uint32_t, 3> tri;
+
+        for (int k=0; k<3; k++) tri[k] = keep[vertexCell[indices[3 * t + k]]];
+
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) continue;
+
+        std::rotate(tri.begin(), std::min_element(tri.begin(), tri.end()), tri.end());
+
+        if (!seen.insert(tri).second) continue;
+
+        out.indices.insert(out.indices.end(), tri.begin(), tri.end());
+    }
+
+    optimizeVertexCache(out.indices, positions.size());
+
+    return out;
+}
+
+std::vector<LodLevel> Medea::buildLodChain(std::span<const VertexPosition> positions, std::span<const uint32_t> indices, uint32_t maxLevels) {
+    std::vector<LodLevel> out;
+    out.push_back(LodLevel{std::vector<uint32_t>(indices.begin(), indices.end()), 0.f});
+
+    uint32_t prevTriangles = indices.size() / 3;
+    uint32_t prevRes = LodLimits::maxGridRes;
+
+    while (out.size() < maxLevels) {
+        const uint32_t target = prevTriangles / 2;
+
+        if (target < LodLimits::minTriangles) break;
+
+        //finest grid that gets down to target; triangles go (roughly) up with resolution
+        uint32_t lo = 1, hi = prevRes, bestRes = 0;
+        LodLevel best;
+
+        while (lo <= hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            LodLevel level = simplifyClusters(positions, indices, mid);
+
+            if (level.indices.size() / 3 <= target) {
+                best = std::move(level);
+                bestRes = mid;
+                lo = mid + 1;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+
+        if (bestRes == 0 || best.indices.size() / 3 < LodLimits::minTriangles) break;
+
+        //errors are against the mesh itself, so this only catches clustering noise; selection needs them to go up
+        best.error = std::max(best.error, out.back().error);
+
+        prevTriangles = best.indices.size() / 3;
+        prevRes = bestRes;
+
+        out.push_back(std::move(best));
+    }
+
+    return out;
+}
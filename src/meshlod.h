@@ -0,0 +1,48 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Discrete LODs: FullMesh::make builds a chain of simplified index buffers over the mesh's own vertices (so every level shares its vertex
+///  streams; only the indices and meshlets differ), each with the object space error it introduces. Broadphase and shadow cull project
+///  that error per view and pick the coarsest level under RenderSettings::lodErrorPixels, writing its draw fields into their copy of the
+///  RenderEntity.
+///
+/// Simplification is vertex clustering (Rossignac & Borrel, "Multi-resolution 3D approximations for rendering complex scenes", 1993): a
+///  grid over the mesh's bounds, every cell's vertices collapse into one of them, and triangles that lose a corner go. The vertex a cell
+///  keeps is the one its triangles' plane quadrics (Garland & Heckbert 1997) like best, so corners and creases stay put. Fast and
+///  robust, but topology blind; fine at the distances the coarse levels get used at.
+
+namespace Medea {
+
+    namespace LodLimits {
+        constexpr uint32_t maxLevels = 5;           //<- including the mesh itself
+        constexpr uint32_t minTriangles = 32;       //<- no level gets simplified below this
+        constexpr uint32_t maxGridRes = 1024;
+    }
+
+    /// one level of FullMesh::lods, on the GPU (RenderEntity::lodAddress). What cull copies into its RenderEntity copy
+    struct MeshLod {
+        uint64_t meshletAddress;
+        uint32_t meshletCount;
+        uint32_t firstIndex;            //<- into the MeshIndexPool
+        uint32_t indexCount;
+        glm::float32 error;             //<- object space; how far any vertex ended up from where it was
+    };
+
+    struct LodLevel {
+        std::vector<uint32_t> indices;  //<- 3 per triangle, into the mesh's vertices; cache optimized
+        float error;
+    };
+
+    /// level 0 is indices as they are (error 0); every next one has at most half the triangles of the one before, and a larger error
+    /// @param indices 3 per triangle, into positions
+    extern std::vector<LodLevel> buildLodChain(std::span<const VertexPosition> positions, std::span<const uint32_t> indices,
+                                               uint32_t maxLevels = LodLimits::maxLevels);
+
+    /// one clustering pass, gridRes cells along the bounds' longest axis
+    extern LodLevel simplifyClusters(std::span<const VertexPosition> positions, std::span<const uint32_t> indices, uint32_t gridRes);
+}
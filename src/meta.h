@@ -7,8 +7,13 @@
 
 #include "metaimage.h"
 
+#include <map>
 #include <memory>
 #include "vertex.h"
+#include "meshlet.h"
+#include "indexedmesh.h"
+#include "vertexquantize.h"
+#include "meshlod.h"
 
 #include "constants.h"
 
@@ -23,15 +28,22 @@ namespace Medea {
         /// Doom Eternal siggraph talk: can compress normal + tangent frame into 3 floats
 
         template<typename T>
-        void transferToGPU(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<T> data, vk::Buffer target) {
-            AllocatedBuffer* staging = new AllocatedBuffer(AllocatedBuffer::loadCPU(allocator, device, data, vk::BufferUsageFlagBits::eTransferSrc));
+        void transferToGPU(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<T> data, vk::Buffer target,
+                           vk::DeviceSize targetOffset = 0) {
+            AllocatedBuffer* staging = nullptr;
+
+            {
+                MemoryCategoryScope stagingMemory(MemoryCategory::transients);
+
+                staging = new AllocatedBuffer(AllocatedBuffer::loadCPU(allocator, device, data, vk::BufferUsageFlagBits::eTransferSrc));
+            }
 
             VkBuffer stageBuf = staging->buffer;
 
             size_t vbSize = data.size_bytes();
 
             CommandJob job = [=] (vk::CommandBuffer cmd, CleanupJobQueueCallback cleanup) {
-                cmd.copyBuffer(stageBuf, target, vk::BufferCopy(0, 0, vbSize));
+                cmd.copyBuffer(stageBuf, target, vk::BufferCopy(0, targetOffset, vbSize));
 
                 void* ptr = staging->info.pMappedData;
 
@@ -59,7 +71,13 @@ namespace Medea {
 
             std::span<char> data((char*) pixelData, size.depth * size.width * size.height * colorWidth);
 
-            AllocatedBuffer* staging = new AllocatedBuffer(AllocatedBuffer::loadCPU(allocator, device, data, vk::BufferUsageFlagBits::eTransferSrc));
+            AllocatedBuffer* staging = nullptr;
+
+            {
+                MemoryCategoryScope stagingMemory(MemoryCategory::transients);
+
+                staging = new AllocatedBuffer(AllocatedBuffer::loadCPU(allocator, device, data, vk::BufferUsageFlagBits::eTransferSrc));
+            }
 
 
             VkBuffer stageBuf = staging->buffer;
@@ -89,7 +107,7 @@ namespace Medea {
 
     }
 
-    /// unindexed
+    /// one vertex stream; indexed through MeshIndexPool
     template<typename Vertex>
     struct MeshBuffer {
         uint32_t totalVertices;
@@ -100,8 +118,7 @@ namespace Medea {
         static MeshBuffer make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<Vertex> vertices) {
             size_t vbSize = vertices.size() * sizeof(Vertex);
 
-            assert(vertices.size() % 3 == 0);
-
+            MemoryCategoryScope meshMemory(MemoryCategory::meshes);
 
             AllocatedBuffer final(device, allocator, vbSize, 
                     vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
@@ -121,8 +138,264 @@ namespace Medea {
         }
     };
 
+    /// MeshletData::pack() on the GPU, once per LOD level, one after the other; see meshlet.h
+    struct MeshletBuffer {
+        uint32_t meshletCount;                      //<- level 0's
+        AllocatedBuffer buffer;
+
+        /// per level: where its pack() starts, in bytes (its offsets are relative to that), and its meshlet count
+        std::vector<vk::DeviceSize> levelOffsets;
+        std::vector<uint32_t> levelCounts;
+
+        static MeshletBuffer make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<const MeshletData> levels) {
+            assert(!levels.empty());
+
+            std::vector<uint32_t> packed;
+            std::vector<vk::DeviceSize> offsets;
+            std::vector<uint32_t> counts;
+
+            for (auto& l : levels) {
+                std::vector<uint32_t> p = l.pack();
+
+                offsets.push_back(packed.size() * sizeof(uint32_t));
+                counts.push_back(l.meshlets.size());
+
+                packed.insert(packed.end(), p.begin(), p.end());
+            }
+
+            MemoryCategoryScope meshMemory(MemoryCategory::meshes);
+
+            AllocatedBuffer final(device, allocator, packed.size() * sizeof(uint32_t),
+                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+            Internal::transferToGPU<uint32_t>(callback, allocator, device, packed, final.buffer);
+
+            return MeshletBuffer(counts.at(0), std::move(final), std::move(offsets), std::move(counts));
+        }
+
+        static MeshletBuffer make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, const MeshletData& meshlets) {
+            return make(callback, allocator, device, std::span<const MeshletData>(&meshlets, 1));
+        }
+    };
+
+    /// FullMesh's LOD chain on the GPU (RenderEntity::lodAddress); see meshlod.h
+    struct MeshLodBuffer {
+        std::vector<MeshLod> levels;                //<- finest first; levels[0] is the mesh itself
+        AllocatedBuffer buffer;
+
+        static MeshLodBuffer make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::vector<MeshLod> levels) {
+            MemoryCategoryScope meshMemory(MemoryCategory::meshes);
+
+            AllocatedBuffer final(device, allocator, levels.size() * sizeof(MeshLod),
+                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+            Internal::transferToGPU<MeshLod>(callback, allocator, device, levels, final.buffer);
+
+            return MeshLodBuffer(std::move(levels), std::move(final));
+        }
+    };
+
+    /// FullMesh's position stream (RenderEntity::positionStreamAddress): VertexPositions, or quantized (see vertexquantize.h)
+    struct PositionStream {
+        uint32_t totalVertices;
+        VertexFormat format;
+        AllocatedBuffer buffer;
+
+        /// bytes the vertex stage fetches per vertex
+        size_t stride() const {
+            return format == VertexFormat::quantized ? sizeof(QuantizedVertexPosition) : sizeof(VertexPosition);
+        }
+
+        static PositionStream make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<VertexPosition> positions) {
+            auto mb = MeshBuffer<VertexPosition>::make(callback, allocator, device, positions);
+
+            return PositionStream(mb.totalVertices, VertexFormat::full, std::move(mb.buffer));
+        }
+
+        static PositionStream make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, const QuantizedPositions& positions) {
+            std::vector<uint32_t> packed = positions.pack();
+
+            MemoryCategoryScope meshMemory(MemoryCategory::meshes);
+
+            AllocatedBuffer final(device, allocator, packed.size() * sizeof(uint32_t),
+                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+            Internal::transferToGPU<uint32_t>(callback, allocator, device, packed, final.buffer);
+
+            return PositionStream(positions.vertices.size(), VertexFormat::quantized, std::move(final));
+        }
+    };
+
+    namespace Internal {
+        struct MeshIndexPoolState {
+            std::shared_ptr<AllocatedBuffer> buffer;
+            uint32_t capacity = 0;                      //<- in indices
+            std::map<uint32_t, uint32_t> freeRanges;    //<- first index -> count; never adjacent, release() merges them
+
+            /// first fit
+            std::optional<uint32_t> take(uint32_t count) {
+                for (auto it = freeRanges.begin(); it != freeRanges.end(); it++) {
+                    auto [first, size] = *it;
+
+                    if (size < count) continue;
+
+                    freeRanges.erase(it);
+
+                    if (size > count) freeRanges.emplace(first + count, size - count);
+
+                    return first;
+                }
+
+                return std::nullopt;
+            }
+
+            void release(uint32_t first, uint32_t count) {
+                if (count == 0) return;
+
+                auto next = freeRanges.lower_bound(first);
+
+                if (next != freeRanges.end() && first + count == next->first) {
+                    count += next->second;
+                    next = freeRanges.erase(next);
+                }
+
+                if (next != freeRanges.begin()) {
+                    auto prev = std::prev(next);
+
+                    if (prev->first + prev->second == first) {
+                        prev->second += count;
+                        return;
+                    }
+                }
+
+                freeRanges.emplace(first, count);
+            }
+        };
+    }
+
+    /// Every mesh's indices, in one buffer: an indexed indirect draw reads whatever index buffer is bound, so a whole draw list (any mix of
+    ///  meshes) has to share one. A mesh gets a range (RenderEntity::firstIndex); its indices are local to its own vertex streams.
+    /// When nothing fits, the buffer doubles. The copy into the new one is queued like an upload, and the old buffer is freed by that
+    ///  job's cleanup, i.e. after every frame that could have bound it
+    class MeshIndexPool {
+        std::shared_ptr<Internal::MeshIndexPoolState> state;
+
+        static std::shared_ptr<AllocatedBuffer> makeBuffer(VmaAllocator allocator, vk::Device device, uint32_t capacity) {
+            MemoryCategoryScope meshMemory(MemoryCategory::meshes);
+
+            return std::make_shared<AllocatedBuffer>(device, allocator, vk::DeviceSize(capacity) * sizeof(uint32_t),
+                    vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+                    | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        }
+
+        void grow(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, uint32_t needed) {
+            uint32_t oldCapacity = state->capacity;
+            uint32_t newCapacity = std::max(2 * oldCapacity, oldCapacity + needed);
+
+            std::shared_ptr<AllocatedBuffer> old = state->buffer;
+            std::shared_ptr<AllocatedBuffer> cur = makeBuffer(allocator, device, newCapacity);
+
+            vk::DeviceSize oldSize = vk::DeviceSize(oldCapacity) * sizeof(uint32_t);
+
+            CommandJob job = [old, cur, oldSize] (vk::CommandBuffer cmd, CleanupJobQueueCallback cleanup) {
+                cmd.copyBuffer(old->buffer, cur->buffer, vk::BufferCopy(0, 0, oldSize));
+
+                //uploads after this may land in (free) ranges the copy just wrote
+                vk::MemoryBarrier2 barrier(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
+                                           vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+
+                cmd.pipelineBarrier2(vk::DependencyInfo({}, barrier));
+
+                cleanup([old] () {});
+            };
+
+            callback(job);
+
+            state->buffer = cur;
+            state->capacity = newCapacity;
+            state->release(oldCapacity, newCapacity - oldCapacity);
+        }
+
+        public:
+        /// a mesh's indices; given back to the pool when this goes
+        class Range {
+            std::shared_ptr<Internal::MeshIndexPoolState> pool;
+
+            public:
+            uint32_t firstIndex = 0;
+            uint32_t count = 0;
+
+            Range() = default;
+
+            Range(std::shared_ptr<Internal::MeshIndexPoolState> _pool, uint32_t _firstIndex, uint32_t _count)
+                : pool(std::move(_pool)), firstIndex(_firstIndex), count(_count) {}
+
+            Range(const Range&) = delete;
+            Range& operator=(const Range&) = delete;
+
+            Range(Range&& o) noexcept : pool(std::move(o.pool)), firstIndex(o.firstIndex), count(o.count) {}
+
+            Range& operator=(Range&& o) noexcept {
+                if (pool) pool->release(firstIndex, count);
+
+                pool = std::move(o.pool);
+                firstIndex = o.firstIndex;
+                count = o.count;
+
+                return *this;
+            }
+
+            ~Range() {
+                if (pool) pool->release(firstIndex, count);
+            }
+        };
+
+        MeshIndexPool(VmaAllocator allocator, vk::Device device, uint32_t initialCapacity = 1 << 16)
+            : state(std::make_shared<Internal::MeshIndexPoolState>()) {
+            state->buffer = makeBuffer(allocator, device, initialCapacity);
+            state->capacity = initialCapacity;
+            state->release(0, initialCapacity);
+        }
+
+        Range add(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<const uint32_t> indices) {
+            uint32_t count = indices.size();
+
+            std::optional<uint32_t> first = state->take(count);
+
+            if (!first) {
+                grow(callback, allocator, device, count);
+                first = state->take(count);
+            }
+
+            assert(first);
+
+            std::vector<uint32_t> stored(indices.begin(), indices.end());
+
+            if (count > 0) Internal::transferToGPU<uint32_t>(callback, allocator, device, stored, state->buffer->buffer, vk::DeviceSize(*first) * sizeof(uint32_t));
+
+            return Range(state, *first, count);
+        }
+
+        /// bound by every indexed draw. Replaced when the pool grows, so keep the pointer alive (cleanup) for as long as commands use it
+        std::shared_ptr<AllocatedBuffer> getBuffer() const {
+            return state->buffer;
+        }
+    };
+
     struct MeshCollider {
         double sphereRad;
+
+        static MeshCollider make(std::span<const VertexPosition> positions) {
+            double sphereRad = 0.0;
+
+            for (auto& p : positions) sphereRad = std::max(sphereRad, Vec3(p.pos).mag());
+
+            return MeshCollider{sphereRad};
+        }
     };
 
     /// NOTE: creating these requires an extraneous full copy of the mesh data, to extract the position stream out of the interleaved vertex data array
@@ -130,42 +403,129 @@ namespace Medea {
     template<typename VertexAttrib>
     struct FullMesh {
         MeshBuffer<VertexAttrib> vertexAttributes;
-        MeshBuffer<VertexPosition> vertexBasePositions;
+        PositionStream vertexBasePositions;
         const size_t totalVertices;
 
         MeshCollider collider;
 
-        static std::shared_ptr<FullMesh<VertexAttrib>> make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device, std::span<MVertex<VertexAttrib>> vertices) {
-            std::vector<VertexAttrib> deinterleavedAttrib;
-            std::vector<VertexPosition> deinterleavedPos;
+        MeshletBuffer meshlets;     //<- for the mesh shader path; built from the same indices, every LOD level's
 
-            deinterleavedAttrib.reserve(vertices.size());
-            deinterleavedPos.reserve(vertices.size());
+        MeshIndexPool::Range indices;   //<- every LOD level's, finest first
 
-            double sphereRad = 0.0;
+        /// post-transform cache, before (soupVertices: one invocation per corner) and after indexing; see indexedmesh.h
+        struct IndexStats {
+            uint32_t soupVertices;
+            VertexCacheStats welded;
+            VertexCacheStats optimized;
+        } indexStats;
+
+        MeshLodBuffer lods;
+
+        struct Deinterleaved {
+            std::vector<VertexAttrib> attributes;
+            std::vector<VertexPosition> positions;
+            MeshCollider collider;
+        };
+
+        /// CPU half of make(): splits the interleaved vertices into the attribute & position streams
+        /// @param order which vertices, in which order (IndexedMesh::vertices); empty for all of them as they are
+        static Deinterleaved deinterleave(std::span<const MVertex<VertexAttrib>> vertices, std::span<const uint32_t> order = {}) {
+            Deinterleaved out;
+
+            size_t count = order.empty() ? vertices.size() : order.size();
+
+            out.attributes.reserve(count);
+            out.positions.reserve(count);
+
+            for (size_t i=0; i<count; i++) {
+                const MVertex<VertexAttrib>& v = vertices[order.empty() ? i : order[i]];
+
+                out.attributes.push_back(v.attributes);
+                out.positions.push_back(v.position);
+            }
+
+            out.collider = MeshCollider::make(out.positions);
+
+            return out;
+        }
+
+        /// welds the triangle soup (identical vertices become one) and reorders it for the vertex cache; see indexedmesh.h
+        /// @param indexPool usually GPUSceneGraph::getMeshIndices(); meshes drawn together have to share one
+        /// @param format VertexFormat::quantized stores positions & normals in 12 bytes instead of 32; see vertexquantize.h
+        /// @param maxLodLevels simplified levels to build, counting the mesh itself (see meshlod.h); 1 for none
+        static std::shared_ptr<FullMesh<VertexAttrib>> make(CommandJobQueueCallback callback, VmaAllocator allocator, vk::Device device,
+                                                            MeshIndexPool& indexPool, std::span<MVertex<VertexAttrib>> vertices,
+                                                            VertexFormat format = VertexFormat::full, uint32_t maxLodLevels = LodLimits::maxLevels) {
+            assert(vertices.size() % 3 == 0);
 
-            for (auto& v : vertices) {
-                deinterleavedAttrib.push_back(v.attributes);
-                deinterleavedPos.push_back(v.position);
+            std::vector<VertexPosition> soupPositions;
+            soupPositions.reserve(vertices.size());
 
-                sphereRad = std::max(sphereRad, Vec3(v.position.pos).mag());
+            for (auto& v : vertices) soupPositions.push_back(v.position);
+
+            IndexedMesh indexed = buildIndexedMesh(soupPositions, dedupeSoup<MVertex<VertexAttrib>>(vertices));
+
+            Deinterleaved d = deinterleave(vertices, indexed.vertices);
+
+            std::optional<QuantizedPositions> quantized;
+
+            //bounds & meshlets from what the shader decodes, so culling stays conservative
+            if (format == VertexFormat::quantized) {
+                quantized = quantizePositions(d.positions);
+
+                d.positions = dequantizePositions(*quantized);
+                d.collider = MeshCollider::make(d.positions);
             }
 
-            auto va = MeshBuffer<VertexAttrib>::make(callback, allocator, device, deinterleavedAttrib);
-            auto vp = MeshBuffer<VertexPosition>::make(callback, allocator, device, deinterleavedPos);
+            auto va = MeshBuffer<VertexAttrib>::make(callback, allocator, device, d.attributes);
+            auto vp = quantized ? PositionStream::make(callback, allocator, device, *quantized)
+                                : PositionStream::make(callback, allocator, device, d.positions);
 
-            size_t totalVertices = vertices.size();
+            size_t totalVertices = indexed.vertices.size();
 
             assert(va.totalVertices == totalVertices);
             assert(vp.totalVertices == totalVertices);
 
-            return std::make_shared<FullMesh>(std::move(va), std::move(vp), totalVertices, MeshCollider{sphereRad});
+            //every level indexes the same vertices, so only indices & meshlets are per level
+            std::vector<LodLevel> chain = buildLodChain(d.positions, indexed.indices, maxLodLevels);
+
+            std::vector<MeshletData> levelMeshlets;
+            std::vector<uint32_t> allIndices;
+
+            for (auto& l : chain) {
+                levelMeshlets.push_back(buildMeshlets(d.positions, l.indices));
+                allIndices.insert(allIndices.end(), l.indices.begin(), l.indices.end());
+            }
+
+            auto ml = MeshletBuffer::make(callback, allocator, device, levelMeshlets);
+
+            MeshIndexPool::Range range = indexPool.add(callback, allocator, device, allIndices);
+
+            std::vector<MeshLod> levels;
+            uint32_t firstIndex = range.firstIndex;
+
+            for (size_t i=0; i<chain.size(); i++) {
+                uint32_t count = chain.at(i).indices.size();
+
+                levels.push_back(MeshLod{ml.buffer.getAddress() + ml.levelOffsets.at(i), ml.levelCounts.at(i), firstIndex, count, chain.at(i).error});
+
+                firstIndex += count;
+            }
+
+            auto lods = MeshLodBuffer::make(callback, allocator, device, std::move(levels));
+
+            IndexStats stats{(uint32_t) vertices.size(), indexed.welded, indexed.optimized};
+
+            return std::make_shared<FullMesh>(std::move(va), std::move(vp), totalVertices, d.collider, std::move(ml), std::move(range), stats,
+                                              std::move(lods));
         }
 
-        static std::shared_ptr<FullMesh<VertexAttrib>> make(CommandJobQueueCallback callback,  VmaAllocator allocator, vk::Device device, std::vector<MVertex<VertexAttrib>>&& vertices) {
+        static std::shared_ptr<FullMesh<VertexAttrib>> make(CommandJobQueueCallback callback,  VmaAllocator allocator, vk::Device device,
+                                                            MeshIndexPool& indexPool, std::vector<MVertex<VertexAttrib>>&& vertices,
+                                                            VertexFormat format = VertexFormat::full, uint32_t maxLodLevels = LodLimits::maxLevels) {
             std::vector<MVertex<VertexAttrib>> stored(vertices);
 
-            return make(callback, allocator, device, stored);
+            return make(callback, allocator, device, indexPool, stored, format, maxLodLevels);
         }
     };
 
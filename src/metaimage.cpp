@@ -58,6 +58,7 @@ void AllocatedImage::generateMipmaps(vk::CommandBuffer cmd, AllocatedImage& trg)
 
 
     trg._currentLayout = vk::ImageLayout::eTransferSrcOptimal;
+    trg._state = ResourceState::written(ResourceUsage::transferWrite());
 }
 
 
@@ -73,6 +74,8 @@ AllocatedImage AllocatedImage::make(Medea::Core& core, vk::ImageCreateInfo ici,
 
     VkImageCreateInfo cici = ici;
 
+    MemoryTracker::get().checkImageBudget(core.allocator, cici, imgAllocInfo);
+
     VK_REQUIRE(vmaCreateImage(core.allocator, &cici, &imgAllocInfo, &rawImage, &rawAllocation, nullptr));
 
     vk::raii::Image outImage(core.device, rawImage);
@@ -139,6 +142,8 @@ AllocatedImage AllocatedImage::makeNoView(Medea::Core& core, vk::ImageCreateInfo
 
     VkImageCreateInfo cici = ici;
 
+    MemoryTracker::get().checkImageBudget(core.allocator, cici, imgAllocInfo);
+
     VK_REQUIRE(vmaCreateImage(core.allocator, &cici, &imgAllocInfo, &rawImage, &rawAllocation, nullptr));
 
     vk::raii::Image outImage(core.device, rawImage);
@@ -162,6 +167,8 @@ std::shared_ptr<AllocatedImage> AllocatedImage::load(Medea::Core& core, CommandJ
     stbi_set_flip_vertically_on_load(true);
     int nrChannels, width, height;
 
+    MemoryCategoryScope textureMemory(MemoryCategory::textures);
+
     unsigned char* data = stbi_load(filepath.data(), &width, &height, &nrChannels, STBI_rgb_alpha);
 
     if (!data) {
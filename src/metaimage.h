@@ -18,34 +18,44 @@ namespace Medea {
 
         bool isDepth;
 
-        [[nodiscard]] vk::ImageMemoryBarrier2 transition(vk::ImageLayout newLayout, bool undefinedSrc = false) {
-            vk::ImageAspectFlags subresourceFlags = isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+        /// Barrier to get from the last tracked use to `usage`; nullopt if there's no hazard and no layout change. Updates the tracked state either way
+        [[nodiscard]] std::optional<vk::ImageMemoryBarrier2> transition(const ResourceUsage& usage, bool undefinedSrc = false) {
+            auto masks = Internal::resolveBarrier(_state, _currentLayout, usage, undefinedSrc, true);
+
+            if (!masks) return std::nullopt;
 
-            vk::ImageLayout oldLayout = undefinedSrc ? vk::ImageLayout::eUndefined : _currentLayout;
+            vk::ImageAspectFlags subresourceFlags = isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
 
-            vk::ImageMemoryBarrier2 barrier(
-                    vk::PipelineStageFlagBits2::eAllCommands,
-                    vk::AccessFlagBits2::eMemoryWrite,
-                    vk::PipelineStageFlagBits2::eAllCommands,
-                    vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite,
-                    oldLayout, newLayout, queueFamily, queueFamily, image,
+            return vk::ImageMemoryBarrier2(
+                    masks->srcStage, masks->srcAccess, masks->dstStage, masks->dstAccess,
+                    masks->oldLayout, masks->newLayout, queueFamily, queueFamily, image,
                     vk::ImageSubresourceRange(subresourceFlags, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers)
             );
+        }
 
-            _currentLayout = newLayout;
-
-            return barrier;
+        /// layout-only version; the usage is guessed from the layout (see ResourceUsage::forLayout)
+        [[nodiscard]] std::optional<vk::ImageMemoryBarrier2> transition(vk::ImageLayout newLayout, bool undefinedSrc = false) {
+            return transition(ResourceUsage::forLayout(newLayout), undefinedSrc);
         }
 
 
         void generateMipmaps(vk::CommandBuffer cmd, AllocatedImage& trg);
 
+        /// see AllocatedBuffer::setCategory
+        void setCategory(MemoryCategory category) {
+            MemoryTracker::get().setCategory(allocation.allocator, allocation.memory, category);
+        }
+
 
         ///Just does a singular image transition. No batching, so potentially suboptimal
-        void transitionSync(vk::CommandBuffer cmd, vk::ImageLayout newLayout, bool undefinedSrc = false) {
-            auto imgBarrier = transition(newLayout, undefinedSrc);
+        void transitionSync(vk::CommandBuffer cmd, const ResourceUsage& usage, bool undefinedSrc = false) {
+            auto imgBarrier = transition(usage, undefinedSrc);
 
-            cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, imgBarrier));
+            if (imgBarrier) Internal::pipelineBarrier(cmd, vk::DependencyInfo({}, {}, {}, *imgBarrier));
+        }
+
+        void transitionSync(vk::CommandBuffer cmd, vk::ImageLayout newLayout, bool undefinedSrc = false) {
+            transitionSync(cmd, ResourceUsage::forLayout(newLayout), undefinedSrc);
         }
         
         void tryTransitionSync(vk::CommandBuffer cmd, vk::ImageLayout newLayout, bool undefinedSrc = false) {
@@ -69,50 +79,143 @@ namespace Medea {
                                     vk::Format format, VkExtent3D extent, bool mipmaps, bool isDepth);
 
         vk::ImageLayout _currentLayout = vk::ImageLayout::eUndefined;
+        ResourceState _state;
     };
 
-    /// NOTE: causes a pipeline barrier; condense when possible
+    /// Collects the barriers for one pass boundary and emits them as a single vkCmdPipelineBarrier2 (see resourcestate.h).
+    /// Tracked state is updated when a resource is added, so add everything in the order the passes use it
+    class BarrierBatch {
+        std::vector<vk::MemoryBarrier2> memoryBarriers;
+        std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+        std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+
+        public:
+        BarrierBatch& image(AllocatedImage& img, const ResourceUsage& usage, bool discard = false) {
+            if (auto b = img.transition(usage, discard)) imageBarriers.push_back(*b);
+
+            return *this;
+        }
+
+        BarrierBatch& image(AllocatedImage& img, vk::ImageLayout layout, bool discard = false) {
+            return image(img, ResourceUsage::forLayout(layout), discard);
+        }
+
+        BarrierBatch& buffer(AllocatedBuffer& buf, const ResourceUsage& usage) {
+            vk::ImageLayout noLayout = vk::ImageLayout::eUndefined;
+
+            if (auto m = Internal::resolveBarrier(buf._state, noLayout, usage, false, false)) {
+                bufferBarriers.push_back(vk::BufferMemoryBarrier2(m->srcStage, m->srcAccess, m->dstStage, m->dstAccess,
+                                                                  VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, buf.buffer, 0, vk::WholeSize));
+            }
+
+            return *this;
+        }
+
+        /// Untracked global barrier, for things without an AllocatedBuffer to track (e.g. gvector uploads)
+        BarrierBatch& memory(const ResourceUsage& src, const ResourceUsage& dst) {
+            memoryBarriers.push_back(vk::MemoryBarrier2(src.stage, src.writes() ? src.access : vk::AccessFlagBits2::eNone, dst.stage, dst.access));
+
+            return *this;
+        }
+
+        /// Queue family ownership transfer, half 1: on the old owner's queue, after its last use. Both halves have to describe the same layout change,
+        ///  so this only records it; the tracked layout moves to newLayout in acquire()
+        BarrierBatch& release(AllocatedImage& img, vk::ImageLayout newLayout, uint32_t srcFamily, uint32_t dstFamily) {
+            vk::ImageAspectFlags aspect = img.isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+
+            imageBarriers.push_back(vk::ImageMemoryBarrier2(img._state.writeStage | img._state.readStages, img._state.writeAccess,
+                vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, img._currentLayout, newLayout, srcFamily, dstFamily, img.image,
+                vk::ImageSubresourceRange(aspect, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers)));
+
+            return *this;
+        }
+
+        /// half 2: on the new owner's queue, after waiting on a semaphore signalled after the release
+        BarrierBatch& acquire(AllocatedImage& img, const ResourceUsage& usage, uint32_t srcFamily, uint32_t dstFamily) {
+            vk::ImageAspectFlags aspect = img.isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+
+            imageBarriers.push_back(vk::ImageMemoryBarrier2(vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, usage.stage, usage.access,
+                img._currentLayout, usage.layout, srcFamily, dstFamily, img.image,
+                vk::ImageSubresourceRange(aspect, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers)));
+
+            img._currentLayout = usage.layout;
+            img._state = usage.writes() ? ResourceState{usage.stage, usage.access} : ResourceState{usage.stage, vk::AccessFlagBits2::eNone, usage.stage, usage.access};
+
+            return *this;
+        }
+
+        BarrierBatch& release(AllocatedBuffer& buf, uint32_t srcFamily, uint32_t dstFamily) {
+            bufferBarriers.push_back(vk::BufferMemoryBarrier2(buf._state.writeStage | buf._state.readStages, buf._state.writeAccess,
+                vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, srcFamily, dstFamily, buf.buffer, 0, vk::WholeSize));
+
+            return *this;
+        }
+
+        BarrierBatch& acquire(AllocatedBuffer& buf, const ResourceUsage& usage, uint32_t srcFamily, uint32_t dstFamily) {
+            bufferBarriers.push_back(vk::BufferMemoryBarrier2(vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, usage.stage, usage.access,
+                srcFamily, dstFamily, buf.buffer, 0, vk::WholeSize));
+
+            buf._state = usage.writes() ? ResourceState{usage.stage, usage.access} : ResourceState{usage.stage, vk::AccessFlagBits2::eNone, usage.stage, usage.access};
+
+            return *this;
+        }
+
+        bool empty() const {
+            return memoryBarriers.empty() && bufferBarriers.empty() && imageBarriers.empty();
+        }
+
+        void flush(vk::CommandBuffer cmd) {
+            Internal::pipelineBarrier(cmd, vk::DependencyInfo({}, memoryBarriers, bufferBarriers, imageBarriers));
+
+            memoryBarriers.clear();
+            bufferBarriers.clear();
+            imageBarriers.clear();
+        }
+    };
+
+    /// NOTE: causes a pipeline barrier (unless nothing needs one); condense when possible
+    inline void multiTransition(vk::CommandBuffer cmd, const std::vector<std::reference_wrapper<AllocatedImage>>& images, const std::vector<ResourceUsage>& usages, bool undefinedSrc = false) {
+        assert(images.size() == usages.size());
+
+        BarrierBatch batch;
+
+        for (size_t i=0; i<images.size(); i++) batch.image(images[i].get(), usages[i], undefinedSrc);
+
+        batch.flush(cmd);
+    }
+
+    /// NOTE: causes a pipeline barrier (unless nothing needs one); condense when possible
     inline void multiTransition(vk::CommandBuffer cmd, const std::vector<std::reference_wrapper<AllocatedImage>>& images, const std::vector<vk::ImageLayout>& layouts, bool undefinedSrc = false) {
         assert(images.size() == layouts.size());
-        
-        if (images.size() == 0) return;
 
-        std::vector<vk::ImageMemoryBarrier2> barrier;
-        barrier.reserve(images.size());
-        
-        for (size_t i=0; i<images.size(); i++) barrier.push_back(images[i].get().transition(layouts[i], undefinedSrc));
+        BarrierBatch batch;
 
-        vk::DependencyInfo dep({}, {}, {}, barrier);
+        for (size_t i=0; i<images.size(); i++) batch.image(images[i].get(), layouts[i], undefinedSrc);
 
-        cmd.pipelineBarrier2(dep);
+        batch.flush(cmd);
     }
 
-    /// NOTE: causes a pipeline barrier; condense when possible
+    /// NOTE: causes a pipeline barrier (unless nothing needs one); condense when possible
     inline void multiTransition(vk::CommandBuffer cmd, const std::vector<std::reference_wrapper<AllocatedImage>>& images, vk::ImageLayout layout, bool undefinedSrc = false) {
-        if (images.size() == 0) return;
-
-        std::vector<vk::ImageMemoryBarrier2> barrier;
-        barrier.reserve(images.size());
-        
-        for (size_t i=0; i<images.size(); i++) barrier.push_back(images[i].get().transition(layout, undefinedSrc));
+        BarrierBatch batch;
 
-        vk::DependencyInfo dep({}, {}, {}, barrier);
+        for (auto& img : images) batch.image(img.get(), layout, undefinedSrc);
 
-        cmd.pipelineBarrier2(dep);
+        batch.flush(cmd);
     }
 
-    /// NOTE: causes a pipeline barrier; condense when possible
-    inline void multiTransition(vk::CommandBuffer cmd, std::vector<AllocatedImage>& images, vk::ImageLayout layout, bool undefinedSrc = false) {
-        if (images.size() == 0) return;
+    /// NOTE: causes a pipeline barrier (unless nothing needs one); condense when possible
+    inline void multiTransition(vk::CommandBuffer cmd, std::vector<AllocatedImage>& images, const ResourceUsage& usage, bool undefinedSrc = false) {
+        BarrierBatch batch;
 
-        std::vector<vk::ImageMemoryBarrier2> barrier;
-        barrier.reserve(images.size());
-        
-        for (size_t i=0; i<images.size(); i++) barrier.push_back(images[i].transition(layout, undefinedSrc));
+        for (auto& img : images) batch.image(img, usage, undefinedSrc);
 
-        vk::DependencyInfo dep({}, {}, {}, barrier);
+        batch.flush(cmd);
+    }
 
-        cmd.pipelineBarrier2(dep);
+    /// NOTE: causes a pipeline barrier (unless nothing needs one); condense when possible
+    inline void multiTransition(vk::CommandBuffer cmd, std::vector<AllocatedImage>& images, vk::ImageLayout layout, bool undefinedSrc = false) {
+        multiTransition(cmd, images, ResourceUsage::forLayout(layout), undefinedSrc);
     }
 
     namespace Internal {
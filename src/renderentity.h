@@ -32,13 +32,39 @@ namespace Medea {
         uint32_t materialID;    //index of which material this entity uses. material uniform array addr derived from this in broadphase cull
         uint32_t materialUniformIdx; //<- index in material uniform array
 
-        //these entries form an indirect drawcall.
+        //these entries form an indexed indirect drawcall (VkDrawIndexedIndirectCommand)
         uint32_t meshSize; //<- numTriangles * 3. indexCount
         uint32_t instanceCount = 1;
-        //uint32_t firstIndex = 0; //<- if I copy all (unique) mesh indices into a single buffer, then I can just offset into it fairly simply. 
-        // But, ^ is a bit harder if you have to stream in mesh data (for example, for runtime created creatures). Can ignore for a while
-        int32_t vertexOffset = 0;
+        uint32_t firstIndex = 0; //<- into GPUSceneGraph's MeshIndexPool, which has every mesh's indices
+        int32_t vertexOffset = 0; //<- 0: indices are local to the mesh, whose streams meshAddress/positionStreamAddress already point at
         uint32_t firstInstance = 0;
+
+        uint32_t shadowLight = 0;   //<- only set in the shadow pass's draw list: light index + 1, i.e. which atlas tile this copy is drawn into
+
+        uint32_t id = 0;            //<- RenderEntityID, i.e. the index in RenderWorld's list; copies keep it. Indexes per entity GPU state (occlusion visibility)
+
+        //these form an indirect mesh tasks drawcall (VkDrawMeshTasksIndirectCommandEXT), for the mesh shader path: one task workgroup per
+        // MeshletLimits::perTaskGroup meshlets
+        uint32_t taskGroupsX = 0;
+        uint32_t taskGroupsY = 1;
+        uint32_t taskGroupsZ = 1;
+
+        //placement as of the previous frame, for motion vectors (TemporalUpscaler). Equal to pos/rot unless it moved last frame; see RenderWorld::setPos
+        glm::avec3 prevPos;
+        glm::avec4 prevRot;
+
+        uint64_t meshletAddress = 0;    //<- FullMesh::meshlets
+        uint32_t meshletCount = 0;
+
+        uint32_t vertexFormat = 0;      //<- VertexFormat: how positionStreamAddress is laid out
+
+        //FullMesh::lods: a MeshLod per level, finest first. Broadphase and shadow cull pick a level per view and write its draw fields
+        // (meshSize, firstIndex, meshletAddress/Count, taskGroupsX) into their copy; the ones here are level 0's
+        uint64_t lodAddress = 0;
+        uint32_t lodCount = 1;
+        uint32_t lodLevel = 0;          //<- which of them the draw fields are; set by whoever picked it
+
+        uint32_t instanceGroup = 0;     //<- dense id per (mesh, material), from RenderWorld::add. Automatic instancing groups copies by it + lodLevel
     };
 
     
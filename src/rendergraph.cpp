@@ -0,0 +1,696 @@
+#include "rendergraph.h"
+
+#include "gvector.h"
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <sstream>
+
+using namespace Medea;
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RGHandle h, const ResourceUsage& usage) {
+    assert(h.idx < graph.resources.size());
+
+    pass.accesses.push_back(Access{h.idx, usage, false, false});
+
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RGHandle h, const ResourceUsage& usage, bool discard) {
+    assert(h.idx < graph.resources.size());
+
+    pass.accesses.push_back(Access{h.idx, usage, true, discard});
+
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffect() {
+    pass.sideEffect = true;
+
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::asyncCompute() {
+    pass.async = true;
+
+    return *this;
+}
+
+
+namespace {
+    vk::raii::Semaphore makeTimeline(vk::raii::Device& device) {
+        vk::SemaphoreTypeCreateInfo typeInfo(vk::SemaphoreType::eTimeline, 0);
+
+        vk::SemaphoreCreateInfo sci;
+        sci.pNext = &typeInfo;
+
+        return vk::raii::Semaphore(device, sci);
+    }
+
+    vk::raii::CommandPool makeFramePool(vk::raii::Device& device, uint32_t family) {
+        return vk::raii::CommandPool(device, vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, family));
+    }
+}
+
+vk::CommandBuffer RenderGraph::reset(Core& core, vk::CommandBuffer cmd, bool asyncCompute) {
+    passes.clear();
+    resources.clear();
+
+    frameCmd = cmd;
+    asyncFrame = asyncCompute && core.computeQueue.has_value();
+
+    if (!asyncFrame) return frameCmd;
+
+    if (!async) {
+        std::vector<AsyncFrame> frames;
+
+        for (int i=0; i<BUF_FRAMES_IN_FLIGHT; i++) {
+            frames.push_back(AsyncFrame{QueueBuffers{makeFramePool(core.device, core.graphicsQueueFamily)},
+                                        QueueBuffers{makeFramePool(core.device, core.computeQueueFamily)}});
+        }
+
+        async = std::make_unique<AsyncQueues>(AsyncQueues{makeTimeline(core.device), makeTimeline(core.device), 0, 0, std::move(frames)});
+    }
+
+    async->frameIdx = (async->frameIdx + 1) % async->frames.size();
+
+    AsyncFrame& f = async->frames.at(async->frameIdx);
+
+    {
+        MEDEA_PROFILE_ZONE("RenderGraph::waitAsyncFrame");
+
+        //normally long done; the window's fences already keep us this many frames behind
+        std::array<vk::Semaphore, 2> sems = {*async->graphicsTimeline, *async->computeTimeline};
+        std::array<uint64_t, 2> values = {f.graphicsValue, f.computeValue};
+
+        VK_REQUIRE(core.device.waitSemaphores(vk::SemaphoreWaitInfo({}, sems, values), UINT64_MAX));
+    }
+
+    f.graphics.pool.reset();
+    f.compute.pool.reset();
+    f.graphics.used = 0;
+    f.compute.used = 0;
+
+    prologueCmd = nextBuffer(core, f.graphics);
+
+    return prologueCmd;
+}
+
+vk::CommandBuffer RenderGraph::nextBuffer(Core& core, QueueBuffers& qb) {
+    if (qb.used == qb.buffers.size()) {
+        auto fresh = core.device.allocateCommandBuffers(vk::CommandBufferAllocateInfo(*qb.pool, vk::CommandBufferLevel::ePrimary, 1));
+
+        qb.buffers.push_back(std::move(fresh.at(0)));
+    }
+
+    vk::CommandBuffer cmd = *qb.buffers.at(qb.used++);
+
+    cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    return cmd;
+}
+
+RGHandle RenderGraph::importImage(std::string_view name, AllocatedImage& img, bool output) {
+    Resource r;
+    r.name = name;
+    r.image = &img;
+    r.output = output;
+
+    resources.push_back(std::move(r));
+
+    return RGHandle{uint32_t(resources.size()-1)};
+}
+
+RGHandle RenderGraph::importBuffer(std::string_view name, AllocatedBuffer& buf, bool output) {
+    Resource r;
+    r.name = name;
+    r.buffer = &buf;
+    r.output = output;
+
+    resources.push_back(std::move(r));
+
+    return RGHandle{uint32_t(resources.size()-1)};
+}
+
+RGHandle RenderGraph::createImage(std::string_view name, const RGImageDesc& desc) {
+    Resource r;
+    r.name = name;
+    r.imageDesc = desc;
+
+    resources.push_back(std::move(r));
+
+    return RGHandle{uint32_t(resources.size()-1)};
+}
+
+RGHandle RenderGraph::createBuffer(std::string_view name, const RGBufferDesc& desc) {
+    Resource r;
+    r.name = name;
+    r.bufferDesc = desc;
+
+    resources.push_back(std::move(r));
+
+    return RGHandle{uint32_t(resources.size()-1)};
+}
+
+void RenderGraph::addPass(std::string_view name, std::function<void(PassBuilder&)> setup, ExecuteFunc execute) {
+    passes.push_back(Pass{std::string(name), {}, std::move(execute)});
+
+    PassBuilder builder(*this, passes.back());
+    setup(builder);
+}
+
+AllocatedImage& RenderGraph::getImage(RGHandle h) {
+    Resource& r = resources.at(h.idx);
+
+    if (r.image == nullptr) {
+        std::cerr<<"RenderGraph: \""<<r.name<<"\" isn't an image, or is a transient used outside of execute()"<<std::endl;
+        assert(false);
+    }
+
+    return *r.image;
+}
+
+AllocatedBuffer& RenderGraph::getBuffer(RGHandle h) {
+    Resource& r = resources.at(h.idx);
+
+    if (r.buffer == nullptr) {
+        std::cerr<<"RenderGraph: \""<<r.name<<"\" isn't a buffer, or is a transient used outside of execute()"<<std::endl;
+        assert(false);
+    }
+
+    return *r.buffer;
+}
+
+
+/// Walks backwards keeping track of which resources someone later still needs. Writes aren't assumed to cover the whole resource
+///  (a compute pass might only touch part of a buffer), so only discarding writes end a resource's need
+void RenderGraph::cull() {
+    std::vector<bool> needed(resources.size(), false);
+
+    for (size_t i=passes.size(); i-- > 0;) {
+        Pass& p = passes.at(i);
+
+        p.alive = p.sideEffect;
+
+        for (auto& a : p.accesses) {
+            if (a.write && (needed.at(a.resource) || resources.at(a.resource).output)) p.alive = true;
+        }
+
+        if (!p.alive) continue;
+
+        for (auto& a : p.accesses) if (a.discard) needed.at(a.resource) = false;
+        for (auto& a : p.accesses) if (!a.write) needed.at(a.resource) = true;
+    }
+}
+
+namespace {
+    struct TransientPlan {
+        uint32_t resource;
+        vk::MemoryRequirements reqs;
+    };
+
+    struct Slot {
+        size_t lastUse;
+        vk::MemoryRequirements reqs;
+    };
+}
+
+void RenderGraph::allocateTransients(Core& core, CleanupJobQueueCallback cleanup) {
+    MEDEA_PROFILE_ZONE("RenderGraph::allocateTransients");
+
+    std::vector<uint32_t> order;
+
+    for (uint32_t i=0; i<resources.size(); i++) {
+        Resource& r = resources.at(i);
+
+        if (!r.imageDesc && !r.bufferDesc) continue;
+
+        //declared but never used by a live pass
+        if (r.firstUse == SIZE_MAX) continue;
+
+        order.push_back(i);
+    }
+
+    std::sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) { return resources.at(a).firstUse < resources.at(b).firstUse; });
+
+    //same transients with the same lifetimes -> same aliasing, so the last frame's pool can be reused as is
+    std::stringstream keyStream;
+
+    for (uint32_t i : order) {
+        Resource& r = resources.at(i);
+
+        keyStream << r.firstUse << "-" << r.lastUse << ":";
+
+        if (r.imageDesc) {
+            const vk::ImageCreateInfo& ici = r.imageDesc->info;
+
+            keyStream << "i" << int(ici.imageType) << "," << int(ici.format) << "," << ici.extent.width << "x" << ici.extent.height << "x" << ici.extent.depth
+                      << "," << ici.mipLevels << "," << ici.arrayLayers << "," << uint32_t(ici.usage) << "," << int(r.imageDesc->viewType) << ";";
+        }
+        else {
+            keyStream << "b" << r.bufferDesc->size << "," << uint32_t(r.bufferDesc->usage) << ";";
+        }
+    }
+
+    std::string key = keyStream.str();
+
+    if (!pool || pool->key != key) {
+        //frames in flight may still be using the old one
+        if (pool) cleanup([old = std::move(pool)] () {});
+
+        MemoryCategoryScope transientMemory(MemoryCategory::transients);
+
+        auto next = std::make_shared<TransientPool>();
+        next->key = key;
+
+        std::vector<vk::raii::Image> images;
+        std::vector<vk::Buffer> buffers;
+        std::vector<vk::MemoryRequirements> reqs;
+
+        images.reserve(order.size());
+
+        for (uint32_t i : order) {
+            Resource& r = resources.at(i);
+
+            if (r.imageDesc) {
+                images.push_back(vk::raii::Image(core.device, r.imageDesc->info));
+                buffers.push_back(nullptr);
+
+                reqs.push_back(images.back().getMemoryRequirements());
+            }
+            else {
+                vk::Buffer buf = (*core.device).createBuffer(vk::BufferCreateInfo({}, r.bufferDesc->size, r.bufferDesc->usage));
+
+                images.push_back(vk::raii::Image(nullptr));
+                buffers.push_back(buf);
+
+                reqs.push_back((*core.device).getBufferMemoryRequirements(buf));
+            }
+        }
+
+        //greedy interval packing: reuse the first slot whose last user is done before this one starts
+        std::vector<Slot> slots;
+        std::vector<size_t> slotOf(order.size());
+
+        for (size_t t=0; t<order.size(); t++) {
+            Resource& r = resources.at(order.at(t));
+
+            size_t chosen = SIZE_MAX;
+
+            for (size_t s=0; s<slots.size(); s++) {
+                if (slots.at(s).lastUse < r.firstUse && (slots.at(s).reqs.memoryTypeBits & reqs.at(t).memoryTypeBits)) {
+                    chosen = s;
+                    break;
+                }
+            }
+
+            if (chosen == SIZE_MAX) {
+                slots.push_back(Slot{r.lastUse, reqs.at(t)});
+                chosen = slots.size()-1;
+            }
+            else {
+                Slot& s = slots.at(chosen);
+
+                s.lastUse = r.lastUse;
+                s.reqs.size = std::max(s.reqs.size, reqs.at(t).size);
+                s.reqs.alignment = std::max(s.reqs.alignment, reqs.at(t).alignment);
+                s.reqs.memoryTypeBits &= reqs.at(t).memoryTypeBits;
+            }
+
+            slotOf.at(t) = chosen;
+        }
+
+        stats.transientBytes = 0;
+        stats.allocatedBytes = 0;
+
+        for (auto& r : reqs) stats.transientBytes += r.size;
+
+        for (auto& s : slots) {
+            VmaAllocationCreateInfo aci = {};
+            aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+            aci.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            VkMemoryRequirements cReqs = s.reqs;
+            VmaAllocation mem;
+
+            VK_REQUIRE(vmaAllocateMemory(core.allocator, &cReqs, &aci, &mem, nullptr));
+
+            next->memory.push_back(Internal::WrappedAllocation(core.allocator, mem));
+            next->slotStates.push_back(ResourceState{});
+
+            stats.allocatedBytes += s.reqs.size;
+        }
+
+        for (size_t t=0; t<order.size(); t++) {
+            Resource& r = resources.at(order.at(t));
+            VmaAllocation mem = next->memory.at(slotOf.at(t)).memory;
+
+            Transient out{nullptr, nullptr, slotOf.at(t)};
+
+            if (r.imageDesc) {
+                const RGImageDesc& desc = *r.imageDesc;
+
+                VK_REQUIRE(vmaBindImageMemory(core.allocator, mem, *images.at(t)));
+
+                vk::ImageAspectFlags aspect = desc.isDepth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+
+                vk::ImageViewCreateInfo ivci({}, *images.at(t), desc.viewType, desc.info.format, vk::ComponentMapping(),
+                                             vk::ImageSubresourceRange(aspect, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers));
+
+                vk::raii::ImageView view(core.device, ivci);
+
+                //memory belongs to the slot, so the image gets an empty allocation
+                out.image = std::make_unique<AllocatedImage>(AllocatedImage{std::move(images.at(t)), std::move(view), desc.info.format,
+                    Internal::WrappedAllocation(core.allocator, VK_NULL_HANDLE), desc.info.extent, core.graphicsQueueFamily, desc.info.mipLevels,
+                    desc.info, desc.isDepth});
+            }
+            else {
+                VK_REQUIRE(vmaBindBufferMemory(core.allocator, mem, buffers.at(t)));
+
+                VmaAllocationInfo info = {};
+                info.size = r.bufferDesc->size;
+
+                out.buffer = std::make_unique<AllocatedBuffer>(*core.device, core.allocator, buffers.at(t), VK_NULL_HANDLE, info,
+                                                               r.bufferDesc->size, r.bufferDesc->usage);
+            }
+
+            next->transients.push_back(std::move(out));
+        }
+
+        pool = std::move(next);
+    }
+
+    stats.transients = order.size();
+    stats.memorySlots = pool->memory.size();
+
+    for (size_t t=0; t<order.size(); t++) {
+        Resource& r = resources.at(order.at(t));
+        Transient& tr = pool->transients.at(t);
+
+        r.transientIdx = t;
+        r.image = tr.image.get();
+        r.buffer = tr.buffer.get();
+    }
+}
+
+void RenderGraph::recordPass(vk::CommandBuffer cmd, Pass& p, bool computeQueue, uint32_t srcFamily, uint32_t dstFamily,
+                             const PassBeginFunc& onPassBegin, const PassEndFunc& onPassEnd) {
+    if (onPassBegin) onPassBegin(cmd, p.name, computeQueue);
+
+    BarrierBatch barriers;
+
+    for (auto& a : p.accesses) {
+        Resource& r = resources.at(a.resource);
+
+        const bool transient = r.imageDesc || r.bufferDesc;
+
+        ResourceState& state = r.image ? r.image->_state : r.buffer->_state;
+        ResourceState* slotState = transient ? &pool->slotStates.at(pool->transients.at(r.transientIdx).slot) : nullptr;
+
+        //whatever used this memory last (possibly another transient) has to be done with it first. If that was on the other queue,
+        // the semaphore wait already covers it, and its stages don't exist on this one
+        if (a.discard && a.crossQueue)  state = ResourceState{};
+        else if (slotState && a.discard) state = *slotState;
+
+        if (a.acquire) {
+            if (r.image) barriers.acquire(*r.image, a.usage, srcFamily, dstFamily);
+            else         barriers.acquire(*r.buffer, a.usage, srcFamily, dstFamily);
+        }
+        else if (r.image) barriers.image(*r.image, a.usage, a.discard);
+        else              barriers.buffer(*r.buffer, a.usage);
+
+        if (slotState) *slotState = state;
+    }
+
+    barriers.flush(cmd);
+
+    p.execute(cmd);
+
+    if (onPassEnd) onPassEnd(cmd, computeQueue);
+}
+
+void RenderGraph::execute(Core& core, CleanupJobQueueCallback cleanup, PassBeginFunc onPassBegin, PassEndFunc onPassEnd) {
+    MEDEA_PROFILE_ZONE("RenderGraph::execute");
+
+    cull();
+
+    std::vector<size_t> live;
+
+    for (size_t i=0; i<passes.size(); i++) if (passes.at(i).alive) live.push_back(i);
+
+    stats.passes = live.size();
+    stats.culledPasses = passes.size() - live.size();
+    stats.submits = 0;
+    stats.queueTransfers = 0;
+    stats.asyncPasses.clear();
+
+    //transient lifetimes, in live pass indices
+    for (size_t l=0; l<live.size(); l++) {
+        for (auto& a : passes.at(live.at(l)).accesses) {
+            Resource& r = resources.at(a.resource);
+
+            if (!r.imageDesc && !r.bufferDesc) continue;
+
+            if (r.firstUse == SIZE_MAX) {
+                r.firstUse = l;
+
+                if (!a.write) std::cerr<<"WARN: RenderGraph: transient \""<<r.name<<"\" is read by \""<<passes.at(live.at(l)).name<<"\" before anything writes it"<<std::endl;
+
+                //nothing to preserve; also means aliases don't need their layout respected
+                a.discard = true;
+            }
+
+            r.lastUse = l;
+        }
+    }
+
+    allocateTransients(core, cleanup);
+
+    if (asyncFrame) {
+        executeAsync(core, live, onPassBegin, onPassEnd);
+        return;
+    }
+
+    for (size_t passIdx : live) recordPass(frameCmd, passes.at(passIdx), false, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, onPassBegin, onPassEnd);
+}
+
+namespace {
+    enum class QueueKind { graphics, compute };
+
+    /// One submit's worth of passes
+    struct Segment {
+        QueueKind queue;
+        std::vector<size_t> passes;     //<- live indices
+        std::vector<std::pair<uint32_t, vk::ImageLayout>> releases;     //<- resource + the layout its acquire wants, recorded after the passes
+        std::set<size_t> waits;         //<- segments on the other queue
+        uint64_t value = 0;             //<- timeline value signalled when it's done
+    };
+
+    struct Owner {
+        QueueKind queue = QueueKind::graphics;
+        size_t segment = SIZE_MAX;      //<- last one to touch it this frame
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    };
+}
+
+/// Cuts the live passes into per-queue segments, works out semaphore waits and ownership transfers, then records + submits each segment.
+///  Segment 0 is always the graphics prologue handed out by reset(), and the last one is always frameCmd (graphics)
+void RenderGraph::executeAsync(Core& core, const std::vector<size_t>& live, const PassBeginFunc& onPassBegin, const PassEndFunc& onPassEnd) {
+    auto queueOf = [&] (size_t l) { return passes.at(live.at(l)).async ? QueueKind::compute : QueueKind::graphics; };
+
+    //dependencies go through memory, so aliased transients count as the same thing
+    auto memoryKey = [&] (uint32_t res) {
+        Resource& r = resources.at(res);
+
+        return (r.imageDesc || r.bufferDesc) ? resources.size() + pool->transients.at(r.transientIdx).slot : size_t(res);
+    };
+
+    const size_t keys = resources.size() + pool->memory.size();
+
+    //anything the other queue waits on ends its segment, so the wait doesn't also cover the rest of the run
+    std::vector<bool> splitAfter(live.size(), false);
+
+    {
+        std::vector<size_t> lastAccess(keys, SIZE_MAX);
+
+        for (size_t l=0; l<live.size(); l++) {
+            for (auto& a : passes.at(live.at(l)).accesses) {
+                size_t& prev = lastAccess.at(memoryKey(a.resource));
+
+                if (prev != SIZE_MAX && prev != l && queueOf(prev) != queueOf(l)) splitAfter.at(prev) = true;
+
+                prev = l;
+            }
+        }
+    }
+
+    std::vector<Segment> segs{Segment{QueueKind::graphics}};
+    std::vector<size_t> segOf(live.size());
+
+    for (size_t l=0; l<live.size(); l++) {
+        if (segs.back().queue != queueOf(l) || (l > 0 && splitAfter.at(l-1))) segs.push_back(Segment{queueOf(l)});
+
+        segs.back().passes.push_back(l);
+        segOf.at(l) = segs.size()-1;
+    }
+
+    if (segs.size() == 1 || segs.back().queue == QueueKind::compute) segs.push_back(Segment{QueueKind::graphics});
+
+    const size_t finalSeg = segs.size()-1;
+
+    auto familyOf = [&] (QueueKind q) { return q == QueueKind::compute ? core.computeQueueFamily : core.graphicsQueueFamily; };
+
+    std::vector<Owner> memory(keys), owners(resources.size());
+
+    for (size_t l=0; l<live.size(); l++) {
+        const size_t s = segOf.at(l);
+        const QueueKind q = segs.at(s).queue;
+
+        for (auto& a : passes.at(live.at(l)).accesses) {
+            Owner& m = memory.at(memoryKey(a.resource));
+
+            if (m.queue != q) {
+                a.crossQueue = true;
+
+                if (m.segment != SIZE_MAX) segs.at(s).waits.insert(m.segment);
+            }
+
+            m.queue = q;
+            m.segment = s;
+
+            Owner& o = owners.at(a.resource);
+
+            if (o.queue != q) {
+                if (!a.discard) {
+                    a.acquire = true;
+
+                    //not touched yet this frame: graphics owns it from last frame, and the prologue comes before anything else
+                    segs.at(o.segment == SIZE_MAX ? 0 : o.segment).releases.push_back({a.resource, a.usage.layout});
+
+                    stats.queueTransfers++;
+                }
+
+                o.queue = q;
+            }
+
+            o.segment = s;
+            o.layout = a.usage.layout;
+        }
+    }
+
+    //the prologue has everything the graph depends on (uploads, query resets, last frame's graphics work in submission order);
+    // later compute segments come after the first in queue order anyway
+    for (size_t s=0; s<segs.size(); s++) {
+        if (segs.at(s).queue == QueueKind::compute) {
+            segs.at(s).waits.insert(0);
+            break;
+        }
+    }
+
+    //the frame's fence is only on the final submit, so it waits on all compute work. Also hand everything back to graphics for next frame
+    std::vector<uint32_t> finalAcquires;
+
+    for (size_t s=finalSeg; s-- > 0;) {
+        if (segs.at(s).queue == QueueKind::compute) {
+            segs.at(finalSeg).waits.insert(s);
+            break;
+        }
+    }
+
+    for (uint32_t i=0; i<owners.size(); i++) {
+        Owner& o = owners.at(i);
+
+        if (o.queue != QueueKind::compute) continue;
+
+        segs.at(o.segment).releases.push_back({i, o.layout});
+        finalAcquires.push_back(i);
+
+        stats.queueTransfers++;
+    }
+
+    AsyncFrame& f = async->frames.at(async->frameIdx);
+
+    for (size_t s=0; s<segs.size(); s++) {
+        Segment& seg = segs.at(s);
+
+        const bool compute = seg.queue == QueueKind::compute;
+        const uint32_t ownFamily = familyOf(seg.queue);
+        const uint32_t otherFamily = familyOf(compute ? QueueKind::graphics : QueueKind::compute);
+
+        vk::CommandBuffer cmd = s == 0 ? prologueCmd
+                              : s == finalSeg ? frameCmd
+                              : nextBuffer(core, compute ? f.compute : f.graphics);
+
+        if (s == finalSeg && finalAcquires.size()) {
+            BarrierBatch acquires;
+
+            for (uint32_t i : finalAcquires) {
+                Resource& r = resources.at(i);
+                ResourceUsage any{vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite, owners.at(i).layout};
+
+                if (r.image) acquires.acquire(*r.image, any, otherFamily, ownFamily);
+                else         acquires.acquire(*r.buffer, any, otherFamily, ownFamily);
+            }
+
+            acquires.flush(cmd);
+        }
+
+        for (size_t l : seg.passes) {
+            Pass& p = passes.at(live.at(l));
+
+            if (compute) stats.asyncPasses.push_back(p.name);
+
+            recordPass(cmd, p, compute, otherFamily, ownFamily, onPassBegin, onPassEnd);
+        }
+
+        if (seg.releases.size()) {
+            BarrierBatch releases;
+
+            for (auto& [i, layout] : seg.releases) {
+                Resource& r = resources.at(i);
+
+                if (r.image) releases.release(*r.image, layout, ownFamily, otherFamily);
+                else         releases.release(*r.buffer, ownFamily, otherFamily);
+            }
+
+            releases.flush(cmd);
+        }
+
+        std::vector<vk::SemaphoreSubmitInfo> waits;
+
+        for (size_t w : seg.waits) {
+            vk::Semaphore sem = segs.at(w).queue == QueueKind::compute ? *async->computeTimeline : *async->graphicsTimeline;
+
+            waits.push_back(vk::SemaphoreSubmitInfo(sem, segs.at(w).value, vk::PipelineStageFlagBits2::eAllCommands));
+        }
+
+        seg.value = compute ? ++async->computeValue : ++async->graphicsValue;
+
+        vk::SemaphoreSubmitInfo signal(compute ? *async->computeTimeline : *async->graphicsTimeline, seg.value, vk::PipelineStageFlagBits2::eAllCommands);
+
+        if (compute) f.computeValue = seg.value;
+        else         f.graphicsValue = seg.value;
+
+        if (s == finalSeg) {
+            for (auto& w : waits) core.primaryWindow.addSubmitWait(w);
+
+            core.primaryWindow.addSubmitSignal(signal);
+            break;
+        }
+
+        cmd.end();
+
+        vk::CommandBufferSubmitInfo cmdInfo(cmd);
+        vk::SubmitInfo2 sub({}, waits, cmdInfo, signal);
+
+        {
+            MEDEA_PROFILE_ZONE("queueSubmit");
+
+            if (compute) core.computeQueue->submit2(sub);
+            else         core.graphicsQueue.submit2(sub);
+        }
+
+        stats.submits++;
+    }
+}
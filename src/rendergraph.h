@@ -0,0 +1,209 @@
+#pragma once
+
+#include "core.h"
+#include "metaimage.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Per-frame render graph. Passes declare what they read and write (as ResourceUsages, see resourcestate.h); execute() then
+///  - culls passes whose writes nobody reads (unless they're outputs or have side effects),
+///  - gives transient resources memory, aliasing ones whose lifetimes don't overlap,
+///  - emits one BarrierBatch per pass with whatever transitions/hazards the declarations imply,
+///  - and runs the passes in declaration order (dependencies are derived from it, so it's always a valid order).
+///
+/// With async compute (see reset()), passes marked asyncCompute() run on Core::computeQueue. The frame is then cut into submits wherever work
+///  crosses queues; each waits on the other queue's timeline semaphore only where a declared access needs it, and non-discarded resources get
+///  queue family ownership transfers. Between frames, everything is owned by the graphics queue.
+///
+///     cmd = graph.reset(core, cmd);
+///     RGHandle froxels = graph.importBuffer("froxelArray", froxelArray);
+///     graph.addPass("froxelSetup",
+///         [&] (RenderGraph::PassBuilder& b) { b.write(froxels, ResourceUsage::computeWrite()); },
+///         [&] (vk::CommandBuffer cmd) { cmd.dispatch(...); });
+///     ...
+///     graph.execute(core, cleanup);
+
+namespace Medea {
+
+    /// A resource declared on a RenderGraph; only valid until the next reset()
+    struct RGHandle {
+        uint32_t idx = UINT32_MAX;
+
+        bool valid() const {
+            return idx != UINT32_MAX;
+        }
+    };
+
+    struct RGImageDesc {
+        vk::ImageCreateInfo info;
+        vk::ImageViewType viewType;
+        bool isDepth = false;
+    };
+
+    struct RGBufferDesc {
+        vk::DeviceSize size;
+        vk::BufferUsageFlags usage;
+    };
+
+    /// From the last execute()
+    struct RenderGraphStats {
+        size_t passes = 0;
+        size_t culledPasses = 0;
+        size_t transients = 0;
+        size_t memorySlots = 0;             //<- allocations backing the transients; < transients means something got aliased
+        vk::DeviceSize transientBytes = 0;  //<- what the transients would take unaliased
+        vk::DeviceSize allocatedBytes = 0;
+
+        size_t submits = 0;                 //<- extra queue submits for async compute (the frame's own submit isn't counted)
+        size_t queueTransfers = 0;          //<- ownership transfers between the graphics and compute queue families
+        std::vector<std::string> asyncPasses;   //<- ran on the compute queue
+    };
+
+    class RenderGraph {
+        public:
+        using ExecuteFunc = std::function<void(vk::CommandBuffer cmd)>;
+        using PassBeginFunc = std::function<void(vk::CommandBuffer cmd, std::string_view name, bool computeQueue)>;
+        using PassEndFunc = std::function<void(vk::CommandBuffer cmd, bool computeQueue)>;
+
+        private:
+        struct Access {
+            uint32_t resource;
+            ResourceUsage usage;
+            bool write;
+            bool discard;
+
+            //set per frame when async compute splits the frame
+            bool crossQueue = false;    //<- memory was last touched on the other queue
+            bool acquire = false;       //<- ...and its contents come along, via an ownership transfer
+        };
+
+        struct Pass {
+            std::string name;
+            std::vector<Access> accesses;
+            ExecuteFunc execute;
+            bool sideEffect = false;
+            bool async = false;
+            bool alive = false;
+        };
+
+        struct Resource {
+            std::string name;
+
+            AllocatedImage* image = nullptr;    //<- imported, or the pool's once execute() allocated it
+            AllocatedBuffer* buffer = nullptr;
+
+            std::optional<RGImageDesc> imageDesc;   //<- set for transients
+            std::optional<RGBufferDesc> bufferDesc;
+
+            bool output = false;
+
+            //transients only
+            size_t firstUse = SIZE_MAX;
+            size_t lastUse = 0;
+            size_t transientIdx = 0;
+        };
+
+        struct Transient {
+            std::unique_ptr<AllocatedImage> image;
+            std::unique_ptr<AllocatedBuffer> buffer;
+            size_t slot;
+        };
+
+        /// Transients + their memory, reused frame to frame as long as the graph declares the same transients with the same lifetimes
+        struct TransientPool {
+            std::vector<Internal::WrappedAllocation> memory;    //<- one per slot; declared first, so it's freed after what's bound to it
+            std::vector<Transient> transients;
+            std::vector<ResourceState> slotStates;              //<- last access to anything in the slot, so aliases wait on each other
+            std::string key;
+        };
+
+        struct QueueBuffers {
+            vk::raii::CommandPool pool;
+            std::vector<vk::raii::CommandBuffer> buffers;
+            size_t used = 0;
+        };
+
+        /// Per frame in flight. Its pools are only reset once the timeline values it signalled last time have been reached
+        struct AsyncFrame {
+            QueueBuffers graphics, compute;
+            uint64_t graphicsValue = 0, computeValue = 0;
+        };
+
+        /// Created the first time a frame asks for async compute
+        struct AsyncQueues {
+            vk::raii::Semaphore graphicsTimeline, computeTimeline;
+            uint64_t graphicsValue = 0, computeValue = 0;   //<- last value handed out on each
+            std::vector<AsyncFrame> frames;
+            size_t frameIdx = 0;
+        };
+
+        std::vector<Pass> passes;
+        std::vector<Resource> resources;
+
+        std::shared_ptr<TransientPool> pool;
+        std::unique_ptr<AsyncQueues> async;
+
+        bool asyncFrame = false;
+        vk::CommandBuffer frameCmd, prologueCmd;
+
+        RenderGraphStats stats;
+
+        void cull();
+        void allocateTransients(Core& core, CleanupJobQueueCallback cleanup);
+
+        vk::CommandBuffer nextBuffer(Core& core, QueueBuffers& qb);
+        void recordPass(vk::CommandBuffer cmd, Pass& p, bool computeQueue, uint32_t srcFamily, uint32_t dstFamily,
+                        const PassBeginFunc& onPassBegin, const PassEndFunc& onPassEnd);
+        void executeAsync(Core& core, const std::vector<size_t>& live, const PassBeginFunc& onPassBegin, const PassEndFunc& onPassEnd);
+
+        public:
+        class PassBuilder {
+            RenderGraph& graph;
+            Pass& pass;
+
+            public:
+            PassBuilder(RenderGraph& g, Pass& p) : graph(g), pass(p) {}
+
+            PassBuilder& read(RGHandle h, const ResourceUsage& usage);
+            /// @param discard previous contents aren't needed (full clear/overwrite); lets earlier writers be culled, and skips preserving image contents
+            PassBuilder& write(RGHandle h, const ResourceUsage& usage, bool discard = false);
+            /// never culled (readbacks, anything observed outside the graph's resources)
+            PassBuilder& sideEffect();
+            /// may run on the async compute queue: compute/transfer work only, and every resource it touches has to be declared
+            PassBuilder& asyncCompute();
+        };
+
+        /// Start of frame; drops passes/resources, but keeps the transient pool.
+        /// @param frameCmd the primary window's command buffer for this frame; the last graphics work is recorded into it, so it has to be submitted by MVKWindow::endDraw
+        /// @param asyncCompute run asyncCompute() passes on Core::computeQueue (ignored if there isn't one)
+        /// @return where to record anything the graph's passes depend on. With async compute that's the graph's first submit, which goes out during
+        ///  execute(), i.e. before whatever was recorded into frameCmd earlier
+        vk::CommandBuffer reset(Core& core, vk::CommandBuffer frameCmd, bool asyncCompute = false);
+
+        /// @param output written for someone outside the graph (e.g. the swapchain blit), so its writers are never culled
+        RGHandle importImage(std::string_view name, AllocatedImage& img, bool output = false);
+        RGHandle importBuffer(std::string_view name, AllocatedBuffer& buf, bool output = false);
+
+        /// Graph-owned, lives for one frame. Contents are undefined at the first access, which has to be a write
+        RGHandle createImage(std::string_view name, const RGImageDesc& desc);
+        RGHandle createBuffer(std::string_view name, const RGBufferDesc& desc);
+
+        void addPass(std::string_view name, std::function<void(PassBuilder&)> setup, ExecuteFunc execute);
+
+        /// transients only exist once execute() has started, so call these from pass callbacks
+        AllocatedImage& getImage(RGHandle h);
+        AllocatedBuffer& getBuffer(RGHandle h);
+
+        /// @param onPassBegin/onPassEnd wrapped around each pass (barriers included), e.g. for GPU timestamps
+        void execute(Core& core, CleanupJobQueueCallback cleanup, PassBeginFunc onPassBegin = {}, PassEndFunc onPassEnd = {});
+
+        const RenderGraphStats& getStats() const {
+            return stats;
+        }
+    };
+}
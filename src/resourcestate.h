@@ -0,0 +1,218 @@
+#pragma once
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include <cassert>
+#include <optional>
+
+/// Resource state tracking for minimal sync2 barriers. Every AllocatedImage/AllocatedBuffer remembers its last write and who has read it since;
+///  a transition only emits a barrier for a real hazard (RAW, WAR, WAW, or a layout change), scoped to the stages actually involved:
+///
+///     BarrierBatch()
+///         .buffer(froxelArray, ResourceUsage::computeRead())
+///         .image(volLightingImage, ResourceUsage::computeWrite(vk::ImageLayout::eGeneral))
+///         .flush(cmd);                                                //<- one vkCmdPipelineBarrier2 for the whole pass boundary
+///
+/// See BarrierStats for counting what actually got emitted.
+
+namespace Medea {
+
+    /// How a pass is about to use a resource
+    struct ResourceUsage {
+        vk::PipelineStageFlags2 stage;
+        vk::AccessFlags2 access;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;  //<- ignored for buffers
+
+        ResourceUsage operator|(const ResourceUsage& o) const {
+            assert(layout == o.layout);
+
+            return ResourceUsage{stage | o.stage, access | o.access, layout};
+        }
+
+        bool writes() const {
+            const vk::AccessFlags2 WRITE_ACCESS = vk::AccessFlagBits2::eShaderWrite | vk::AccessFlagBits2::eShaderStorageWrite
+                | vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentWrite
+                | vk::AccessFlagBits2::eTransferWrite | vk::AccessFlagBits2::eHostWrite | vk::AccessFlagBits2::eMemoryWrite;
+
+            return bool(access & WRITE_ACCESS);
+        }
+
+        static ResourceUsage none(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, l};
+        }
+
+        static ResourceUsage transferRead(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferRead, l};
+        }
+        static ResourceUsage transferWrite(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite, l};
+        }
+
+        static ResourceUsage computeRead(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderRead, l};
+        }
+        /// read-modify-write, e.g. atomics or storage images that are accumulated into
+        static ResourceUsage computeWrite(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite, l};
+        }
+
+        static ResourceUsage vertexRead(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eVertexShader, vk::AccessFlagBits2::eShaderRead, l};
+        }
+        static ResourceUsage fragmentRead(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eShaderRead, l};
+        }
+        /// task + mesh shaders; only valid with DeviceCapabilities::meshShader
+        static ResourceUsage meshRead(vk::ImageLayout l = vk::ImageLayout::eUndefined) {
+            return {vk::PipelineStageFlagBits2::eTaskShaderEXT | vk::PipelineStageFlagBits2::eMeshShaderEXT, vk::AccessFlagBits2::eShaderRead, l};
+        }
+        static ResourceUsage indirectRead() {
+            return {vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead};
+        }
+
+        static ResourceUsage colorAttachment() {
+            return {vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite,
+                    vk::ImageLayout::eColorAttachmentOptimal};
+        }
+        static ResourceUsage depthAttachment() {
+            return {vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+                    vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
+                    vk::ImageLayout::eDepthAttachmentOptimal};
+        }
+
+        static ResourceUsage hostRead() {
+            return {vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead};
+        }
+
+        /// last use before vkQueuePresent; the submit's signal semaphore covers the rest
+        static ResourceUsage present() {
+            return {vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::ImageLayout::ePresentSrcKHR};
+        }
+
+        /// Typical usage for an image in this layout. eGeneral can mean anything, so it falls back to ALL_COMMANDS; prefer passing a real usage for those
+        static ResourceUsage forLayout(vk::ImageLayout l) {
+            switch (l) {
+                case vk::ImageLayout::eUndefined:                   return none();
+                case vk::ImageLayout::eColorAttachmentOptimal:      return colorAttachment();
+                case vk::ImageLayout::eDepthAttachmentOptimal:      return depthAttachment();
+                case vk::ImageLayout::eShaderReadOnlyOptimal:
+                    return {vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader,
+                            vk::AccessFlagBits2::eShaderSampledRead, l};
+                case vk::ImageLayout::eTransferSrcOptimal:          return transferRead(l);
+                case vk::ImageLayout::eTransferDstOptimal:          return transferWrite(l);
+                case vk::ImageLayout::ePresentSrcKHR:               return present();
+
+                default:
+                    return {vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite, l};
+            }
+        }
+    };
+
+    /// Tracked per resource. Layout lives next to it (AllocatedImage::_currentLayout)
+    struct ResourceState {
+        vk::PipelineStageFlags2 writeStage = vk::PipelineStageFlagBits2::eNone;    //<- last write (or layout transition)
+        vk::AccessFlags2 writeAccess = vk::AccessFlagBits2::eNone;
+
+        vk::PipelineStageFlags2 readStages = vk::PipelineStageFlagBits2::eNone;    //<- stages that read since, and have the write made visible
+        vk::AccessFlags2 readAccess = vk::AccessFlagBits2::eNone;
+
+        /// for resources written outside of tracking (e.g. mip generation)
+        static ResourceState written(const ResourceUsage& u) {
+            return ResourceState{u.stage, u.access};
+        }
+    };
+
+    /// Running totals of everything emitted through Internal::pipelineBarrier; diff two snapshots to get per-frame numbers
+    struct BarrierStats {
+        uint64_t batches = 0;           //<- vkCmdPipelineBarrier2 calls
+        uint64_t memoryBarriers = 0;
+        uint64_t bufferBarriers = 0;
+        uint64_t imageBarriers = 0;
+        uint64_t allCommandsBarriers = 0;   //<- barriers whose source scope is ALL_COMMANDS, i.e. full pipeline drains
+        uint64_t elided = 0;            //<- transitions that turned out not to need a barrier
+
+        BarrierStats operator-(const BarrierStats& o) const {
+            return BarrierStats{batches - o.batches, memoryBarriers - o.memoryBarriers, bufferBarriers - o.bufferBarriers,
+                                imageBarriers - o.imageBarriers, allCommandsBarriers - o.allCommandsBarriers, elided - o.elided};
+        }
+
+        /// all recording is on the render thread, so these are plain counters
+        static BarrierStats& get() {
+            static BarrierStats stats;
+
+            return stats;
+        }
+    };
+
+    namespace Internal {
+        struct BarrierMasks {
+            vk::PipelineStageFlags2 srcStage;
+            vk::AccessFlags2 srcAccess;
+            vk::PipelineStageFlags2 dstStage;
+            vk::AccessFlags2 dstAccess;
+            vk::ImageLayout oldLayout;
+            vk::ImageLayout newLayout;
+        };
+
+        /// Advances state/layout to `usage`, returning the barrier needed to get there (if any).
+        /// @param discard treat the old contents as garbage (oldLayout = eUndefined)
+        inline std::optional<BarrierMasks> resolveBarrier(ResourceState& state, vk::ImageLayout& layout, const ResourceUsage& usage, bool discard, bool isImage) {
+            const bool layoutChange = isImage && (discard || layout != usage.layout);
+
+            BarrierMasks out{state.writeStage | state.readStages, state.writeAccess, usage.stage, usage.access,
+                             discard ? vk::ImageLayout::eUndefined : layout, isImage ? usage.layout : layout};
+
+            if (!layoutChange && !usage.writes()) {
+                //read after read, or the write is already visible to this stage
+                bool covered = state.writeStage == vk::PipelineStageFlagBits2::eNone
+                    || (!(usage.stage & ~state.readStages) && !(usage.access & ~state.readAccess));
+
+                state.readStages |= usage.stage;
+                state.readAccess |= usage.access;
+
+                if (covered) {
+                    BarrierStats::get().elided++;
+                    return std::nullopt;
+                }
+
+                out.srcStage = state.writeStage;
+                return out;
+            }
+
+            //write, or layout transition (which is a write): wait on the last write and every read since
+            bool nothingToWaitOn = out.srcStage == vk::PipelineStageFlagBits2::eNone;
+
+            if (isImage) layout = usage.layout;
+
+            //a later read has to wait for this write, even in the same stage; a read-only transition already made itself visible to usage.stage
+            if (usage.writes()) state = ResourceState{usage.stage, usage.access};
+            else                state = ResourceState{usage.stage, vk::AccessFlagBits2::eNone, usage.stage, usage.access};
+
+            if (nothingToWaitOn && !layoutChange) {
+                BarrierStats::get().elided++;
+                return std::nullopt;
+            }
+
+            return out;
+        }
+
+        inline void pipelineBarrier(vk::CommandBuffer cmd, const vk::DependencyInfo& dep) {
+            if (dep.memoryBarrierCount + dep.bufferMemoryBarrierCount + dep.imageMemoryBarrierCount == 0) return;
+
+            BarrierStats& stats = BarrierStats::get();
+
+            stats.batches++;
+            stats.memoryBarriers += dep.memoryBarrierCount;
+            stats.bufferBarriers += dep.bufferMemoryBarrierCount;
+            stats.imageBarriers += dep.imageMemoryBarrierCount;
+
+            auto drains = [] (vk::PipelineStageFlags2 s) { return bool(s & vk::PipelineStageFlagBits2::eAllCommands); };
+
+            for (uint32_t i=0; i<dep.memoryBarrierCount; i++)       stats.allCommandsBarriers += drains(dep.pMemoryBarriers[i].srcStageMask);
+            for (uint32_t i=0; i<dep.bufferMemoryBarrierCount; i++) stats.allCommandsBarriers += drains(dep.pBufferMemoryBarriers[i].srcStageMask);
+            for (uint32_t i=0; i<dep.imageMemoryBarrierCount; i++)  stats.allCommandsBarriers += drains(dep.pImageMemoryBarriers[i].srcStageMask);
+
+            cmd.pipelineBarrier2(dep);
+        }
+    }
+}
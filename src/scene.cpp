@@ -12,27 +12,6 @@ namespace Internal {
 
 
 
-Medea::Internal::PerFrameDynamicBuffers Medea::Internal::PerFrameDynamicBuffers::make(vk::Device device, VmaAllocator allocator, const glist<RenderEntity>& entities) {
-    vk::BufferUsageFlags defaultBufFlags = vk::BufferUsageFlagBits::eStorageBuffer;
-
-    const VmaMemoryUsage vmaCPU = VmaMemoryUsage::VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
-    const VmaMemoryUsage vmaGPU = VmaMemoryUsage::VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
-
-
-    vk::BufferUsageFlags bufDefault = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
-
-    //size_t entitySize = entities.size;
-    //size_t totalVertices = 0;
-    //for (auto& e : entities) totalVertices += e.meshSize;
-
-    return Medea::Internal::PerFrameDynamicBuffers {
-        //std::move(cpuEntities),
-        AllocatedBuffer(device, allocator, entities.getBuffer().size, 
-            bufDefault | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst, {}, vmaGPU)
-    };
-}
-
-
 struct alignas(sizeof(float) * 4) RenderGlobal {
     glm::mat4 camView, camProjection;
     BufferRef drawcallUniformArrayAddress;
@@ -42,6 +21,7 @@ struct alignas(sizeof(float) * 4) RenderGlobal {
 
 RenderWorld::RenderWorld(Core& core, vk::CommandBuffer cmd, GPUSceneGraph& graph)
     : entities(core.allocator, core.device, cmd),
+      clusters(core, cmd),
       uniformDeleteCallback([&] (size_t materialID, size_t materialIdx) {
         graph.deleteUniform(materialID, materialIdx);
       }) {
@@ -76,6 +56,18 @@ DescriptorAllocator makeVolShadowDescAllocator(vk::raii::Device& device) {
     return DescriptorAllocator::make(device, 5, poolRatios);
 }
 
+std::vector<vk::DescriptorSetLayoutBinding> occlusionCullBinding() {
+    return {vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute)};
+}
+
+DescriptorAllocator makeOcclusionDescAllocator(vk::raii::Device& device) {
+    std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios =
+        {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 1)};
+
+    //one set per frame, freed once the frame's done
+    return DescriptorAllocator::make(device, 2 * BUF_FRAMES_IN_FLIGHT + 1, poolRatios);
+}
+
 vk::ImageCreateInfo volLightingImageICI(Core& core) {
     return vk::ImageCreateInfo(
         {}, vk::ImageType::e3D, vk::Format::eR16G16B16A16Sfloat, 
@@ -93,6 +85,38 @@ vk::ImageViewCreateInfo volLightingImageIVCI() {
     return ivci;
 }
 
+/// 1x1x1, for the volumetric bindings of depth-only passes
+vk::ImageCreateInfo dummyVolumeICI(Core& core) {
+    return vk::ImageCreateInfo(
+        {}, vk::ImageType::e3D, vk::Format::eR16Unorm, vk::Extent3D(1, 1, 1), 1, 1,
+        vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::SharingMode::eExclusive, core.graphicsQueueFamily);
+}
+
+vk::ImageViewCreateInfo dummyVolumeIVCI() {
+    vk::ImageViewCreateInfo ivci({}, nullptr, vk::ImageViewType::e3D, vk::Format::eR16Unorm);
+    ivci.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+    return ivci;
+}
+
+/// 1x1 "nothing occludes anything", for the mesh path's Hi-Z binding outside occlusion culling's second phase
+vk::ImageCreateInfo dummyHiZICI(Core& core) {
+    return vk::ImageCreateInfo(
+        {}, vk::ImageType::e2D, vk::Format::eR32Sfloat, vk::Extent3D(1, 1, 1), 1, 1,
+        vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal,
+        vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::SharingMode::eExclusive, core.graphicsQueueFamily);
+}
+
+vk::ImageViewCreateInfo dummyHiZIVCI() {
+    vk::ImageViewCreateInfo ivci({}, nullptr, vk::ImageViewType::e2D, vk::Format::eR32Sfloat);
+    ivci.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+    return ivci;
+}
+
 vk::SamplerCreateInfo bilinearClampedSCI() {
     return vk::SamplerCreateInfo({}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eNearest,
         vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge);
@@ -110,6 +134,15 @@ GPUSceneGraph::GPUSceneGraph(Core& core, vk::CommandBuffer cmd, BindlessTextureA
                     vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
                     VmaMemoryUsage::VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE),
       broadphaseCullShader(decltype(broadphaseCullShader)::make(core.device, "./shader/broadphaseCull.comp")),
+      clusterCullShader(decltype(clusterCullShader)::make(core.device, "./shader/clusterCull.comp")),
+      clusterEntityCullShader(decltype(clusterEntityCullShader)::make(core.device, "./shader/clusterEntityCull.comp")),
+      shadowCullShader(decltype(shadowCullShader)::make(core.device, "./shader/shadowCull.comp")),
+      shadowCullScanShader(decltype(shadowCullScanShader)::make(core.device, "./shader/shadowCullScan.comp")),
+      occlusionSplitShader(decltype(occlusionSplitShader)::make(core.device, "./shader/occlusionSplit.comp")),
+      occlusionCullShader(decltype(occlusionCullShader)::make(core.device, "./shader/occlusionCull.comp", occlusionCullBinding())),
+      instanceGroupShader(decltype(instanceGroupShader)::make(core.device, "./shader/instanceGroup.comp")),
+      instanceGroupScanShader(decltype(instanceGroupScanShader)::make(core.device, "./shader/instanceGroupScan.comp")),
+      materialBinShader(decltype(materialBinShader)::make(core.device, "./shader/materialBin.comp")),
       clusterLightShader(decltype(clusterLightShader)::make(core.device, "./shader/setupTiled.comp")),
       shadowTransmittanceShader(decltype(shadowTransmittanceShader)::make(core.device, "./shader/shadowTransmittance.comp", shadowLayoutBinding())),
       volScatteringShader(decltype(volScatteringShader)::make(core.device, "./shader/volumetricScattering.comp", scatterBinding())),
@@ -118,8 +151,103 @@ GPUSceneGraph::GPUSceneGraph(Core& core, vk::CommandBuffer cmd, BindlessTextureA
       shadowTransmittanceArrayAllocator(makeVolShadowDescAllocator(core.device)),
       lights(core.allocator, core.device, cmd, Medea::RenderConstants::maxLights),
       textures(texRef),
+      meshIndices(core.allocator, *core.device),
       volLightingImage(AllocatedImage::make(core, volLightingImageICI(core), volLightingImageIVCI(), vk::ImageAspectFlagBits::eColor, vk::ImageViewType::e3D, 0, false)),
-      volLightingSampler(core.device, bilinearClampedSCI()) {}
+      volLightingSampler(core.device, bilinearClampedSCI()),
+      dummyVolume(AllocatedImage::make(core, dummyVolumeICI(core), dummyVolumeIVCI(), vk::ImageAspectFlagBits::eColor, vk::ImageViewType::e3D, 0, false)),
+      dummyHiZ(AllocatedImage::make(core, dummyHiZICI(core), dummyHiZIVCI(), vk::ImageAspectFlagBits::eColor, vk::ImageViewType::e2D, 0, false)),
+      pointSampler(core.device, volLightingSCI()),
+      hiZ(HiZPyramid::make(core)),
+      occlusionDescriptors(makeOcclusionDescAllocator(core.device)),
+      profiler(GPUProfiler::make(core)),
+      pipelineStats(PipelineStatsProfiler::make(core)),
+      computeTimestamps(core.caps.computeTimestamps) {
+    froxelArray.setCategory(MemoryCategory::volumetrics);
+    volLightingImage.setCategory(MemoryCategory::volumetrics);
+
+    //never actually read for anything that ends up on screen, but keep it defined (no fog, full transmittance)
+    dummyVolume.transitionSync(cmd, ResourceUsage::transferWrite(vk::ImageLayout::eTransferDstOptimal), true);
+    cmd.clearColorImage(dummyVolume.image, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue{1.f, 1.f, 1.f, 1.f},
+                        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    dummyVolume.transitionSync(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    dummyHiZ.transitionSync(cmd, ResourceUsage::transferWrite(vk::ImageLayout::eTransferDstOptimal), true);
+    cmd.clearColorImage(dummyHiZ.image, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue{1.f, 1.f, 1.f, 1.f},
+                        vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+    dummyHiZ.transitionSync(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    for (int i=0; i<BUF_FRAMES_IN_FLIGHT; i++) {
+        cullReadbacks.push_back(CullReadback{AllocatedBuffer(core.device, core.allocator, 9 * RenderConstants::arrayHeaderSize, vk::BufferUsageFlagBits::eTransferDst,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, VMA_MEMORY_USAGE_AUTO)});
+    }
+}
+
+void GPUSceneGraph::resolveCullStats() {
+    cullReadbackIdx = (cullReadbackIdx + 1) % cullReadbacks.size();
+
+    CullReadback& rb = cullReadbacks.at(cullReadbackIdx);
+
+    if (!rb.written) return;
+
+    VK_REQUIRE(vmaInvalidateAllocation(rb.buffer.allocator, rb.buffer.allocation, 0, VK_WHOLE_SIZE));
+
+    uint32_t visible;
+    memcpy(&visible, rb.buffer.info.pMappedData, sizeof(visible));
+
+    cullStats = rb.pending;
+    cullStats.broadphaseVisible = visible;
+
+    //shadow draw list header: drawn, then requested
+    if (rb.shadowList) {
+        uint32_t shadowHeader[2];
+        memcpy(shadowHeader, (const char*) rb.buffer.info.pMappedData + RenderConstants::arrayHeaderSize, sizeof(shadowHeader));
+
+        cullStats.shadowDraws = shadowHeader[0];
+        cullStats.shadowDrawsDropped = shadowHeader[1] - shadowHeader[0];
+
+        //the list was full: grow it for the frames after this one, with some headroom as the readback's a few frames stale
+        if (cullStats.shadowDrawsDropped > 0) {
+            if (!shadowDropWarned) {
+                std::cerr<<"WARN: shadow draw list full, dropped "<<cullStats.shadowDrawsDropped<<" of "<<shadowHeader[1]
+                         <<" caster x light pairs; growing it (see RenderSettings::shadowDrawsPerEntity)"<<std::endl;
+            }
+
+            shadowDropWarned = true;
+            shadowCapacityNeeded = std::max(shadowCapacityNeeded, shadowHeader[1] + shadowHeader[1] / 4);
+        }
+    }
+    else {
+        cullStats.shadowDraws = visible * cullStats.lights;
+    }
+
+    //early list header: drawn; late list header: drawn, then occluded
+    if (rb.occlusion) {
+        uint32_t early, late[2];
+        memcpy(&early, (const char*) rb.buffer.info.pMappedData + 2 * RenderConstants::arrayHeaderSize, sizeof(early));
+        memcpy(late, (const char*) rb.buffer.info.pMappedData + 3 * RenderConstants::arrayHeaderSize, sizeof(late));
+
+        cullStats.occlusionEarly = early;
+        cullStats.occlusionLate = late[0];
+        cullStats.occluded = late[1];
+    }
+
+    //visible cluster list header: dispatch args, x first
+    if (rb.clusters) {
+        memcpy(&cullStats.clustersVisible, (const char*) rb.buffer.info.pMappedData + 4 * RenderConstants::arrayHeaderSize, sizeof(uint32_t));
+    }
+
+    //instanced draw headers: draw count first. Shadow, culled, early, late; zero where that list wasn't grouped
+    if (rb.instancing) {
+        uint32_t draws[4];
+
+        for (int i=0; i<4; i++) memcpy(&draws[i], (const char*) rb.buffer.info.pMappedData + (5 + i) * RenderConstants::arrayHeaderSize, sizeof(uint32_t));
+
+        cullStats.instanceDraws = rb.occlusion ? draws[2] + draws[3] : draws[1];
+        cullStats.shadowInstanceDraws = rb.shadowList ? draws[0] : draws[1] * cullStats.lights;
+    }
+
+    rb.written = false;
+}
 
 
 
@@ -127,7 +255,8 @@ void GPUSceneGraph::render(Core& core, vk::CommandBuffer cmd, CleanupJobQueueCal
                     RenderWorld& world,
                     vk::Viewport viewport,
                     const std::vector<AllocatedImage2Ref>& color, std::optional<AllocatedImage2Ref> depth, std::optional<vk::CompareOp> depthOp,
-                    double currentTime) {
+                    double currentTime, TemporalUpscaler* upscaler) {
+    MEDEA_PROFILE_ZONE("GPUSceneGraph::render");
 
     Vec3 cameraWorldPos = Vec3::GlmXYZ(glm::inverse(camView) * glm::vec4(0, 0, 0, 1));
     
@@ -137,7 +266,40 @@ void GPUSceneGraph::render(Core& core, vk::CommandBuffer cmd, CleanupJobQueueCal
         return;
     }
 
-    //gotta update before we set size of dynamicBuffer.broadphaseCulledEntities
+    //the compute work needs the volumetric passes to be worth a second queue
+    const bool asyncCompute = settings.asyncCompute && settings.volumetrics;
+
+    //with async compute, the graph's first submit goes out before the frame's own, so everything it depends on is recorded there
+    vk::CommandBuffer frameCmd = cmd;
+
+    //the profilers' pools and the cull readbacks rotate once per render(), so a second call in the same frame (same command buffer)
+    // would reuse a slot that's still in flight
+    assert(frameCmd != lastFrameCmd && "GPUSceneGraph::render called twice in one frame");
+    lastFrameCmd = frameCmd;
+
+    cmd = renderGraph.reset(core, frameCmd, asyncCompute);
+
+    profiler.beginFrame(cmd);
+    pipelineStats.beginFrame(cmd);
+
+    MemoryTracker::get().newFrame();
+
+    resolveCullStats();
+
+    //ends in frameCmd, after the graph's last pass
+    profiler.begin(cmd, "GPUSceneGraph::render");
+
+    beginPass(cmd, "upload");
+
+    //catch up prevPos/prevRot of anything that stopped moving, before they go up with the rest
+    world.advanceFrame();
+
+    const bool clusterCulling = settings.clusterCulling;
+
+    //cluster bounds are refit from the entities' CPU copies; always kept up to date, so toggling clusterCulling doesn't need a rebuild
+    world.clusters.update(entities, core.allocator, core.device, cmd);
+
+    //gotta update before we size broadphaseCulledEntities off of it
     entities.gpuUpdate(core.allocator, core.device, cmd);
 
     if (lights.size() > RenderConstants::maxLights) {
@@ -150,6 +312,8 @@ void GPUSceneGraph::render(Core& core, vk::CommandBuffer cmd, CleanupJobQueueCal
     lights.gpuUpdate(core.allocator, core.device, cmd);
 
     while (volumetricShadows.size() < lights.size()) {
+        MemoryCategoryScope volMemory(MemoryCategory::volumetrics);
+
         vk::Extent3D span(VolShadow::VOL_SHADOW_RES.x, VolShadow::VOL_SHADOW_RES.y, VolShadow::VOL_SHADOW_RES.z);
 
         vk::ImageUsageFlags imgFlags = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
@@ -172,325 +336,1350 @@ void GPUSceneGraph::render(Core& core, vk::CommandBuffer cmd, CleanupJobQueueCal
            && volShadowSamplers.size() == volShadowViews.size() 
            && volShadowViews.size() >= lights.size());
 
+
+    std::vector<vk::DeviceAddress> materialUniformPtrMapping;
+
     {
-        std::vector<AllocatedImage2Ref> allRefs = color;
-        if (depth) allRefs.push_back(depth.value());
-        allRefs.push_back(*megashader->shadowAtlas.image);
-        allRefs.push_back(volLightingImage);
+        MEDEA_PROFILE_ZONE("materialSetUpdate");
+
+        for (size_t i=0; i<materialSets.size(); i++) {
+            auto& mset = materialSets.at(i);
 
-        Medea::multiTransition(cmd, allRefs, vk::ImageLayout::eGeneral, true);
+            vk::DeviceAddress uptr = mset.get().update(core.allocator, *core.device, cmd);
 
-        Medea::multiTransition(cmd, volumetricShadows, vk::ImageLayout::eGeneral, false);
+            materialUniformPtrMapping.push_back(uptr);
+        }
     }
 
+    vk::BufferUsageFlags bufDefault = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+    auto gpuMaterialUniformMap = std::make_shared<AllocatedBuffer>(AllocatedBuffer::loadCPU<vk::DeviceAddress>(core.allocator, core.device, materialUniformPtrMapping, bufDefault));
+
 
-    std::vector<vk::DeviceAddress> materialUniformPtrMapping;
-    
-    for (size_t i=0; i<materialSets.size(); i++) {
-        auto& mset = materialSets.at(i);
+    cleanup([gpuMaterialUniformMap] () {});
 
-        vk::DeviceAddress uptr = mset.get().update(core.allocator, *core.device, cmd);
+    //with an upscaler, rasterization is jittered; froxels/volumetrics keep camProj, since they're sampled per froxel rather than per pixel
+    glm::mat4 rasterProj = camProj;
+    std::vector<Internal::TemporalUniforms> temporal = {Internal::TemporalUniforms{camProj * camView, camProj * camView}};
 
-        materialUniformPtrMapping.push_back(uptr);
+    if (upscaler) {
+        temporal.at(0) = upscaler->beginFrame(camView, camProj, VkExtent2D{uint32_t(viewport.width), uint32_t(std::abs(viewport.height))});
+        rasterProj = upscaler->jitterProjection(camProj);
     }
 
-    vk::BufferUsageFlags bufDefault = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
-    auto gpuMaterialUniformMap = std::make_shared<AllocatedBuffer>(AllocatedBuffer::loadCPU<vk::DeviceAddress>(core.allocator, core.device, materialUniformPtrMapping, bufDefault));
+    auto temporalUniforms = std::make_shared<AllocatedBuffer>(AllocatedBuffer::loadCPU<Internal::TemporalUniforms>(core.allocator, core.device, temporal,
+                                                                                                                 vk::BufferUsageFlagBits::eUniformBuffer));
+
+    cleanup([temporalUniforms] () {});
+
+    //light views + atlas tiles, for per-light culling and the shadow pass. Never empty, so there's always something to bind
+    std::vector<Internal::ShadowView> shadowViewData;
+
+    for (LightDef ldef : lights) shadowViewData.push_back(Internal::ShadowView{ldef.getViewProj(), ldef.getOldAtlasPosExtents()});
 
+    if (shadowViewData.empty()) shadowViewData.push_back(Internal::ShadowView{});
 
-    std::shared_ptr<Internal::PerFrameDynamicBuffers> dynamicBufPtr = 
-        std::make_shared<Internal::PerFrameDynamicBuffers>(Internal::PerFrameDynamicBuffers::make(core.device, core.allocator, entities));
+    auto shadowViews = std::make_shared<AllocatedBuffer>(AllocatedBuffer::loadCPU<Internal::ShadowView>(core.allocator, core.device, shadowViewData, bufDefault));
 
-    Internal::PerFrameDynamicBuffers& dynamicBuf = *dynamicBufPtr;
-    cleanup([dynamicBufPtr, gpuMaterialUniformMap] () {});
+    cleanup([shadowViews] () {});
 
-    {    
-        //zero out broadphase cull header (can't be done in CS invocation)
-        cmd.fillBuffer(dynamicBuf.broadphaseCulledEntities.buffer, 0, 16, 0);
+    //gvector/material uniform uploads aren't tracked per buffer; they're read by every compute and draw pass after this
+    BarrierBatch()
+        .memory(ResourceUsage::transferWrite(), ResourceUsage::computeRead() | ResourceUsage::vertexRead() | ResourceUsage::fragmentRead())
+        .flush(cmd);
 
-        //-1 initialize froxel array, 
-        cmd.fillBuffer(froxelArray.buffer, 0, froxelArray.info.size, -1);
+    endPass(cmd);
 
-        //clear
-        auto clearRangeC = Medea::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
-        auto clearRangeDepthC = Medea::imageSubresourceRange(VK_IMAGE_ASPECT_DEPTH_BIT);
 
-        vk::ImageSubresourceRange clearRange(clearRangeC);
-        vk::ImageSubresourceRange clearRangeDepth(clearRangeDepthC);
-        vk::ClearColorValue clearColor{0.f, 0.f, 0.f, 1.f};
+    //everything from here on is declared on the render graph, which works out barriers/transitions from the reads and writes
+    std::vector<RGHandle> colorRes;
+    for (size_t i=0; i<color.size(); i++) colorRes.push_back(renderGraph.importImage("color" + std::to_string(i), color.at(i), true));
 
-        cmd.clearColorImage(color.at(0).get().image, vk::ImageLayout::eGeneral, clearColor, clearRange);
-        cmd.clearDepthStencilImage(depth.value().get().image, vk::ImageLayout::eGeneral, vk::ClearDepthStencilValue(1.0, 0), clearRangeDepth);
-        cmd.clearDepthStencilImage(megashader->shadowAtlas.image->image, vk::ImageLayout::eGeneral, vk::ClearDepthStencilValue(1.0, 0), clearRangeDepth);
+    RGHandle depthRes = renderGraph.importImage("depth", depth.value(), true);
+    RGHandle shadowAtlasRes = renderGraph.importImage("shadowAtlas", *megashader->shadowAtlas.image);
+    RGHandle volLightingRes = renderGraph.importImage("volLighting", volLightingImage);
+    RGHandle froxelRes = renderGraph.importBuffer("froxelArray", froxelArray);
+    RGHandle velocityRes = upscaler ? renderGraph.importImage("velocity", upscaler->getVelocity()) : RGHandle{};
 
-        vk::ClearColorValue volClear{0.f, 0.f, 0.f, 0.f};
+    //covered by the upload barrier on the graphics queue, but handing it to the compute queue has to wait on the copy too
+    if (asyncCompute) lights.getBuffer()._state = ResourceState::written(ResourceUsage::transferWrite());
 
+    RGHandle lightsRes = renderGraph.importBuffer("lights", lights.getBuffer());
 
+    std::vector<RGHandle> volShadowRes;
+    for (size_t i=0; i<volumetricShadows.size(); i++) volShadowRes.push_back(renderGraph.importImage("volShadow" + std::to_string(i), volumetricShadows.at(i)));
 
-        vk::MemoryBarrier2 transferBarrier(
-            vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite,
-            vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eAllGraphics, 
-            vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eIndirectCommandRead);
+    //sizeof gpuEntities, to avoid worst case of no culling. Also works as indirect draw buffer
+    RGHandle culledRes = renderGraph.createBuffer("broadphaseCulledEntities", RGBufferDesc{entities.getBuffer().size,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+        | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc});
 
+    //visible clusters, written by clusterCull; the header is the indirect dispatch for the entity pass
+    RGHandle clusterListRes;
 
-        cmd.pipelineBarrier2(vk::DependencyInfo({}, transferBarrier, {}, {}));
+    if (clusterCulling) {
+        clusterListRes = renderGraph.createBuffer("visibleClusters", RGBufferDesc{RenderConstants::arrayHeaderSize + std::max<size_t>(world.clusters.size(), 1) * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc});
     }
-    using bufFlags = vk::BufferUsageFlagBits;
-    auto flags = bufFlags::eStorageBuffer | bufFlags::eIndirectBuffer | bufFlags::eShaderDeviceAddress;
 
+    const bool shadowCulling = settings.shadowCulling;
 
+    //light × entity pairs, laid out like the broadphase output (header with the count, then RenderEntity copies); filled in by shadowCullWrite.
+    // Grown to what an earlier frame asked for if it overflowed, up to every pair
+    const uint64_t shadowPairs = uint64_t(entities.size()) * lights.size();
+    const uint64_t shadowBase = uint64_t(entities.size()) * std::min<uint32_t>(lights.size(), settings.shadowDrawsPerEntity);
+    const uint32_t shadowCapacity = std::max<uint32_t>(1, uint32_t(std::min<uint64_t>(shadowPairs, std::max<uint64_t>(shadowBase, shadowCapacityNeeded))));
 
-    RenderGlobal outGlobal{camView, camProj, entities.getBuffer(), lights.getBuffer()};
+    RGHandle shadowListRes, lightCountsRes;
 
-    //setup froxel array (belongs in transfer pass, since shadows are defined and rendered exogenously, and this just sets up indices for froxels)
-    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, clusterLightShader.pipeline);
-    clusterLightShader.setPush(cmd, Medea::Internal::FroxelPush(glm::inverse(camProj * camView), camView, lights.getBuffer(), froxelArray));
+    if (shadowCulling) {
+        shadowListRes = renderGraph.createBuffer("shadowDrawList", RGBufferDesc{RenderConstants::arrayHeaderSize + vk::DeviceSize(shadowCapacity) * sizeof(RenderEntity),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferSrc});
 
-    cmd.dispatch(Froxel::FROXELS_W, Froxel::FROXELS_H, Froxel::FROXELS_Z);
+        lightCountsRes = renderGraph.createBuffer("shadowLightCounts", RGBufferDesc{std::max<size_t>(lights.size(), 1) * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst});
+    }
 
-    //all of our draw passes go here
+    //Hi-Z is built by sampling depth
+    bool occlusion = settings.occlusionCulling;
 
-    //BROADPHASE CULLING
+    if (occlusion && !(depth.value().get().info.usage & vk::ImageUsageFlagBits::eSampled)) {
+        if (!occlusionDepthWarned) std::cerr<<"WARNING: GPUSceneGraph::render: occlusion culling needs a depth target with eSampled usage. Rendering without it."<<std::endl;
 
-    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, broadphaseCullShader.pipeline);
-    broadphaseCullShader.setPush(cmd, Medea::Internal::CullCSPush{entities.getBuffer(), dynamicBuf.broadphaseCulledEntities, *gpuMaterialUniformMap});
+        occlusionDepthWarned = true;
+        occlusion = false;
+    }
 
-    {
-        const int LOCAL_W = 64;
-        cmd.dispatch(entities.size() / LOCAL_W + ((entities.size() % LOCAL_W) == 0 ? 0 : 1), 1, 1);
+    //early: survivors visible last frame; late: survivors visible now that weren't drawn early. Both laid out like the broadphase output
+    RGHandle earlyRes, lateRes, hiZRes, visibilityRes;
+    VkExtent2D renderExtent{uint32_t(std::abs(viewport.width)), uint32_t(std::abs(viewport.height))};
+
+    if (occlusion) {
+        if (!occlusionVisibility || occlusionVisibility->size < entities.size() * sizeof(uint32_t)) {
+            if (occlusionVisibility) {
+                auto old = occlusionVisibility;
+                cleanup([old] () {});
+            }
+
+            //headroom, so a growing world doesn't reset visibility every frame
+            occlusionVisibility = std::make_shared<AllocatedBuffer>(core.device, core.allocator, std::max<size_t>(2 * entities.size(), 64) * sizeof(uint32_t),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+            occlusionVisibilityFresh = true;
+        }
+
+        VkExtent3D depthExtent = depth.value().get().imageExtent;
+        hiZ.resize(core, cleanup, VkExtent2D{depthExtent.width, depthExtent.height});
+
+        RGBufferDesc listDesc{entities.getBuffer().size,
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc};
+
+        earlyRes = renderGraph.createBuffer("occlusionEarly", listDesc);
+        lateRes = renderGraph.createBuffer("occlusionLate", listDesc);
+        hiZRes = renderGraph.importImage("hiZ", hiZ.getImage());
+        visibilityRes = renderGraph.importBuffer("occlusionVisibility", *occlusionVisibility);
     }
 
-    //SHADOW TRANSMITTANCE (just needs post-cull lightlist & fog list)
+    //mesh path: draw lists (and whatever the vertex code reads) are read by the task and mesh stages instead
+    const bool meshShading = settings.meshShading && megashader->meshPipeline.has_value();
+    megashader->meshShading = meshShading;
+    megashader->depthPipelines = settings.depthPipelines;
 
-    multiTransition(cmd, volumetricShadows, vk::ImageLayout::eGeneral);
+    //visibility buffer: IDs only make sense for triangles of the vertex path, so its geometry passes never use the mesh path (shadows still can)
+    const bool visibility = megashader->visibility.has_value();
+    const bool meshGeometry = meshShading && !visibility;
 
-    {
-        shadowTransmittanceShader.setPush(cmd, Medea::Internal::ShadowTransmittancePush{BufferRef::null, lights.getBuffer(), float(currentTime)});
+    //the visibility buffer + each pixel's material bin as depth (see GSGBindlessShader::VisibilityPipelines); transient, sized like depth
+    RGHandle visRes, materialDepthRes;
 
+    if (visibility) {
+        VkExtent3D depthExtent = depth.value().get().imageExtent;
 
-        std::shared_ptr<vk::raii::DescriptorSet> dset
-            = std::make_shared<vk::raii::DescriptorSet>(std::move(shadowTransmittanceArrayAllocator.allocate(core.device, shadowTransmittanceShader.descLayout)));
-    
-        std::vector<vk::DescriptorImageInfo> descImgInfo;
+        auto targetInfo = [&] (vk::Format format, vk::ImageUsageFlags usage) {
+            return vk::ImageCreateInfo({}, vk::ImageType::e2D, format, vk::Extent3D(depthExtent.width, depthExtent.height, 1), 1, 1,
+                vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, usage | vk::ImageUsageFlagBits::eTransferDst,
+                vk::SharingMode::eExclusive, core.graphicsQueueFamily);
+        };
 
-        descImgInfo.reserve(lights.size());
-        
+        visRes = renderGraph.createImage("visibilityBuffer", RGImageDesc{
+            targetInfo(vk::Format::eR32G32Uint, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled), vk::ImageViewType::e2D});
 
-        for (size_t i=0; i<lights.size(); i++) {
-            descImgInfo.push_back(vk::DescriptorImageInfo({}, volShadowViews.at(i), vk::ImageLayout::eGeneral));
+        materialDepthRes = renderGraph.createImage("materialDepth", RGImageDesc{
+            targetInfo(vk::Format::eD32Sfloat, vk::ImageUsageFlagBits::eDepthStencilAttachment), vk::ImageViewType::e2D, true});
+    }
+
+    //AUTOMATIC INSTANCING: a list drawn on the vertex path gets a grouped copy, one key's (RenderEntity::instanceGroup, lodLevel) copies
+    // after another, and a draw per key with all of them as instances. Passes that'd draw or index the list use those instead
+    struct InstancedList {
+        RGHandle records;       //<- the list's copies, grouped; firstInstance is the slot in here
+        RGHandle commands;      //<- header with the draw count, then a VkDrawIndexedIndirectCommand per key
+        RGHandle groups;        //<- per key: copies/next free slot, first copy
+        uint32_t capacity;
+    };
+
+    const uint32_t instanceKeys = std::max<uint32_t>(world.instanceGroupCount(), 1) * LodLimits::maxLevels;
+
+    std::unordered_map<uint32_t, InstancedList> instancedLists;     //<- by the source list's RGHandle::idx
+
+    auto makeInstanced = [&] (RGHandle list, uint32_t capacity, const std::string& name) {
+        capacity = std::max<uint32_t>(capacity, 1);
+
+        InstancedList l;
+        l.capacity = capacity;
+
+        l.records = renderGraph.createBuffer(name + "Grouped", RGBufferDesc{RenderConstants::arrayHeaderSize + vk::DeviceSize(capacity) * sizeof(RenderEntity),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer});
+
+        l.commands = renderGraph.createBuffer(name + "InstancedDraws", RGBufferDesc{RenderConstants::arrayHeaderSize
+            + vk::DeviceSize(std::min(capacity, instanceKeys)) * sizeof(vk::DrawIndexedIndirectCommand),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+            | vk::BufferUsageFlagBits::eTransferSrc});
+
+        l.groups = renderGraph.createBuffer(name + "InstanceGroups", RGBufferDesc{vk::DeviceSize(instanceKeys) * 2 * sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst});
+
+        instancedLists.emplace(list.idx, l);
+    };
+
+    if (settings.instancing) {
+        //the shadow pass draws the shadow list, or without one the broadphase output once per light
+        const bool SHADOW_VERTEX = !meshShading, MAIN_VERTEX = !meshGeometry;
+
+        if (shadowCulling && SHADOW_VERTEX) makeInstanced(shadowListRes, shadowCapacity, "shadowDrawList");
+
+        if ((!shadowCulling && SHADOW_VERTEX) || (!occlusion && MAIN_VERTEX)) makeInstanced(culledRes, entities.size(), "broadphaseCulledEntities");
+
+        if (occlusion && MAIN_VERTEX) {
+            makeInstanced(earlyRes, entities.size(), "occlusionEarly");
+            makeInstanced(lateRes, entities.size(), "occlusionLate");
         }
+    }
 
-        vk::WriteDescriptorSet write(*dset, 0, 0, vk::DescriptorType::eStorageImage, descImgInfo, {}, {});
+    auto findInstanced = [&] (RGHandle list) -> const InstancedList* {
+        auto it = instancedLists.find(list.idx);
 
-        core.device.updateDescriptorSets(write, {});
+        return it == instancedLists.end() ? nullptr : &it->second;
+    };
 
-        //capture group holds onto shared ptr until frame is known to be done processing
-        ///TODO: reconsider
-        cleanup([dset] () {});
+    //what's bound as the entity list when drawing list
+    auto drawnList = [&] (RGHandle list) {
+        const InstancedList* l = findInstanced(list);
+
+        return l ? l->records : list;
+    };
+
+    //MATERIAL PIPELINES: the camera's (vertex path) lists also get their draws binned by material, each material's drawn through its own
+    // specialization of the megashader. Draw offsets come from the CPU, so each material's range is sized by how many entities use it (an
+    // entry, or instanced a group, is at most one draw), laid out by a prefix sum here; the bins hold one draw per entity and none are dropped
+    struct MaterialBins {
+        RGHandle counts;        //<- per material: draws; then materialRanges
+        RGHandle commands;      //<- per material: its range of VkDrawIndexedIndirectCommands
+        uint32_t capacity;      //<- the list's
+    };
+
+    const uint32_t materialCount = megashader->materialCount;
+
+    std::unordered_map<uint32_t, MaterialBins> materialBins;       //<- by the source list's RGHandle::idx
+
+    //per material: its range's first draw, then per material: its range's size. Same for every binned list
+    std::vector<uint32_t> materialRanges;
+    uint32_t materialDraws = 0;
+
+    if (settings.materialPipelines && !visibility && !meshGeometry && materialCount > 0) {
+        const uint32_t capacity = std::max<uint32_t>(entities.size(), 1);
+
+        materialRanges.resize(2 * materialCount, 0);
+
+        for (uint32_t m=0; m<materialCount; m++) {
+            uint32_t size = m < world.materialEntities.size() ? world.materialEntities.at(m) : 0;
+
+            materialRanges.at(m) = materialDraws;
+            materialRanges.at(materialCount + m) = size;
+            materialDraws += size;
+        }
+
+        //uploaded with updateBuffer in the clear pass
+        assert(materialRanges.size() * sizeof(uint32_t) <= 65536);
+
+        for (RGHandle list : occlusion ? std::vector<RGHandle>{earlyRes, lateRes} : std::vector<RGHandle>{culledRes}) {
+            MaterialBins bins;
+            bins.capacity = capacity;
 
-        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shadowTransmittanceShader.pipeline);
-        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, shadowTransmittanceShader.layout, 0, **dset, {});
+            bins.counts = renderGraph.createBuffer("materialDrawCounts", RGBufferDesc{vk::DeviceSize(3 * materialCount) * sizeof(uint32_t),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer
+                | vk::BufferUsageFlagBits::eTransferDst});
 
-        cmd.dispatch(2, 2, lights.size());
+            bins.commands = renderGraph.createBuffer("materialDraws", RGBufferDesc{vk::DeviceSize(std::max(materialDraws, 1u))
+                * sizeof(vk::DrawIndexedIndirectCommand),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eIndirectBuffer});
+
+            materialBins.emplace(list.idx, bins);
+        }
     }
 
+    auto findBins = [&] (RGHandle list) -> const MaterialBins* {
+        auto it = materialBins.find(list.idx);
 
-    //SKINNING
+        return it == materialBins.end() ? nullptr : &it->second;
+    };
 
-    //SHADOW PASS (and per-frustrum culling step?)
-    multiTransition(cmd, {*megashader->shadowAtlas.image}, {vk::ImageLayout::eDepthAttachmentOptimal});
+    const ResourceUsage MESH_READ = meshShading ? ResourceUsage::meshRead() : ResourceUsage::none();
+    const ResourceUsage DRAW_READ = ResourceUsage::indirectRead() | ResourceUsage::vertexRead() | ResourceUsage::fragmentRead() | MESH_READ;
+    const ResourceUsage SAMPLED = ResourceUsage::forLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+    //compute only, so it's also valid on the async compute queue
+    const ResourceUsage COMPUTE_SAMPLED = ResourceUsage::computeRead(vk::ImageLayout::eShaderReadOnlyOptimal);
 
-    vk::Extent3D saDim = megashader->shadowAtlas.image->imageExtent;
-    vk::Viewport shadowAtlasViewport(0, 0, saDim.width, saDim.height, 0.0, 1.0);
+    auto readDrawList = [&] (RenderGraph::PassBuilder& b, RGHandle list) {
+        b.read(drawnList(list), DRAW_READ);
 
-    bool volLightReady = false;
+        if (const InstancedList* l = findInstanced(list)) b.read(l->commands, ResourceUsage::indirectRead());
 
-    auto volShadowUpdateFunc = [&] (vk::DescriptorSet dset) {
+        if (const MaterialBins* bins = findBins(list)) {
+            b.read(bins->counts, ResourceUsage::indirectRead())
+                .read(bins->commands, ResourceUsage::indirectRead());
+        }
+    };
+
+    //the main pass binds every volumetric shadow + the volumetric lighting image, whatever layout they're in at the time
+    auto readVolShadows = [&] (RenderGraph::PassBuilder& b, const ResourceUsage& usage) {
+        for (auto& r : volShadowRes) b.read(r, usage);
+    };
+
+    renderGraph.addPass("clear",
+        [&] (RenderGraph::PassBuilder& b) {
+            b.write(culledRes, ResourceUsage::transferWrite())
+                .write(froxelRes, ResourceUsage::transferWrite(), true)
+                .write(colorRes.at(0), ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true)
+                .write(depthRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true)
+                .write(shadowAtlasRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true);
+
+            if (velocityRes.valid()) b.write(velocityRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true);
+
+            if (visibility) {
+                b.write(visRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true)
+                    .write(materialDepthRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true);
+            }
+
+            if (shadowCulling) b.write(lightCountsRes, ResourceUsage::transferWrite(), true);
+
+            for (auto& [idx, l] : instancedLists) b.write(l.groups, ResourceUsage::transferWrite(), true);
+
+            for (auto& [idx, bins] : materialBins) b.write(bins.counts, ResourceUsage::transferWrite(), true);
+
+            if (clusterCulling) b.write(clusterListRes, ResourceUsage::transferWrite());
+
+            if (occlusion) {
+                b.write(earlyRes, ResourceUsage::transferWrite())
+                    .write(lateRes, ResourceUsage::transferWrite());
+
+                if (occlusionVisibilityFresh) b.write(visibilityRes, ResourceUsage::transferWrite(), true);
+            }
+        },
+        [&] (vk::CommandBuffer cmd) {
+            //zero out broadphase cull header (can't be done in CS invocation)
+            cmd.fillBuffer(renderGraph.getBuffer(culledRes).buffer, 0, 16, 0);
+
+            //-1 initialize froxel array, 
+            cmd.fillBuffer(froxelArray.buffer, 0, froxelArray.info.size, -1);
+
+            if (shadowCulling) cmd.fillBuffer(renderGraph.getBuffer(lightCountsRes).buffer, 0, VK_WHOLE_SIZE, 0);
+
+            for (auto& [idx, l] : instancedLists) cmd.fillBuffer(renderGraph.getBuffer(l.groups).buffer, 0, VK_WHOLE_SIZE, 0);
+
+            for (auto& [idx, bins] : materialBins) {
+                vk::Buffer counts = renderGraph.getBuffer(bins.counts).buffer;
+
+                cmd.fillBuffer(counts, 0, materialCount * sizeof(uint32_t), 0);
+                cmd.updateBuffer<uint32_t>(counts, materialCount * sizeof(uint32_t), materialRanges);
+            }
+
+            //(0, 1, 1) workgroups; clusterCull counts up x
+            if (clusterCulling) cmd.updateBuffer<uint32_t>(renderGraph.getBuffer(clusterListRes).buffer, 0, {0u, 1u, 1u, 0u});
+
+            if (occlusion) {
+                cmd.fillBuffer(renderGraph.getBuffer(earlyRes).buffer, 0, 16, 0);
+                cmd.fillBuffer(renderGraph.getBuffer(lateRes).buffer, 0, 16, 0);
+
+                //nothing's known to be visible yet, so everything goes through the late test
+                if (occlusionVisibilityFresh) cmd.fillBuffer(occlusionVisibility->buffer, 0, VK_WHOLE_SIZE, 0);
+
+                occlusionVisibilityFresh = false;
+            }
+
+            //clear
+            auto clearRangeC = Medea::imageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            auto clearRangeDepthC = Medea::imageSubresourceRange(VK_IMAGE_ASPECT_DEPTH_BIT);
+
+            vk::ImageSubresourceRange clearRange(clearRangeC);
+            vk::ImageSubresourceRange clearRangeDepth(clearRangeDepthC);
+            vk::ClearColorValue clearColor{0.f, 0.f, 0.f, 1.f};
+
+            cmd.clearColorImage(color.at(0).get().image, vk::ImageLayout::eGeneral, clearColor, clearRange);
+            cmd.clearDepthStencilImage(depth.value().get().image, vk::ImageLayout::eGeneral, vk::ClearDepthStencilValue(1.0, 0), clearRangeDepth);
+            cmd.clearDepthStencilImage(megashader->shadowAtlas.image->image, vk::ImageLayout::eGeneral, vk::ClearDepthStencilValue(1.0, 0), clearRangeDepth);
+
+            //all ones: no entity; the classify pass skips those pixels, so they keep a material depth no bin has
+            if (visibility) {
+                cmd.clearColorImage(renderGraph.getImage(visRes).image, vk::ImageLayout::eGeneral,
+                                    vk::ClearColorValue(std::array<uint32_t, 4>{~0u, ~0u, ~0u, ~0u}), clearRange);
+                cmd.clearDepthStencilImage(renderGraph.getImage(materialDepthRes).image, vk::ImageLayout::eGeneral,
+                                           vk::ClearDepthStencilValue(1.0, 0), clearRangeDepth);
+            }
+
+            //background has no geometry to write motion, so it's treated as static
+            if (velocityRes.valid()) cmd.clearColorImage(upscaler->getVelocity().image, vk::ImageLayout::eGeneral, vk::ClearColorValue{0.f, 0.f, 0.f, 0.f}, clearRange);
+        });
+
+
+    //setup froxel array (belongs in transfer pass, since shadows are defined and rendered exogenously, and this just sets up indices for froxels)
+    renderGraph.addPass("froxelSetup",
+        [&] (RenderGraph::PassBuilder& b) {
+            b.read(lightsRes, ResourceUsage::computeRead())
+                .write(froxelRes, ResourceUsage::computeWrite())
+                .asyncCompute();
+        },
+        [&] (vk::CommandBuffer cmd) {
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, clusterLightShader.pipeline);
+            clusterLightShader.setPush(cmd, Medea::Internal::FroxelPush(glm::inverse(camProj * camView), camView, lights.getBuffer(), froxelArray));
+
+            cmd.dispatch(Froxel::FROXELS_W, Froxel::FROXELS_H, Froxel::FROXELS_Z);
+        });
+
+    //BROADPHASE CULLING
+    auto clusterCullPush = [&] () {
+        return Internal::ClusterCullPush{rasterProj * camView, world.clusters.getBounds(), world.clusters.getMembers(), entities.getBuffer(),
+                                         renderGraph.getBuffer(clusterListRes), renderGraph.getBuffer(culledRes), *gpuMaterialUniformMap, *shadowViews,
+                                         (uint32_t) lights.size(), (uint32_t) world.clusters.size()};
+    };
+
+    const float lodScale = settings.lod && settings.lodErrorPixels > 0.f ? 0.5f * std::abs(viewport.height) / settings.lodErrorPixels : 0.f;
+
+    auto clusterEntityCullPush = [&] () {
+        return Internal::ClusterEntityCullPush{rasterProj * camView, world.clusters.getBounds(), world.clusters.getMembers(), entities.getBuffer(),
+                                               renderGraph.getBuffer(clusterListRes), renderGraph.getBuffer(culledRes), *gpuMaterialUniformMap,
+                                               *shadowViews, (uint32_t) lights.size(), lodScale};
+    };
+
+    if (clusterCulling) {
+        //clusters vs the camera + light frustums, then one workgroup per surviving cluster for its entities
+        renderGraph.addPass("clusterCull",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.write(clusterListRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, clusterCullShader.pipeline);
+                clusterCullShader.setPush(cmd, clusterCullPush());
+
+                const uint32_t LOCAL_W = 64;
+                cmd.dispatch((world.clusters.size() + LOCAL_W - 1) / LOCAL_W, 1, 1);
+            });
+
+        renderGraph.addPass("broadphaseCull",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(clusterListRes, ResourceUsage::indirectRead() | ResourceUsage::computeRead())
+                    .write(culledRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, clusterEntityCullShader.pipeline);
+                clusterEntityCullShader.setPush(cmd, clusterEntityCullPush());
+
+                cmd.dispatchIndirect(renderGraph.getBuffer(clusterListRes).buffer, 0);
+            });
+    }
+    else {
+        renderGraph.addPass("broadphaseCull",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.write(culledRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, broadphaseCullShader.pipeline);
+                broadphaseCullShader.setPush(cmd, Medea::Internal::CullCSPush{entities.getBuffer(), renderGraph.getBuffer(culledRes), *gpuMaterialUniformMap});
+
+                const int LOCAL_W = 64;
+                cmd.dispatch(entities.size() / LOCAL_W + ((entities.size() % LOCAL_W) == 0 ? 0 : 1), 1, 1);
+            });
+    }
+
+    //passes run in renderGraph.execute(), so anything their execute functions capture by reference has to outlive the blocks below
+    const int CULL_LOCAL_W = 64;
+    const uint32_t entityGroups = entities.size() / CULL_LOCAL_W + ((entities.size() % CULL_LOCAL_W) == 0 ? 0 : 1);
+
+    //ShadowView::atlasRect scales this down to the light's tile
+    const float shadowLodScale = settings.lod && settings.lodErrorPixels > 0.f
+        ? 0.5f * RenderConstants::shadowAtlasResolution.y / settings.lodErrorPixels : 0.f;
+
+    auto shadowCullPush = [&] (uint32_t phase) {
+        return Internal::ShadowCullPush{renderGraph.getBuffer(culledRes), renderGraph.getBuffer(shadowListRes), *shadowViews,
+                                        renderGraph.getBuffer(lightCountsRes), (uint32_t) lights.size(), shadowCapacity, phase,
+                                        shadowLodScale, settings.shadowLodBias};
+    };
+
+    //the viewport in Hi-Z UV; Hi-Z covers the top left renderExtent of depth, like the viewport
+    glm::vec2 hiZBase(std::max(renderExtent.width, 1u), std::max(renderExtent.height, 1u));
+    glm::vec4 hiZScaleBias = hiZUVScaleBias(glm::vec4(viewport.x, viewport.y, viewport.width, viewport.height), hiZBase);
+
+    //rasterProj, so the test matches what pre-Z actually wrote
+    auto occlusionPush = [&] (RGHandle outRes) {
+        return Internal::OcclusionCullPush{rasterProj * camView, hiZScaleBias, glm::uvec4(renderExtent.width, renderExtent.height, hiZ.getMipCount(), 0),
+                                           renderGraph.getBuffer(culledRes), renderGraph.getBuffer(outRes), *occlusionVisibility};
+    };
+
+    //OCCLUSION CULLING, phase 1: what was visible last frame goes into the early list, which pre-Z draws before the Hi-Z is built
+    if (occlusion) {
+        renderGraph.addPass("occlusionSplit",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(culledRes, ResourceUsage::computeRead())
+                    .read(visibilityRes, ResourceUsage::computeRead())
+                    .write(earlyRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, occlusionSplitShader.pipeline);
+                occlusionSplitShader.setPush(cmd, occlusionPush(earlyRes));
+
+                cmd.dispatch(entityGroups, 1, 1);
+            });
+    }
+
+    //PER-LIGHT SHADOW CULLING: count each light's casters among the broadphase survivors, prefix sum the counts into offsets,
+    // then write every light's casters into its own contiguous run of the shadow draw list
+    if (shadowCulling) {
+        renderGraph.addPass("shadowCullCount",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(culledRes, ResourceUsage::computeRead())
+                    .write(lightCountsRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shadowCullShader.pipeline);
+                shadowCullShader.setPush(cmd, shadowCullPush(0));
+
+                cmd.dispatch(entityGroups, lights.size(), 1);
+            });
+
+        renderGraph.addPass("shadowCullScan",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.write(lightCountsRes, ResourceUsage::computeWrite())
+                    .write(shadowListRes, ResourceUsage::computeWrite(), true);
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shadowCullScanShader.pipeline);
+                shadowCullScanShader.setPush(cmd, shadowCullPush(0));
+
+                cmd.dispatch(1, 1, 1);
+            });
+
+        renderGraph.addPass("shadowCullWrite",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(culledRes, ResourceUsage::computeRead())
+                    .write(lightCountsRes, ResourceUsage::computeWrite())
+                    .write(shadowListRes, ResourceUsage::computeWrite());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shadowCullShader.pipeline);
+                shadowCullShader.setPush(cmd, shadowCullPush(1));
+
+                cmd.dispatch(entityGroups, lights.size(), 1);
+            });
+    }
+
+    //AUTOMATIC INSTANCING: count each key's copies, prefix sum the counts into offsets (writing a draw per non-empty key), then copy every
+    // entry into its key's run of the grouped list. Like per-light shadow culling, with keys for lights
+    auto addInstancingPasses = [&] (RGHandle list, const std::string& name) {
+        const InstancedList* found = findInstanced(list);
+
+        if (!found) return;
+
+        const InstancedList l = *found;
+        const uint32_t groups = l.capacity / CULL_LOCAL_W + ((l.capacity % CULL_LOCAL_W) == 0 ? 0 : 1);
+
+        auto push = [this, l, list, instanceKeys] (uint32_t phase) {
+            return Internal::InstanceGroupPush{renderGraph.getBuffer(list), renderGraph.getBuffer(l.records), renderGraph.getBuffer(l.groups),
+                                               renderGraph.getBuffer(l.commands), instanceKeys, phase};
+        };
+
+        renderGraph.addPass(name + "InstanceCount",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(list, ResourceUsage::computeRead())
+                    .write(l.groups, ResourceUsage::computeWrite());
+            },
+            [this, push, groups] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, instanceGroupShader.pipeline);
+                instanceGroupShader.setPush(cmd, push(0));
+
+                cmd.dispatch(groups, 1, 1);
+            });
+
+        renderGraph.addPass(name + "InstanceScan",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(list, ResourceUsage::computeRead())
+                    .write(l.groups, ResourceUsage::computeWrite())
+                    .write(l.records, ResourceUsage::computeWrite(), true)
+                    .write(l.commands, ResourceUsage::computeWrite(), true);
+            },
+            [this, push] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, instanceGroupScanShader.pipeline);
+                instanceGroupScanShader.setPush(cmd, push(0));
+
+                cmd.dispatch(1, 1, 1);
+            });
+
+        renderGraph.addPass(name + "InstanceWrite",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(list, ResourceUsage::computeRead())
+                    .write(l.groups, ResourceUsage::computeWrite())
+                    .write(l.records, ResourceUsage::computeWrite());
+            },
+            [this, push, groups] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, instanceGroupShader.pipeline);
+                instanceGroupShader.setPush(cmd, push(1));
+
+                cmd.dispatch(groups, 1, 1);
+            });
+    };
+
+    //MATERIAL PIPELINES: each entry (group, if instanced) of what the list draws appends its draw to its material's range
+    auto addMaterialBinPass = [&] (RGHandle list, const std::string& name) {
+        const MaterialBins* found = findBins(list);
+
+        if (!found) return;
+
+        const MaterialBins bins = *found;
+        const InstancedList* instanced = findInstanced(list);
+        const RGHandle groupsRes = instanced ? instanced->groups : RGHandle{};
+        const RGHandle drawn = drawnList(list);
+        const uint32_t groups = bins.capacity / CULL_LOCAL_W + ((bins.capacity % CULL_LOCAL_W) == 0 ? 0 : 1);
+
+        renderGraph.addPass(name + "MaterialBin",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(drawn, ResourceUsage::computeRead())
+                    .write(bins.counts, ResourceUsage::computeWrite())
+                    .write(bins.commands, ResourceUsage::computeWrite(), true);
+
+                if (groupsRes.valid()) b.read(groupsRes, ResourceUsage::computeRead());
+            },
+            [this, bins, groupsRes, drawn, groups, materialCount, instanceKeys] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, materialBinShader.pipeline);
+                materialBinShader.setPush(cmd, Internal::MaterialBinPush{renderGraph.getBuffer(drawn),
+                    groupsRes.valid() ? BufferRef(renderGraph.getBuffer(groupsRes)) : BufferRef::null,
+                    renderGraph.getBuffer(bins.counts), renderGraph.getBuffer(bins.commands),
+                    materialCount, instanceKeys, groupsRes.valid() ? 1u : 0u});
+
+                cmd.dispatch(groups, 1, 1);
+            });
+    };
+
+    addInstancingPasses(culledRes, "broadphase");
+    addInstancingPasses(earlyRes, "occlusionEarly");
+    addInstancingPasses(shadowListRes, "shadowCull");
+
+    addMaterialBinPass(culledRes, "broadphase");
+    addMaterialBinPass(earlyRes, "occlusionEarly");
+
+    //copy out the surviving entity count (and shadow draw count) for getCullStats()
+    renderGraph.addPass("cullReadback",
+        [&] (RenderGraph::PassBuilder& b) {
+            b.read(culledRes, ResourceUsage::transferRead()).sideEffect();
+
+            if (shadowCulling) b.read(shadowListRes, ResourceUsage::transferRead());
+
+            if (clusterCulling) b.read(clusterListRes, ResourceUsage::transferRead());
+        },
+        [&] (vk::CommandBuffer cmd) {
+            CullReadback& rb = cullReadbacks.at(cullReadbackIdx);
+
+            cmd.copyBuffer(renderGraph.getBuffer(culledRes).buffer, rb.buffer.buffer, vk::BufferCopy(0, 0, RenderConstants::arrayHeaderSize));
+
+            if (shadowCulling) {
+                cmd.copyBuffer(renderGraph.getBuffer(shadowListRes).buffer, rb.buffer.buffer,
+                               vk::BufferCopy(0, RenderConstants::arrayHeaderSize, RenderConstants::arrayHeaderSize));
+            }
+
+            if (clusterCulling) {
+                cmd.copyBuffer(renderGraph.getBuffer(clusterListRes).buffer, rb.buffer.buffer,
+                               vk::BufferCopy(0, 4 * RenderConstants::arrayHeaderSize, RenderConstants::arrayHeaderSize));
+            }
+
+            rb.pending = GPUCullStats{(uint32_t) entities.size(), 0, (uint32_t) lights.size()};
+            rb.pending.clusters = clusterCulling ? world.clusters.liveCount() : 0;
+            rb.shadowList = shadowCulling;
+            rb.clusters = clusterCulling;
+            rb.occlusion = false;   //<- set by occlusionReadback, once the late list is done
+            rb.instancing = false;  //<- set by instancingReadback
+            rb.written = true;
+        });
+
+    //SHADOW TRANSMITTANCE (just needs post-cull lightlist & fog list)
+    renderGraph.addPass("shadowTransmittance",
+        [&] (RenderGraph::PassBuilder& b) {
+            //not discarded: while volumetrics are off, images stay at full transmittance from an earlier frame
+            ResourceUsage usage = settings.volumetrics ? ResourceUsage::computeWrite(vk::ImageLayout::eGeneral)
+                                                       : ResourceUsage::transferWrite(vk::ImageLayout::eGeneral);
+
+            for (auto& r : volShadowRes) b.write(r, usage);
+
+            if (settings.volumetrics) b.read(lightsRes, ResourceUsage::computeRead()).asyncCompute();
+        },
+        [&] (vk::CommandBuffer cmd) {
+            if (!settings.volumetrics) {
+                //full transmittance; only newly used images need it, since nothing else writes them while volumetrics are off
+                auto clearRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+
+                for (size_t i=neutralVolShadows; i<lights.size(); i++) {
+                    cmd.clearColorImage(volumetricShadows.at(i).image, vk::ImageLayout::eGeneral, vk::ClearColorValue{1.f, 1.f, 1.f, 1.f}, clearRange);
+                }
+
+                neutralVolShadows = std::max(neutralVolShadows, lights.size());
+
+                return;
+            }
+
+            neutralVolShadows = 0;
+
+            shadowTransmittanceShader.setPush(cmd, Medea::Internal::ShadowTransmittancePush{BufferRef::null, lights.getBuffer(), float(currentTime)});
+
+
+            std::shared_ptr<vk::raii::DescriptorSet> dset
+                = std::make_shared<vk::raii::DescriptorSet>(std::move(shadowTransmittanceArrayAllocator.allocate(core.device, shadowTransmittanceShader.descLayout)));
         
+            std::vector<vk::DescriptorImageInfo> descImgInfo;
+
+            descImgInfo.reserve(lights.size());
+            
+
+            for (size_t i=0; i<lights.size(); i++) {
+                descImgInfo.push_back(vk::DescriptorImageInfo({}, volShadowViews.at(i), vk::ImageLayout::eGeneral));
+            }
+
+            vk::WriteDescriptorSet write(*dset, 0, 0, vk::DescriptorType::eStorageImage, descImgInfo, {}, {});
+
+            {
+                MEDEA_PROFILE_ZONE("descriptorWrites");
+
+                core.device.updateDescriptorSets(write, {});
+            }
+
+            //capture group holds onto shared ptr until frame is known to be done processing
+            ///TODO: reconsider
+            cleanup([dset] () {});
+
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shadowTransmittanceShader.pipeline);
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, shadowTransmittanceShader.layout, 0, **dset, {});
+
+            cmd.dispatch(2, 2, lights.size());
+        });
+
+
+    //SKINNING
+
+    auto volShadowUpdateFunc = [&] (vk::DescriptorSet dset) {
+        MEDEA_PROFILE_ZONE("volShadowDescriptorWrites");
+
         std::vector<vk::DescriptorImageInfo> descImgInfo;
 
         for (size_t i=0; i<lights.size(); i++) {
-            descImgInfo.push_back(vk::DescriptorImageInfo(volShadowSamplers.at(i), volShadowViews.at(i), vk::ImageLayout::eShaderReadOnlyOptimal));
+            descImgInfo.push_back(vk::DescriptorImageInfo(volShadowSamplers.at(i), volShadowViews.at(i), volumetricShadows.at(i)._currentLayout));
         }
 
-        vk::ImageLayout volLightLayout = volLightReady ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eGeneral;
+        //General until the volumetric passes are done with it; the graph has already put it in whichever layout this pass declared
+        vk::DescriptorImageInfo vlightInfo(volLightingSampler, volLightingImage.imageView, volLightingImage._currentLayout);
 
-        vk::DescriptorImageInfo vlightInfo(volLightingSampler, volLightingImage.imageView, volLightLayout);
+        vk::DescriptorBufferInfo temporalInfo(temporalUniforms->buffer, 0, sizeof(Internal::TemporalUniforms));
+        vk::DescriptorBufferInfo shadowViewInfo(shadowViews->buffer, 0, VK_WHOLE_SIZE);
 
         vk::WriteDescriptorSet w0(dset, 0, 0, vk::DescriptorType::eCombinedImageSampler, vlightInfo, {}, {});
         vk::WriteDescriptorSet write(dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, descImgInfo, {}, {});
+        vk::WriteDescriptorSet w2(dset, 2, 0, vk::DescriptorType::eUniformBuffer, {}, temporalInfo, {});
+        vk::WriteDescriptorSet w3(dset, 3, 0, vk::DescriptorType::eStorageBuffer, {}, shadowViewInfo, {});
 
-        core.device.updateDescriptorSets({w0, write}, {});
+        core.device.updateDescriptorSets({w0, write, w2, w3}, {});
     };
 
+    //depth-only passes don't fog anything, so they get the dummy volume instead of waiting on the volumetric passes (which can then overlap them)
+    auto depthVolumeUpdateFunc = [&] (vk::DescriptorSet dset) {
+        MEDEA_PROFILE_ZONE("volShadowDescriptorWrites");
 
-    multiTransition(cmd, volumetricShadows, vk::ImageLayout::eShaderReadOnlyOptimal);
+        vk::DescriptorImageInfo dummyInfo(volLightingSampler, dummyVolume.imageView, dummyVolume._currentLayout);
 
-    {
-        vk::MemoryBarrier2 vsBarrier(
-            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderWrite,
-            vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eAllGraphics, 
-            vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eIndirectCommandRead);
+        std::vector<vk::DescriptorImageInfo> descImgInfo(lights.size(), dummyInfo);
 
+        vk::DescriptorBufferInfo temporalInfo(temporalUniforms->buffer, 0, sizeof(Internal::TemporalUniforms));
+        vk::DescriptorBufferInfo shadowViewInfo(shadowViews->buffer, 0, VK_WHOLE_SIZE);
 
-        cmd.pipelineBarrier2(vk::DependencyInfo({}, vsBarrier, {}, {}));
-    }
+        vk::WriteDescriptorSet w0(dset, 0, 0, vk::DescriptorType::eCombinedImageSampler, dummyInfo, {}, {});
+        vk::WriteDescriptorSet write(dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, descImgInfo, {}, {});
+        vk::WriteDescriptorSet w2(dset, 2, 0, vk::DescriptorType::eUniformBuffer, {}, temporalInfo, {});
+        vk::WriteDescriptorSet w3(dset, 3, 0, vk::DescriptorType::eStorageBuffer, {}, shadowViewInfo, {});
+
+        core.device.updateDescriptorSets({w0, write, w2, w3}, {});
+    };
+
+    //all the depth-only pipeline's reduced layout has (see GSGBindlessShader::bindDepth)
+    const vk::DescriptorBufferInfo depthShadowViewInfo(shadowViews->buffer, 0, VK_WHOLE_SIZE);
+
+    //every mesh's indices; a mesh uploaded later this frame may grow the pool into a new buffer, so this one has to outlive the frame
+    std::shared_ptr<AllocatedBuffer> meshIndexBuffer = meshIndices.getBuffer();
+    cleanup([meshIndexBuffer] () {});
+
+    //draws the first count of a list laid out like the broadphase output: one indexed indirect draw per entry, or with meshTasks (the mesh
+    // path) one indirect mesh tasks draw per entry (a task workgroup per MeshletLimits::perTaskGroup meshlets). With instancing, the
+    // list's grouped copy instead, and on the vertex path one draw per group
+    auto drawEntities = [&] (vk::CommandBuffer cmd, RGHandle list, uint32_t maxDraws, bool meshTasks) {
+        AllocatedBuffer& buf = renderGraph.getBuffer(drawnList(list));
+        const InstancedList* instanced = findInstanced(list);
+
+        if (meshTasks) {
+            cmd.drawMeshTasksIndirectCountEXT(buf.buffer, RenderConstants::arrayHeaderSize + offsetof(RenderEntity, taskGroupsX),
+                buf.buffer, 0, maxDraws, sizeof(RenderEntity), *core.device.getDispatcher());
+        }
+        else if (instanced) {
+            AllocatedBuffer& draws = renderGraph.getBuffer(instanced->commands);
+
+            cmd.bindIndexBuffer(meshIndexBuffer->buffer, 0, vk::IndexType::eUint32);
 
+            cmd.drawIndexedIndirectCount(draws.buffer, RenderConstants::arrayHeaderSize, draws.buffer, 0,
+                std::min(maxDraws, instanceKeys), sizeof(vk::DrawIndexedIndirectCommand));
+        }
+        else {
+            cmd.bindIndexBuffer(meshIndexBuffer->buffer, 0, vk::IndexType::eUint32);
+
+            cmd.drawIndexedIndirectCount(buf.buffer, RenderConstants::arrayHeaderSize + offsetof(RenderEntity, meshSize),
+                buf.buffer, 0, maxDraws, sizeof(RenderEntity));
+        }
+    };
 
-    megashader->v2Bind(core.device, cmd, cleanup, shadowAtlasViewport, {}, *megashader->shadowAtlas.image, vk::CompareOp::eLess, volShadowUpdateFunc);
+    //mesh path: what the task shader culls the next draws' meshlets against (set 2). Occlusion uses this frame's Hi-Z, i.e. only makes
+    // sense for the late list; everything else gets the dummy
+    auto bindMeshletCull = [&] (vk::CommandBuffer cmd, uint32_t flags) {
+        if (!meshShading) return;
 
-    //doing a different (indirect) drawcall per light feels suboptimal, but if I'm doing per light culling it's necessary
-    // and, this means I don't need weird shader hacks to do viewport/scissor limiting
-    for (LightDef ldef : lights) {
-        glm::vec2 saRes = glm::vec2(RenderConstants::shadowAtlasResolution.toVec2().toGlmVec2());
+        const bool HI_Z = flags & Internal::MeshletCullUniforms::CULL_OCCLUSION;
 
-        glm::avec4 atlasPosExtents = ldef.getOldAtlasPosExtents();
+        vk::DescriptorImageInfo hiZInfo = HI_Z ? vk::DescriptorImageInfo(hiZ.getSampler(), hiZ.getImage().imageView, vk::ImageLayout::eGeneral)
+                                               : vk::DescriptorImageInfo(hiZ.getSampler(), dummyHiZ.imageView, dummyHiZ._currentLayout);
 
-        glm::vec4 pe = atlasPosExtents * glm::vec4(saRes, saRes);
+        Internal::MeshletCullUniforms uniforms {
+            rasterProj * camView,
+            glm::vec4(cameraWorldPos.toGlmVec3(), 1),
+            hiZScaleBias,
+            glm::uvec4(renderExtent.width, renderExtent.height, HI_Z ? hiZ.getMipCount() : 0, flags)
+        };
 
-        vk::Viewport curViewport(pe.x, pe.y + pe.w, pe.z, -pe.w, 0.0, 1.0);
-        vk::Rect2D curScissor({(i32) pe.x, (i32) pe.y}, {(u32) pe.z, (u32) pe.w});
+        megashader->bindMeshletCull(core.device, cmd, cleanup, uniforms, hiZInfo);
+    };
 
-        Internal::GPUDrivenPush curPush {
-            glm::mat4(1),
-            ldef.getViewProj(),
-            dynamicBuf.broadphaseCulledEntities,
+    //SHADOW PASS (and per-frustrum culling step?)
+    renderGraph.addPass("shadowPass",
+        [&] (RenderGraph::PassBuilder& b) {
+            readDrawList(b, shadowCulling ? shadowListRes : culledRes);
+
+            b.write(shadowAtlasRes, ResourceUsage::depthAttachment());
+        },
+        [&] (vk::CommandBuffer cmd) {
+            vk::Extent3D saDim = megashader->shadowAtlas.image->imageExtent;
+            vk::Viewport shadowAtlasViewport(0, 0, saDim.width, saDim.height, 0.0, 1.0);
+
+            AllocatedBuffer& culled = renderGraph.getBuffer(drawnList(culledRes));
+
+            megashader->bindDepth(core.device, cmd, cleanup, shadowAtlasViewport, *megashader->shadowAtlas.image, vk::CompareOp::eLess,
+                                  depthVolumeUpdateFunc, depthShadowViewInfo);
+
+            //meshlets still get frustum culled against their light; the camera's cone and Hi-Z don't apply
+            bindMeshletCull(cmd, 0);
+
+            //one draw for every light: each list entry knows its light, and the vertex shader projects into that light's tile (see GSGBindlessShader)
+            if (shadowCulling) {
+                AllocatedBuffer& shadowList = renderGraph.getBuffer(drawnList(shadowListRes));
+
+                //identity view/projection: the light's viewProj is applied per entry, after the material
+                Internal::GPUDrivenPush push {
+                    glm::mat4(1),
+                    glm::mat4(1),
+                    shadowList,
+                    BufferRef::null,
+                    BufferRef::null,
+                    0,
+                    currentTime
+                };
+
+                cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->depthLayout(), megashader->depthStages(), 0, push);
+
+                //same flip as the per light viewports below
+                cmd.setViewport(0, vk::Viewport(0, saDim.height, saDim.width, -float(saDim.height), 0.0, 1.0));
+                cmd.setScissor(0, vk::Rect2D({0, 0}, {saDim.width, saDim.height}));
+
+                drawEntities(cmd, shadowListRes, shadowCapacity, meshShading);
+            }
+            //one (indirect) drawcall per light, each drawing every broadphase survivor
+            else {
+                MEDEA_PROFILE_ZONE("shadowDrawRecording");
+
+                for (LightDef ldef : lights) {
+                    glm::vec2 saRes = glm::vec2(RenderConstants::shadowAtlasResolution.toVec2().toGlmVec2());
+
+                    glm::avec4 atlasPosExtents = ldef.getOldAtlasPosExtents();
+
+                    glm::vec4 pe = atlasPosExtents * glm::vec4(saRes, saRes);
+
+                    vk::Viewport curViewport(pe.x, pe.y + pe.w, pe.z, -pe.w, 0.0, 1.0);
+                    vk::Rect2D curScissor({(i32) pe.x, (i32) pe.y}, {(u32) pe.z, (u32) pe.w});
+
+                    Internal::GPUDrivenPush curPush {
+                        glm::mat4(1),
+                        ldef.getViewProj(),
+                        culled,
+                        BufferRef::null,
+                        BufferRef::null,
+                        0,
+                        currentTime
+                    };
+
+                    cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->depthLayout(), megashader->depthStages(), 0, curPush);
+
+                    cmd.setViewport(0, curViewport);
+                    cmd.setScissor(0, curScissor);
+
+                    drawEntities(cmd, culledRes, entities.size(), meshShading);
+                }
+            }
+            cmd.endRendering();
+        });
+
+    //Extra culling for main pass?
+
+    //no lights or froxels; like the shadow pass
+    auto depthPush = [&] (RGHandle list) {
+        return Internal::GPUDrivenPush {
+            camView,
+            rasterProj,
+            renderGraph.getBuffer(drawnList(list)),
             BufferRef::null,
             BufferRef::null,
             0,
             currentTime
         };
+    };
 
-        cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->layout, vk::ShaderStageFlagBits::eAllGraphics, 0, curPush);
 
-        cmd.setViewport(0, curViewport);
-        cmd.setScissor(0, curScissor);
+    //draws a list laid out like the broadphase output; binned, one material (pipeline) at a time. Leaves the last material's bound.
+    // depthPass: pre-Z, which keeps the depth-only pipeline bindDepth bound if there is one
+    auto drawList = [&] (vk::CommandBuffer cmd, RGHandle list, bool depthPass) {
+        const MaterialBins* bins = findBins(list);
 
-        cmd.drawIndirectCount(dynamicBuf.broadphaseCulledEntities.buffer, RenderConstants::arrayHeaderSize + offsetof(RenderEntity, meshSize), 
-            dynamicBuf.broadphaseCulledEntities.buffer, 0, entities.size(), sizeof(RenderEntity));
-    }
-    cmd.endRendering();
+        if (!bins || (depthPass && settings.depthPipelines)) {
+            drawEntities(cmd, list, entities.size(), meshGeometry);
 
-    multiTransition(cmd, {*megashader->shadowAtlas.image}, vk::ImageLayout::eShaderReadOnlyOptimal);
+            return;
+        }
 
-    //Extra culling for main pass?
+        AllocatedBuffer& counts = renderGraph.getBuffer(bins->counts);
+        AllocatedBuffer& draws = renderGraph.getBuffer(bins->commands);
+
+        cmd.bindIndexBuffer(meshIndexBuffer->buffer, 0, vk::IndexType::eUint32);
+
+        for (uint32_t m=0; m<materialCount; m++) {
+            const uint32_t first = materialRanges.at(m);
+            const uint32_t size = materialRanges.at(materialCount + m);
+
+            if (size == 0) continue;
 
-    Internal::GPUDrivenPush mainPush {
-        camView,
-        camProj,
-        dynamicBuf.broadphaseCulledEntities,
-        lights,
-        froxelArray,
-        0,
-        currentTime
+            cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, megashader->materialPipelines.at(m));
+
+            cmd.drawIndexedIndirectCount(draws.buffer, vk::DeviceSize(first) * sizeof(vk::DrawIndexedIndirectCommand),
+                counts.buffer, m * sizeof(uint32_t), size, sizeof(vk::DrawIndexedIndirectCommand));
+        }
     };
 
+    //the main pass tests depth for equality, so on the mesh path it has to keep exactly the meshlets pre-Z kept for the same list
+    auto meshletCullFlags = [&] (RGHandle list) {
+        uint32_t flags = Internal::MeshletCullUniforms::CULL_CONE;
 
-    //VOL LIGHTING PASS
-    multiTransition(cmd, {*megashader->shadowAtlas.image}, {vk::ImageLayout::eShaderReadOnlyOptimal});
+        if (occlusion && list.idx == lateRes.idx) flags |= Internal::MeshletCullUniforms::CULL_OCCLUSION;
 
-    //In-scattering (needs shadow atlas)
-    {
-        volScatteringShader.setPush(cmd, 
-            Medea::Internal::ScatteringPush{
-                glm::inverse(camProj * camView), 
-                glm::vec4(cameraWorldPos.toGlmVec3(), currentTime),
-                BufferRef::null,
-                lights.getBuffer(),
-                froxelArray
-                });
+        return flags;
+    };
 
-        std::shared_ptr<vk::raii::DescriptorSet> dset
-            = std::make_shared<vk::raii::DescriptorSet>(std::move(shadowTransmittanceArrayAllocator.allocate(core.device, volScatteringShader.descLayout)));
-    
-        std::vector<vk::DescriptorImageInfo> descImgInfo;
+    //with occlusion culling, pre-Z only draws what was visible last frame; the rest is tested against the Hi-Z of that, then drawn by preZLate
+    const RGHandle preZList = occlusion ? earlyRes : culledRes;
 
-        descImgInfo.reserve(lights.size());
-        
+    //pre-Z, or on the visibility buffer path the geometry pass, which writes the visibility buffer along with depth. listIdx is which draw
+    // list (0: early/culled, 1: late) the entity slots it writes index, and is part of the pixels' material bins
+    auto bindGeometry = [&] (vk::CommandBuffer cmd, RGHandle list, uint32_t listIdx) {
+        Internal::GPUDrivenPush push = depthPush(list);
 
-        for (size_t i=0; i<lights.size(); i++) {
-            descImgInfo.push_back(vk::DescriptorImageInfo(volShadowSamplers.at(i), volShadowViews.at(i), vk::ImageLayout::eGeneral));
+        if (!visibility) {
+            megashader->bindDepth(core.device, cmd, cleanup, viewport, depth, vk::CompareOp::eLess, depthVolumeUpdateFunc, depthShadowViewInfo);
+
+            cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->depthLayout(), megashader->depthStages(), 0, push);
+
+            bindMeshletCull(cmd, meshletCullFlags(list));
+
+            return;
         }
 
-        vk::DescriptorImageInfo volLightDII({}, volLightingImage.imageView, vk::ImageLayout::eGeneral);
-        vk::DescriptorImageInfo shadowAtlasDII(megashader->shadowAtlas.sampler, megashader->shadowAtlas.image->imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+        push.drawcallIdx = listIdx;
+
+        cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->layout, megashader->stages, 0, push);
+
+        //no velocity here; the resolve writes it
+        megashader->v2Bind(core.device, cmd, cleanup, viewport, {renderGraph.getImage(visRes)}, depth, vk::CompareOp::eLess, depthVolumeUpdateFunc,
+                           std::nullopt, *megashader->visibility->geometry);
+
+        //v2Bind only sets this for depth-only passes
+        cmd.setCullMode(vk::CullModeFlagBits::eBack);
+    };
+
+    //PRE-Z; declared before the volumetric passes so it can overlap them with async compute
+    renderGraph.addPass(visibility ? "visibility" : "preZ",
+        [&] (RenderGraph::PassBuilder& b) {
+            readDrawList(b, preZList);
+
+            b.write(depthRes, ResourceUsage::depthAttachment());
+
+            if (visibility) b.write(visRes, ResourceUsage::colorAttachment());
+        },
+        [&] (vk::CommandBuffer cmd) {
+            bindGeometry(cmd, preZList, 0);
+            
+            drawList(cmd, preZList, !visibility);
+
+            cmd.endRendering();
+        });
+
+    //OCCLUSION CULLING, phase 2: Hi-Z from the early draws, test every survivor against it, draw what's newly visible
+    if (occlusion) {
+        hiZ.addBuildPass(core, renderGraph, cleanup, depthRes, hiZRes, renderExtent);
+
+        std::shared_ptr<vk::raii::DescriptorSet> dset
+            = std::make_shared<vk::raii::DescriptorSet>(std::move(occlusionDescriptors.allocate(core.device, occlusionCullShader.descLayout)));
+
+        cleanup([dset] () {});
+
+        renderGraph.addPass("occlusionCull",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(culledRes, ResourceUsage::computeRead())
+                    .read(hiZRes, ResourceUsage::computeRead(vk::ImageLayout::eGeneral))
+                    .write(visibilityRes, ResourceUsage::computeWrite())
+                    .write(lateRes, ResourceUsage::computeWrite());
+            },
+            [&, dset] (vk::CommandBuffer cmd) {
+                vk::DescriptorImageInfo hiZDII(hiZ.getSampler(), hiZ.getImage().imageView, vk::ImageLayout::eGeneral);
+                vk::WriteDescriptorSet w0(*dset, 0, 0, vk::DescriptorType::eCombinedImageSampler, hiZDII, {}, {});
+
+                {
+                    MEDEA_PROFILE_ZONE("descriptorWrites");
+
+                    core.device.updateDescriptorSets(w0, {});
+                }
+
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, occlusionCullShader.pipeline);
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, occlusionCullShader.layout, 0, **dset, {});
+                occlusionCullShader.setPush(cmd, occlusionPush(lateRes));
+
+                cmd.dispatch(entityGroups, 1, 1);
+            });
+
+        addInstancingPasses(lateRes, "occlusionLate");
+        addMaterialBinPass(lateRes, "occlusionLate");
+
+        //early/late/occluded counts for getCullStats(); same slot as cullReadback
+        renderGraph.addPass("occlusionReadback",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(earlyRes, ResourceUsage::transferRead())
+                    .read(lateRes, ResourceUsage::transferRead())
+                    .sideEffect();
+            },
+            [&] (vk::CommandBuffer cmd) {
+                CullReadback& rb = cullReadbacks.at(cullReadbackIdx);
+
+                cmd.copyBuffer(renderGraph.getBuffer(earlyRes).buffer, rb.buffer.buffer,
+                               vk::BufferCopy(0, 2 * RenderConstants::arrayHeaderSize, RenderConstants::arrayHeaderSize));
+                cmd.copyBuffer(renderGraph.getBuffer(lateRes).buffer, rb.buffer.buffer,
+                               vk::BufferCopy(0, 3 * RenderConstants::arrayHeaderSize, RenderConstants::arrayHeaderSize));
+
+                rb.occlusion = true;
+            });
+
+        renderGraph.addPass(visibility ? "visibilityLate" : "preZLate",
+            [&] (RenderGraph::PassBuilder& b) {
+                readDrawList(b, lateRes);
 
-        vk::WriteDescriptorSet w0(*dset, 0, 0, vk::DescriptorType::eStorageImage, volLightDII, {}, {});
-        vk::WriteDescriptorSet w1(*dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, shadowAtlasDII, {}, {});
+                b.write(depthRes, ResourceUsage::depthAttachment());
 
-        vk::WriteDescriptorSet w2(*dset, 2, 0, vk::DescriptorType::eCombinedImageSampler, descImgInfo, {}, {});
+                if (visibility) b.write(visRes, ResourceUsage::colorAttachment());
 
-        core.device.updateDescriptorSets({w0, w1, w2}, {});
+                if (meshGeometry) b.read(hiZRes, ResourceUsage::meshRead(vk::ImageLayout::eGeneral));
+            },
+            [&] (vk::CommandBuffer cmd) {
+                bindGeometry(cmd, lateRes, 1);
+
+                drawList(cmd, lateRes, !visibility);
+
+                cmd.endRendering();
+            });
+    }
+
+
+    //instanced draw counts for getCullStats(); same slot as cullReadback
+    if (!instancedLists.empty()) {
+        //shadow, culled, early, late
+        const std::array<RGHandle, 4> slots = {shadowListRes, culledRes, earlyRes, lateRes};
+
+        renderGraph.addPass("instancingReadback",
+            [&] (RenderGraph::PassBuilder& b) {
+                for (RGHandle list : slots) {
+                    if (const InstancedList* l = findInstanced(list)) b.read(l->commands, ResourceUsage::transferRead());
+                }
+
+                b.sideEffect();
+            },
+            [&, slots] (vk::CommandBuffer cmd) {
+                CullReadback& rb = cullReadbacks.at(cullReadbackIdx);
+
+                for (size_t i=0; i<slots.size(); i++) {
+                    vk::DeviceSize offset = (5 + i) * RenderConstants::arrayHeaderSize;
+
+                    if (const InstancedList* l = findInstanced(slots.at(i))) {
+                        cmd.copyBuffer(renderGraph.getBuffer(l->commands).buffer, rb.buffer.buffer, vk::BufferCopy(0, offset, RenderConstants::arrayHeaderSize));
+                    }
+                    else {
+                        cmd.fillBuffer(rb.buffer.buffer, offset, RenderConstants::arrayHeaderSize, 0);
+                    }
+                }
+
+                rb.instancing = true;
+            });
+    }
+
+
+    //VOL LIGHTING PASS
+    if (!settings.volumetrics) {
+        renderGraph.addPass("volClear",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.write(volLightingRes, ResourceUsage::transferWrite(vk::ImageLayout::eGeneral), true);
+            },
+            [&] (vk::CommandBuffer cmd) {
+                //no in-scattering, full transmittance
+                vk::ClearColorValue noFog{0.f, 0.f, 0.f, 1.f};
+
+                cmd.clearColorImage(volLightingImage.image, vk::ImageLayout::eGeneral, noFog, vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+            });
+    }
+    //In-scattering (needs shadow atlas)
+    else {
+        std::shared_ptr<vk::raii::DescriptorSet> dset
+            = std::make_shared<vk::raii::DescriptorSet>(std::move(shadowTransmittanceArrayAllocator.allocate(core.device, volScatteringShader.descLayout)));
 
         //capture group holds onto shared ptr until frame is known to be done processing
         ///TODO: reconsider
         cleanup([dset] () {});
 
-        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, volScatteringShader.pipeline);
-        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, volScatteringShader.layout, 0, **dset, {});
+        renderGraph.addPass("volScattering",
+            [&] (RenderGraph::PassBuilder& b) {
+                readVolShadows(b, COMPUTE_SAMPLED);
+
+                b.read(shadowAtlasRes, COMPUTE_SAMPLED)
+                    .read(froxelRes, ResourceUsage::computeRead())
+                    .read(lightsRes, ResourceUsage::computeRead())
+                    .write(volLightingRes, ResourceUsage::computeWrite(vk::ImageLayout::eGeneral), true)
+                    .asyncCompute();
+            },
+            [&, dset] (vk::CommandBuffer cmd) {
+                volScatteringShader.setPush(cmd, 
+                    Medea::Internal::ScatteringPush{
+                        glm::inverse(camProj * camView), 
+                        glm::vec4(cameraWorldPos.toGlmVec3(), currentTime),
+                        BufferRef::null,
+                        lights.getBuffer(),
+                        froxelArray
+                        });
+
+                std::vector<vk::DescriptorImageInfo> descImgInfo;
+
+                descImgInfo.reserve(lights.size());
+                
+
+                for (size_t i=0; i<lights.size(); i++) {
+                    descImgInfo.push_back(vk::DescriptorImageInfo(volShadowSamplers.at(i), volShadowViews.at(i), volumetricShadows.at(i)._currentLayout));
+                }
+
+                vk::DescriptorImageInfo volLightDII({}, volLightingImage.imageView, vk::ImageLayout::eGeneral);
+                vk::DescriptorImageInfo shadowAtlasDII(megashader->shadowAtlas.sampler, megashader->shadowAtlas.image->imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+                vk::WriteDescriptorSet w0(*dset, 0, 0, vk::DescriptorType::eStorageImage, volLightDII, {}, {});
+                vk::WriteDescriptorSet w1(*dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, shadowAtlasDII, {}, {});
+
+                vk::WriteDescriptorSet w2(*dset, 2, 0, vk::DescriptorType::eCombinedImageSampler, descImgInfo, {}, {});
+
+                {
+                    MEDEA_PROFILE_ZONE("descriptorWrites");
+
+                    core.device.updateDescriptorSets({w0, w1, w2}, {});
+                }
+
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, volScatteringShader.pipeline);
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, volScatteringShader.layout, 0, **dset, {});
+
+                cmd.dispatch(VolLighting::VOL_LIGHTING_RES.x / 8, VolLighting::VOL_LIGHTING_RES.y/8, VolLighting::VOL_LIGHTING_RES.z);
+            });
+
+        renderGraph.addPass("volAccumulate",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.write(volLightingRes, ResourceUsage::computeWrite(vk::ImageLayout::eGeneral)).asyncCompute();
+            },
+            [&, dset] (vk::CommandBuffer cmd) {
+                cmd.bindPipeline(vk::PipelineBindPoint::eCompute, volAccumulateShader.pipeline);
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, volAccumulateShader.layout, 0, **dset, {});
+
+                cmd.dispatch(VolLighting::VOL_LIGHTING_RES.x / 8, VolLighting::VOL_LIGHTING_RES.y/8, 1);
+            });
+    }
+
+
+    auto mainPush = [&] (RGHandle list) {
+        return Internal::GPUDrivenPush {
+            camView,
+            rasterProj,
+            renderGraph.getBuffer(drawnList(list)),
+            lights,
+            froxelArray,
+            0,
+            currentTime
+        };
+    };
+
 
-        cmd.dispatch(VolLighting::VOL_LIGHTING_RES.x / 8, VolLighting::VOL_LIGHTING_RES.y/8, VolLighting::VOL_LIGHTING_RES.z);
+    //Main pass; depth is written by pre-Z, so the depth attachment write here orders after it
+    if (!visibility) renderGraph.addPass("mainPass",
+        [&] (RenderGraph::PassBuilder& b) {
+            readVolShadows(b, SAMPLED);
 
-        vk::MemoryBarrier2 csBarrier(
-            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderWrite,
-            vk::PipelineStageFlagBits2::eComputeShader, 
-            vk::AccessFlagBits2::eShaderRead | vk::AccessFlagBits2::eShaderWrite);
+            b.read(volLightingRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                .read(shadowAtlasRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                .read(froxelRes, ResourceUsage::fragmentRead())
+                .read(lightsRes, ResourceUsage::vertexRead() | ResourceUsage::fragmentRead() | MESH_READ)
+                .write(depthRes, ResourceUsage::depthAttachment());
 
+            if (occlusion) {
+                readDrawList(b, earlyRes);
+                readDrawList(b, lateRes);
+            }
+            else {
+                readDrawList(b, culledRes);
+            }
 
-        cmd.pipelineBarrier2(vk::DependencyInfo({}, csBarrier, {}, {}));
+            for (auto& c : colorRes) b.write(c, ResourceUsage::colorAttachment());
 
+            if (velocityRes.valid()) b.write(velocityRes, ResourceUsage::colorAttachment());
 
-        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, volAccumulateShader.pipeline);
-        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, volAccumulateShader.layout, 0, **dset, {});
+            if (occlusion && meshGeometry) b.read(hiZRes, ResourceUsage::meshRead(vk::ImageLayout::eGeneral));
+        },
+        [&] (vk::CommandBuffer cmd) {
+            std::optional<AllocatedImage2Ref> velocity;
+            if (upscaler) velocity = upscaler->getVelocity();
 
-        cmd.dispatch(VolLighting::VOL_LIGHTING_RES.x / 8, VolLighting::VOL_LIGHTING_RES.y/8, 1);
+            megashader->v2Bind(core.device, cmd, cleanup, viewport, color, depth, vk::CompareOp::eEqual, volShadowUpdateFunc, velocity);
 
-        vk::MemoryBarrier2 accumBarrier(
-            vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderWrite,
-            vk::PipelineStageFlagBits2::eFragmentShader, 
-            vk::AccessFlagBits2::eShaderRead);
+            //pre-Z may have been recorded into another command buffer, so push constants don't carry over
+            for (RGHandle list : occlusion ? std::vector<RGHandle>{earlyRes, lateRes} : std::vector<RGHandle>{culledRes}) {
+                cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->layout, megashader->stages, 0, mainPush(list));
 
-        cmd.pipelineBarrier2(vk::DependencyInfo({}, accumBarrier, {}, {}));
+                bindMeshletCull(cmd, meshletCullFlags(list));
 
-    }
+                drawList(cmd, list, false);
+            }
 
-    multiTransition(cmd, {volLightingImage}, vk::ImageLayout::eShaderReadOnlyOptimal);
+            cmd.endRendering();
+        });
 
-    volLightReady = true;
+    //VISIBILITY BUFFER: sort pixels into material bins by depth, then shade each bin with one fullscreen draw. Every covered pixel is shaded
+    // once, by the one material it has, with the same inputs (lights, froxels, volumetrics) as the main pass
+    const std::vector<RGHandle> mainLists = occlusion ? std::vector<RGHandle>{earlyRes, lateRes} : std::vector<RGHandle>{culledRes};
 
+    //v2Bind flips the viewport; the resolve has to undo that to get NDC from gl_FragCoord
+    auto bindVisibility = [&] (vk::CommandBuffer cmd) {
+        AllocatedImage& vis = renderGraph.getImage(visRes);
 
-    //PRE-Z (Note: no dependencies; can be way earlier)
-    cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->layout, vk::ShaderStageFlagBits::eAllGraphics, 0, mainPush);
+        megashader->bindVisibility(core.device, cmd, cleanup, vk::DescriptorImageInfo(pointSampler, vis.imageView, vis._currentLayout),
+                                   vk::DescriptorBufferInfo(meshIndexBuffer->buffer, 0, VK_WHOLE_SIZE),
+                                   Internal::VisibilityResolveUniforms{glm::vec4(viewport.x, viewport.height, viewport.width, -viewport.height)});
+    };
 
-    megashader->v2Bind(core.device, cmd, cleanup, viewport, {}, depth, vk::CompareOp::eLess, volShadowUpdateFunc);
-    
-    cmd.drawIndirectCount(dynamicBuf.broadphaseCulledEntities.buffer, RenderConstants::arrayHeaderSize + offsetof(RenderEntity, meshSize), 
-        dynamicBuf.broadphaseCulledEntities.buffer, 0, entities.size(), sizeof(RenderEntity));
+    if (visibility) {
+        renderGraph.addPass("materialClassify",
+            [&] (RenderGraph::PassBuilder& b) {
+                b.read(visRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                    .write(materialDepthRes, ResourceUsage::depthAttachment());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                megashader->v2Bind(core.device, cmd, cleanup, viewport, {}, renderGraph.getImage(materialDepthRes), vk::CompareOp::eAlways,
+                                   depthVolumeUpdateFunc, std::nullopt, *megashader->visibility->classify);
 
-    cmd.endRendering();
+                cmd.setCullMode(vk::CullModeFlagBits::eNone);
 
+                bindVisibility(cmd);
 
-    {
-        vk::ImageMemoryBarrier2 depthBarrier(
-            vk::PipelineStageFlagBits2::eLateFragmentTests, vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
-            vk::PipelineStageFlagBits2::eEarlyFragmentTests, vk::AccessFlagBits2::eDepthStencilAttachmentRead,
-            vk::ImageLayout::eUndefined, vk::ImageLayout::eUndefined,
-            core.graphicsQueueFamily,
-            core.graphicsQueueFamily,
-            depth.value().get().image,
-            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers));
+                cmd.draw(3, 1, 0, 0);
 
-        
-        cmd.pipelineBarrier2(vk::DependencyInfo({}, {}, {}, depthBarrier));
+                cmd.endRendering();
+            });
+
+        renderGraph.addPass("materialResolve",
+            [&] (RenderGraph::PassBuilder& b) {
+                readVolShadows(b, SAMPLED);
+
+                b.read(volLightingRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                    .read(shadowAtlasRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                    .read(froxelRes, ResourceUsage::fragmentRead())
+                    .read(lightsRes, ResourceUsage::fragmentRead())
+                    .read(visRes, ResourceUsage::fragmentRead(vk::ImageLayout::eShaderReadOnlyOptimal))
+                    .write(materialDepthRes, ResourceUsage::depthAttachment());
+
+                //the visibility buffer's slots index what the geometry passes drew
+                for (RGHandle list : mainLists) b.read(drawnList(list), ResourceUsage::fragmentRead());
+
+                for (auto& c : colorRes) b.write(c, ResourceUsage::colorAttachment());
+
+                if (velocityRes.valid()) b.write(velocityRes, ResourceUsage::colorAttachment());
+            },
+            [&] (vk::CommandBuffer cmd) {
+                std::optional<AllocatedImage2Ref> velocity;
+                if (upscaler) velocity = upscaler->getVelocity();
+
+                megashader->v2Bind(core.device, cmd, cleanup, viewport, color, renderGraph.getImage(materialDepthRes), vk::CompareOp::eEqual,
+                                   volShadowUpdateFunc, velocity, *megashader->visibility->resolve);
+
+                cmd.setCullMode(vk::CullModeFlagBits::eNone);
+
+                bindVisibility(cmd);
+
+                //a bin's pixels all index the same list, so its draw gets that list's push constants; the instance index is the bin
+                for (uint32_t l=0; l<mainLists.size(); l++) {
+                    cmd.pushConstants<Medea::Internal::GPUDrivenPush>(megashader->layout, megashader->stages, 0, mainPush(mainLists.at(l)));
+
+                    for (uint32_t m=0; m<megashader->materialCount; m++) {
+                        if (settings.materialPipelines) {
+                            cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, megashader->visibility->materialResolve.at(m));
+                        }
+
+                        cmd.draw(3, 1, 0, l * megashader->materialCount + m);
+                    }
+                }
+
+                cmd.endRendering();
+            });
     }
 
+    if (upscaler) upscaler->addPass(core, renderGraph, cleanup, colorRes.at(0), depthRes, velocityRes);
 
-    //Main pass
-    megashader->v2Bind(core.device, cmd, cleanup, viewport, color, depth, vk::CompareOp::eEqual, volShadowUpdateFunc);
 
-    cmd.drawIndirectCount(dynamicBuf.broadphaseCulledEntities.buffer, RenderConstants::arrayHeaderSize + offsetof(RenderEntity, meshSize), 
-        dynamicBuf.broadphaseCulledEntities.buffer, 0, entities.size(), sizeof(RenderEntity));
+    renderGraph.execute(core, cleanup,
+        [this] (vk::CommandBuffer cmd, std::string_view name, bool computeQueue) { beginPass(cmd, name, computeQueue); },
+        [this] (vk::CommandBuffer cmd, bool computeQueue) { endPass(cmd, computeQueue); });
 
-    cmd.endRendering();
+    profiler.end(frameCmd);
 
-}
\ No newline at end of file
+    profiler.endFrame();
+    pipelineStats.endFrame();
+}
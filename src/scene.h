@@ -7,11 +7,17 @@
 
 #include "constants.h"
 #include <unordered_set>
+#include <map>
 #include "compute.h"
 
 #include "internal/metacodegen.h"
 
 #include "gvector.h"
+#include "gpuprofiler.h"
+#include "rendergraph.h"
+#include "temporalupscaler.h"
+#include "hizpyramid.h"
+#include "entityclusters.h"
 
 ///current TODO: get some way of streaming the uniform buffers to the GPU
 /// maybe this should all be uploaded as a single buffer? Idk.
@@ -22,6 +28,19 @@ namespace Medea {
 
     struct GPUSceneGraph;
 
+    /// How GPUSceneGraph shades the main view. Fixed by GPUSceneGraph::compileMaterialSets, as each has its own pipelines
+    enum class ShadingPath {
+        forward,            //<- pre-Z, then the main pass runs the whole megashader again with an equal depth test
+        visibilityBuffer,   //<- one geometry pass writes triangle IDs, then every pixel is shaded once, binned by material (see VisibilityPipelines)
+    };
+
+    /// What a material needs in the depth-only passes (shadows, pre-Z) with RenderSettings::depthPipelines. Given to its MaterialSet
+    enum class DepthMode {
+        position,           //<- the vertex code only does gl_Position = projection * view * model * vec4(pos, 1); depth passes read just the position stream
+        vertex,             //<- the vertex code moves vertices (wind, displacement, ...), so depth passes have to run it
+        alphaTest,          //<- vertex code, plus the fragment code to discard below Internal::DepthOnly::alphaCutoff alpha. Gives the depth passes a fragment stage
+    };
+
     class IMaterialSet {
         public:
 
@@ -31,6 +50,8 @@ namespace Medea {
         virtual vk::DeviceAddress update(VmaAllocator allocator, vk::Device device, vk::CommandBuffer cmd) =0;
 
         virtual std::pair<Internal::VMaterialVertex, Internal::VMaterialFragment> introspect(const std::string& entryName, uint32_t materialID) const =0;
+
+        virtual DepthMode depthMode() const =0;
     };
 
     namespace Internal {
@@ -41,23 +62,36 @@ namespace Medea {
             glm::avec3 fragWorldNormal;
             glm::avec2 fragUV;
             uint32_t fragTex;
+
+            //written by the generated main() rather than materials, for motion vectors
+            glm::avec4 fragClipPos;
+            glm::avec4 fragPrevClipPos;
         };
 
         /// @brief GPU scene graph frag out;
         struct GSGFOut {
             glm::avec4 fragColor;
+            glm::avec2 fragVelocity;    //<- current minus previous UV; only kept if render() was given a TemporalUpscaler
         };
 
         struct MeshPtr {
             BufferRef attributeAddress;
             BufferRef positionAddress;
+            BufferRef meshletAddress;
+            BufferRef lodAddress;
             MeshCollider collider;
             size_t totalVertices;
+            uint32_t meshletCount;
+            uint32_t firstIndex, indexCount;    //<- LOD level 0's
+            VertexFormat vertexFormat;
+            uint32_t lodCount;
 
             template<typename T>
             MeshPtr(FullMesh<T>& base)
-                : attributeAddress(base.vertexAttributes.buffer), positionAddress(base.vertexBasePositions.buffer), 
-                collider(base.collider), totalVertices(base.totalVertices) {}
+                : attributeAddress(base.vertexAttributes.buffer), positionAddress(base.vertexBasePositions.buffer), meshletAddress(base.meshlets.buffer),
+                lodAddress(base.lods.buffer), collider(base.collider), totalVertices(base.totalVertices), meshletCount(base.meshlets.meshletCount),
+                firstIndex(base.lods.levels.at(0).firstIndex), indexCount(base.lods.levels.at(0).indexCount),
+                vertexFormat(base.vertexBasePositions.format), lodCount(base.lods.levels.size()) {}
         };
 
         struct RenderEntityInit {
@@ -83,11 +117,18 @@ namespace Medea {
 
         std::string vertexShaderPath, fragmentShaderPath;
 
+        DepthMode depth;
+
         public:
         using UTYPE = Uniform;
         using VTYPE = VIn;
 
-        MaterialSet(GPUSceneGraph& base_, Core& core, vk::CommandBuffer cmd, std::string_view vtxPath, std::string_view fragPath);
+        MaterialSet(GPUSceneGraph& base_, Core& core, vk::CommandBuffer cmd, std::string_view vtxPath, std::string_view fragPath,
+                    DepthMode depth = DepthMode::position);
+
+        DepthMode depthMode() const override {
+            return depth;
+        }
 
         std::pair<Internal::VMaterialVertex, Internal::VMaterialFragment> introspect(const std::string& entryName, uint32_t materialID) const override {
             std::string vtxSrc = readFile(vertexShaderPath).value();
@@ -121,16 +162,6 @@ namespace Medea {
     namespace Internal {
         struct SceneGraphState;
 
-        struct PerFrameDynamicBuffers {
-            AllocatedBuffer broadphaseCulledEntities; //sizeof gpuEntities, to avoid worst case of no culling. Also works as indirect draw buffer
-
-            //for now, no additional culling
-            //AllocatedBuffer 
-
-
-            static PerFrameDynamicBuffers make(vk::Device device, VmaAllocator allocator, const glist<RenderEntity>& entities);
-        };
-
         struct FroxelPush {
             glm::mat4 inverseViewProj;
             glm::mat4 view;
@@ -154,6 +185,86 @@ namespace Medea {
             BufferRef materialUniformBufferMapping;
         };
 
+        /// one per light, for the shadow pass (megashader set 1, binding 3) and per-light culling
+        struct ShadowView {
+            glm::mat4 viewProj;
+            glm::avec4 atlasRect;       //<- LightDef::getOldAtlasPosExtents()
+        };
+
+        /// shadowCull.comp (phase 0: count, 1: write) and shadowCullScan.comp
+        struct ShadowCullPush {
+            BufferRef inArr;            //<- broadphase output
+            BufferRef outArr;           //<- shadow draw list, same layout as the broadphase output
+            BufferRef shadowViews;
+            BufferRef lightCounts;      //<- per light: casters, then (after the scan) the next free slot
+            uint32_t lightCount;
+            uint32_t capacity;
+            uint32_t phase;
+            glm::float32 lodScale;      //<- half the shadow atlas height over RenderSettings::lodErrorPixels; 0: keep the camera's LOD
+            uint32_t lodBias;           //<- RenderSettings::shadowLodBias
+        };
+
+        /// occlusionSplit.comp and occlusionCull.comp
+        struct OcclusionCullPush {
+            glm::mat4 viewProj;             //<- what the depth was rasterized with
+            glm::vec4 uvScaleBias;          //<- NDC xy to Hi-Z UV, i.e. the viewport relative to the Hi-Z's base extent
+            glm::uvec4 pyramidExtentMips;   //<- xy: Hi-Z base extent; z: mip count
+            BufferRef inArr;                //<- broadphase output
+            BufferRef outArr;               //<- early (split) or late (cull) draw list, same layout as the broadphase output
+            BufferRef visibility;           //<- one uint per RenderEntity::id, nonzero if it passed last frame's occlusion test
+        };
+
+        /// clusterCull.comp and clusterEntityCull.comp. Something's visible if it's in the camera's frustum or any light's
+        struct ClusterCullPush {
+            glm::mat4 viewProj;
+            BufferRef clusters;                 //<- EntityClusters::getBounds()
+            BufferRef members;                  //<- EntityClusters::getMembers()
+            BufferRef entities;
+            BufferRef clusterList;              //<- header: dispatch indirect args (visible clusters, 1, 1), then the visible cluster indices
+            BufferRef outArr;                   //<- broadphase output
+            BufferRef materialUniformBufferMapping;
+            BufferRef shadowViews;
+            uint32_t lightCount;
+            uint32_t clusterCount;
+        };
+
+        /// clusterEntityCull.comp: ClusterCullPush, but it goes by the cluster list, so the LOD scale takes the cluster count's place (push
+        ///  constants are at the guaranteed 128 bytes)
+        struct ClusterEntityCullPush {
+            glm::mat4 viewProj;
+            BufferRef clusters;
+            BufferRef members;
+            BufferRef entities;
+            BufferRef clusterList;
+            BufferRef outArr;
+            BufferRef materialUniformBufferMapping;
+            BufferRef shadowViews;
+            uint32_t lightCount;
+            glm::float32 lodScale;              //<- half the viewport height over RenderSettings::lodErrorPixels; 0: always LOD 0
+        };
+
+        /// instanceGroup.comp (phase 0: count, 1: write) and instanceGroupScan.comp: regroups a draw list so every (RenderEntity::instanceGroup,
+        ///  lodLevel) key's copies are contiguous, with one VkDrawIndexedIndirectCommand per key drawing all of them as instances
+        struct InstanceGroupPush {
+            BufferRef inArr;            //<- any draw list
+            BufferRef outArr;           //<- the same copies, grouped; same layout
+            BufferRef groups;           //<- per key: copies, then (after the scan) the next free slot; and the first copy seen
+            BufferRef commands;         //<- header with the draw count, then the draws
+            uint32_t keyCount;          //<- RenderWorld::instanceGroupCount() * LodLimits::maxLevels
+            uint32_t phase;
+        };
+
+        /// materialBin.comp: a draw list's entries (or, instanced, its groups) as indexed indirect draws, binned by material
+        struct MaterialBinPush {
+            BufferRef list;             //<- what's drawn; the grouped list if instanced
+            BufferRef groups;           //<- InstanceGroupPush::groups after the write phase; null if not instanced
+            BufferRef counts;           //<- per material: draws; then per material: its range's first draw; then per material: its range's size
+            BufferRef commands;         //<- every material's range of VkDrawIndexedIndirectCommands, back to back
+            uint32_t materialCount;
+            uint32_t keyCount;          //<- InstanceGroupPush::keyCount
+            uint32_t instanced;
+        };
+
         struct ShadowTransmittancePush {
             BufferRef volMaterialDataStructure;
             BufferRef lightDefArray;
@@ -168,6 +279,22 @@ namespace Medea {
             BufferRef froxelArray;
         };
 
+        /// megashader set 2 on the mesh path: meshletCull.task's per list culling
+        struct MeshletCullUniforms {
+            glm::mat4 viewProj;             //<- what the Hi-Z's depth was rasterized with
+            glm::vec4 cameraPos;
+            glm::vec4 hiZUVScaleBias;       //<- see OcclusionCullPush::uvScaleBias
+            glm::uvec4 hiZExtentMipsFlags;  //<- xy: Hi-Z base extent; z: mip count; w: CULL_* flags
+
+            static constexpr uint32_t CULL_CONE = 1;
+            static constexpr uint32_t CULL_OCCLUSION = 2;
+        };
+
+        /// megashader set 2 binding 3, for the visibility buffer's material resolve
+        struct VisibilityResolveUniforms {
+            glm::vec4 viewport;             //<- x, y, width, height as v2Bind sets it (flipped), to get from gl_FragCoord back to NDC
+        };
+
         ///GPUSceneGraph vulkan backend, basically
         template<typename V2F, typename FOut>
         struct GSGBindlessShader {
@@ -185,12 +312,66 @@ namespace Medea {
 
             DescriptorAllocator dAllocator;
 
+            /// the task/mesh pipeline (meshletCull.task + the vertex materials run per meshlet vertex); only if the device has mesh shaders
+            std::optional<vk::raii::Pipeline> meshPipeline;
+
+            /// pipeline, specialized to one material each (by materialID; see MaterialSpecialization), for RenderSettings::materialPipelines.
+            ///  Same shaders, layout and state, so they can be bound over v2Bind's
+            std::vector<vk::raii::Pipeline> materialPipelines;
+
+            /// ShadingPath::visibilityBuffer. All three share the megashader's layout; bind them through v2Bind's pipelineOverride
+            struct VisibilityPipelines {
+                vk::raii::Pipeline geometry;    //<- the vertex path + a fragment shader writing the visibility buffer (R32G32_UINT) and depth
+                vk::raii::Pipeline classify;    //<- fullscreen: visibility buffer -> material depth (the pixel's bin)
+                vk::raii::Pipeline resolve;     //<- fullscreen per bin at its material depth: the vertex and fragment paths per pixel
+                std::vector<vk::raii::Pipeline> materialResolve;    //<- resolve specialized to each material; a bin only ever has one
+            };
+
+            std::optional<VisibilityPipelines> visibility;
+            uint32_t materialCount;             //<- part of a visibility bin
+
+            /// RenderSettings::depthPipelines: the shadow and pre-Z passes' pipeline, bound by bindDepth. The vertex path's position only
+            ///  transform (Internal::DepthOnly) for DepthMode::position materials, the megashader's vertex code for the rest, and a fragment
+            ///  stage only if one's DepthMode::alphaTest
+            struct DepthPipeline {
+                vk::raii::Pipeline pipeline;
+
+                /// only if every material is DepthMode::position: then nothing but the draw list and ShadowViews is read, so the layout's
+                ///  an empty set 0, set 1 with only ShadowViews (binding 3), and vertex stage push constants. Otherwise it's the megashader's
+                std::optional<vk::raii::DescriptorSetLayout> emptyDescLayout;
+                std::optional<vk::raii::DescriptorSetLayout> descLayout;
+                std::optional<vk::raii::PipelineLayout> layout;
+                std::optional<DescriptorAllocator> descriptors;
+            };
+
+            DepthPipeline depthOnly;
+
+            /// set 2, for inputs that change per pass: meshletCull.task's uniforms + Hi-Z (bindings 0, 1; bindMeshletCull) and the visibility
+            ///  buffer + resolve uniforms (bindings 2, 3; bindVisibility). Only there on the mesh or visibility buffer paths
+            std::optional<vk::raii::DescriptorSetLayout> passDescLayout;
+            std::optional<DescriptorAllocator> passDescriptors;    //<- set 2 is bound once per draw list, so it gets its own (small) pool
+
+            /// every stage any of the pipelines has; push constants have to be pushed with exactly these
+            vk::ShaderStageFlags stages;
+
+            /// set per frame: whether v2Bind binds meshPipeline. Draws then have to go through drawMeshTasksIndirectCountEXT, and each
+            ///  draw list needs bindMeshletCull
+            bool meshShading = false;
+
+            /// set per frame: whether bindDepth binds depthOnly (the mesh path never does; its task shader's culling is worth more)
+            bool depthPipelines = false;
+
             static std::unique_ptr<GSGBindlessShader> make(Core& core, 
-                                                           std::vector<std::reference_wrapper<IMaterialSet>> materials, BindlessTextureArray& textures) {
+                                                           std::vector<std::reference_wrapper<IMaterialSet>> materials, BindlessTextureArray& textures,
+                                                           ShadingPath path = ShadingPath::forward) {
 
                 std::vector<Internal::VMaterialVertex> vertexMaterials;
                 std::vector<Internal::VMaterialFragment> fragMaterials;
 
+                //the materials whose code the depth-only pipeline has to run (see DepthMode)
+                std::vector<Internal::VMaterialVertex> depthVertexMaterials;
+                std::vector<Internal::VMaterialFragment> alphaTested;
+
                 vk::raii::Device& device = core.device;
                 VmaAllocator allocator = core.allocator;
 
@@ -200,34 +381,91 @@ namespace Medea {
 
                     auto pair = mat.get().introspect(name, idx);
 
+                    const DepthMode DEPTH_MODE = mat.get().depthMode();
+
+                    if (DEPTH_MODE != DepthMode::position) depthVertexMaterials.push_back(pair.first);
+                    if (DEPTH_MODE == DepthMode::alphaTest) alphaTested.push_back(pair.second);
+
                     vertexMaterials.push_back(std::move(pair.first));
                     fragMaterials.push_back(std::move(pair.second));
 
                     idx++;
                 }
 
+                MemoryCategoryScope shadowMemory(MemoryCategory::shadows);
+
                 RenderTexture shadowAtlas = RenderTexture::makeDepth(core, RenderConstants::shadowAtlasResolution);
                 RenderTexture dummyShadowAtlas = RenderTexture::makeDepth(core, Coord(1));
 
-                vk::DescriptorSetLayoutBinding shadowAtlasBinding = shadowAtlas.makeBinding(0, vk::ShaderStageFlagBits::eAllGraphics);
-                vk::DescriptorSetLayoutBinding texBinding = textures.makeBinding(1, vk::ShaderStageFlagBits::eAllGraphics);
+                //the mesh path runs the vertex code in the mesh stage, and culls (incl. shadow views) in the task stage
+                const bool MESH_PATH = core.caps.meshShader;
+                const bool VISIBILITY = path == ShadingPath::visibilityBuffer;
+
+                //bins are per draw list (early + late with occlusion culling) and material
+                assert(!VISIBILITY || 2 * materials.size() <= Internal::VisibilityBits::maxBins);
+                const vk::ShaderStageFlags stages = MESH_PATH ? vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT
+                                                              : vk::ShaderStageFlags(vk::ShaderStageFlagBits::eAllGraphics);
+
+                vk::DescriptorSetLayoutBinding shadowAtlasBinding = shadowAtlas.makeBinding(0, stages);
+                vk::DescriptorSetLayoutBinding texBinding = textures.makeBinding(1, stages);
 
                 vk::DescriptorSetLayoutBinding volLightBinding = 
-                    vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eAllGraphics);
+                    vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, stages);
                 vk::DescriptorSetLayoutBinding volShadowBinding = 
-                    vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, RenderConstants::maxLights, vk::ShaderStageFlagBits::eAllGraphics);
+                    vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, RenderConstants::maxLights, stages);
+                vk::DescriptorSetLayoutBinding temporalBinding = 
+                    vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eUniformBuffer, 1, stages);
+                vk::DescriptorSetLayoutBinding shadowViewBinding = 
+                    vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, stages);
 
                 std::stringstream bonusStream;
                 bonusStream << "layout (set = 0, binding = 0) uniform sampler2DShadow shadowAtlas;\n";
                 bonusStream << "layout (set = 0, binding = 1) uniform sampler2D medeaTextures["+std::to_string(textures.MAX_TEXTURES)+"];\n";
                 bonusStream << "layout (set = 1, binding = 0) uniform sampler3D volumetricLighting;\n";
                 bonusStream << "layout (set = 1, binding = 1) uniform sampler3D volumetricShadows["+std::to_string(RenderConstants::maxLights)+"];\n";
-
-                std::string vtxSrc  = Internal::vmaterialSrcVtx<V2F>(vertexMaterials, bonusStream.str());
-                std::string fragSrc = Internal::vmaterialSrcFrag<V2F, FOut>(fragMaterials, bonusStream.str());
+                bonusStream << "layout (set = 1, binding = 2) uniform MedeaTemporal { mat4 viewProj; mat4 prevViewProj; } medeaTemporal;\n";
+                bonusStream << "struct _MedeaShadowView { mat4 viewProj; vec4 atlasRect; };\n";
+                bonusStream << "layout (set = 1, binding = 3) readonly buffer MedeaShadowViews { _MedeaShadowView data[]; } medeaShadowViews;\n";
+
+                //invariant: the main pass tests pre-Z's depth for equality, and pre-Z may have come from the depth-only pipeline
+                std::string vtxBonus = bonusStream.str() + "out float gl_ClipDistance[4];\n" + "invariant gl_Position;\n";
+
+                //motion vectors: the undeformed vertex through this and last frame's entity transform + camera. Materials that displace vertices
+                // (wind etc.) won't have that in their motion
+                std::string motionEpilogue = 
+                    "\tRenderEntity _prevEntity = entity;\n"
+                    "\t_prevEntity.pos = entity.prevPos;\n"
+                    "\t_prevEntity.rot = entity.prevRot;\n"
+                    "\tfragClipPos = medeaTemporal.viewProj * model * vec4(pos, 1.0);\n"
+                    "\tfragPrevClipPos = medeaTemporal.prevViewProj * _medeaEntityToModel(_prevEntity) * vec4(pos, 1.0);\n";
+
+                //shadow draw list entries: the shadow pass pushes identity view/projection, so gl_Position is still in world space. Project it
+                // with the entry's light and squash it into that light's atlas tile; the viewport covers the whole atlas, so the clip distances
+                // do what the per-tile scissor used to
+                std::string shadowEpilogue =
+                    "\tif (entity.shadowLight != 0) {\n"
+                    "\t\t_MedeaShadowView sv = medeaShadowViews.data[entity.shadowLight - 1];\n"
+                    "\t\tvec4 c = sv.viewProj * gl_Position;\n"
+                    "\t\tgl_ClipDistance[0] = c.w + c.x; gl_ClipDistance[1] = c.w - c.x;\n"
+                    "\t\tgl_ClipDistance[2] = c.w + c.y; gl_ClipDistance[3] = c.w - c.y;\n"
+                    "\t\tvec4 r = sv.atlasRect;\n"
+                    "\t\tgl_Position = vec4((c.x + c.w) * r.z + (2.0 * r.x - 1.0) * c.w, (c.y - c.w) * r.w + (1.0 - 2.0 * r.y) * c.w, c.z, c.w);\n"
+                    "\t}\n"
+                    "\telse {\n"
+                    "\t\tgl_ClipDistance[0] = 1.0; gl_ClipDistance[1] = 1.0; gl_ClipDistance[2] = 1.0; gl_ClipDistance[3] = 1.0;\n"
+                    "\t}\n";
+
+                std::string vtxEpilogue = motionEpilogue + shadowEpilogue;
+
+                //NDC -> UV flips Y (see the viewport in v2Bind)
+                std::string fragEpilogue =
+                    "\tfragVelocity = (fragClipPos.xy / fragClipPos.w - fragPrevClipPos.xy / fragPrevClipPos.w) * vec2(0.5, -0.5);\n";
+
+                std::string vtxSrc  = Internal::vmaterialSrcVtx<V2F>(vertexMaterials, vtxBonus, vtxEpilogue);
+                std::string fragSrc = Internal::vmaterialSrcFrag<V2F, FOut>(fragMaterials, bonusStream.str(), fragEpilogue);
 
                 std::vector<vk::DescriptorSetLayoutBinding> imageBindings = {shadowAtlasBinding, texBinding};
-                std::vector<vk::DescriptorSetLayoutBinding> volBindings = {volLightBinding, volShadowBinding};
+                std::vector<vk::DescriptorSetLayoutBinding> volBindings = {volLightBinding, volShadowBinding, temporalBinding, shadowViewBinding};
 
                 vk::raii::DescriptorSetLayout descLayout(device, vk::DescriptorSetLayoutCreateInfo({}, imageBindings));
 
@@ -235,9 +473,38 @@ namespace Medea {
 
                 std::vector<vk::DescriptorSetLayout> layouts = {*descLayout, *vsDescLayout};
 
+                std::optional<vk::raii::DescriptorSetLayout> passDescLayout;
+                std::optional<DescriptorAllocator> passDescriptors;
+
+                if (MESH_PATH || VISIBILITY) {
+                    std::vector<vk::DescriptorSetLayoutBinding> passBindings;
+
+                    if (MESH_PATH) {
+                        passBindings.push_back(vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTaskEXT));
+                        passBindings.push_back(vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eTaskEXT));
+                    }
+
+                    if (VISIBILITY) {
+                        passBindings.push_back(vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment));
+                        passBindings.push_back(vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment));
+                        passBindings.push_back(vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment));
+                    }
+
+                    passDescLayout.emplace(device, vk::DescriptorSetLayoutCreateInfo({}, passBindings));
+
+                    layouts.push_back(**passDescLayout);
+
+                    std::vector<DescriptorAllocator::PoolSizeRatio> passRatios = {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eUniformBuffer, 2),
+                                                                                  DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 2),
+                                                                                  DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eStorageBuffer, 1)};
+
+                    //a handful of draw lists per frame, times frames in flight
+                    passDescriptors = DescriptorAllocator::make(device, 32, passRatios);
+                }
+
                 vk::PipelineLayoutCreateInfo plci({}, layouts);
 
-                vk::PushConstantRange pushRange({vk::ShaderStageFlagBits::eAllGraphics}, 0, sizeof(Internal::GPUDrivenPush));
+                vk::PushConstantRange pushRange(stages, 0, sizeof(Internal::GPUDrivenPush));
 
                 //auto pushArr = {pushPerMat, pushPerInst};
 
@@ -261,27 +528,307 @@ namespace Medea {
                     .setMultisampleDisable()
                     .setBlendingDisable()
                     .setDepthTestEnable(true, vk::CompareOp::eLess)
-                    .setColorAttachmentFormat(RenderConstants::screenFormat)
+                    .setColorAttachmentFormats({RenderConstants::screenFormat, RenderConstants::velocityFormat})
+                    .setDepthFormat(vk::Format::eD32Sfloat)
+                    .build(device);
+
+                std::vector<vk::raii::Pipeline> materialPipelines;
+
+                for (uint32_t m=0; m<materials.size(); m++) {
+                    materialPipelines.push_back(builder.setSpecialization(Internal::MaterialSpecialization::constantID, m).build(device));
+                }
+
+                //DEPTH-ONLY: position only unless a material says otherwise. Only the shadow epilogue; nothing here needs motion vectors
+                std::string depthVtxSrc = Internal::vmaterialSrcVtx<V2F>(depthVertexMaterials, vtxBonus, shadowEpilogue, Internal::DepthOnly::position);
+
+                DepthPipeline depthOnly{nullptr};
+
+                if (depthVertexMaterials.empty()) {
+                    vk::DescriptorSetLayoutBinding depthShadowViewBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex);
+
+                    depthOnly.emptyDescLayout.emplace(device, vk::DescriptorSetLayoutCreateInfo());
+                    depthOnly.descLayout.emplace(device, vk::DescriptorSetLayoutCreateInfo({}, depthShadowViewBinding));
+
+                    std::vector<vk::DescriptorSetLayout> depthLayouts = {**depthOnly.emptyDescLayout, **depthOnly.descLayout};
+
+                    vk::PushConstantRange depthPushRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(Internal::GPUDrivenPush));
+
+                    depthOnly.layout.emplace(device, vk::PipelineLayoutCreateInfo({}, depthLayouts, depthPushRange));
+
+                    std::vector<DescriptorAllocator::PoolSizeRatio> depthRatios = {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eStorageBuffer, 1)};
+
+                    //shadows, pre-Z and its late pass, times frames in flight
+                    depthOnly.descriptors = DescriptorAllocator::make(device, 16, depthRatios);
+                }
+
+                PipelineBuilder depthBuilder(depthOnly.layout ? *depthOnly.layout : layout);
+
+                if (alphaTested.empty()) depthBuilder.setVertexShader(device, depthVtxSrc, namePref+"_DepthVertex");
+                else {
+                    std::string depthFragSrc = Internal::vmaterialSrcDepthFrag<V2F, FOut>(alphaTested, bonusStream.str());
+
+                    depthBuilder.setShaders(device, depthVtxSrc, depthFragSrc, namePref+"_DepthVertex", namePref+"_DepthFragment");
+                }
+
+                depthOnly.pipeline = depthBuilder
+                    .setTopology(vk::PrimitiveTopology::eTriangleList)
+                    .setPolygonMode(vk::PolygonMode::eFill)
+                    .setCullMode()
+                    .setMultisampleDisable()
+                    .setBlendingDisable()
+                    .setDepthTestEnable(true, vk::CompareOp::eLess)
+                    .setColorAttachmentFormats({})
                     .setDepthFormat(vk::Format::eD32Sfloat)
                     .build(device);
 
-                std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios = {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 5 * textures.MAX_TEXTURES)};
+                std::optional<vk::raii::Pipeline> meshPipeline;
+
+                if (MESH_PATH) {
+                    //gl_ClipDistance is per vertex output in a mesh shader; the vertex code writes the global, the epilogue copies it out
+                    std::string meshBonus = bonusStream.str() + "float _medeaClipDistance[4];\n"
+                        "out gl_MeshPerVertexEXT { vec4 gl_Position; float gl_ClipDistance[4]; } gl_MeshVerticesEXT[];\n";
+
+                    std::string meshVertexEpilogue =
+                        "\t\tfor (int i = 0; i < 4; i++) gl_MeshVerticesEXT[_medeaOutVertex].gl_ClipDistance[i] = _medeaClipDistance[i];\n";
+
+                    std::string taskSrc = Internal::vmaterialSrcTask<V2F>(bonusStream.str(), readFile("./shader/meshletCull.task").value());
+                    std::string meshSrc = Internal::vmaterialSrcMesh<V2F>(vertexMaterials, meshBonus, vtxEpilogue, meshVertexEpilogue);
+
+                    PipelineBuilder meshBuilder(layout);
+
+                    meshPipeline = meshBuilder
+                        .setMeshShaders(device, taskSrc, meshSrc, fragSrc, namePref+"_Task", namePref+"_Mesh", namePref+"_MeshFragment")
+                        .setPolygonMode(vk::PolygonMode::eFill)
+                        .setCullMode()
+                        .setMultisampleDisable()
+                        .setBlendingDisable()
+                        .setDepthTestEnable(true, vk::CompareOp::eLess)
+                        .setColorAttachmentFormats({RenderConstants::screenFormat, RenderConstants::velocityFormat})
+                        .setDepthFormat(vk::Format::eD32Sfloat)
+                        .build(device);
+                }
+
+                std::optional<VisibilityPipelines> visibility;
+
+                if (VISIBILITY) {
+                    //the geometry pass runs the vertex path as is; the IDs it writes only work for it, not for meshlets
+                    std::string visFragSrc = Internal::vmaterialSrcVisibility<V2F>(bonusStream.str(), materials.size());
+
+                    std::string resolveBonus = bonusStream.str() + "float _medeaClipDistance[4];\n"
+                        "layout (set = 2, binding = 2) uniform usampler2D medeaVisibility;\n"
+                        "layout (set = 2, binding = 3) uniform MedeaVisibilityResolve { vec4 viewport; } medeaVisibilityResolve;\n"
+                        "layout (set = 2, binding = 4) readonly buffer MedeaMeshIndices { uint data[]; } medeaMeshIndices;\n";
+
+                    std::string resolveSrc = Internal::vmaterialSrcResolve<V2F, FOut>(vertexMaterials, fragMaterials, resolveBonus, vtxEpilogue, fragEpilogue);
+                    std::string binVtxSrc = readFile("./shader/visibilityBin.vert").value();
+
+                    PipelineBuilder geometryBuilder(layout), classifyBuilder(layout), resolveBuilder(layout);
+
+                    vk::raii::Pipeline geometry = geometryBuilder
+                        .setShaders(device, vtxSrc, visFragSrc, nameVtx, namePref+"_Visibility")
+                        .setTopology(vk::PrimitiveTopology::eTriangleList)
+                        .setPolygonMode(vk::PolygonMode::eFill)
+                        .setCullMode()
+                        .setMultisampleDisable()
+                        .setBlendingDisable()
+                        .setDepthTestEnable(true, vk::CompareOp::eLess)
+                        .setColorAttachmentFormats({vk::Format::eR32G32Uint, RenderConstants::velocityFormat})
+                        .setDepthFormat(vk::Format::eD32Sfloat)
+                        .build(device);
+
+                    //writes every covered pixel's bin, whatever was there
+                    vk::raii::Pipeline classify = classifyBuilder
+                        .loadShaders(device, "./shader/visibilityBin.vert", "./shader/visibilityClassify.frag")
+                        .setTopology(vk::PrimitiveTopology::eTriangleList)
+                        .setPolygonMode(vk::PolygonMode::eFill)
+                        .setCullMode(vk::CullModeFlagBits::eNone)
+                        .setMultisampleDisable()
+                        .setBlendingDisable()
+                        .setDepthTestEnable(true, vk::CompareOp::eAlways)
+                        .setColorAttachmentFormats({})
+                        .setDepthFormat(vk::Format::eD32Sfloat)
+                        .build(device);
+
+                    //tests the material depth for equality, never writes it
+                    vk::raii::Pipeline resolve = resolveBuilder
+                        .setShaders(device, binVtxSrc, resolveSrc, namePref+"_VisibilityBin", namePref+"_Resolve")
+                        .setTopology(vk::PrimitiveTopology::eTriangleList)
+                        .setPolygonMode(vk::PolygonMode::eFill)
+                        .setCullMode(vk::CullModeFlagBits::eNone)
+                        .setMultisampleDisable()
+                        .setBlendingDisable()
+                        .setDepthTestEnable(false, vk::CompareOp::eEqual)
+                        .setColorAttachmentFormats({RenderConstants::screenFormat, RenderConstants::velocityFormat})
+                        .setDepthFormat(vk::Format::eD32Sfloat)
+                        .build(device);
+
+                    std::vector<vk::raii::Pipeline> materialResolve;
+
+                    for (uint32_t m=0; m<materials.size(); m++) {
+                        materialResolve.push_back(resolveBuilder.setSpecialization(Internal::MaterialSpecialization::constantID, m).build(device));
+                    }
+
+                    visibility.emplace(VisibilityPipelines{std::move(geometry), std::move(classify), std::move(resolve), std::move(materialResolve)});
+                }
+
+                std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios = {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 5 * textures.MAX_TEXTURES),
+                                                                              DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eUniformBuffer, 1),
+                                                                              DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eStorageBuffer, 1)};
                 
 
                 return std::make_unique<GSGBindlessShader>(std::move(layout), std::move(pipeline), std::move(descLayout), std::move(vsDescLayout),
                     allocator,  textures,
                     std::move(shadowAtlas),
                     std::move(dummyShadowAtlas),
-                    DescriptorAllocator::make(device, 20, poolRatios));
+                    DescriptorAllocator::make(device, 20, poolRatios),
+                    std::move(meshPipeline), std::move(materialPipelines), std::move(visibility), (uint32_t) materials.size(), std::move(depthOnly),
+                    std::move(passDescLayout), std::move(passDescriptors), stages);
+            }
+
+            /// mesh path only: set 2 for the next draws, i.e. what meshletCull.task culls the draw list's meshlets against. Shadow
+            ///  draw list entries only ever get frustum culled (against their light), whatever the flags
+            /// @param hiZ only sampled with CULL_OCCLUSION, but always has to be a valid image (in the task stage's read layout)
+            void bindMeshletCull(vk::raii::Device& device, vk::CommandBuffer cmd, CleanupJobQueueCallback cleanCallback,
+                                 const MeshletCullUniforms& uniforms, vk::DescriptorImageInfo hiZ) {
+                assert(meshShading && passDescLayout);
+
+                std::vector<MeshletCullUniforms> data = {uniforms};
+
+                std::shared_ptr<AllocatedBuffer> ubo = std::make_shared<AllocatedBuffer>(
+                    AllocatedBuffer::loadCPU<MeshletCullUniforms>(allocator, *device, data, vk::BufferUsageFlagBits::eUniformBuffer));
+
+                std::shared_ptr<vk::raii::DescriptorSet> dset = std::make_shared<vk::raii::DescriptorSet>(passDescriptors->allocate(device, *passDescLayout));
+
+                vk::DescriptorBufferInfo uboInfo(ubo->buffer, 0, sizeof(MeshletCullUniforms));
+
+                std::vector<vk::WriteDescriptorSet> writes = {
+                    vk::WriteDescriptorSet(*dset, 0, 0, vk::DescriptorType::eUniformBuffer, {}, uboInfo),
+                    vk::WriteDescriptorSet(*dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, hiZ)};
+
+                device.updateDescriptorSets(writes, {});
+
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 2, **dset, {});
+
+                cleanCallback([ubo, dset] () {});
+            }
+
+            /// visibility buffer path only: set 2 for the classify and resolve draws
+            /// @param visibilityImage the geometry passes' output, in a fragment shader read layout. Only ever texelFetch'ed
+            /// @param meshIndices MeshIndexPool's buffer, to find a triangle's vertices
+            void bindVisibility(vk::raii::Device& device, vk::CommandBuffer cmd, CleanupJobQueueCallback cleanCallback,
+                                vk::DescriptorImageInfo visibilityImage, vk::DescriptorBufferInfo meshIndices, const VisibilityResolveUniforms& uniforms) {
+                assert(visibility && passDescLayout);
+
+                std::vector<VisibilityResolveUniforms> data = {uniforms};
+
+                std::shared_ptr<AllocatedBuffer> ubo = std::make_shared<AllocatedBuffer>(
+                    AllocatedBuffer::loadCPU<VisibilityResolveUniforms>(allocator, *device, data, vk::BufferUsageFlagBits::eUniformBuffer));
+
+                std::shared_ptr<vk::raii::DescriptorSet> dset = std::make_shared<vk::raii::DescriptorSet>(passDescriptors->allocate(device, *passDescLayout));
+
+                vk::DescriptorBufferInfo uboInfo(ubo->buffer, 0, sizeof(VisibilityResolveUniforms));
+
+                std::vector<vk::WriteDescriptorSet> writes = {
+                    vk::WriteDescriptorSet(*dset, 2, 0, vk::DescriptorType::eCombinedImageSampler, visibilityImage),
+                    vk::WriteDescriptorSet(*dset, 3, 0, vk::DescriptorType::eUniformBuffer, {}, uboInfo),
+                    vk::WriteDescriptorSet(*dset, 4, 0, vk::DescriptorType::eStorageBuffer, {}, meshIndices)};
+
+                device.updateDescriptorSets(writes, {});
+
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 2, **dset, {});
+
+                cleanCallback([ubo, dset] () {});
+            }
+
+            /// whether bindDepth binds depthOnly with its own (reduced) layout
+            bool depthReduced() const {
+                return depthPipelines && !meshShading && depthOnly.layout;
+            }
+
+            /// what push constants have to go through after bindDepth
+            vk::PipelineLayout depthLayout() const {
+                return depthReduced() ? **depthOnly.layout : *layout;
+            }
+
+            vk::ShaderStageFlags depthStages() const {
+                return depthReduced() ? vk::ShaderStageFlags(vk::ShaderStageFlagBits::eVertex) : stages;
+            }
+
+            /// v2Bind for depth-only passes (no color): binds depthOnly with RenderSettings::depthPipelines, else the megashader. Push
+            ///  constants afterwards, through depthLayout() and depthStages()
+            /// @param updateVolShadowDescriptor only called if the megashader's layout is used (see v2Bind)
+            /// @param shadowViews ShadowViews, for shadow draw list entries; all the reduced layout has
+            void bindDepth(vk::raii::Device& device, vk::CommandBuffer cmd, CleanupJobQueueCallback cleanCallback, vk::Viewport viewport,
+                           std::optional<AllocatedImage2Ref> depth, vk::CompareOp depthOp,
+                           std::function<void(vk::DescriptorSet dset)> updateVolShadowDescriptor, vk::DescriptorBufferInfo shadowViews) {
+                if (!depthReduced()) {
+                    const bool DEPTH_ONLY = depthPipelines && !meshShading;
+
+                    v2Bind(device, cmd, cleanCallback, viewport, {}, depth, depthOp, updateVolShadowDescriptor, std::nullopt,
+                           DEPTH_ONLY ? *depthOnly.pipeline : vk::Pipeline());
+
+                    return;
+                }
+
+                MEDEA_PROFILE_ZONE("GSGBindlessShader::bindDepth");
+
+                cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *depthOnly.pipeline);
+
+                cmd.setCullMode(vk::CullModeFlagBits::eBack);
+                cmd.setDepthTestEnable(true);
+                cmd.setDepthCompareOp(depthOp);
+
+                //set 0 is empty, and never used
+                std::shared_ptr<vk::raii::DescriptorSet> dset = std::make_shared<vk::raii::DescriptorSet>(depthOnly.descriptors->allocate(device, *depthOnly.descLayout));
+
+                vk::WriteDescriptorSet write(*dset, 3, 0, vk::DescriptorType::eStorageBuffer, {}, shadowViews);
+
+                device.updateDescriptorSets(write, {});
+
+                cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, **depthOnly.layout, 1, **dset, {});
+
+                cleanCallback([dset] () {});
+
+                assert(!depth || depth.value().get()._currentLayout == vk::ImageLayout::eDepthAttachmentOptimal);
+
+                std::optional<vk::RenderingAttachmentInfo> depthAttachment;
+
+                if (depth) depthAttachment = vk::RenderingAttachmentInfo(depth.value().get().imageView, depth.value().get()._currentLayout);
+
+                vk::Rect2D drawArea({(int32_t) viewport.x, (int32_t) viewport.y}, {(uint32_t) viewport.width, (uint32_t) viewport.height});
+
+                vk::RenderingInfo renderInfo;
+
+                renderInfo.setRenderArea(drawArea)
+                    .setLayerCount(1);
+
+                if (depthAttachment) renderInfo.setPDepthAttachment(&depthAttachment.value());
+
+                cmd.beginRendering(renderInfo);
+
+                //same flip as v2Bind
+                viewport.y = viewport.height;
+                viewport.height = -viewport.height;
+
+                cmd.setViewport(0, viewport);
+                cmd.setScissor(0, drawArea);
             }
         
         
+            /// NOTE: attachments have to already be in attachment layouts (declare them as writes on the RenderGraph pass)
+            /// @param updateVolShadowDescriptor writes all of set 1 (volumetrics, TemporalUniforms, ShadowViews)
+            /// @param velocity fragVelocity's attachment; without one (and in depth-only passes) it's discarded
+            /// @param pipelineOverride bound instead of pipeline/meshPipeline, e.g. one of VisibilityPipelines
             void v2Bind(vk::raii::Device& device, vk::CommandBuffer cmd, CleanupJobQueueCallback cleanCallback, vk::Viewport viewport, 
                                 const std::vector<AllocatedImage2Ref>& color, std::optional<AllocatedImage2Ref> depth, std::optional<vk::CompareOp> depthOp,
-                                std::function<void(vk::DescriptorSet dset)> updateVolShadowDescriptor) {
-                cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, *pipeline);
+                                std::function<void(vk::DescriptorSet dset)> updateVolShadowDescriptor,
+                                std::optional<AllocatedImage2Ref> velocity = std::nullopt, vk::Pipeline pipelineOverride = nullptr) {
+                MEDEA_PROFILE_ZONE("GSGBindlessShader::v2Bind");
+
+                cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelineOverride ? pipelineOverride : meshShading ? **meshPipeline : *pipeline);
 
-                multiTransition(cmd, {*dummyShadowAtlas.image}, {vk::ImageLayout::eShaderReadOnlyOptimal});
+                //only transitions the first time
+                dummyShadowAtlas.image->transitionSync(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
 
 
 
@@ -313,27 +860,23 @@ namespace Medea {
 
                 std::vector<vk::RenderingAttachmentInfo> colorAttachments;
 
-                {
-                    std::vector<AllocatedImage2Ref> fullImgs;
-                    std::vector<vk::ImageLayout> layouts;
-
-                    if (depth) {
-                        fullImgs.push_back(depth.value());
-                        layouts.push_back(vk::ImageLayout::eDepthAttachmentOptimal);
-                    }
-
-                    for (auto& img : color) {
-                        fullImgs.push_back(img);
-                        layouts.push_back(vk::ImageLayout::eColorAttachmentOptimal);
-                    }
+                assert(!depth || depth.value().get()._currentLayout == vk::ImageLayout::eDepthAttachmentOptimal);
 
-                    multiTransition(cmd, fullImgs, layouts, false);
-                }
+                for (auto& img : color) assert(img.get()._currentLayout == vk::ImageLayout::eColorAttachmentOptimal);
 
                 for (auto& c : color) {
                     colorAttachments.push_back(vk::RenderingAttachmentInfo(c.get().imageView, c.get()._currentLayout));
                 }
 
+                //velocity is location 1; a null view drops the writes (VK_EXT_dynamic_rendering_unused_attachments)
+                if (!DEPTH_PASS) {
+                    assert(color.size() == 1);
+                    assert(!velocity || velocity->get()._currentLayout == vk::ImageLayout::eColorAttachmentOptimal);
+
+                    colorAttachments.push_back(velocity ? vk::RenderingAttachmentInfo(velocity->get().imageView, velocity->get()._currentLayout)
+                                                        : vk::RenderingAttachmentInfo());
+                }
+
                 std::optional<vk::RenderingAttachmentInfo> depthAttachment;
 
                 if (depth) depthAttachment = vk::RenderingAttachmentInfo(depth.value().get().imageView, depth.value().get()._currentLayout);
@@ -350,13 +893,8 @@ namespace Medea {
 
 
                 {
-                    vk::MemoryBarrier2 membar(vk::PipelineStageFlagBits2::eBottomOfPipe, {}, 
-                        vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite);
-                    vk::DependencyInfo di({}, membar, {}, {});
-                    cmd.pipelineBarrier2(di);
-                }
+                    MEDEA_PROFILE_ZONE("descriptorWrites");
 
-                {
                     std::vector<vk::WriteDescriptorSet> writes;
 
                     std::unique_ptr<Internal::WriteGroup> wg0;
@@ -399,10 +937,119 @@ namespace Medea {
 
     class GPUSceneGraph;
 
+    /// Per-frame toggles for GPUSceneGraph::render
+    struct RenderSettings {
+        /// shadow transmittance + in-scattering + accumulation. When off, the volume is cleared to "no fog" instead
+        bool volumetrics = true;
+
+        /// froxel setup + the volumetric passes run on Core::computeQueue (if there is one), overlapping the shadow and pre-Z passes
+        bool asyncCompute = false;
+
+        /// cull the broadphase survivors against each light's frustum on the GPU and draw all shadows with one drawIndirectCount.
+        ///  When off, every light draws every broadphase survivor (one drawIndirectCount per light)
+        bool shadowCulling = false;
+
+        /// shadow draw list capacity, as light × entity pairs per entity (capped at the light count). Pairs past it are dropped (see GPUCullStats);
+        ///  the list then grows to fit from the cull readback, a few frames later, with a warning the first time
+        uint32_t shadowDrawsPerEntity = 8;
+
+        /// two-phase Hi-Z occlusion culling of the main view: pre-Z draws what was visible last frame, a Hi-Z pyramid is built from that
+        ///  depth, and everything is tested against it; what's newly visible is drawn after. Needs eSampled usage on the depth target
+        ///  (ignored with a warning otherwise). Shadows still draw every broadphase survivor
+        bool occlusionCulling = false;
+
+        /// broadphase culls RenderWorld's entity clusters against the camera's and lights' frustums first, then only the entities in
+        ///  clusters that survived (indirect dispatch). When off, every entity record is read
+        bool clusterCulling = false;
+
+        /// draw through the megashader's task/mesh pipeline: the task shader culls each entity's meshlets (frustum, normal cone, and Hi-Z in
+        ///  occlusion culling's second phase) before the mesh shader runs the vertex code. Falls back to the vertex pipeline on devices
+        ///  without VK_EXT_mesh_shader (see GPUSceneGraph::meshShadingAvailable)
+        bool meshShading = false;
+
+        /// per entity and view, draw the coarsest LOD level (see meshlod.h) whose error projects to at most lodErrorPixels. The camera's
+        ///  is picked in the cluster broadphase (so it needs clusterCulling; the other broadphase draws level 0), each light's in per-light
+        ///  shadow culling (shadowCulling; without it, shadows draw what the camera picked)
+        bool lod = false;
+        float lodErrorPixels = 1.f;
+
+        /// levels coarser than the light's own projection asks for; shadow maps get filtered, so the detail's mostly lost anyway
+        uint32_t shadowLodBias = 1;
+
+        /// after culling, regroup each draw list so copies of the same mesh (LOD level) and material are contiguous, and draw every group
+        ///  with one instanced indexed indirect draw instead of one per copy. Only lists drawn on the vertex path; the mesh path has no
+        ///  instance count, and draws the (still valid) grouped list one copy per draw
+        bool instancing = false;
+
+        /// draw the camera's view with one pipeline per material (the megashader specialized to it; see MaterialSpecialization) instead
+        ///  of the megashader's switch over every material, so no draw pays for the heaviest material's registers or diverges between
+        ///  materials within a wave. Pre-Z and main pass lists are binned by material after culling, and drawn with one
+        ///  drawIndexedIndirectCount per material. The vertex path only (the mesh path keeps the megashader); on the visibility buffer
+        ///  path, the resolve's per material draws use the specialized resolves
+        bool materialPipelines = false;
+
+        /// draw the shadow and pre-Z passes with the megashader's depth-only pipeline (GSGBindlessShader::DepthPipeline): DepthMode::position
+        ///  materials go straight from the position stream to gl_Position, with nothing else read and a reduced descriptor layout, and
+        ///  there's no fragment stage unless a material's DepthMode::alphaTest. The vertex path only (the mesh path keeps the megashader);
+        ///  pre-Z lists are then drawn unbinned even with materialPipelines
+        bool depthPipelines = false;
+    };
+
+    /// Read back from the GPU, so a few frames stale (like GPUProfiler)
+    struct GPUCullStats {
+        uint32_t entities = 0;              //<- entities submitted to broadphase cull
+        uint32_t broadphaseVisible = 0;     //<- entities surviving broadphase cull (the main pass drawcall count)
+        uint32_t lights = 0;                //<- lights rendered (after CPU side filtering)
+
+        /// light × entity pairs the shadow pass drew; lights * broadphaseVisible without RenderSettings::shadowCulling
+        uint32_t shadowDraws = 0;
+        uint32_t shadowDrawsDropped = 0;    //<- pairs that passed culling but didn't fit in the draw list
+
+        /// with RenderSettings::occlusionCulling; broadphase survivors are split into these three
+        uint32_t occlusionEarly = 0;        //<- drawn in phase 1 (visible last frame)
+        uint32_t occlusionLate = 0;         //<- drawn in phase 2 (newly visible against this frame's Hi-Z)
+        uint32_t occluded = 0;              //<- failed the Hi-Z test (some were still drawn early, as they were visible last frame)
+
+        /// with RenderSettings::clusterCulling
+        uint32_t clusters = 0;              //<- non-empty entity clusters submitted to cluster cull
+        uint32_t clustersVisible = 0;       //<- clusters whose entities were tested
+
+        /// with RenderSettings::instancing: indexed indirect draws the main view's (vertex path) lists were grouped into, i.e. the drawcall
+        ///  count instead of broadphaseVisible; and the same for the shadow draw list
+        uint32_t instanceDraws = 0;
+        uint32_t shadowInstanceDraws = 0;
+    };
+
     class RenderWorld {
         glist<RenderEntity> entities;
+        EntityClusters clusters;
         std::function<void(size_t materialID, size_t materialIdx)> uniformDeleteCallback;
 
+        //entities setPos'd since the last render(), and during the frame before; the latter get prevPos/prevRot caught up if they've stopped
+        std::unordered_set<size_t> movedThisFrame;
+        std::vector<size_t> movedLastFrame;
+
+        //(position stream, material) -> RenderEntity::instanceGroup. Ids aren't reused, so a group's never split by removing its first entity
+        std::map<std::pair<uint64_t, u32>, u32> instanceGroups;
+
+        //live entities per materialID; sizes each material's range of the material bins (RenderSettings::materialPipelines)
+        std::vector<u32> materialEntities;
+
+        /// called by GPUSceneGraph::render before uploading entities
+        void advanceFrame() {
+            for (size_t id : movedLastFrame) {
+                if (movedThisFrame.contains(id)) continue;
+
+                RenderEntity& e = entities.atMut(id);
+
+                e.prevPos = e.pos;
+                e.prevRot = e.rot;
+            }
+
+            movedLastFrame.assign(movedThisFrame.begin(), movedThisFrame.end());
+            movedThisFrame.clear();
+        }
+
         public:
         RenderWorld(Core& core, vk::CommandBuffer cmd, GPUSceneGraph& graph);
 
@@ -423,23 +1070,59 @@ namespace Medea {
                 (u32) init.materialID,
                 (u32) init.materialUniformIdx,
 
-                (u32) init.mesh.totalVertices, //mesh size
+                init.mesh.indexCount, //mesh size
                 1, //instances
-                //first index goes here
+                init.mesh.firstIndex,
                 0, //vertex off
-                0 //first instance
+                0, //first instance
+                0, //shadow light
+                0, //id; set below, once the slot's known
+
+                (init.mesh.meshletCount + MeshletLimits::perTaskGroup - 1) / MeshletLimits::perTaskGroup, //task groups
+                1,
+                1,
+
+                init.pos.pos.toGlmVec3(),   //<- no motion on the first frame
+                init.pos.dir.toGlmVec4(),
+
+                init.mesh.meshletAddress.address,
+                init.mesh.meshletCount,
+
+                (u32) init.mesh.vertexFormat,
+
+                init.mesh.lodAddress.address,
+                init.mesh.lodCount,
+                0, //lod level
+
+                //LODs share their mesh's position stream, so it names the mesh
+                instanceGroups.try_emplace({init.mesh.positionAddress.address, (u32) init.materialID}, (u32) instanceGroups.size()).first->second
             };
 
             size_t rid = entities.add(r);
 
+            entities.atMut(rid).id = rid;
+
+            clusters.add(rid, init.pos.pos.toGlmVec3());
+
+            if (materialEntities.size() <= init.materialID) materialEntities.resize(init.materialID + 1, 0);
+            materialEntities.at(init.materialID)++;
+
             return RenderEntityID{rid};
         }
 
         void setPos(RenderEntityID rid, Placement pos) {
             RenderEntity& e = entities.atMut(rid.ID);
 
+            //first move this frame: where it was is where it was last frame
+            if (movedThisFrame.insert(rid.ID).second) {
+                e.prevPos = e.pos;
+                e.prevRot = e.rot;
+            }
+
             e.pos = pos.pos.toGlmVec3();
             e.rot = pos.dir.toGlmVec4();
+
+            clusters.move(rid.ID, e.pos);
         }
 
 
@@ -451,6 +1134,13 @@ namespace Medea {
             e.meshSize = 0; //<- signals to broadphase cull that this is a zombie entry
 
             entities.remove(rid.ID);
+            clusters.remove(rid.ID);
+
+            //the index gets reused, and a new entity shouldn't inherit its motion
+            movedThisFrame.erase(rid.ID);
+            std::erase(movedLastFrame, rid.ID);
+
+            materialEntities.at(mid)--;
 
             uniformDeleteCallback(e.materialID, e.materialUniformIdx);
             //materialSets.at(e.materialID).get().removeUniform(e.materialUniformIdx);
@@ -460,6 +1150,11 @@ namespace Medea {
             return entities.at(rid.ID).materialUniformIdx;
         }
 
+        /// distinct (mesh, material) pairs ever added
+        u32 instanceGroupCount() const {
+            return instanceGroups.size();
+        }
+
         friend class GPUSceneGraph;
     };
 
@@ -481,6 +1176,15 @@ namespace Medea {
         std::vector<vk::raii::Sampler> volShadowSamplers;
 
         ComputeShader<Internal::CullCSPush> broadphaseCullShader;
+        ComputeShader<Internal::ClusterCullPush> clusterCullShader;
+        ComputeShader<Internal::ClusterEntityCullPush> clusterEntityCullShader;
+        ComputeShader<Internal::ShadowCullPush> shadowCullShader;
+        ComputeShader<Internal::ShadowCullPush> shadowCullScanShader;
+        ComputeShader<Internal::OcclusionCullPush> occlusionSplitShader;
+        ComputeShader<Internal::OcclusionCullPush> occlusionCullShader;
+        ComputeShader<Internal::InstanceGroupPush> instanceGroupShader;
+        ComputeShader<Internal::InstanceGroupPush> instanceGroupScanShader;
+        ComputeShader<Internal::MaterialBinPush> materialBinShader;
         ComputeShader<Internal::FroxelPush> clusterLightShader;
         ComputeShader<Internal::ShadowTransmittancePush> shadowTransmittanceShader;
         ComputeShader<Internal::ScatteringPush> volScatteringShader;
@@ -489,10 +1193,16 @@ namespace Medea {
         DescriptorAllocator shadowTransmittanceArrayAllocator;
 
         BindlessTextureArray& textures;
+
+        MeshIndexPool meshIndices;      //<- every FullMesh's indices; bound for every draw
         
         AllocatedImage volLightingImage;
         vk::raii::Sampler volLightingSampler;
 
+        AllocatedImage dummyVolume;     //<- bound instead of the volumetric images in depth-only passes, so they don't depend on the volumetric passes
+        AllocatedImage dummyHiZ;        //<- the mesh path's set 2 Hi-Z when its draw list isn't occlusion culled
+        vk::raii::Sampler pointSampler; //<- nearest; integer images (the visibility buffer) can't be sampled linearly
+
         std::unordered_map<size_t, size_t> ridToUniformIdx;
         
         //std::unique_ptr<Internal::SceneGraphState> renderState;
@@ -500,22 +1210,87 @@ namespace Medea {
 
         std::unique_ptr<Internal::GSGBindlessShader<V2F, FOut>> megashader = nullptr;
 
+        HiZPyramid hiZ;
+        DescriptorAllocator occlusionDescriptors;
+
+        /// per entity occlusion results, carried over to the next frame. Replaced (and reset to "not visible") when the entity list outgrows it
+        std::shared_ptr<AllocatedBuffer> occlusionVisibility;
+        bool occlusionVisibilityFresh = false;     //<- needs zeroing before use
+        bool occlusionDepthWarned = false;
+
+        uint32_t shadowCapacityNeeded = 0;  //<- requested shadow draw list pairs, from a cull readback that overflowed
+        bool shadowDropWarned = false;
+
+        GPUProfiler profiler;
+        PipelineStatsProfiler pipelineStats;
+
+        vk::CommandBuffer lastFrameCmd;     //<- render()'s, to catch a second call in the same frame
+
+        RenderGraph renderGraph;
+
+        struct CullReadback {
+            AllocatedBuffer buffer;     //<- copies of the broadphase cull, shadow, early and late draw list headers, then the visible cluster list's,
+                                        //   then the instanced draw headers
+            GPUCullStats pending;
+            bool shadowList = false;    //<- RenderSettings::shadowCulling was on, so the second header is there
+            bool occlusion = false;     //<- occlusion culling ran, so the third and fourth are there
+            bool clusters = false;      //<- cluster culling ran, so the fifth is there
+            bool instancing = false;    //<- lists were grouped; the grouped shadow, culled/early and late lists' draw counts are the 6th to 9th
+            bool written = false;
+        };
+
+        std::vector<CullReadback> cullReadbacks;
+        size_t cullReadbackIdx = 0;
+        GPUCullStats cullStats;
+
+        /// same frame-in-flight argument as GPUProfiler::beginFrame: by the time a slot comes around again, its frame is done
+        void resolveCullStats();
+
+        size_t neutralVolShadows = 0;   //<- volumetric shadow images already cleared to full transmittance while volumetrics are off
+
+        bool computeTimestamps;         //<- DeviceCapabilities::computeTimestamps
+
+        /// GPU timestamp marker + pipeline statistics query for one pass of render(). On the async compute queue there are no (graphics) pipeline
+        ///  statistics, and timestamps only if the queue family has them
+        void beginPass(vk::CommandBuffer cmd, std::string_view name, bool computeQueue = false) {
+            if (!computeQueue || computeTimestamps) profiler.begin(cmd, name);
+            if (!computeQueue) pipelineStats.begin(cmd, name);
+        }
+
+        void endPass(vk::CommandBuffer cmd, bool computeQueue = false) {
+            if (!computeQueue) pipelineStats.end(cmd);
+            if (!computeQueue || computeTimestamps) profiler.end(cmd);
+        }
+
 
         public:
 
         gvector<LightDef> lights;
 
+        RenderSettings settings;
+
         GPUSceneGraph(Core& core, vk::CommandBuffer cmd, BindlessTextureArray& texRef);
 
-        void compileMaterialSets(Core& core) {
-            megashader = std::remove_reference<decltype(*megashader)>::type::make(core, materialSets, textures);
+        /// @param path can't change afterwards; the visibility buffer needs its own pipelines
+        void compileMaterialSets(Core& core, ShadingPath path = ShadingPath::forward) {
+            megashader = std::remove_reference<decltype(*megashader)>::type::make(core, materialSets, textures, path);
+        }
+
+        ShadingPath getShadingPath() const {
+            return megashader && megashader->visibility ? ShadingPath::visibilityBuffer : ShadingPath::forward;
         }
 
+        /// NOTE: with settings.asyncCompute, part of the frame is submitted from in here, ahead of cmd (see RenderGraph::reset); anything render()
+        ///  needs from this frame has to be recorded into cmd by a previous frame, or submitted already
+        /// @param viewport can be a sub-rect of color/depth (see DynamicResolution), as long as its aspect ratio matches camProj's; froxels and
+        ///  volumetrics work in NDC, so they don't care about its size
+        /// @param upscaler jitters the projection, writes motion vectors, and resolves into its own output at the end of the frame
+        ///  (color and depth then need eSampled usage)
         void render(Core& core, vk::CommandBuffer cmd, CleanupJobQueueCallback cleanup, glm::mat4 camView, glm::mat4 camProj,
                     RenderWorld& world,
                     vk::Viewport viewport,
                     const std::vector<AllocatedImage2Ref>& color, std::optional<AllocatedImage2Ref> depth, std::optional<vk::CompareOp> depthOp,
-                    double currentTime);
+                    double currentTime, TemporalUpscaler* upscaler = nullptr);
 
         size_t registerMaterialSet(IMaterialSet& mset) {
             assert(megashader.get() == nullptr);
@@ -529,13 +1304,48 @@ namespace Medea {
             materialSets.at(materialID).get().removeUniform(materialIdx);
         }
 
+        /// per-pass GPU timings of render(), a few frames stale
+        const GPUProfiler& getProfiler() const {
+            return profiler;
+        }
+
+        GPUProfiler& getProfiler() {
+            return profiler;
+        }
+
+        /// per-pass vertex/fragment/compute invocation counts of render(), a few frames stale
+        const PipelineStatsProfiler& getPipelineStats() const {
+            return pipelineStats;
+        }
+
+        const GPUCullStats& getCullStats() const {
+            return cullStats;
+        }
+
+        /// pass to FullMesh::make for every mesh this draws
+        MeshIndexPool& getMeshIndices() {
+            return meshIndices;
+        }
+
+        /// whether RenderSettings::meshShading does anything, i.e. the device has mesh shaders. Valid after compileMaterialSets
+        bool meshShadingAvailable() const {
+            return megashader && megashader->meshPipeline.has_value();
+        }
+
+        /// passes culled, transient memory aliased etc. during the last render()
+        const RenderGraphStats& getRenderGraphStats() const {
+            return renderGraph.getStats();
+        }
+
         template<typename U, typename VIn>
         friend class MaterialSet;
     };
 
     template<typename Uniform, typename VIn>
-    MaterialSet<Uniform, VIn>::MaterialSet(GPUSceneGraph& base_, Core& core, vk::CommandBuffer cmd, std::string_view vtxSrc, std::string_view fragSrc)
-        : base(base_), backing(core.allocator, core.device, cmd), vertexShaderPath(vtxSrc), fragmentShaderPath(fragSrc), thisID(base_.registerMaterialSet(*this)) {}
+    MaterialSet<Uniform, VIn>::MaterialSet(GPUSceneGraph& base_, Core& core, vk::CommandBuffer cmd, std::string_view vtxSrc, std::string_view fragSrc,
+                                           DepthMode depth)
+        : base(base_), backing(core.allocator, core.device, cmd), vertexShaderPath(vtxSrc), fragmentShaderPath(fragSrc), depth(depth),
+        thisID(base_.registerMaterialSet(*this)) {}
 
 
 
@@ -0,0 +1,146 @@
+#include "temporalupscaler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace Medea;
+
+std::vector<vk::DescriptorSetLayoutBinding> upscaleBindings() {
+    std::vector<vk::DescriptorSetLayoutBinding> out;
+
+    //color, depth, velocity, last frame's history
+    for (uint32_t i=0; i<4; i++) out.push_back(vk::DescriptorSetLayoutBinding(i, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute));
+
+    //this frame's history
+    out.push_back(vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute));
+
+    return out;
+}
+
+vk::SamplerCreateInfo clampedSCI(vk::Filter filter) {
+    return vk::SamplerCreateInfo({}, filter, filter, vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge);
+}
+
+/// radical inverse, base b
+float halton(uint32_t idx, uint32_t base) {
+    float f = 1.f, out = 0.f;
+
+    while (idx > 0) {
+        f /= float(base);
+        out += f * float(idx % base);
+        idx /= base;
+    }
+
+    return out;
+}
+
+
+TemporalUpscaler TemporalUpscaler::make(Core& core, VkExtent2D outputExtent, VkExtent2D maxRenderExtent) {
+    AllocatedImage velocity = AllocatedImage::make(core,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        vk::ImageAspectFlagBits::eColor, RenderConstants::velocityFormat, VkExtent3D{maxRenderExtent.width, maxRenderExtent.height, 1}, false, false);
+
+    auto makeHistory = [&] () {
+        return AllocatedImage::make(core,
+            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+            vk::ImageAspectFlagBits::eColor, vk::Format::eR16G16B16A16Sfloat, VkExtent3D{outputExtent.width, outputExtent.height, 1}, false, false);
+    };
+
+    std::array<AllocatedImage, 2> history = {makeHistory(), makeHistory()};
+
+    std::vector<DescriptorAllocator::PoolSizeRatio> poolRatios =
+        {DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eCombinedImageSampler, 4),
+         DescriptorAllocator::PoolSizeRatio(vk::DescriptorType::eStorageImage, 1)};
+
+    //one set per frame, freed once the frame's done
+    DescriptorAllocator descriptors = DescriptorAllocator::make(core.device, 2 * BUF_FRAMES_IN_FLIGHT + 1, poolRatios);
+
+    return TemporalUpscaler(outputExtent, std::move(velocity), std::move(history),
+        vk::raii::Sampler(core.device, clampedSCI(vk::Filter::eNearest)), vk::raii::Sampler(core.device, clampedSCI(vk::Filter::eLinear)),
+        ComputeShader<Internal::TemporalUpscalePush>::make(core.device, "./shader/temporalUpscale.comp", upscaleBindings()),
+        std::move(descriptors));
+}
+
+Internal::TemporalUniforms TemporalUpscaler::beginFrame(const glm::mat4& view, const glm::mat4& proj, VkExtent2D extent) {
+    renderExtent = extent;
+
+    //enough jitter phases that every output pixel gets a few samples landing in it (~8 per output pixel covered by a render pixel)
+    double ratio = double(outputExtent.width) / double(std::max(renderExtent.width, 1u));
+    uint32_t phases = std::clamp(uint32_t(std::ceil(8.0 * ratio * ratio)), 8u, 64u);
+
+    jitterIdx = (jitterIdx % phases) + 1;   //<- Halton index 0 is (0, 0) on every cycle, so skip it
+    jitter = glm::vec2(halton(jitterIdx, 2), halton(jitterIdx, 3)) - glm::vec2(0.5f);
+
+    glm::mat4 viewProj = proj * view;
+
+    //first frame: no motion
+    Internal::TemporalUniforms out{viewProj, historyValid ? prevViewProj : viewProj};
+
+    prevViewProj = viewProj;
+    historyIdx = 1 - historyIdx;
+
+    return out;
+}
+
+glm::mat4 TemporalUpscaler::jitterProjection(const glm::mat4& proj) const {
+    return jitteredProjection(proj, jitter, glm::vec2(renderExtent.width, renderExtent.height));
+}
+
+void TemporalUpscaler::addPass(Core& core, RenderGraph& graph, CleanupJobQueueCallback cleanup, RGHandle color, RGHandle depth, RGHandle velocityRes) {
+    AllocatedImage& prev = history.at(1 - historyIdx);
+    AllocatedImage& out = history.at(historyIdx);
+
+    RGHandle prevRes = graph.importImage("taaHistoryPrev", prev);
+    RGHandle outRes = graph.importImage("taaHistory", out, true);
+
+    const ResourceUsage SAMPLED = ResourceUsage::computeRead(vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    std::shared_ptr<vk::raii::DescriptorSet> dset = std::make_shared<vk::raii::DescriptorSet>(std::move(descriptors.allocate(core.device, shader.descLayout)));
+
+    cleanup([dset] () {});
+
+    Internal::TemporalUpscalePush push{
+        glm::vec4(jitterSampleOffset(jitter), renderExtent.width, renderExtent.height),
+        glm::vec4(outputExtent.width, outputExtent.height, historyValid ? 1.f : 0.f, float(blend))
+    };
+
+    graph.addPass("temporalUpscale",
+        [&] (RenderGraph::PassBuilder& b) {
+            b.read(color, SAMPLED)
+                .read(depth, SAMPLED)
+                .read(velocityRes, SAMPLED)
+                .read(prevRes, SAMPLED)
+                .write(outRes, ResourceUsage::computeWrite(vk::ImageLayout::eGeneral), true);
+        },
+        [&core, &graph, this, dset, color, depth, push] (vk::CommandBuffer cmd) {
+            AllocatedImage& colorImg = graph.getImage(color);
+            AllocatedImage& depthImg = graph.getImage(depth);
+
+            vk::DescriptorImageInfo colorDII(pointSampler, colorImg.imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::DescriptorImageInfo depthDII(pointSampler, depthImg.imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::DescriptorImageInfo velocityDII(pointSampler, velocity.imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::DescriptorImageInfo prevDII(linearSampler, history.at(1 - historyIdx).imageView, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vk::DescriptorImageInfo outDII({}, history.at(historyIdx).imageView, vk::ImageLayout::eGeneral);
+
+            vk::WriteDescriptorSet w0(*dset, 0, 0, vk::DescriptorType::eCombinedImageSampler, colorDII, {}, {});
+            vk::WriteDescriptorSet w1(*dset, 1, 0, vk::DescriptorType::eCombinedImageSampler, depthDII, {}, {});
+            vk::WriteDescriptorSet w2(*dset, 2, 0, vk::DescriptorType::eCombinedImageSampler, velocityDII, {}, {});
+            vk::WriteDescriptorSet w3(*dset, 3, 0, vk::DescriptorType::eCombinedImageSampler, prevDII, {}, {});
+            vk::WriteDescriptorSet w4(*dset, 4, 0, vk::DescriptorType::eStorageImage, outDII, {}, {});
+
+            {
+                MEDEA_PROFILE_ZONE("descriptorWrites");
+
+                core.device.updateDescriptorSets({w0, w1, w2, w3, w4}, {});
+            }
+
+            cmd.bindPipeline(vk::PipelineBindPoint::eCompute, shader.pipeline);
+            cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, shader.layout, 0, **dset, {});
+            shader.setPush(cmd, push);
+
+            const uint32_t LOCAL_W = 8;
+            cmd.dispatch((outputExtent.width + LOCAL_W - 1) / LOCAL_W, (outputExtent.height + LOCAL_W - 1) / LOCAL_W, 1);
+        });
+
+    historyValid = true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core.h"
+#include "metaimage.h"
+#include "compute.h"
+#include "rendergraph.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <array>
+
+/// Temporal upscaling/antialiasing. GPUSceneGraph::render jitters the projection by a subpixel offset each frame, the megashader writes
+///  per pixel motion (from this and last frame's camera + entity transforms), and a compute pass at the end of the graph accumulates
+///  the jittered, lower resolution frames into an output resolution history:
+///
+///     TemporalUpscaler taa = TemporalUpscaler::make(core, outputExtent, maxRenderExtent);
+///     ...
+///     graph.render(core, cmd, cleanup, view, proj, world, dynRes.getViewport(), {color}, depth, vk::CompareOp::eLess, time, &taa);
+///     taa.getOutput().transitionSync(cmd, vk::ImageLayout::eTransferSrcOptimal);
+///     present.endDraw(*taa.getOutput().image, taa.getOutputExtent());
+///
+/// The color and depth targets handed to render() need eSampled usage. Works with any render extent up to the max (e.g. DynamicResolution's);
+///  the history is kept at the output extent, so it survives render extent changes.
+
+namespace Medea {
+
+    namespace Internal {
+        /// Megashader set 1, binding 2. Unjittered, so motion vectors don't pick up the jitter
+        struct TemporalUniforms {
+            glm::mat4 viewProj;
+            glm::mat4 prevViewProj;
+        };
+
+        struct TemporalUpscalePush {
+            glm::vec4 sampleOffsetRenderExtent;     //<- xy: jitterSampleOffset, where in its pixel each input sample was taken; zw: render extent
+            glm::vec4 outputExtentParams;           //<- xy: output extent; z: 1 if the history is valid; w: blend weight of a sample right on the pixel
+        };
+    }
+
+    /// proj, offset by jitter (in render pixels, applied in NDC, so +y is up)
+    inline glm::mat4 jitteredProjection(const glm::mat4& proj, glm::vec2 jitter, glm::vec2 renderExtent) {
+        return glm::translate(glm::mat4(1), glm::vec3(2.f * jitter / renderExtent, 0.f)) * proj;
+    }
+
+    /// where in its pixel (relative to the center, in pixels, +y down) a frame drawn with jitteredProjection(proj, jitter) samples the
+    ///  unjittered scene. The geometry moves by +jitter, so each pixel sees what was -jitter from it: -x, and +y with v2Bind's flipped viewport
+    inline glm::vec2 jitterSampleOffset(glm::vec2 jitter) {
+        return glm::vec2(-jitter.x, jitter.y);
+    }
+
+    class TemporalUpscaler {
+        VkExtent2D outputExtent;
+
+        AllocatedImage velocity;                    //<- max render extent; only the render extent's worth is written each frame
+        std::array<AllocatedImage, 2> history;      //<- ping-ponged: read last frame's, write this frame's
+        size_t historyIdx = 0;
+        bool historyValid = false;
+
+        vk::raii::Sampler pointSampler, linearSampler;
+
+        ComputeShader<Internal::TemporalUpscalePush> shader;
+        DescriptorAllocator descriptors;
+
+        uint32_t jitterIdx = 0;
+        glm::vec2 jitter = glm::vec2(0);            //<- in render pixels, applied in NDC (so +y is up)
+
+        glm::mat4 prevViewProj = glm::mat4(1);
+        VkExtent2D renderExtent = {0, 0};
+
+        TemporalUpscaler(VkExtent2D output, AllocatedImage&& vel, std::array<AllocatedImage, 2>&& hist, vk::raii::Sampler&& point, vk::raii::Sampler&& linear,
+                         ComputeShader<Internal::TemporalUpscalePush>&& cs, DescriptorAllocator&& desc)
+            : outputExtent(output), velocity(std::move(vel)), history(std::move(hist)), pointSampler(std::move(point)), linearSampler(std::move(linear)),
+              shader(std::move(cs)), descriptors(std::move(desc)) {}
+
+        public:
+        /// weight of the new frame for an output pixel that a sample landed right on; lower is smoother but ghosts more
+        double blend = 0.1;
+
+        static TemporalUpscaler make(Core& core, VkExtent2D outputExtent, VkExtent2D maxRenderExtent);
+
+        /// Called by GPUSceneGraph::render at the start of a frame. Advances the jitter sequence
+        /// @return unjittered view-projection for this and the previous frame, for the megashader's motion vectors
+        Internal::TemporalUniforms beginFrame(const glm::mat4& view, const glm::mat4& proj, VkExtent2D renderExtent);
+
+        /// @return proj, offset by this frame's jitter
+        glm::mat4 jitterProjection(const glm::mat4& proj) const;
+
+        /// Adds the upscale pass to the graph; called by GPUSceneGraph::render after the main pass
+        void addPass(Core& core, RenderGraph& graph, CleanupJobQueueCallback cleanup, RGHandle color, RGHandle depth, RGHandle velocityRes);
+
+        AllocatedImage& getVelocity() {
+            return velocity;
+        }
+
+        /// this frame's result (once render() has run), at getOutputExtent()
+        AllocatedImage& getOutput() {
+            return history.at(historyIdx);
+        }
+
+        VkExtent2D getOutputExtent() const {
+            return outputExtent;
+        }
+
+        /// drop the history, e.g. on camera cuts; the next frame is just the upsampled input
+        void reset() {
+            historyValid = false;
+        }
+    };
+}
@@ -0,0 +1,180 @@
+#include "vertexquantize.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numbers>
+
+using namespace Medea;
+
+namespace {
+    /// same rounding as GLSL's packUnorm2x16/packSnorm2x16, so unpack*2x16 in the shader gets back what dequantize* computes
+    uint32_t packUnorm16(float v) {
+        return (uint32_t) std::round(std::clamp(v, 0.f, 1.f) * 65535.f);
+    }
+
+    uint32_t packSnorm16(float v) {
+        return uint32_t(int32_t(std::round(std::clamp(v, -1.f, 1.f) * 32767.f))) & 0xFFFF;
+    }
+
+    float unpackUnorm16(uint32_t v) {
+        return float(v & 0xFFFF) / 65535.f;
+    }
+
+    float unpackSnorm16(uint32_t v) {
+        return std::clamp(float(int16_t(v & 0xFFFF)) / 32767.f, -1.f, 1.f);
+    }
+
+    float signNotZero(float v) {
+        return v >= 0.f ? 1.f : -1.f;
+    }
+
+    glm::vec3 decodeNormal(uint32_t packed) {
+        return octDecode(glm::vec2(unpackSnorm16(packed), unpackSnorm16(packed >> 16)));
+    }
+}
+
+glm::vec2 Medea::octEncode(glm::vec3 n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+
+    if (l1 <= 0.f) return glm::vec2(0.f, 0.f);
+
+    n /= l1;
+
+    if (n.z >= 0.f) return glm::vec2(n.x, n.y);
+
+    //lower hemisphere folds over the diagonals
+    return glm::vec2((1.f - std::abs(n.y)) * signNotZero(n.x), (1.f - std::abs(n.x)) * signNotZero(n.y));
+}
+
+glm::vec3 Medea::octDecode(glm::vec2 e) {
+    glm::vec3 n(e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y));
+
+    float t = std::max(-n.z, 0.f);
+
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+
+    return glm::normalize(n);
+}
+
+void Medea::tangentBasis(glm::vec3 n, glm::vec3& b1, glm::vec3& b2) {
+    float s = signNotZero(n.z);
+    float a = -1.f / (s + n.z);
+    float b = n.x * n.y * a;
+
+    b1 = glm::vec3(1.f + s * n.x * n.x * a, s * b, -s * n.x);
+    b2 = glm::vec3(b, s + n.y * n.y * a, -n.y);
+}
+
+std::vector<uint32_t> QuantizedPositions::pack() const {
+    static_assert(sizeof(QuantizedPositionHeader) % sizeof(uint32_t) == 0);
+    static_assert(sizeof(QuantizedVertexPosition) == 3 * sizeof(uint32_t));
+
+    const size_t HEADER_UINTS = sizeof(QuantizedPositionHeader) / sizeof(uint32_t);
+
+    std::vector<uint32_t> out(HEADER_UINTS + 3 * vertices.size());
+
+    memcpy(out.data(), &header, sizeof(QuantizedPositionHeader));
+
+    if (!vertices.empty()) memcpy(out.data() + HEADER_UINTS, vertices.data(), vertices.size() * sizeof(QuantizedVertexPosition));
+
+    return out;
+}
+
+QuantizedPositions Medea::quantizePositions(std::span<const VertexPosition> positions, std::span<const glm::vec4> tangents) {
+    assert(tangents.empty() || tangents.size() == positions.size());
+
+    QuantizedPositions out;
+    out.header = QuantizedPositionHeader{glm::avec4(0), glm::avec4(0)};
+
+    if (positions.empty()) return out;
+
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+
+    for (auto& p : positions) {
+        lo = glm::min(lo, glm::vec3(p.pos));
+        hi = glm::max(hi, glm::vec3(p.pos));
+    }
+
+    glm::vec3 extent = hi - lo;
+
+    out.header.offset = glm::avec4(lo, 0.f);
+    out.header.scale = glm::avec4(extent, 0.f);
+
+    out.vertices.reserve(positions.size());
+
+    const float TWO_PI = 2.f * std::numbers::pi_v<float>;
+
+    for (size_t i=0; i<positions.size(); i++) {
+        glm::vec3 p = positions[i].pos;
+
+        uint32_t q[3];
+
+        //flat along an axis: everything's at the offset
+        for (int k=0; k<3; k++) q[k] = extent[k] > 0.f ? packUnorm16((p[k] - lo[k]) / extent[k]) : 0;
+
+        glm::vec2 oct = octEncode(positions[i].normal);
+
+        QuantizedVertexPosition v;
+        v.posXY = q[0] | (q[1] << 16);
+        v.normal = packSnorm16(oct.x) | (packSnorm16(oct.y) << 16);
+
+        uint32_t tangent = 0;
+
+        if (!tangents.empty()) {
+            //the angle's measured in the basis of the normal as the shader decodes it
+            glm::vec3 b1, b2;
+            tangentBasis(decodeNormal(v.normal), b1, b2);
+
+            glm::vec3 t = tangents[i];
+
+            float angle = std::atan2(glm::dot(t, b2), glm::dot(t, b1));
+            float turns = angle / TWO_PI;
+
+            if (turns < 0.f) turns += 1.f;
+
+            tangent = uint32_t(std::round(turns * QuantizedTangentBits::angleSteps)) % QuantizedTangentBits::angleSteps;
+
+            if (tangents[i].w < 0.f) tangent |= QuantizedTangentBits::bitangentSign;
+        }
+
+        v.posZTangent = q[2] | (tangent << 16);
+
+        out.vertices.push_back(v);
+    }
+
+    return out;
+}
+
+glm::vec4 Medea::dequantizeTangent(const QuantizedVertexPosition& v) {
+    const float TWO_PI = 2.f * std::numbers::pi_v<float>;
+
+    uint32_t tangent = v.posZTangent >> 16;
+
+    glm::vec3 b1, b2;
+    tangentBasis(decodeNormal(v.normal), b1, b2);
+
+    float angle = float(tangent % QuantizedTangentBits::angleSteps) / QuantizedTangentBits::angleSteps * TWO_PI;
+
+    float sign = (tangent & QuantizedTangentBits::bitangentSign) ? -1.f : 1.f;
+
+    return glm::vec4(std::cos(angle) * b1 + std::sin(angle) * b2, sign);
+}
+
+std::vector<VertexPosition> Medea::dequantizePositions(const QuantizedPositions& q) {
+    std::vector<VertexPosition> out;
+    out.reserve(q.vertices.size());
+
+    glm::vec3 offset = q.header.offset, scale = q.header.scale;
+
+    for (auto& v : q.vertices) {
+        glm::vec3 unorm(unpackUnorm16(v.posXY), unpackUnorm16(v.posXY >> 16), unpackUnorm16(v.posZTangent));
+
+        out.push_back(VertexPosition{offset + scale * unorm, decodeNormal(v.normal)});
+    }
+
+    return out;
+}
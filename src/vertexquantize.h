@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vertex.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Quantized position streams: FullMesh::make(..., VertexFormat::quantized) stores each vertex's position + normal (+ tangent frame) in 12
+///  bytes instead of VertexPosition's 32. Positions are unorm16s within the mesh's bounds, normals octahedral snorm16s, and the tangent is
+///  an angle around the normal plus the bitangent's sign (the Doom Eternal tangent frame trick), all decoded by the megashader's vertex
+///  stage (see Internal::vertexDecodeGLSL). The attribute stream's untouched.
+///
+/// Worth it where position fetch is the cost, i.e. the shadow and depth only passes, which read nothing else. Error per axis is at most
+///  extent / 131070, so ~1/100mm for a 1m mesh.
+
+namespace Medea {
+
+    /// how FullMesh::vertexBasePositions is stored; RenderEntity::vertexFormat
+    enum class VertexFormat : uint32_t {
+        full = 0,           //<- VertexPosition
+        quantized = 1,      //<- QuantizedPositionHeader, then QuantizedVertexPositions
+    };
+
+    namespace QuantizedTangentBits {
+        constexpr uint32_t angleBits = 15;
+        constexpr uint32_t angleSteps = 1u << angleBits;       //<- per full turn, starting at tangentBasis's first axis
+        constexpr uint32_t bitangentSign = 1u << angleBits;     //<- set: bitangent = -cross(normal, tangent)
+    }
+
+    struct QuantizedVertexPosition {
+        uint32_t posXY;         //<- unorm16 x (low half), y; within QuantizedPositionHeader's bounds
+        uint32_t posZTangent;   //<- unorm16 z (low half), then the tangent (QuantizedTangentBits)
+        uint32_t normal;        //<- octahedral, snorm16 x (low half), y
+    };
+
+    /// in front of the QuantizedVertexPositions in the buffer: position = offset + scale * unorm
+    struct alignas(16) QuantizedPositionHeader {
+        glm::avec4 offset;      //<- bounds min
+        glm::avec4 scale;       //<- bounds extent
+    };
+
+    struct QuantizedPositions {
+        QuantizedPositionHeader header;
+        std::vector<QuantizedVertexPosition> vertices;
+
+        /// header + vertices as uploaded
+        std::vector<uint32_t> pack() const;
+    };
+
+    /// @param tangents xyz: tangent, w: bitangent sign; one per position, or empty for none (decodes to tangentBasis's first axis)
+    extern QuantizedPositions quantizePositions(std::span<const VertexPosition> positions, std::span<const glm::vec4> tangents = {});
+
+    /// what the GPU decodes, for bounds & error checks
+    extern std::vector<VertexPosition> dequantizePositions(const QuantizedPositions& q);
+    extern glm::vec4 dequantizeTangent(const QuantizedVertexPosition& v);
+
+    /// octahedral mapping of a unit vector onto [-1, 1]^2 (Cigolle et al., "A Survey of Efficient Representations for Independent Unit
+    ///  Vectors", 2014)
+    extern glm::vec2 octEncode(glm::vec3 n);
+    extern glm::vec3 octDecode(glm::vec2 e);
+
+    /// orthonormal basis around n (Duff et al., "Building an Orthonormal Basis, Revisited", 2017); the zero angle of a packed tangent
+    extern void tangentBasis(glm::vec3 n, glm::vec3& b1, glm::vec3& b2);
+}